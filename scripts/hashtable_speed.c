@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2013 HSR Hochschule fuer Technik Rapperswil
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include <library.h>
+#include <collections/hashtable.h>
+#include <collections/concurrent_hashtable.h>
+#include <threading/thread.h>
+#include <threading/mutex.h>
+#include <threading/rwlock.h>
+
+static void usage()
+{
+	printf("usage: hashtable_speed threads items operations [read%%]\n");
+	printf("  measures the throughput of a hashtable_t protected by a mutex\n");
+	printf("  or a rwlock, as used by most subsystems, and of a\n");
+	printf("  concurrent_hashtable_t, with the given number of items and\n");
+	printf("  operations per thread. read%% of the operations are lookups\n");
+	printf("  (default 90), the others replace an item (remove and put).\n");
+	exit(1);
+}
+
+/**
+ * Table variants compared
+ */
+typedef enum {
+	TABLE_MUTEX,
+	TABLE_RWLOCK,
+	TABLE_CONCURRENT,
+} table_type_t;
+
+static char *table_names[] = {
+	"hashtable_t/mutex",
+	"hashtable_t/rwlock",
+	"concurrent_hashtable_t",
+};
+
+/**
+ * Table under test
+ */
+static struct {
+	table_type_t type;
+	hashtable_t *ht;
+	mutex_t *mutex;
+	rwlock_t *lock;
+	concurrent_hashtable_t *cht;
+} table;
+
+/**
+ * Keys, the items are their own values
+ */
+static u_int *keys;
+
+/**
+ * Number of items, operations per thread and read ratio
+ */
+static int items, operations, reads;
+
+static u_int hash(u_int *key)
+{
+	return chunk_hash(chunk_from_thing(*key));
+}
+
+static bool equals(u_int *key, u_int *other_key)
+{
+	return *key == *other_key;
+}
+
+static void *get(u_int *key)
+{
+	void *value;
+
+	switch (table.type)
+	{
+		case TABLE_MUTEX:
+			table.mutex->lock(table.mutex);
+			value = table.ht->get(table.ht, key);
+			table.mutex->unlock(table.mutex);
+			return value;
+		case TABLE_RWLOCK:
+			table.lock->read_lock(table.lock);
+			value = table.ht->get(table.ht, key);
+			table.lock->unlock(table.lock);
+			return value;
+		case TABLE_CONCURRENT:
+		default:
+			return table.cht->get(table.cht, key);
+	}
+}
+
+static void replace(u_int *key)
+{
+	switch (table.type)
+	{
+		case TABLE_MUTEX:
+			table.mutex->lock(table.mutex);
+			table.ht->remove(table.ht, key);
+			table.ht->put(table.ht, key, key);
+			table.mutex->unlock(table.mutex);
+			break;
+		case TABLE_RWLOCK:
+			table.lock->write_lock(table.lock);
+			table.ht->remove(table.ht, key);
+			table.ht->put(table.ht, key, key);
+			table.lock->unlock(table.lock);
+			break;
+		case TABLE_CONCURRENT:
+			table.cht->remove(table.cht, key);
+			table.cht->put(table.cht, key, key);
+			break;
+	}
+}
+
+/**
+ * Run the operations of a thread
+ */
+static void *run(void *data)
+{
+	u_int seed = (uintptr_t)data, *key;
+	int i;
+
+	for (i = 0; i < operations; i++)
+	{
+		key = &keys[rand_r(&seed) % items];
+		if (rand_r(&seed) % 100 < reads)
+		{
+			get(key);
+		}
+		else
+		{
+			replace(key);
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Current time in ms
+ */
+static double now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/**
+ * Benchmark a table variant
+ */
+static void bench(table_type_t type, int count)
+{
+	thread_t *threads[count];
+	double start, ms;
+	int i;
+
+	table.type = type;
+	table.ht = hashtable_create((hashtable_hash_t)hash,
+								(hashtable_equals_t)equals, items);
+	table.mutex = mutex_create(MUTEX_TYPE_DEFAULT);
+	table.lock = rwlock_create(RWLOCK_TYPE_DEFAULT);
+	table.cht = concurrent_hashtable_create((hashtable_hash_t)hash,
+								(hashtable_equals_t)equals, items, 0);
+	for (i = 0; i < items; i++)
+	{
+		table.ht->put(table.ht, &keys[i], &keys[i]);
+		table.cht->put(table.cht, &keys[i], &keys[i]);
+	}
+
+	start = now();
+	for (i = 0; i < count; i++)
+	{
+		threads[i] = thread_create(run, (void*)(uintptr_t)(i + 1));
+	}
+	for (i = 0; i < count; i++)
+	{
+		threads[i]->join(threads[i]);
+	}
+	ms = now() - start;
+
+	printf("%-24s: %d threads, %.0f operations/s\n", table_names[type],
+		   count, (double)operations * count * 1000.0 / ms);
+
+	table.cht->destroy(table.cht);
+	table.lock->destroy(table.lock);
+	table.mutex->destroy(table.mutex);
+	table.ht->destroy(table.ht);
+}
+
+int main(int argc, char *argv[])
+{
+	int count, i;
+
+	if (argc < 4)
+	{
+		usage();
+	}
+	count = atoi(argv[1]);
+	items = atoi(argv[2]);
+	operations = atoi(argv[3]);
+	reads = argc > 4 ? atoi(argv[4]) : 90;
+	if (count <= 0 || items <= 0 || operations <= 0)
+	{
+		usage();
+	}
+
+	library_init(NULL);
+	atexit(library_deinit);
+
+	keys = malloc(items * sizeof(u_int));
+	for (i = 0; i < items; i++)
+	{
+		keys[i] = i;
+	}
+
+	bench(TABLE_MUTEX, count);
+	bench(TABLE_RWLOCK, count);
+	bench(TABLE_CONCURRENT, count);
+
+	free(keys);
+	return 0;
+}
@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2013 HSR Hochschule fuer Technik Rapperswil
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include <library.h>
+#include <utils/debug.h>
+#include <collections/linked_list.h>
+#include <networking/host.h>
+#include <selectors/traffic_selector.h>
+#include <threading/thread.h>
+
+static void usage()
+{
+	printf("usage: ike_alloc_speed threads setups [window]\n");
+	printf("  simulates the allocations of small objects (hosts, identities,\n");
+	printf("  traffic selectors and lists) done during IKE_SA setup, with the\n");
+	printf("  given number of setups per thread. Each thread keeps window\n");
+	printf("  (default 64) simulated SAs established, replacing the oldest.\n");
+	exit(1);
+}
+
+/**
+ * Objects of a simulated IKE_SA
+ */
+typedef struct {
+	host_t *me, *other;
+	identification_t *my_id, *other_id;
+	linked_list_t *my_ts, *other_ts;
+} sa_t;
+
+/**
+ * Number of setups per thread and SAs kept established
+ */
+static int setups, window;
+
+/**
+ * Create a list with a cloned copy of each traffic selector in list
+ */
+static linked_list_t *clone_ts(linked_list_t *list)
+{
+	return list->clone_offset(list, offsetof(traffic_selector_t, clone));
+}
+
+/**
+ * Narrow the traffic selectors of list to those of other
+ */
+static linked_list_t *narrow_ts(linked_list_t *list, linked_list_t *other)
+{
+	enumerator_t *e1, *e2;
+	traffic_selector_t *ts1, *ts2, *subset;
+	linked_list_t *narrowed;
+
+	narrowed = linked_list_create();
+	e1 = list->create_enumerator(list);
+	while (e1->enumerate(e1, &ts1))
+	{
+		e2 = other->create_enumerator(other);
+		while (e2->enumerate(e2, &ts2))
+		{
+			subset = ts1->get_subset(ts1, ts2);
+			if (subset)
+			{
+				narrowed->insert_last(narrowed, subset);
+			}
+		}
+		e2->destroy(e2);
+	}
+	e1->destroy(e1);
+	return narrowed;
+}
+
+/**
+ * Simulate the allocations of an IKE_SA setup
+ */
+static void setup(sa_t *sa, u_int seed)
+{
+	linked_list_t *proposed, *configured;
+	host_t *host;
+	identification_t *id;
+	char buf[64];
+
+	snprintf(buf, sizeof(buf), "10.%u.%u.%u", (seed >> 16) & 0xff,
+			 (seed >> 8) & 0xff, seed & 0xff);
+	host = host_create_from_string(buf, 500);
+	sa->other = host->clone(host);
+	host->destroy(host);
+	sa->me = host_create_from_string("192.168.0.1", 500);
+	sa->other->set_port(sa->other, 4500);
+	sa->me->set_port(sa->me, 4500);
+
+	snprintf(buf, sizeof(buf), "peer-%u@strongswan.org", seed);
+	id = identification_create_from_string(buf);
+	sa->other_id = id->clone(id);
+	id->destroy(id);
+	sa->my_id = identification_create_from_string("C=CH, O=strongSwan, CN=gw");
+
+	proposed = linked_list_create();
+	proposed->insert_last(proposed,
+			traffic_selector_create_from_cidr("0.0.0.0/0", 0, 0, 65535));
+	proposed->insert_last(proposed,
+			traffic_selector_create_from_cidr("::/0", 0, 0, 65535));
+	configured = linked_list_create();
+	configured->insert_last(configured,
+			traffic_selector_create_from_cidr("10.0.0.0/8", 0, 0, 65535));
+	configured->insert_last(configured,
+			traffic_selector_create_dynamic(0, 0, 65535));
+
+	sa->my_ts = narrow_ts(configured, proposed);
+	sa->other_ts = clone_ts(sa->my_ts);
+
+	proposed->destroy_offset(proposed, offsetof(traffic_selector_t, destroy));
+	configured->destroy_offset(configured,
+							   offsetof(traffic_selector_t, destroy));
+}
+
+/**
+ * Destroy the objects of a simulated IKE_SA
+ */
+static void teardown(sa_t *sa)
+{
+	sa->me->destroy(sa->me);
+	sa->other->destroy(sa->other);
+	sa->my_id->destroy(sa->my_id);
+	sa->other_id->destroy(sa->other_id);
+	sa->my_ts->destroy_offset(sa->my_ts, offsetof(traffic_selector_t, destroy));
+	sa->other_ts->destroy_offset(sa->other_ts,
+								 offsetof(traffic_selector_t, destroy));
+}
+
+/**
+ * Run the setups of a thread
+ */
+static void *run(void *data)
+{
+	u_int seed = (uintptr_t)data;
+	sa_t sas[window];
+	int i;
+
+	memset(sas, 0, sizeof(sas));
+	for (i = 0; i < setups; i++)
+	{
+		if (sas[i % window].me)
+		{
+			teardown(&sas[i % window]);
+		}
+		setup(&sas[i % window], seed * setups + i);
+	}
+	for (i = 0; i < window; i++)
+	{
+		if (sas[i].me)
+		{
+			teardown(&sas[i]);
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Current time in ms
+ */
+static double now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+int main(int argc, char *argv[])
+{
+	thread_t **threads;
+	double start, ms;
+	int count, i;
+
+	if (argc < 3)
+	{
+		usage();
+	}
+	count = atoi(argv[1]);
+	setups = atoi(argv[2]);
+	window = argc > 3 ? atoi(argv[3]) : 64;
+	if (count <= 0 || setups <= 0 || window <= 0)
+	{
+		usage();
+	}
+
+	library_init(NULL);
+	atexit(library_deinit);
+	dbg_default_set_level(0);
+
+	threads = calloc(count, sizeof(thread_t*));
+	start = now();
+	for (i = 0; i < count; i++)
+	{
+		threads[i] = thread_create(run, (void*)(uintptr_t)i);
+	}
+	for (i = 0; i < count; i++)
+	{
+		threads[i]->join(threads[i]);
+	}
+	ms = now() - start;
+	free(threads);
+
+	printf("%d threads, %d setups: %.0f setups/s\n", count, count * setups,
+		   (double)setups * count * 1000.0 / ms);
+	return 0;
+}
@@ -0,0 +1,249 @@
+/*
+ * Copyright (C) 2013 HSR Hochschule fuer Technik Rapperswil
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include <library.h>
+#include <threading/thread.h>
+
+/**
+ * Size of the fake ESP packets sent to load the NAT-T port
+ */
+#define ESP_SIZE 1400
+
+static void usage()
+{
+	printf("usage: natt_latency address port probes [flooders]\n");
+	printf("  measures the latency of IKE packets sent to the NAT-T port of\n");
+	printf("  charon, without and with concurrent ESP load. The probes are\n");
+	printf("  IKE_SA_INIT requests no config exists for, so charon answers\n");
+	printf("  them with NO_PROPOSAL_CHOSEN without any DH computation.\n");
+	printf("  Use the kernel-libipsec plugin in charon, other kernel-ipsec\n");
+	printf("  backends drop the ESP packets before they reach userland.\n");
+	exit(1);
+}
+
+/**
+ * Destination of probes and ESP packets
+ */
+static host_t *dst;
+
+/**
+ * State of a thread sending fake ESP packets
+ */
+typedef struct {
+	/** thread */
+	thread_t *thread;
+	/** socket */
+	int fd;
+	/** number of packets sent */
+	u_int64_t sent;
+} flooder_t;
+
+/**
+ * Send fake ESP packets as fast as possible
+ */
+static void *flood(flooder_t *this)
+{
+	char buf[ESP_SIZE];
+
+	/* any non-zero SPI, i.e. no Non-ESP marker */
+	memset(buf, 0x42, sizeof(buf));
+	while (TRUE)
+	{
+		if (sendto(this->fd, buf, sizeof(buf), 0, dst->get_sockaddr(dst),
+				   *dst->get_sockaddr_len(dst)) == sizeof(buf))
+		{
+			this->sent++;
+		}
+		thread_cancellation_point();
+	}
+	return NULL;
+}
+
+/**
+ * Current time in ms
+ */
+static double now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/**
+ * Non-ESP marker and IKE_SA_INIT request with SA, KE and Nonce payloads
+ */
+static u_char request[] = {
+	/* Non-ESP marker */
+	0x00,0x00,0x00,0x00,
+	/* IKE header, initiator SPI at offset 4 */
+	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+	0x21,0x20,0x22,0x08,0x00,0x00,0x00,0x00,
+	0x00,0x00,0x00,0xdc,
+	/* SA payload with a single AES-CBC proposal */
+	0x22,0x00,0x00,0x14,
+	0x00,0x00,0x00,0x10,0x01,0x01,0x00,0x01,
+	0x00,0x00,0x00,0x08,0x01,0x00,0x00,0x0c,
+	/* KE payload, MODP1024 with 128 bytes of data at offset 60 */
+	0x28,0x00,0x00,0x88,0x00,0x02,0x00,0x00,
+	[60 ... 187] = 0x5a,
+	/* Nonce payload with 32 bytes of data */
+	0x00,0x00,0x00,0x24,
+	[192 ... 223] = 0xa5,
+};
+
+/**
+ * Send an IKE probe and wait for the response, returns latency in ms or < 0
+ */
+static double probe(int fd, u_int64_t spi)
+{
+	u_char rsp[512];
+	double start;
+	ssize_t len;
+
+	memcpy(request + 4, &spi, sizeof(spi));
+
+	start = now();
+	if (send(fd, request, sizeof(request), 0) != sizeof(request))
+	{
+		return -1;
+	}
+	while (TRUE)
+	{
+		len = recv(fd, rsp, sizeof(rsp), 0);
+		if (len < 0)
+		{	/* timeout */
+			return -1;
+		}
+		if (len >= 4 + 28 && memeq(rsp + 4, &spi, sizeof(spi)))
+		{
+			return now() - start;
+		}
+		/* late response to a previous probe */
+	}
+}
+
+/**
+ * Compare function to sort latencies
+ */
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(double*)a, y = *(double*)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/**
+ * Run a series of probes and print the results
+ */
+static void run(int fd, int probes, char *label)
+{
+	double results[probes], sum = 0;
+	int i, received = 0;
+
+	for (i = 0; i < probes; i++)
+	{
+		results[received] = probe(fd, random() + ((u_int64_t)random() << 32));
+		if (results[received] >= 0)
+		{
+			sum += results[received++];
+		}
+		usleep(10000);
+	}
+	if (!received)
+	{
+		printf("%-8s: no responses\n", label);
+		return;
+	}
+	qsort(results, received, sizeof(double), cmp_double);
+	printf("%-8s: %d/%d responses, min %.3fms, avg %.3fms, median %.3fms, "
+		   "99%% %.3fms, max %.3fms\n", label, received, probes, results[0],
+		   sum / received, results[received / 2],
+		   results[received * 99 / 100], results[received - 1]);
+}
+
+int main(int argc, char *argv[])
+{
+	flooder_t *flooders;
+	struct timeval tv = {
+		.tv_sec = 1,
+	};
+	double start;
+	u_int64_t sent = 0;
+	int fd, probes, count = 2, i;
+
+	if (argc < 4)
+	{
+		usage();
+	}
+	probes = atoi(argv[3]);
+	if (argc > 4)
+	{
+		count = atoi(argv[4]);
+	}
+
+	library_init(NULL);
+	atexit(library_deinit);
+
+	dst = host_create_from_string(argv[1], atoi(argv[2]));
+	if (!dst || probes <= 0 || count < 0)
+	{
+		usage();
+	}
+	srandom(time(NULL));
+
+	fd = socket(dst->get_family(dst), SOCK_DGRAM, IPPROTO_UDP);
+	if (fd < 0 ||
+		connect(fd, dst->get_sockaddr(dst), *dst->get_sockaddr_len(dst)) < 0 ||
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0)
+	{
+		fprintf(stderr, "opening probe socket failed: %s\n", strerror(errno));
+		return 1;
+	}
+
+	run(fd, probes, "idle");
+
+	flooders = calloc(count, sizeof(flooder_t));
+	for (i = 0; i < count; i++)
+	{
+		flooders[i].fd = socket(dst->get_family(dst), SOCK_DGRAM, IPPROTO_UDP);
+		flooders[i].thread = thread_create((void*)flood, &flooders[i]);
+	}
+	start = now();
+
+	run(fd, probes, "ESP load");
+
+	for (i = 0; i < count; i++)
+	{
+		flooders[i].thread->cancel(flooders[i].thread);
+		flooders[i].thread->join(flooders[i].thread);
+		close(flooders[i].fd);
+		sent += flooders[i].sent;
+	}
+	printf("ESP load: %llu packets, %.0f packets/s\n", (unsigned long long)sent,
+		   sent * 1000.0 / (now() - start));
+
+	free(flooders);
+	close(fd);
+	dst->destroy(dst);
+	return 0;
+}
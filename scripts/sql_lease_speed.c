@@ -0,0 +1,346 @@
+/*
+ * Copyright (C) 2013 HSR Hochschule fuer Technik Rapperswil
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <library.h>
+#include <threading/thread.h>
+
+/**
+ * Number of clients (identities) simulated per thread
+ */
+#define CLIENTS 16
+
+static void usage()
+{
+	printf("usage: sql_lease_speed file threads rounds\n");
+	printf("  creates a SQLite attr-sql pool database in file (which gets\n");
+	printf("  overwritten) and measures the lease acquire/release cycle of\n");
+	printf("  the attr-sql plugin, with rounds cycles per client and\n");
+	printf("  %d clients per thread.\n", CLIENTS);
+	exit(1);
+}
+
+/**
+ * Database under test
+ */
+static database_t *db;
+
+/**
+ * Number of cycles per client
+ */
+static int rounds;
+
+/**
+ * State of a thread simulating clients
+ */
+typedef struct {
+	/** thread */
+	thread_t *thread;
+	/** index of first client */
+	int first;
+	/** number of failed cycles */
+	int failed;
+} worker_t;
+
+/**
+ * Tables used by attr-sql, see testing/hosts/default/etc/ipsec.d/tables.sql
+ */
+static char *schema[] = {
+	"CREATE TABLE identities ("
+	"  id INTEGER NOT NULL PRIMARY KEY AUTOINCREMENT,"
+	"  type INTEGER NOT NULL, data BLOB NOT NULL, UNIQUE (type, data))",
+	"CREATE TABLE pools ("
+	"  id INTEGER NOT NULL PRIMARY KEY AUTOINCREMENT,"
+	"  name TEXT NOT NULL, start BLOB NOT NULL, end BLOB NOT NULL,"
+	"  timeout INTEGER NOT NULL)",
+	"CREATE INDEX pools_name ON pools (name)",
+	"CREATE TABLE addresses ("
+	"  id INTEGER NOT NULL PRIMARY KEY AUTOINCREMENT,"
+	"  pool INTEGER NOT NULL, address BLOB NOT NULL,"
+	"  identity INTEGER NOT NULL DEFAULT 0,"
+	"  acquired INTEGER NOT NULL DEFAULT 0,"
+	"  released INTEGER NOT NULL DEFAULT 1)",
+	"CREATE INDEX addresses_pool ON addresses (pool)",
+	"CREATE INDEX addresses_address ON addresses (address)",
+	"CREATE INDEX addresses_identity ON addresses (identity)",
+	"CREATE TABLE leases ("
+	"  id INTEGER NOT NULL PRIMARY KEY AUTOINCREMENT,"
+	"  address INTEGER NOT NULL, identity INTEGER NOT NULL,"
+	"  acquired INTEGER NOT NULL, released INTEGER NOT NULL)",
+};
+
+/**
+ * Create the tables and a pool with an address for each client
+ */
+static bool setup(int clients)
+{
+	u_int32_t addr;
+	int i, pool;
+
+	for (i = 0; i < countof(schema); i++)
+	{
+		if (db->execute(db, NULL, schema[i]) < 0)
+		{
+			return FALSE;
+		}
+	}
+	addr = htonl(0x0a000001);
+	if (db->execute(db, &pool, "INSERT INTO pools (name, start, end, timeout) "
+			"VALUES (?, ?, ?, 0)", DB_TEXT, "bench",
+			DB_BLOB, chunk_from_thing(addr), DB_BLOB, chunk_from_thing(addr)) != 1)
+	{
+		return FALSE;
+	}
+	db->execute(db, NULL, "BEGIN TRANSACTION");
+	for (i = 0; i < clients; i++)
+	{
+		addr = htonl(0x0a000001 + i);
+		db->execute(db, NULL, "INSERT INTO addresses (pool, address) "
+					"VALUES (?, ?)", DB_UINT, pool,
+					DB_BLOB, chunk_from_thing(addr));
+	}
+	db->execute(db, NULL, "COMMIT TRANSACTION");
+	return TRUE;
+}
+
+/**
+ * Look up or insert an identity, as in attr-sql
+ */
+static u_int get_identity(chunk_t id)
+{
+	enumerator_t *e;
+	u_int row;
+
+	e = db->query(db, "SELECT id FROM identities WHERE type = ? AND data = ?",
+				  DB_INT, ID_FQDN, DB_BLOB, id, DB_UINT);
+	if (e && e->enumerate(e, &row))
+	{
+		e->destroy(e);
+		return row;
+	}
+	DESTROY_IF(e);
+	if (db->execute(db, &row, "INSERT INTO identities (type, data) "
+					"VALUES (?, ?)", DB_INT, ID_FQDN, DB_BLOB, id) == 1)
+	{
+		return row;
+	}
+	return 0;
+}
+
+/**
+ * Look up the pool, as in attr-sql
+ */
+static u_int get_pool()
+{
+	enumerator_t *e;
+	chunk_t start;
+	u_int pool = 0, timeout;
+
+	e = db->query(db, "SELECT id, start, timeout FROM pools WHERE name = ?",
+				  DB_TEXT, "bench", DB_UINT, DB_BLOB, DB_UINT);
+	if (e && !e->enumerate(e, &pool, &start, &timeout))
+	{
+		pool = 0;
+	}
+	DESTROY_IF(e);
+	return pool;
+}
+
+/**
+ * Acquire an existing or a new lease with static leases, as in attr-sql
+ */
+static bool acquire(u_int pool, u_int identity, chunk_t *address)
+{
+	enumerator_t *e;
+	u_int id;
+
+	while (TRUE)
+	{
+		e = db->query(db, "SELECT id, address FROM addresses "
+				"WHERE pool = ? AND identity = ? AND released != 0 LIMIT 1",
+				DB_UINT, pool, DB_UINT, identity, DB_UINT, DB_BLOB);
+		if (!e || !e->enumerate(e, &id, address))
+		{
+			DESTROY_IF(e);
+			e = db->query(db, "SELECT id, address FROM addresses "
+					"WHERE pool = ? AND identity = 0 LIMIT 1",
+					DB_UINT, pool, DB_UINT, DB_BLOB);
+			if (!e || !e->enumerate(e, &id, address))
+			{
+				DESTROY_IF(e);
+				return FALSE;
+			}
+		}
+		*address = chunk_clone(*address);
+		e->destroy(e);
+		/* another client might have taken the address in the meantime */
+		if (db->execute(db, NULL, "UPDATE addresses SET "
+					"acquired = ?, released = 0, identity = ? "
+					"WHERE id = ? AND released != 0 "
+					"AND (identity = ? OR identity = 0)",
+					DB_UINT, time(NULL), DB_UINT, identity, DB_UINT, id,
+					DB_UINT, identity) > 0)
+		{
+			return TRUE;
+		}
+		chunk_free(address);
+	}
+}
+
+/**
+ * Release a lease and log it to the history, as in attr-sql
+ */
+static bool release(u_int pool, chunk_t address)
+{
+	time_t now = time(NULL);
+
+	if (db->execute(db, NULL, "UPDATE addresses SET released = ? WHERE "
+			"pool = ? AND address = ?", DB_UINT, now,
+			DB_UINT, pool, DB_BLOB, address) > 0)
+	{
+		return db->execute(db, NULL,
+				"INSERT INTO leases (address, identity, acquired, released)"
+				" SELECT id, identity, acquired, ? FROM addresses "
+				" WHERE pool = ? AND address = ?",
+				DB_UINT, now, DB_UINT, pool, DB_BLOB, address) == 1;
+	}
+	return FALSE;
+}
+
+/**
+ * Acquire and release a lease for a client, in a transaction each as attr-sql
+ */
+static bool cycle(char *id)
+{
+	chunk_t address = chunk_empty;
+	u_int identity, pool;
+	bool ok;
+
+	if (!db->transaction(db, TRUE))
+	{
+		return FALSE;
+	}
+	identity = get_identity(chunk_from_str(id));
+	pool = get_pool();
+	ok = identity && pool && acquire(pool, identity, &address);
+	if (!db->commit(db) || !ok || !db->transaction(db, TRUE))
+	{
+		chunk_free(&address);
+		return FALSE;
+	}
+	ok = get_pool() == pool && release(pool, address);
+	chunk_free(&address);
+	return db->commit(db) && ok;
+}
+
+/**
+ * Run acquire/release cycles for a set of clients
+ */
+static void *work(worker_t *this)
+{
+	char id[32];
+	int round, i;
+
+	for (round = 0; round < rounds; round++)
+	{
+		for (i = this->first; i < this->first + CLIENTS; i++)
+		{
+			snprintf(id, sizeof(id), "client%d.strongswan.org", i);
+			if (!cycle(id))
+			{
+				this->failed++;
+			}
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Current time in ms
+ */
+static double now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+int main(int argc, char *argv[])
+{
+	worker_t *workers;
+	char uri[512];
+	double start, ms;
+	int threads, failed = 0, cycles, i;
+
+	if (argc < 4)
+	{
+		usage();
+	}
+	threads = atoi(argv[2]);
+	rounds = atoi(argv[3]);
+	if (threads <= 0 || rounds <= 0)
+	{
+		usage();
+	}
+
+	library_init(NULL);
+	atexit(library_deinit);
+	lib->plugins->load(lib->plugins, PLUGINS);
+
+	snprintf(uri, sizeof(uri), "%s-wal", argv[1]);
+	unlink(uri);
+	snprintf(uri, sizeof(uri), "%s-shm", argv[1]);
+	unlink(uri);
+	unlink(argv[1]);
+	snprintf(uri, sizeof(uri), "sqlite://%s", argv[1]);
+	db = lib->db->create(lib->db, uri);
+	if (!db)
+	{
+		fprintf(stderr, "opening database %s failed\n", uri);
+		return 1;
+	}
+	if (!setup(threads * CLIENTS))
+	{
+		fprintf(stderr, "creating attr-sql tables failed\n");
+		db->destroy(db);
+		return 1;
+	}
+
+	workers = calloc(threads, sizeof(worker_t));
+	start = now();
+	for (i = 0; i < threads; i++)
+	{
+		workers[i].first = i * CLIENTS;
+		workers[i].thread = thread_create((void*)work, &workers[i]);
+	}
+	for (i = 0; i < threads; i++)
+	{
+		workers[i].thread->join(workers[i].thread);
+		failed += workers[i].failed;
+	}
+	ms = now() - start;
+
+	cycles = threads * CLIENTS * rounds;
+	printf("%d threads: %d acquire/release cycles in %.0fms, %.0f cycles/s, "
+		   "%.3fms per cycle, %d failed\n", threads, cycles, ms,
+		   cycles * 1000.0 / ms, ms * threads / cycles, failed);
+
+	free(workers);
+	db->destroy(db);
+	return failed != 0;
+}
@@ -74,6 +74,7 @@ sa/keymat.h sa/keymat.c \
 sa/ike_sa_manager.c sa/ike_sa_manager.h \
 sa/task_manager.h sa/task_manager.c \
 sa/shunt_manager.c sa/shunt_manager.h \
+sa/rekey_limiter.c sa/rekey_limiter.h \
 sa/trap_manager.c sa/trap_manager.h \
 sa/task.c sa/task.h
 
@@ -457,10 +457,12 @@ static void destroy(private_daemon_t *this)
 #endif /* ME */
 	/* make sure the cache is clear before unloading plugins */
 	lib->credmgr->flush_cache(lib->credmgr, CERT_ANY);
+	lib->dh_pool->flush(lib->dh_pool);
 	lib->plugins->unload(lib->plugins);
 	DESTROY_IF(this->kernel_handler);
 	DESTROY_IF(this->public.traps);
 	DESTROY_IF(this->public.shunts);
+	DESTROY_IF(this->public.rekey_limiter);
 	DESTROY_IF(this->public.ike_sa_manager);
 	DESTROY_IF(this->public.controller);
 	DESTROY_IF(this->public.eap);
@@ -583,6 +585,7 @@ private_daemon_t *daemon_create(const char *name)
 	this->public.socket = socket_manager_create();
 	this->public.traps = trap_manager_create();
 	this->public.shunts = shunt_manager_create();
+	this->public.rekey_limiter = rekey_limiter_create();
 	this->kernel_handler = kernel_handler_create();
 
 	return this;
@@ -160,6 +160,7 @@ typedef struct daemon_t daemon_t;
 #include <sa/ike_sa_manager.h>
 #include <sa/trap_manager.h>
 #include <sa/shunt_manager.h>
+#include <sa/rekey_limiter.h>
 #include <config/backend_manager.h>
 #include <sa/eap/eap_manager.h>
 #include <sa/xauth/xauth_manager.h>
@@ -224,6 +225,11 @@ struct daemon_t {
 	 */
 	shunt_manager_t *shunts;
 
+	/**
+	 * Admission control for rekeyings
+	 */
+	rekey_limiter_t *rekey_limiter;
+
 	/**
 	 * Manager for the different configuration backends.
 	 */
@@ -45,7 +45,7 @@
 #include <encoding/payloads/unknown_payload.h>
 
 /**
- * Generating is done in a data buffer.
+ * Generating is done in a data buffer, allocated on demand unless reserved.
  * This is the start size of this buffer in bytes.
  */
 #define GENERATOR_DATA_BUFFER_SIZE 500
@@ -149,27 +149,43 @@ static u_int32_t get_offset(private_generator_t *this)
 }
 
 /**
- * Makes sure enough space is available in buffer to store amount of bits.
+ * Resize the buffer to the given size in bytes.
  */
-static void make_space_available(private_generator_t *this, int bits)
+static void resize(private_generator_t *this, int new_buffer_size)
 {
-	while ((get_space(this) * 8 - this->current_bit) < bits)
+	int out_position_offset;
+
+	if (this->debug)
 	{
-		int old_buffer_size, new_buffer_size, out_position_offset;
+		DBG2(DBG_ENC, "increasing gen buffer from %d to %d byte",
+			 get_size(this), new_buffer_size);
+	}
+	out_position_offset = this->out_position - this->buffer;
+	this->buffer = realloc(this->buffer, new_buffer_size);
+	this->out_position = this->buffer + out_position_offset;
+	this->roof_position = this->buffer + new_buffer_size;
+}
 
-		old_buffer_size = get_size(this);
-		new_buffer_size = old_buffer_size + GENERATOR_DATA_BUFFER_INCREASE_VALUE;
-		out_position_offset = this->out_position - this->buffer;
+/**
+ * Makes sure enough space is available in buffer to store amount of bits.
+ */
+static void make_space_available(private_generator_t *this, int bits)
+{
+	int new_buffer_size;
 
-		if (this->debug)
+	if ((get_space(this) * 8 - this->current_bit) < bits)
+	{
+		new_buffer_size = get_size(this);
+		if (!new_buffer_size)
 		{
-			DBG2(DBG_ENC, "increasing gen buffer from %d to %d byte",
-				 old_buffer_size, new_buffer_size);
+			new_buffer_size = GENERATOR_DATA_BUFFER_SIZE;
 		}
-
-		this->buffer = realloc(this->buffer,new_buffer_size);
-		this->out_position = (this->buffer + out_position_offset);
-		this->roof_position = (this->buffer + new_buffer_size);
+		while ((new_buffer_size - get_length(this)) * 8 -
+				this->current_bit < bits)
+		{
+			new_buffer_size += GENERATOR_DATA_BUFFER_INCREASE_VALUE;
+		}
+		resize(this, new_buffer_size);
 	}
 }
 
@@ -441,6 +457,40 @@ METHOD(generator_t, get_chunk, chunk_t,
 	return data;
 }
 
+METHOD(generator_t, reserve, void,
+	private_generator_t *this, size_t len)
+{
+	if ((size_t)get_space(this) < len)
+	{
+		resize(this, get_length(this) + len);
+	}
+}
+
+METHOD(generator_t, skip_bytes, u_int32_t,
+	private_generator_t *this, size_t len)
+{
+	u_int32_t offset;
+
+	if (this->current_bit != 0)
+	{
+		DBG1(DBG_ENC, "can not skip bytes at bitpos %d", this->current_bit);
+	}
+	make_space_available(this, len * 8);
+	offset = get_offset(this);
+	this->out_position += len;
+	return offset;
+}
+
+METHOD(generator_t, extract_chunk, chunk_t,
+	private_generator_t *this, u_int32_t **lenpos)
+{
+	chunk_t data;
+
+	data = get_chunk(this, lenpos);
+	this->buffer = this->out_position = this->roof_position = NULL;
+	return data;
+}
+
 METHOD(generator_t, generate_payload, void,
 	private_generator_t *this, payload_t *payload)
 {
@@ -588,15 +638,14 @@ generator_t *generator_create()
 		.public = {
 			.get_chunk = _get_chunk,
 			.generate_payload = _generate_payload,
+			.reserve = _reserve,
+			.skip_bytes = _skip_bytes,
+			.extract_chunk = _extract_chunk,
 			.destroy = _destroy,
 		},
-		.buffer = malloc(GENERATOR_DATA_BUFFER_SIZE),
 		.debug = TRUE,
 	);
 
-	this->out_position = this->buffer;
-	this->roof_position = this->buffer + GENERATOR_DATA_BUFFER_SIZE;
-
 	return &this->public;
 }
 
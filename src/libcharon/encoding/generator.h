@@ -59,6 +59,38 @@ struct generator_t {
 	 */
 	chunk_t (*get_chunk) (generator_t *this, u_int32_t **lenpos);
 
+	/**
+	 * Make sure the buffer can take a number of additional bytes.
+	 *
+	 * If the size of the generated data is computed in advance, the buffer
+	 * gets allocated once with the exact size and never reallocated.
+	 *
+	 * @param len			number of bytes to reserve
+	 */
+	void (*reserve)(generator_t *this, size_t len);
+
+	/**
+	 * Skip a number of bytes at the current position, to fill in later.
+	 *
+	 * The content of the skipped bytes is undefined.
+	 *
+	 * @param len			number of bytes to skip, 0 to get current offset
+	 * @return				offset of the skipped bytes in generated data
+	 */
+	u_int32_t (*skip_bytes)(generator_t *this, size_t len);
+
+	/**
+	 * Take ownership of the generated data.
+	 *
+	 * Works like get_chunk(), but the returned chunk has to be freed by the
+	 * caller. The generator can't be used afterwards, except for destroying
+	 * it.
+	 *
+	 * @param lenpos		receives a pointer to fill in length value
+	 * @param return		allocated chunk with generated data
+	 */
+	chunk_t (*extract_chunk) (generator_t *this, u_int32_t **lenpos);
+
 	/**
 	 * Destroys a generator_t object.
 	 */
@@ -803,6 +803,56 @@ static message_rule_t message_rules[] = {
 };
 
 
+/**
+ * Maximum packet size for fragmented packets (same as in sockets)
+ */
+#define MAX_PACKET 10000
+
+/**
+ * Length of the header of an encrypted fragment payload
+ */
+#define ENCRYPTED_FRAGMENT_HEADER_LENGTH 8
+
+/**
+ * A single fragment within a fragmented message
+ */
+typedef struct {
+
+	/** fragment number */
+	u_int16_t num;
+
+	/** fragment data */
+	chunk_t data;
+
+} fragment_t;
+
+/**
+ * Data used to reassemble a fragmented message
+ */
+typedef struct {
+
+	/**
+	 * Total number of fragments, as announced by the peer
+	 */
+	u_int16_t last;
+
+	/**
+	 * List of fragments (fragment_t*), sorted by number
+	 */
+	linked_list_t *list;
+
+	/**
+	 * Length of all currently received fragments
+	 */
+	size_t len;
+
+	/**
+	 * Maximum length of a fragmented message
+	 */
+	size_t max_packet;
+
+} fragment_data_t;
+
 typedef struct private_message_t private_message_t;
 
 /**
@@ -889,6 +939,16 @@ struct private_message_t {
 	 * The message rule for this message instance
 	 */
 	message_rule_t *rule;
+
+	/**
+	 * Data used to reassemble a fragmented message
+	 */
+	fragment_data_t *frag;
+
+	/**
+	 * Decrypted or reassembled data, referenced by parsed payloads
+	 */
+	chunk_t data;
 };
 
 /**
@@ -1127,9 +1187,38 @@ METHOD(message_t, create_payload_enumerator, enumerator_t*,
 	return this->payloads->create_enumerator(this->payloads);
 }
 
+/**
+ * Copy the parsed data all payloads reference, so they can outlive the
+ * message or its packet data
+ */
+static void copy_payload_data(private_message_t *this)
+{
+	enumerator_t *enumerator;
+	payload_t *payload;
+
+	enumerator = this->payloads->create_enumerator(this->payloads);
+	while (enumerator->enumerate(enumerator, &payload))
+	{
+		payload_copy_data(payload, this->packet->get_data(this->packet));
+		payload_copy_data(payload, this->data);
+	}
+	enumerator->destroy(enumerator);
+}
+
+/**
+ * Release the parsed data a payload references before destroying it
+ */
+static void release_payload_data(private_message_t *this, payload_t *payload)
+{
+	payload_release_data(payload, this->packet->get_data(this->packet));
+	payload_release_data(payload, this->data);
+}
+
 METHOD(message_t, remove_payload_at, void,
 	private_message_t *this, enumerator_t *enumerator)
 {
+	/* the removed payload is not known here, detach all of them */
+	copy_payload_data(this);
 	this->payloads->remove_at(this->payloads, enumerator);
 }
 
@@ -1301,6 +1390,21 @@ static char* get_string(private_message_t *this, char *buf, int len)
 				len -= written;
 			}
 		}
+		if (payload->get_type(payload) == ENCRYPTED_FRAGMENT)
+		{
+			encrypted_fragment_payload_t *frag;
+
+			frag = (encrypted_fragment_payload_t*)payload;
+			written = snprintf(pos, len, "(%u/%u)",
+							   frag->get_fragment_number(frag),
+							   frag->get_total_fragments(frag));
+			if (written >= len || written < 0)
+			{
+				return buf;
+			}
+			pos += written;
+			len -= written;
+		}
 	}
 	enumerator->destroy(enumerator);
 
@@ -1379,6 +1483,14 @@ static encryption_payload_t* wrap_payloads(private_message_t *this)
 	linked_list_t *payloads;
 	payload_t *current;
 
+	if (this->payloads->get_last(this->payloads,
+								 (void**)&current) == SUCCESS &&
+		current->get_type(current) == ENCRYPTED_FRAGMENT)
+	{	/* a fragment of an already generated encryption payload */
+		this->payloads->remove_last(this->payloads, (void**)&current);
+		return (encryption_payload_t*)current;
+	}
+
 	/* copy all payloads in a temporary list */
 	payloads = linked_list_create();
 	while (this->payloads->remove_first(this->payloads,
@@ -1431,6 +1543,32 @@ METHOD(message_t, disable_sort, void,
 	this->sort_disabled = TRUE;
 }
 
+/**
+ * Compute the size of the encoded message, including the encryption payload
+ */
+static size_t get_encoded_length(private_message_t *this,
+								 ike_header_t *ike_header,
+								 encryption_payload_t *encryption)
+{
+	enumerator_t *enumerator;
+	payload_t *payload;
+	size_t len;
+
+	len = ike_header->payload_interface.get_length(
+											&ike_header->payload_interface);
+	enumerator = create_payload_enumerator(this);
+	while (enumerator->enumerate(enumerator, &payload))
+	{
+		len += payload->get_length(payload);
+	}
+	enumerator->destroy(enumerator);
+	if (encryption)
+	{
+		len += encryption->get_length(encryption);
+	}
+	return len;
+}
+
 METHOD(message_t, generate, status_t,
 	private_message_t *this, keymat_t *keymat, packet_t **packet)
 {
@@ -1468,6 +1606,9 @@ METHOD(message_t, generate, status_t,
 		return NOT_SUPPORTED;
 	}
 
+	/* parsed payloads must not reference the packet data we replace */
+	copy_payload_data(this);
+
 	if (!this->sort_disabled)
 	{
 		order_payloads(this);
@@ -1558,7 +1699,13 @@ METHOD(message_t, generate, status_t,
 		}
 	}
 
+	if (encryption)
+	{	/* set_transform() has to be called before get_length() */
+		encryption->set_transform(encryption, aead);
+	}
 	generator = generator_create();
+	generator->reserve(generator, get_encoded_length(this, ike_header,
+													 encryption));
 
 	/* generate all payloads with proper next type */
 	payload = (payload_t*)ike_header;
@@ -1577,40 +1724,47 @@ METHOD(message_t, generate, status_t,
 	}
 	else
 	{
-		next_type = encryption ? ENCRYPTED : NO_PAYLOAD;
+		next_type = NO_PAYLOAD;
+		if (encryption)
+		{
+			next_type = encryption->payload_interface.get_type(
+														(payload_t*)encryption);
+		}
 	}
 	payload->set_next_type(payload, next_type);
 	generator->generate_payload(generator, payload);
 	ike_header->destroy(ike_header);
 
 	if (encryption)
-	{	/* set_transform() has to be called before get_length() */
-		encryption->set_transform(encryption, aead);
+	{
+		this->payloads->insert_last(this->payloads, encryption);
 		if (this->is_encrypted)
 		{	/* for IKEv1 instead of associated data we provide the IV */
-			if (!keymat_v1->get_iv(keymat_v1, this->message_id, &chunk))
+			if (!keymat_v1->get_iv(keymat_v1, this->message_id, &chunk) ||
+				encryption->encrypt(encryption, chunk) != SUCCESS)
 			{
 				generator->destroy(generator);
 				return FAILED;
 			}
+			generator->generate_payload(generator,
+										&encryption->payload_interface);
 		}
 		else
-		{	/* build associated data (without header of encryption payload) */
+		{	/* fill in length, including encryption payload, as the data
+			 * generated so far is used as associated data */
 			chunk = generator->get_chunk(generator, &lenpos);
-			/* fill in length, including encryption payload */
 			htoun32(lenpos, chunk.len + encryption->get_length(encryption));
+			if (encryption->generate_encrypted(encryption,
+											   generator) != SUCCESS)
+			{
+				generator->destroy(generator);
+				return INVALID_STATE;
+			}
 		}
-		this->payloads->insert_last(this->payloads, encryption);
-		if (encryption->encrypt(encryption, chunk) != SUCCESS)
-		{
-			generator->destroy(generator);
-			return INVALID_STATE;
-		}
-		generator->generate_payload(generator, &encryption->payload_interface);
 	}
-	chunk = generator->get_chunk(generator, &lenpos);
+	chunk = generator->extract_chunk(generator, &lenpos);
 	htoun32(lenpos, chunk.len);
-	this->packet->set_data(this->packet, chunk_clone(chunk));
+	this->packet->set_data(this->packet, chunk);
 	if (this->is_encrypted)
 	{
 		/* update the IV for the next IKEv1 message */
@@ -1631,6 +1785,173 @@ METHOD(message_t, generate, status_t,
 	return SUCCESS;
 }
 
+/**
+ * Create an enumerator over a list of packets, which get owned by the caller
+ */
+static enumerator_t *create_packet_enumerator(linked_list_t *packets)
+{
+	return enumerator_create_cleaner(packets->create_enumerator(packets),
+									 (void*)packets->destroy, packets);
+}
+
+/**
+ * Generate a single fragment with the given data
+ */
+static status_t generate_fragment(private_message_t *this, keymat_t *keymat,
+								  encrypted_fragment_payload_t *fragment,
+								  packet_t **packet)
+{
+	private_message_t *message;
+	host_t *src, *dst;
+	status_t status;
+
+	message = (private_message_t*)message_create(this->major_version,
+												 this->minor_version);
+	message->ike_sa_id = this->ike_sa_id->clone(this->ike_sa_id);
+	message->exchange_type = this->exchange_type;
+	message->message_id = this->message_id;
+	message->is_request = this->is_request;
+	message->version_flag = this->version_flag;
+	message->reserved[0] = this->reserved[0];
+	message->reserved[1] = this->reserved[1];
+	message->sort_disabled = TRUE;
+	src = this->packet->get_source(this->packet);
+	dst = this->packet->get_destination(this->packet);
+	message->packet->set_source(message->packet, src->clone(src));
+	message->packet->set_destination(message->packet, dst->clone(dst));
+	add_payload(message, (payload_t*)fragment);
+	status = generate(message, keymat, packet);
+	message->public.destroy(&message->public);
+	return status;
+}
+
+METHOD(message_t, fragment, status_t,
+	private_message_t *this, keymat_t *keymat, size_t frag_len,
+	enumerator_t **fragments)
+{
+	encrypted_fragment_payload_t *fragment;
+	encryption_payload_t *encryption;
+	generator_t *generator;
+	linked_list_t *packets, *payloads;
+	payload_t *payload, *next;
+	packet_t *packet;
+	payload_type_t first;
+	enumerator_t *enumerator;
+	aead_t *aead = NULL;
+	chunk_t data, plain;
+	u_int32_t *lenpos;
+	size_t bs, max, len;
+	u_int16_t num, count;
+	status_t status;
+
+	if (!is_encoded(this))
+	{
+		status = generate(this, keymat, &packet);
+		if (status != SUCCESS)
+		{
+			return status;
+		}
+		packet->destroy(packet);
+	}
+	packets = linked_list_create();
+
+	data = this->packet->get_data(this->packet);
+	if (data.len <= frag_len + IKE_HEADER_LENGTH +
+					ENCRYPTED_FRAGMENT_HEADER_LENGTH ||
+		this->major_version != IKEV2_MAJOR_VERSION ||
+		this->payloads->get_count(this->payloads) != 1 ||
+		this->payloads->get_first(this->payloads, (void**)&payload) != SUCCESS ||
+		payload->get_type(payload) != ENCRYPTED)
+	{	/* no need or no way to fragment the message */
+		packets->insert_last(packets, this->packet->clone(this->packet));
+		*fragments = create_packet_enumerator(packets);
+		return SUCCESS;
+	}
+	encryption = (encryption_payload_t*)payload;
+
+	aead = keymat->get_aead(keymat, FALSE);
+	bs = aead->get_block_size(aead);
+	max = aead->get_iv_size(aead) + aead->get_icv_size(aead);
+	if (frag_len <= max + bs)
+	{
+		DBG1(DBG_ENC, "fragment size %zu too small, not fragmenting", frag_len);
+		packets->insert_last(packets, this->packet->clone(this->packet));
+		*fragments = create_packet_enumerator(packets);
+		return SUCCESS;
+	}
+	/* align to the block size, at least one byte is needed for the padding
+	 * length */
+	max = frag_len - max;
+	max = max - (max % bs) - 1;
+
+	/* generate the plain content of the encryption payload again, the
+	 * payloads are moved back after generating the fragments */
+	payloads = linked_list_create();
+	len = 0;
+	while ((payload = encryption->remove_payload(encryption)))
+	{
+		len += payload->get_length(payload);
+		payloads->insert_last(payloads, payload);
+	}
+	first = NO_PAYLOAD;
+	generator = generator_create();
+	generator->reserve(generator, len);
+	enumerator = payloads->create_enumerator(payloads);
+	if (enumerator->enumerate(enumerator, &payload))
+	{
+		first = payload->get_type(payload);
+		while (enumerator->enumerate(enumerator, &next))
+		{
+			payload->set_next_type(payload, next->get_type(next));
+			generator->generate_payload(generator, payload);
+			payload = next;
+		}
+		payload->set_next_type(payload, NO_PAYLOAD);
+		generator->generate_payload(generator, payload);
+	}
+	enumerator->destroy(enumerator);
+	plain = generator->get_chunk(generator, &lenpos);
+
+	count = plain.len / max + (plain.len % max ? 1 : 0);
+	DBG1(DBG_ENC, "splitting IKE message with length of %zu bytes into "
+		 "%hu fragments", data.len, count);
+	status = SUCCESS;
+	for (num = 1; num <= count; num++)
+	{
+		data = chunk_create(plain.ptr, min(plain.len, max));
+		plain = chunk_skip(plain, data.len);
+		fragment = encrypted_fragment_payload_create_from_data(num, count,
+															   data);
+		if (num == 1)
+		{
+			fragment->encrypted.payload_interface.set_next_type(
+						&fragment->encrypted.payload_interface, first);
+		}
+		status = generate_fragment(this, keymat, fragment, &packet);
+		if (status != SUCCESS)
+		{
+			DBG1(DBG_ENC, "failed to generate IKE fragment");
+			break;
+		}
+		packets->insert_last(packets, packet);
+	}
+	generator->destroy(generator);
+
+	while (payloads->remove_first(payloads, (void**)&payload) == SUCCESS)
+	{
+		encryption->add_payload(encryption, payload);
+	}
+	payloads->destroy(payloads);
+
+	if (status != SUCCESS)
+	{
+		packets->destroy_offset(packets, offsetof(packet_t, destroy));
+		return status;
+	}
+	*fragments = create_packet_enumerator(packets);
+	return SUCCESS;
+}
+
 METHOD(message_t, get_packet, packet_t*,
 	private_message_t *this)
 {
@@ -1795,6 +2116,7 @@ static status_t parse_payloads(private_message_t *this)
 		{
 			DBG1(DBG_ENC, "%N payload verification failed",
 				 payload_type_names, type);
+			release_payload_data(this, payload);
 			payload->destroy(payload);
 			return VERIFY_ERROR;
 		}
@@ -1805,7 +2127,7 @@ static status_t parse_payloads(private_message_t *this)
 
 		/* an encryption payload is the last one, so STOP here. decryption is
 		 * done later */
-		if (type == ENCRYPTED)
+		if (type == ENCRYPTED || type == ENCRYPTED_FRAGMENT)
 		{
 			DBG2(DBG_ENC, "%N payload found. Stop parsing",
 				 payload_type_names, type);
@@ -1836,7 +2158,8 @@ static status_t decrypt_payloads(private_message_t *this, keymat_t *keymat)
 
 		DBG2(DBG_ENC, "process payload of type %N", payload_type_names, type);
 
-		if (type == ENCRYPTED || type == ENCRYPTED_V1)
+		if (type == ENCRYPTED || type == ENCRYPTED_V1 ||
+			type == ENCRYPTED_FRAGMENT)
 		{
 			encryption_payload_t *encryption;
 			payload_t *encrypted;
@@ -1910,6 +2233,11 @@ static status_t decrypt_payloads(private_message_t *this, keymat_t *keymat)
 			}
 
 			was_encrypted = TRUE;
+			if (type == ENCRYPTED_FRAGMENT)
+			{	/* the content gets parsed after reassembly */
+				previous = payload;
+				continue;
+			}
 			this->payloads->remove_at(this->payloads, enumerator);
 
 			while ((encrypted = encryption->remove_payload(encryption)))
@@ -1928,6 +2256,8 @@ static status_t decrypt_payloads(private_message_t *this, keymat_t *keymat)
 				this->payloads->insert_last(this->payloads, encrypted);
 				previous = encrypted;
 			}
+			/* the decrypted payloads reference the decrypted data */
+			this->data = encryption->extract_data(encryption);
 			encryption->destroy(encryption);
 		}
 		if (payload_is_known(type) && !was_encrypted &&
@@ -2036,6 +2366,12 @@ METHOD(message_t, parse_body, status_t,
 		return status;
 	}
 
+	if (get_payload(this, ENCRYPTED_FRAGMENT))
+	{	/* the message gets verified after reassembly */
+		DBG1(DBG_ENC, "parsed %s", get_string(this, str, sizeof(str)));
+		return SUCCESS;
+	}
+
 	status = verify(this);
 	if (status != SUCCESS)
 	{
@@ -2091,11 +2427,216 @@ METHOD(message_t, parse_body, status_t,
 	return SUCCESS;
 }
 
+/**
+ * Destroy a single fragment
+ */
+static void fragment_destroy(fragment_t *this)
+{
+	free(this->data.ptr);
+	free(this);
+}
+
+/**
+ * Drop all fragments received so far and prepare for the given total
+ */
+static void reset_fragments(private_message_t *this, u_int16_t last)
+{
+	fragment_t *fragment;
+
+	while (this->frag->list->remove_last(this->frag->list,
+										 (void**)&fragment) == SUCCESS)
+	{
+		fragment_destroy(fragment);
+	}
+	this->frag->last = last;
+	this->frag->len = 0;
+}
+
+/**
+ * Parse the payloads of a reassembled message
+ */
+static status_t parse_reassembled(private_message_t *this, chunk_t plain)
+{
+	parser_t *parser;
+	payload_type_t type;
+	payload_t *payload;
+	status_t status = SUCCESS;
+
+	parser = parser_create(plain);
+	parser->set_zero_copy(parser, TRUE);
+	type = this->first_payload;
+	while (type != NO_PAYLOAD)
+	{
+		if (parser->parse_payload(parser, type, &payload) != SUCCESS)
+		{
+			DBG1(DBG_ENC, "payload type %N could not be parsed",
+				 payload_type_names, type);
+			status = PARSE_ERROR;
+			break;
+		}
+		if (payload->verify(payload) != SUCCESS)
+		{
+			DBG1(DBG_ENC, "%N payload verification failed",
+				 payload_type_names, type);
+			release_payload_data(this, payload);
+			payload->destroy(payload);
+			status = VERIFY_ERROR;
+			break;
+		}
+		type = payload->get_next_type(payload);
+		this->payloads->insert_last(this->payloads, payload);
+	}
+	parser->destroy(parser);
+	return status;
+}
+
+METHOD(message_t, add_fragment, status_t,
+	private_message_t *this, message_t *message)
+{
+	encrypted_fragment_payload_t *payload;
+	enumerator_t *enumerator;
+	fragment_t *fragment;
+	u_int16_t num, total;
+	chunk_t data;
+	char str[BUF_LEN];
+	status_t status;
+
+	if (!this->frag)
+	{
+		return INVALID_STATE;
+	}
+	payload = (encrypted_fragment_payload_t*)message->get_payload(message,
+														ENCRYPTED_FRAGMENT);
+	if (!payload || this->message_id != message->get_message_id(message) ||
+		this->is_request != message->get_request(message) ||
+		this->exchange_type != message->get_exchange_type(message))
+	{
+		return INVALID_ARG;
+	}
+	num = payload->get_fragment_number(payload);
+	total = payload->get_total_fragments(payload);
+
+	if (total > this->frag->last)
+	{
+		if (this->frag->last)
+		{	/* the sender uses a smaller fragment size, start over */
+			DBG1(DBG_ENC, "received fragment with %hu total fragments, "
+				 "expected %hu, restarting reassembly", total,
+				 this->frag->last);
+		}
+		reset_fragments(this, total);
+	}
+	else if (total < this->frag->last)
+	{
+		DBG1(DBG_ENC, "received fragment with %hu total fragments, "
+			 "expected %hu, ignored", total, this->frag->last);
+		return NEED_MORE;
+	}
+
+	enumerator = this->frag->list->create_enumerator(this->frag->list);
+	while (enumerator->enumerate(enumerator, &fragment))
+	{
+		if (fragment->num == num)
+		{	/* ignore a duplicate fragment */
+			DBG1(DBG_ENC, "received duplicate fragment #%hu", num);
+			enumerator->destroy(enumerator);
+			return NEED_MORE;
+		}
+		if (fragment->num > num)
+		{
+			break;
+		}
+	}
+
+	data = payload->get_content(payload);
+	this->frag->len += data.len;
+	if (this->frag->len > this->frag->max_packet)
+	{
+		DBG1(DBG_ENC, "fragmented IKE message is too large");
+		enumerator->destroy(enumerator);
+		reset_fragments(this, 0);
+		return FAILED;
+	}
+	INIT(fragment,
+		.num = num,
+		.data = chunk_clone(data),
+	);
+	this->frag->list->insert_before(this->frag->list, enumerator, fragment);
+	enumerator->destroy(enumerator);
+
+	if (num == 1)
+	{	/* only the first fragment denotes the first contained payload */
+		this->first_payload = payload->encrypted.payload_interface.get_next_type(
+										&payload->encrypted.payload_interface);
+		this->packet->destroy(this->packet);
+		this->packet = message->get_packet(message);
+	}
+
+	if (this->frag->list->get_count(this->frag->list) < total)
+	{
+		DBG1(DBG_ENC, "received fragment #%hu of %hu, waiting for complete "
+			 "IKE message", num, total);
+		return NEED_MORE;
+	}
+
+	DBG1(DBG_ENC, "received fragment #%hu of %hu, reassembling fragmented "
+		 "IKE message", num, total);
+
+	data = chunk_alloc(this->frag->len);
+	data.len = 0;
+	enumerator = this->frag->list->create_enumerator(this->frag->list);
+	while (enumerator->enumerate(enumerator, &fragment))
+	{
+		memcpy(data.ptr + data.len, fragment->data.ptr, fragment->data.len);
+		data.len += fragment->data.len;
+	}
+	enumerator->destroy(enumerator);
+	reset_fragments(this, 0);
+
+	this->rule = get_message_rule(this);
+	if (!this->rule)
+	{
+		DBG1(DBG_ENC, "no message rules specified for a %N %s",
+			 exchange_type_names, this->exchange_type,
+			 this->is_request ? "request" : "response");
+		return NOT_SUPPORTED;
+	}
+	/* parsed payloads reference the reassembled data, keep it */
+	this->data = data;
+	status = parse_reassembled(this, data);
+	if (status != SUCCESS)
+	{
+		return status;
+	}
+	status = verify(this);
+	if (status != SUCCESS)
+	{
+		return status;
+	}
+	DBG1(DBG_ENC, "parsed %s", get_string(this, str, sizeof(str)));
+	return SUCCESS;
+}
+
 METHOD(message_t, destroy, void,
 	private_message_t *this)
 {
+	payload_t *payload;
+
+	if (this->frag)
+	{
+		this->frag->list->destroy_function(this->frag->list,
+										   (void*)fragment_destroy);
+		free(this->frag);
+	}
 	DESTROY_IF(this->ike_sa_id);
-	this->payloads->destroy_offset(this->payloads, offsetof(payload_t, destroy));
+	while (this->payloads->remove_last(this->payloads,
+									   (void**)&payload) == SUCCESS)
+	{
+		release_payload_data(this, payload);
+		payload->destroy(payload);
+	}
+	this->payloads->destroy(this->payloads);
+	free(this->data.ptr);
 	this->packet->destroy(this->packet);
 	this->parser->destroy(this->parser);
 	free(this);
@@ -2132,6 +2673,7 @@ message_t *message_create_from_packet(packet_t *packet)
 			.add_notify = _add_notify,
 			.disable_sort = _disable_sort,
 			.generate = _generate,
+			.fragment = _fragment,
 			.is_encoded = _is_encoded,
 			.set_source = _set_source,
 			.get_source = _get_source,
@@ -2143,6 +2685,7 @@ message_t *message_create_from_packet(packet_t *packet)
 			.get_notify = _get_notify,
 			.parse_header = _parse_header,
 			.parse_body = _parse_body,
+			.add_fragment = _add_fragment,
 			.get_packet = _get_packet,
 			.get_packet_data = _get_packet_data,
 			.destroy = _destroy,
@@ -2154,6 +2697,7 @@ message_t *message_create_from_packet(packet_t *packet)
 		.payloads = linked_list_create(),
 		.parser = parser_create(packet->get_data(packet)),
 	);
+	this->parser->set_zero_copy(this->parser, TRUE);
 
 	return &this->public;
 }
@@ -2170,3 +2714,31 @@ message_t *message_create(int major, int minor)
 
 	return this;
 }
+
+/*
+ * Described in header.
+ */
+message_t *message_create_defrag(message_t *fragment)
+{
+	private_message_t *this;
+	ike_sa_id_t *id;
+
+	if (!fragment->get_payload(fragment, ENCRYPTED_FRAGMENT))
+	{
+		return NULL;
+	}
+	this = (private_message_t*)message_create(
+									fragment->get_major_version(fragment),
+									fragment->get_minor_version(fragment));
+	id = fragment->get_ike_sa_id(fragment);
+	this->ike_sa_id = id->clone(id);
+	this->message_id = fragment->get_message_id(fragment);
+	this->exchange_type = fragment->get_exchange_type(fragment);
+	this->is_request = fragment->get_request(fragment);
+	INIT(this->frag,
+		.list = linked_list_create(),
+		.max_packet = lib->settings->get_int(lib->settings,
+								"%s.max_packet", MAX_PACKET, charon->name),
+	);
+	return &this->public;
+}
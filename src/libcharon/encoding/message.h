@@ -238,6 +238,24 @@ struct message_t {
 	 */
 	status_t (*parse_body) (message_t *this, keymat_t *keymat);
 
+	/**
+	 * Add a fragment to a message created with message_create_defrag().
+	 *
+	 * Fragments may be added in any order, duplicates are ignored. Once all
+	 * fragments are received the reassembled content gets parsed and
+	 * verified like a regular message body.
+	 *
+	 * @param fragment	parsed and decrypted fragment message
+	 * @return
+	 *					- SUCCESS if message is complete and verified
+	 *					- NEED_MORE if fragments are missing
+	 *					- INVALID_ARG if fragment does not belong to message
+	 *					- FAILED if reassembled message is too large
+	 *					- PARSE_ERROR, VERIFY_ERROR if reassembled content
+	 *					  is invalid
+	 */
+	status_t (*add_fragment)(message_t *this, message_t *fragment);
+
 	/**
 	 * Generates the UDP packet of specific message.
 	 *
@@ -257,6 +275,27 @@ struct message_t {
 	 */
 	status_t (*generate) (message_t *this, keymat_t *keymat, packet_t **packet);
 
+	/**
+	 * Generates the message split into encrypted fragments (RFC 7383).
+	 *
+	 * The message is generated first (if not already done). If the result
+	 * does not exceed the given fragment size, or if the message is not
+	 * protected by an IKEv2 encryption payload, a single packet is returned.
+	 * Otherwise the content of the encryption payload gets split into
+	 * encrypted fragment payloads, each sent in a separate packet.
+	 *
+	 * @param keymat	keymat to encrypt/sign message(s)
+	 * @param frag_len	maximum length of the encrypted data in a fragment
+	 *					(without IKE and fragment header)
+	 * @param fragments	enumerator over generated packets (packet_t*),
+	 *					each enumerated packet gets owned by the caller
+	 * @return
+	 *					- SUCCESS if message could be generated
+	 *					- see generate() for other values
+	 */
+	status_t (*fragment)(message_t *this, keymat_t *keymat, size_t frag_len,
+						 enumerator_t **fragments);
+
 	/**
 	 * Check if the message has already been encoded using generate().
 	 *
@@ -380,4 +419,14 @@ message_t *message_create_from_packet(packet_t *packet);
  */
 message_t *message_create(int major, int minor);
 
+/**
+ * Creates a message_t object used to reassemble fragmented messages.
+ *
+ * Use add_fragment() to add the given and all further fragments.
+ *
+ * @param fragment		parsed message containing an encrypted fragment
+ * @return				message_t object, NULL if not a fragment
+ */
+message_t *message_create_defrag(message_t *fragment);
+
 #endif /** MESSAGE_H_ @}*/
@@ -62,6 +62,19 @@ struct parser_t {
 	 */
 	void (*reset_context) (parser_t *this);
 
+	/**
+	 * Enable or disable zero-copy parsing.
+	 *
+	 * In zero-copy mode data fields of parsed payloads reference the parsed
+	 * chunk directly instead of a copy. Such payloads are valid only as long
+	 * as that chunk, and the chunk owner has to call payload_release_data()
+	 * before destroying them. Encrypted data is always copied, as it gets
+	 * decrypted in place.
+	 *
+	 * @param enable		TRUE to reference data, FALSE to copy it
+	 */
+	void (*set_zero_copy) (parser_t *this, bool enable);
+
 	/**
 	 * Destroys a parser_t object.
 	 */
@@ -259,16 +259,25 @@ METHOD(encryption_payload_t, remove_payload, payload_t *,
 	return NULL;
 }
 
+METHOD(encryption_payload_t, extract_data, chunk_t,
+	private_encryption_payload_t *this)
+{
+	chunk_t data;
+
+	data = this->encrypted;
+	this->encrypted = chunk_empty;
+	return data;
+}
+
 /**
- * Generate payload before encryption
+ * Generate contained payloads, returns FALSE if there are none
  */
-static chunk_t generate(private_encryption_payload_t *this,
-						generator_t *generator)
+static bool generate_payloads(private_encryption_payload_t *this,
+							  generator_t *generator)
 {
 	payload_t *current, *next;
 	enumerator_t *enumerator;
-	u_int32_t *lenpos;
-	chunk_t chunk = chunk_empty;
+	bool generated = FALSE;
 
 	enumerator = this->payloads->create_enumerator(this->payloads);
 	if (enumerator->enumerate(enumerator, &current))
@@ -283,12 +292,26 @@ static chunk_t generate(private_encryption_payload_t *this,
 		}
 		current->set_next_type(current, NO_PAYLOAD);
 		generator->generate_payload(generator, current);
-
-		chunk = generator->get_chunk(generator, &lenpos);
 		DBG2(DBG_ENC, "generated content in encryption payload");
+		generated = TRUE;
 	}
 	enumerator->destroy(enumerator);
-	return chunk;
+	return generated;
+}
+
+/**
+ * Generate payload before encryption
+ */
+static chunk_t generate(private_encryption_payload_t *this,
+						generator_t *generator)
+{
+	u_int32_t *lenpos;
+
+	if (generate_payloads(this, generator))
+	{
+		return generator->get_chunk(generator, &lenpos);
+	}
+	return chunk_empty;
 }
 
 /**
@@ -308,36 +331,15 @@ static chunk_t append_header(private_encryption_payload_t *this, chunk_t assoc)
 	return chunk_cat("cc", assoc, chunk_from_thing(header));
 }
 
-METHOD(encryption_payload_t, encrypt, status_t,
-	private_encryption_payload_t *this, chunk_t assoc)
+/**
+ * Fill in IV and padding and encrypt the prepared parts in place
+ */
+static status_t encrypt_parts(char *label, aead_t *aead, chunk_t assoc,
+							  chunk_t iv, chunk_t plain, chunk_t padding,
+							  chunk_t icv)
 {
-	chunk_t iv, plain, padding, icv, crypt;
-	generator_t *generator;
+	chunk_t crypt;
 	rng_t *rng;
-	size_t bs;
-
-	if (this->aead == NULL)
-	{
-		DBG1(DBG_ENC, "encrypting encryption payload failed, transform missing");
-		return INVALID_STATE;
-	}
-
-	rng = lib->crypto->create_rng(lib->crypto, RNG_WEAK);
-	if (!rng)
-	{
-		DBG1(DBG_ENC, "encrypting encryption payload failed, no RNG found");
-		return NOT_SUPPORTED;
-	}
-
-	assoc = append_header(this, assoc);
-
-	generator = generator_create();
-	plain = generate(this, generator);
-	bs = this->aead->get_block_size(this->aead);
-	/* we need at least one byte padding to store the padding length */
-	padding.len = bs - (plain.len % bs);
-	iv.len = this->aead->get_iv_size(this->aead);
-	icv.len = this->aead->get_icv_size(this->aead);
 
 	/* prepare data to authenticate-encrypt:
 	 * | IV | plain | padding | ICV |
@@ -346,45 +348,153 @@ METHOD(encryption_payload_t, encrypt, status_t,
 	 *              v          /
 	 *     assoc -> + ------->/
 	 */
-	free(this->encrypted.ptr);
-	this->encrypted = chunk_alloc(iv.len + plain.len + padding.len + icv.len);
-	iv.ptr = this->encrypted.ptr;
-	memcpy(iv.ptr + iv.len, plain.ptr, plain.len);
-	plain.ptr = iv.ptr + iv.len;
-	padding.ptr = plain.ptr + plain.len;
-	icv.ptr = padding.ptr + padding.len;
-	crypt = chunk_create(plain.ptr, plain.len + padding.len);
-	generator->destroy(generator);
-
+	rng = lib->crypto->create_rng(lib->crypto, RNG_WEAK);
+	if (!rng)
+	{
+		DBG1(DBG_ENC, "encrypting %s failed, no RNG found", label);
+		return NOT_SUPPORTED;
+	}
 	if (!rng->get_bytes(rng, iv.len, iv.ptr) ||
 		!rng->get_bytes(rng, padding.len - 1, padding.ptr))
 	{
-		DBG1(DBG_ENC, "encrypting encryption payload failed, no IV or padding");
+		DBG1(DBG_ENC, "encrypting %s failed, no IV or padding", label);
 		rng->destroy(rng);
-		free(assoc.ptr);
 		return FAILED;
 	}
 	padding.ptr[padding.len - 1] = padding.len - 1;
 	rng->destroy(rng);
+	crypt = chunk_create(plain.ptr, plain.len + padding.len);
 
-	DBG3(DBG_ENC, "encryption payload encryption:");
+	DBG3(DBG_ENC, "%s encryption:", label);
 	DBG3(DBG_ENC, "IV %B", &iv);
 	DBG3(DBG_ENC, "plain %B", &plain);
 	DBG3(DBG_ENC, "padding %B", &padding);
 	DBG3(DBG_ENC, "assoc %B", &assoc);
 
-	if (!this->aead->encrypt(this->aead, crypt, assoc, iv, NULL))
+	if (!aead->encrypt(aead, crypt, assoc, iv, NULL))
 	{
-		free(assoc.ptr);
 		return FAILED;
 	}
 
 	DBG3(DBG_ENC, "encrypted %B", &crypt);
 	DBG3(DBG_ENC, "ICV %B", &icv);
+	return SUCCESS;
+}
+
+/**
+ * Encrypt a chunk of data, as used by encryption and encrypted fragment
+ * payloads
+ */
+static status_t encrypt_content(char *label, aead_t *aead, chunk_t plain,
+								chunk_t assoc, chunk_t *encrypted)
+{
+	chunk_t iv, padding, icv;
+	size_t bs;
+
+	bs = aead->get_block_size(aead);
+	/* we need at least one byte padding to store the padding length */
+	padding.len = bs - (plain.len % bs);
+	iv.len = aead->get_iv_size(aead);
+	icv.len = aead->get_icv_size(aead);
+
+	free(encrypted->ptr);
+	*encrypted = chunk_alloc(iv.len + plain.len + padding.len + icv.len);
+	iv.ptr = encrypted->ptr;
+	memcpy(iv.ptr + iv.len, plain.ptr, plain.len);
+	plain.ptr = iv.ptr + iv.len;
+	padding.ptr = plain.ptr + plain.len;
+	icv.ptr = padding.ptr + padding.len;
+
+	return encrypt_parts(label, aead, assoc, iv, plain, padding, icv);
+}
+
+/**
+ * Encrypt data in the buffer of a generator, as used by encryption and
+ * encrypted fragment payloads.
+ *
+ * The IV starts at the given offset, all data generated before serves as
+ * associated data. The plain data follows the IV, it has either been generated
+ * already, or is copied there if given. Padding and ICV get appended.
+ */
+static status_t encrypt_generated(char *label, aead_t *aead,
+								  generator_t *generator, u_int32_t offset,
+								  chunk_t content)
+{
+	chunk_t data, iv, plain, padding, icv;
+	u_int32_t *lenpos;
+	size_t bs;
+
+	bs = aead->get_block_size(aead);
+	iv.len = aead->get_iv_size(aead);
+	icv.len = aead->get_icv_size(aead);
+	plain.len = generator->skip_bytes(generator, 0) - offset - iv.len;
+	padding.len = bs - (plain.len % bs);
+	generator->skip_bytes(generator, padding.len + icv.len);
+
+	/* the buffer does not move anymore, prepare the parts in place */
+	data = generator->get_chunk(generator, &lenpos);
+	iv.ptr = data.ptr + offset;
+	plain.ptr = iv.ptr + iv.len;
+	padding.ptr = plain.ptr + plain.len;
+	icv.ptr = padding.ptr + padding.len;
+	if (content.len)
+	{
+		memcpy(plain.ptr, content.ptr, content.len);
+	}
+	return encrypt_parts(label, aead, chunk_create(data.ptr, offset), iv,
+						 plain, padding, icv);
+}
 
+METHOD(encryption_payload_t, encrypt, status_t,
+	private_encryption_payload_t *this, chunk_t assoc)
+{
+	generator_t *generator;
+	chunk_t plain;
+	status_t status;
+
+	if (this->aead == NULL)
+	{
+		DBG1(DBG_ENC, "encrypting encryption payload failed, transform missing");
+		return INVALID_STATE;
+	}
+
+	assoc = append_header(this, assoc);
+
+	generator = generator_create();
+	plain = generate(this, generator);
+	status = encrypt_content("encryption payload", this->aead, plain, assoc,
+							 &this->encrypted);
+	generator->destroy(generator);
 	free(assoc.ptr);
+	return status;
+}
 
-	return SUCCESS;
+METHOD(encryption_payload_t, generate_encrypted, status_t,
+	private_encryption_payload_t *this, generator_t *generator)
+{
+	u_int32_t offset;
+
+	if (this->aead == NULL)
+	{
+		DBG1(DBG_ENC, "encrypting encryption payload failed, transform missing");
+		return INVALID_STATE;
+	}
+	chunk_free(&this->encrypted);
+	compute_length(this);
+
+	/* the header gets generated with the final length, but without data */
+	generator->generate_payload(generator, &this->public.payload_interface);
+	offset = generator->skip_bytes(generator,
+								   this->aead->get_iv_size(this->aead));
+	generate_payloads(this, generator);
+	return encrypt_generated("encryption payload", this->aead, generator,
+							 offset, chunk_empty);
+}
+
+METHOD(encryption_payload_t, generate_encrypted_v1, status_t,
+	private_encryption_payload_t *this, generator_t *generator)
+{
+	return NOT_SUPPORTED;
 }
 
 METHOD(encryption_payload_t, encrypt_v1, status_t,
@@ -438,6 +548,7 @@ static status_t parse(private_encryption_payload_t *this, chunk_t plain)
 	payload_type_t type;
 
 	parser = parser_create(plain);
+	parser->set_zero_copy(parser, TRUE);
 	type = this->next_payload;
 	while (type != NO_PAYLOAD)
 	{
@@ -459,6 +570,7 @@ static status_t parse(private_encryption_payload_t *this, chunk_t plain)
 		{
 			DBG1(DBG_ENC, "%N verification failed",
 				 payload_type_names, payload->get_type(payload));
+			payload_release_data(payload, this->encrypted);
 			payload->destroy(payload);
 			parser->destroy(parser);
 			return VERIFY_ERROR;
@@ -471,18 +583,16 @@ static status_t parse(private_encryption_payload_t *this, chunk_t plain)
 	return SUCCESS;
 }
 
-METHOD(encryption_payload_t, decrypt, status_t,
-	private_encryption_payload_t *this, chunk_t assoc)
+/**
+ * Decrypt a chunk of data in place, as used by encryption and encrypted
+ * fragment payloads
+ */
+static status_t decrypt_content(char *label, aead_t *aead, chunk_t encrypted,
+								chunk_t assoc, chunk_t *plain)
 {
-	chunk_t iv, plain, padding, icv, crypt;
+	chunk_t iv, padding, icv, crypt;
 	size_t bs;
 
-	if (this->aead == NULL)
-	{
-		DBG1(DBG_ENC, "decrypting encryption payload failed, transform missing");
-		return INVALID_STATE;
-	}
-
 	/* prepare data to authenticate-decrypt:
 	 * | IV | plain | padding | ICV |
 	 *       \____crypt______/   ^
@@ -490,52 +600,70 @@ METHOD(encryption_payload_t, decrypt, status_t,
 	 *              v          /
 	 *     assoc -> + ------->/
 	 */
-
-	bs = this->aead->get_block_size(this->aead);
-	iv.len = this->aead->get_iv_size(this->aead);
-	iv.ptr = this->encrypted.ptr;
-	icv.len = this->aead->get_icv_size(this->aead);
-	icv.ptr = this->encrypted.ptr + this->encrypted.len - icv.len;
+	bs = aead->get_block_size(aead);
+	iv.len = aead->get_iv_size(aead);
+	iv.ptr = encrypted.ptr;
+	icv.len = aead->get_icv_size(aead);
+	icv.ptr = encrypted.ptr + encrypted.len - icv.len;
 	crypt.ptr = iv.ptr + iv.len;
-	crypt.len = this->encrypted.len - iv.len;
+	crypt.len = encrypted.len - iv.len;
 
-	if (iv.len + icv.len > this->encrypted.len ||
+	if (iv.len + icv.len > encrypted.len ||
 		(crypt.len - icv.len) % bs)
 	{
-		DBG1(DBG_ENC, "decrypting encryption payload failed, invalid length");
+		DBG1(DBG_ENC, "decrypting %s failed, invalid length", label);
 		return FAILED;
 	}
 
-	assoc = append_header(this, assoc);
-
-	DBG3(DBG_ENC, "encryption payload decryption:");
+	DBG3(DBG_ENC, "%s decryption:", label);
 	DBG3(DBG_ENC, "IV %B", &iv);
 	DBG3(DBG_ENC, "encrypted %B", &crypt);
 	DBG3(DBG_ENC, "ICV %B", &icv);
 	DBG3(DBG_ENC, "assoc %B", &assoc);
 
-	if (!this->aead->decrypt(this->aead, crypt, assoc, iv, NULL))
+	if (!aead->decrypt(aead, crypt, assoc, iv, NULL))
 	{
-		DBG1(DBG_ENC, "verifying encryption payload integrity failed");
-		free(assoc.ptr);
+		DBG1(DBG_ENC, "verifying %s integrity failed", label);
 		return FAILED;
 	}
-	free(assoc.ptr);
 
-	plain = chunk_create(crypt.ptr, crypt.len - icv.len);
-	padding.len = plain.ptr[plain.len - 1] + 1;
-	if (padding.len > plain.len)
+	*plain = chunk_create(crypt.ptr, crypt.len - icv.len);
+	padding.len = plain->ptr[plain->len - 1] + 1;
+	if (padding.len > plain->len)
 	{
-		DBG1(DBG_ENC, "decrypting encryption payload failed, "
-			 "padding invalid %B", &crypt);
+		DBG1(DBG_ENC, "decrypting %s failed, padding invalid %B", label,
+			 &crypt);
 		return PARSE_ERROR;
 	}
-	plain.len -= padding.len;
-	padding.ptr = plain.ptr + plain.len;
+	plain->len -= padding.len;
+	padding.ptr = plain->ptr + plain->len;
 
-	DBG3(DBG_ENC, "plain %B", &plain);
+	DBG3(DBG_ENC, "plain %B", plain);
 	DBG3(DBG_ENC, "padding %B", &padding);
+	return SUCCESS;
+}
+
+METHOD(encryption_payload_t, decrypt, status_t,
+	private_encryption_payload_t *this, chunk_t assoc)
+{
+	chunk_t plain;
+	status_t status;
+
+	if (this->aead == NULL)
+	{
+		DBG1(DBG_ENC, "decrypting encryption payload failed, transform missing");
+		return INVALID_STATE;
+	}
+
+	assoc = append_header(this, assoc);
+	status = decrypt_content("encryption payload", this->aead, this->encrypted,
+							 assoc, &plain);
+	free(assoc.ptr);
 
+	if (status != SUCCESS)
+	{
+		return status;
+	}
 	return parse(this, plain);
 }
 
@@ -578,7 +706,15 @@ METHOD(encryption_payload_t, set_transform, void,
 METHOD2(payload_t, encryption_payload_t, destroy, void,
 	private_encryption_payload_t *this)
 {
-	this->payloads->destroy_offset(this->payloads, offsetof(payload_t, destroy));
+	payload_t *payload;
+
+	while (this->payloads->remove_last(this->payloads,
+									   (void**)&payload) == SUCCESS)
+	{
+		payload_release_data(payload, this->encrypted);
+		payload->destroy(payload);
+	}
+	this->payloads->destroy(this->payloads);
 	free(this->encrypted.ptr);
 	free(this);
 }
@@ -605,8 +741,10 @@ encryption_payload_t *encryption_payload_create(payload_type_t type)
 			.get_length = _get_length,
 			.add_payload = _add_payload,
 			.remove_payload = _remove_payload,
+			.extract_data = _extract_data,
 			.set_transform = _set_transform,
 			.encrypt = _encrypt,
+			.generate_encrypted = _generate_encrypted,
 			.decrypt = _decrypt,
 			.destroy = _destroy,
 		},
@@ -620,7 +758,388 @@ encryption_payload_t *encryption_payload_create(payload_type_t type)
 	{
 		this->public.encrypt = _encrypt_v1;
 		this->public.decrypt = _decrypt_v1;
+		this->public.generate_encrypted = _generate_encrypted_v1;
+	}
+
+	return &this->public;
+}
+
+/**
+ * Private data of an encrypted_fragment_payload_t object.
+ */
+typedef struct private_encrypted_fragment_payload_t {
+
+	/**
+	 * Public interface.
+	 */
+	encrypted_fragment_payload_t public;
+
+	/**
+	 * The first fragment contains the type of the first payload contained in
+	 * the original encryption payload, for all other fragments it MUST be set
+	 * to zero (and should be ignored)
+	 */
+	u_int8_t next_payload;
+
+	/**
+	 * Flags, including reserved bits
+	 */
+	u_int8_t flags;
+
+	/**
+	 * Length of this payload
+	 */
+	u_int16_t payload_length;
+
+	/**
+	 * Chunk containing the IV, plain, padding and ICV.
+	 */
+	chunk_t encrypted;
+
+	/**
+	 * Fragment number
+	 */
+	u_int16_t fragment_number;
+
+	/**
+	 * Total fragments
+	 */
+	u_int16_t total_fragments;
+
+	/**
+	 * AEAD transform to use
+	 */
+	aead_t *aead;
+
+	/**
+	 * Chunk containing the plain packet data.
+	 */
+	chunk_t plain;
+
+} private_encrypted_fragment_payload_t;
+
+/**
+ * Encoding rules to parse or generate a IKEv2-Encrypted Fragment Payload.
+ *
+ * The defined offsets are the positions in a object of type
+ * private_encrypted_fragment_payload_t.
+ */
+static encoding_rule_t encodings_fragment[] = {
+	/* 1 Byte next payload type, stored in the field next_payload */
+	{ U_INT_8,			offsetof(private_encrypted_fragment_payload_t, next_payload)	},
+	/* Critical and 7 reserved bits, all stored for reconstruction */
+	{ U_INT_8,			offsetof(private_encrypted_fragment_payload_t, flags)			},
+	/* Length of the whole encryption payload*/
+	{ PAYLOAD_LENGTH,	offsetof(private_encrypted_fragment_payload_t, payload_length)	},
+	/* Fragment number */
+	{ U_INT_16,			offsetof(private_encrypted_fragment_payload_t, fragment_number)	},
+	/* Total number of fragments */
+	{ U_INT_16,			offsetof(private_encrypted_fragment_payload_t, total_fragments)	},
+	/* encrypted data, stored in a chunk. contains iv, data, padding */
+	{ CHUNK_DATA,		offsetof(private_encrypted_fragment_payload_t, encrypted)		},
+};
+
+/*
+                           1                   2                   3
+       0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+      +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+      ! Next Payload  !C!  RESERVED   !         Payload Length        !
+      +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+      !        Fragment Number        |        Total Fragments        !
+      +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+      !                     Initialization Vector                     !
+      +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+      !                    Encrypted content                          !
+      +               +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+      !               !             Padding (0-255 octets)            !
+      +-+-+-+-+-+-+-+-+                               +-+-+-+-+-+-+-+-+
+      !                                               !  Pad Length   !
+      +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+      ~                    Integrity Checksum Data                    ~
+      +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+*/
+
+METHOD(payload_t, frag_verify, status_t,
+	private_encrypted_fragment_payload_t *this)
+{
+	if (!this->fragment_number || !this->total_fragments ||
+		this->fragment_number > this->total_fragments)
+	{
+		DBG1(DBG_ENC, "invalid fragment number (%u) or total fragments (%u)",
+			 this->fragment_number, this->total_fragments);
+		return FAILED;
+	}
+	if (this->fragment_number > 1 && this->next_payload != 0)
+	{
+		DBG1(DBG_ENC, "invalid next payload (%u) for fragment %u, ignored",
+			 this->next_payload, this->fragment_number);
+		this->next_payload = 0;
+	}
+	return SUCCESS;
+}
+
+METHOD(payload_t, frag_get_encoding_rules, int,
+	private_encrypted_fragment_payload_t *this, encoding_rule_t **rules)
+{
+	*rules = encodings_fragment;
+	return countof(encodings_fragment);
+}
+
+METHOD(payload_t, frag_get_header_length, int,
+	private_encrypted_fragment_payload_t *this)
+{
+	return 8;
+}
+
+METHOD(payload_t, frag_get_type, payload_type_t,
+	private_encrypted_fragment_payload_t *this)
+{
+	return ENCRYPTED_FRAGMENT;
+}
+
+METHOD(payload_t, frag_get_next_type, payload_type_t,
+	private_encrypted_fragment_payload_t *this)
+{
+	return this->next_payload;
+}
+
+METHOD(payload_t, frag_set_next_type, void,
+	private_encrypted_fragment_payload_t *this, payload_type_t type)
+{
+	if (this->fragment_number == 1 && this->next_payload == NO_PAYLOAD)
+	{
+		this->next_payload = type;
+	}
+}
+
+/**
+ * Compute the length of the whole payload
+ */
+static void frag_compute_length(private_encrypted_fragment_payload_t *this)
+{
+	size_t bs, length = 0;
+
+	if (this->encrypted.len)
+	{
+		length = this->encrypted.len;
+	}
+	else
+	{
+		length = this->plain.len;
+
+		if (this->aead)
+		{
+			/* append padding */
+			bs = this->aead->get_block_size(this->aead);
+			length += bs - (length % bs);
+			/* add iv */
+			length += this->aead->get_iv_size(this->aead);
+			/* add icv */
+			length += this->aead->get_icv_size(this->aead);
+		}
+	}
+	length += frag_get_header_length(this);
+	this->payload_length = length;
+}
+
+METHOD2(payload_t, encryption_payload_t, frag_get_length, size_t,
+	private_encrypted_fragment_payload_t *this)
+{
+	frag_compute_length(this);
+	return this->payload_length;
+}
+
+METHOD(encryption_payload_t, frag_add_payload, void,
+	private_encrypted_fragment_payload_t *this, payload_t* payload)
+{
+	payload->destroy(payload);
+}
+
+METHOD(encryption_payload_t, frag_remove_payload, payload_t*,
+	private_encrypted_fragment_payload_t *this)
+{
+	return NULL;
+}
+
+METHOD(encryption_payload_t, frag_extract_data, chunk_t,
+	private_encrypted_fragment_payload_t *this)
+{
+	return chunk_empty;
+}
+
+METHOD(encryption_payload_t, frag_set_transform, void,
+	private_encrypted_fragment_payload_t *this, aead_t* aead)
+{
+	this->aead = aead;
+}
+
+/**
+ * Append the encrypted fragment payload header to the associated data
+ */
+static chunk_t append_header_frag(private_encrypted_fragment_payload_t *this,
+								  chunk_t assoc)
+{
+	struct {
+		u_int8_t next_payload;
+		u_int8_t flags;
+		u_int16_t length;
+		u_int16_t fragment_number;
+		u_int16_t total_fragments;
+	} __attribute__((packed)) header = {
+		.next_payload = this->next_payload,
+		.flags = this->flags,
+		.length = htons(frag_get_length(this)),
+		.fragment_number = htons(this->fragment_number),
+		.total_fragments = htons(this->total_fragments),
+	};
+	return chunk_cat("cc", assoc, chunk_from_thing(header));
+}
+
+METHOD(encryption_payload_t, frag_encrypt, status_t,
+	private_encrypted_fragment_payload_t *this, chunk_t assoc)
+{
+	status_t status;
+
+	if (!this->aead)
+	{
+		DBG1(DBG_ENC, "encrypting encrypted fragment payload failed, "
+			 "transform missing");
+		return INVALID_STATE;
 	}
+	assoc = append_header_frag(this, assoc);
+	status = encrypt_content("encrypted fragment payload", this->aead,
+							 this->plain, assoc, &this->encrypted);
+	free(assoc.ptr);
+	return status;
+}
+
+METHOD(encryption_payload_t, frag_generate_encrypted, status_t,
+	private_encrypted_fragment_payload_t *this, generator_t *generator)
+{
+	u_int32_t offset;
+
+	if (!this->aead)
+	{
+		DBG1(DBG_ENC, "encrypting encrypted fragment payload failed, "
+			 "transform missing");
+		return INVALID_STATE;
+	}
+	chunk_free(&this->encrypted);
+	frag_compute_length(this);
+
+	generator->generate_payload(generator,
+								&this->public.encrypted.payload_interface);
+	offset = generator->skip_bytes(generator,
+								   this->aead->get_iv_size(this->aead));
+	generator->skip_bytes(generator, this->plain.len);
+	return encrypt_generated("encrypted fragment payload", this->aead,
+							 generator, offset, this->plain);
+}
+
+METHOD(encryption_payload_t, frag_decrypt, status_t,
+	private_encrypted_fragment_payload_t *this, chunk_t assoc)
+{
+	chunk_t plain;
+	status_t status;
+
+	if (!this->aead)
+	{
+		DBG1(DBG_ENC, "decrypting encrypted fragment payload failed, "
+			 "transform missing");
+		return INVALID_STATE;
+	}
+	assoc = append_header_frag(this, assoc);
+	status = decrypt_content("encrypted fragment payload", this->aead,
+							 this->encrypted, assoc, &plain);
+	free(assoc.ptr);
+	if (status == SUCCESS)
+	{
+		free(this->plain.ptr);
+		this->plain = chunk_clone(plain);
+	}
+	return status;
+}
+
+METHOD(encrypted_fragment_payload_t, get_fragment_number, u_int16_t,
+	private_encrypted_fragment_payload_t *this)
+{
+	return this->fragment_number;
+}
+
+METHOD(encrypted_fragment_payload_t, get_total_fragments, u_int16_t,
+	private_encrypted_fragment_payload_t *this)
+{
+	return this->total_fragments;
+}
+
+METHOD(encrypted_fragment_payload_t, frag_get_content, chunk_t,
+	private_encrypted_fragment_payload_t *this)
+{
+	return this->plain;
+}
+
+METHOD2(payload_t, encryption_payload_t, frag_destroy, void,
+	private_encrypted_fragment_payload_t *this)
+{
+	free(this->encrypted.ptr);
+	free(this->plain.ptr);
+	free(this);
+}
+
+/*
+ * Described in header
+ */
+encrypted_fragment_payload_t *encrypted_fragment_payload_create()
+{
+	private_encrypted_fragment_payload_t *this;
+
+	INIT(this,
+		.public = {
+			.encrypted = {
+				.payload_interface = {
+					.verify = _frag_verify,
+					.get_encoding_rules = _frag_get_encoding_rules,
+					.get_header_length = _frag_get_header_length,
+					.get_length = _frag_get_length,
+					.get_next_type = _frag_get_next_type,
+					.set_next_type = _frag_set_next_type,
+					.get_type = _frag_get_type,
+					.destroy = _frag_destroy,
+				},
+				.get_length = _frag_get_length,
+				.add_payload = _frag_add_payload,
+				.remove_payload = _frag_remove_payload,
+				.extract_data = _frag_extract_data,
+				.set_transform = _frag_set_transform,
+				.encrypt = _frag_encrypt,
+				.generate_encrypted = _frag_generate_encrypted,
+				.decrypt = _frag_decrypt,
+				.destroy = _frag_destroy,
+			},
+			.get_fragment_number = _get_fragment_number,
+			.get_total_fragments = _get_total_fragments,
+			.get_content = _frag_get_content,
+			.destroy = (void*)_frag_destroy,
+		},
+		.next_payload = NO_PAYLOAD,
+	);
+	this->payload_length = frag_get_header_length(this);
+
+	return &this->public;
+}
+
+/*
+ * Described in header
+ */
+encrypted_fragment_payload_t *encrypted_fragment_payload_create_from_data(
+								u_int16_t num, u_int16_t total, chunk_t plain)
+{
+	private_encrypted_fragment_payload_t *this;
+
+	this = (private_encrypted_fragment_payload_t*)encrypted_fragment_payload_create();
+	this->fragment_number = num;
+	this->total_fragments = total;
+	this->plain = chunk_clone(plain);
 
 	return &this->public;
 }
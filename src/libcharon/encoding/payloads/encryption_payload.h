@@ -24,10 +24,12 @@
 #define ENCRYPTION_PAYLOAD_H_
 
 typedef struct encryption_payload_t encryption_payload_t;
+typedef struct encrypted_fragment_payload_t encrypted_fragment_payload_t;
 
 #include <library.h>
 #include <crypto/aead.h>
 #include <encoding/payloads/payload.h>
+#include <encoding/generator.h>
 
 /**
  * The encryption payload as described in RFC section 3.14.
@@ -61,6 +63,18 @@ struct encryption_payload_t {
 	 */
 	payload_t* (*remove_payload)(encryption_payload_t *this);
 
+	/**
+	 * Take ownership of the decrypted data.
+	 *
+	 * Decrypted payloads reference the decrypted data directly, so payloads
+	 * taken with remove_payload() are valid only as long as this data. The
+	 * caller has to release them using payload_release_data() before freeing
+	 * the returned chunk.
+	 *
+	 * @return				allocated decrypted data, chunk_empty if none
+	 */
+	chunk_t (*extract_data)(encryption_payload_t *this);
+
 	/**
 	 * Set the AEAD transform to use.
 	 *
@@ -79,6 +93,25 @@ struct encryption_payload_t {
 	 */
 	status_t (*encrypt) (encryption_payload_t *this, chunk_t assoc);
 
+	/**
+	 * Generate, encrypt and sign contained payloads directly into a generator.
+	 *
+	 * The complete payload is appended to the generated data and encrypted in
+	 * place, avoiding any intermediate buffers. All data generated before,
+	 * including the payload header, serves as associated data, so the final
+	 * length of the IKE header must already be set.
+	 *
+	 * This is not supported for IKEv1.
+	 *
+	 * @param generator		generator to write payload to
+	 * @return
+	 * 						- SUCCESS if encryption successful
+	 * 						- FAILED if encryption failed
+	 * 						- INVALID_STATE if aead not supplied, but needed
+	 */
+	status_t (*generate_encrypted)(encryption_payload_t *this,
+								   generator_t *generator);
+
 	/**
 	 * Decrypt, verify and parse contained payloads.
 	 *
@@ -106,4 +139,63 @@ struct encryption_payload_t {
  */
 encryption_payload_t *encryption_payload_create(payload_type_t type);
 
+/**
+ * The encrypted fragment payload as described in RFC 7383.
+ *
+ * The implementation of encrypt() and decrypt() does not handle payloads,
+ * but the raw (reassembled) content of the original encryption payload, see
+ * get_content().
+ */
+struct encrypted_fragment_payload_t {
+
+	/**
+	 * Implements encryption_payload_t interface.
+	 */
+	encryption_payload_t encrypted;
+
+	/**
+	 * Get the fragment number.
+	 *
+	 * @return			fragment number
+	 */
+	u_int16_t (*get_fragment_number)(encrypted_fragment_payload_t *this);
+
+	/**
+	 * Get the total number of fragments.
+	 *
+	 * @return			total number of fragments
+	 */
+	u_int16_t (*get_total_fragments)(encrypted_fragment_payload_t *this);
+
+	/**
+	 * Get the (decrypted) content of this payload.
+	 *
+	 * @return			internal plain data of this fragment
+	 */
+	chunk_t (*get_content)(encrypted_fragment_payload_t *this);
+
+	/**
+	 * Destroys an encrypted_fragment_payload_t object.
+	 */
+	void (*destroy)(encrypted_fragment_payload_t *this);
+};
+
+/**
+ * Creates an empty encrypted_fragment_payload_t object.
+ *
+ * @return			encrypted_fragment_payload_t object
+ */
+encrypted_fragment_payload_t *encrypted_fragment_payload_create();
+
+/**
+ * Creates an encrypted fragment payload from the given data.
+ *
+ * @param num		fragment number (first one should be 1)
+ * @param total		total number of fragments
+ * @param plain		data to encrypt
+ * @return			encrypted_fragment_payload_t object
+ */
+encrypted_fragment_payload_t *encrypted_fragment_payload_create_from_data(
+								u_int16_t num, u_int16_t total, chunk_t plain);
+
 #endif /** ENCRYPTION_PAYLOAD_H_ @}*/
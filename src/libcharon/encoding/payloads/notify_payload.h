@@ -145,6 +145,11 @@ enum notify_type_t {
 	PSK_CONFIRM = 16426,
 	/* EAP Re-authentication Extension, RFC 6867 */
 	ERX_SUPPORTED = 16427,
+	/* IP Flow Mobility support, RFC 6561 */
+	IFOM_CAPABILITY = 16428,
+	SENDER_REQUEST_ID = 16429,
+	/* IKEv2 message fragmentation, RFC 7383 */
+	FRAGMENTATION_SUPPORTED = 16430,
 	/* IKEv1 initial contact */
 	INITIAL_CONTACT_IKEV1 = 24578,
 	/* IKEv1 DPD */
@@ -77,15 +77,17 @@ ENUM_NEXT(payload_type_names, SECURITY_ASSOCIATION, GENERIC_SECURE_PASSWORD_METH
 	"CONFIGURATION",
 	"EXTENSIBLE_AUTHENTICATION",
 	"GENERIC_SECURE_PASSWORD_METHOD");
+ENUM_NEXT(payload_type_names, ENCRYPTED_FRAGMENT, ENCRYPTED_FRAGMENT, GENERIC_SECURE_PASSWORD_METHOD,
+	"ENCRYPTED_FRAGMENT");
 #ifdef ME
-ENUM_NEXT(payload_type_names, ID_PEER, ID_PEER, GENERIC_SECURE_PASSWORD_METHOD,
+ENUM_NEXT(payload_type_names, ID_PEER, ID_PEER, ENCRYPTED_FRAGMENT,
 	"ID_PEER");
 ENUM_NEXT(payload_type_names, NAT_D_DRAFT_00_03_V1, FRAGMENT_V1, ID_PEER,
 	"NAT_D_DRAFT_V1",
 	"NAT_OA_DRAFT_V1",
 	"FRAGMENT");
 #else
-ENUM_NEXT(payload_type_names, NAT_D_DRAFT_00_03_V1, FRAGMENT_V1, GENERIC_SECURE_PASSWORD_METHOD,
+ENUM_NEXT(payload_type_names, NAT_D_DRAFT_00_03_V1, FRAGMENT_V1, ENCRYPTED_FRAGMENT,
 	"NAT_D_DRAFT_V1",
 	"NAT_OA_DRAFT_V1",
 	"FRAGMENT");
@@ -143,15 +145,17 @@ ENUM_NEXT(payload_type_short_names, SECURITY_ASSOCIATION, GENERIC_SECURE_PASSWOR
 	"CP",
 	"EAP",
 	"GSPM");
+ENUM_NEXT(payload_type_short_names, ENCRYPTED_FRAGMENT, ENCRYPTED_FRAGMENT, GENERIC_SECURE_PASSWORD_METHOD,
+	"EF");
 #ifdef ME
-ENUM_NEXT(payload_type_short_names, ID_PEER, ID_PEER, GENERIC_SECURE_PASSWORD_METHOD,
+ENUM_NEXT(payload_type_short_names, ID_PEER, ID_PEER, ENCRYPTED_FRAGMENT,
 	"IDp");
 ENUM_NEXT(payload_type_short_names, NAT_D_DRAFT_00_03_V1, FRAGMENT_V1, ID_PEER,
 	"NAT-D",
 	"NAT-OA",
 	"FRAG");
 #else
-ENUM_NEXT(payload_type_short_names, NAT_D_DRAFT_00_03_V1, FRAGMENT_V1, GENERIC_SECURE_PASSWORD_METHOD,
+ENUM_NEXT(payload_type_short_names, NAT_D_DRAFT_00_03_V1, FRAGMENT_V1, ENCRYPTED_FRAGMENT,
 	"NAT-D",
 	"NAT-OA",
 	"FRAG");
@@ -245,6 +249,8 @@ payload_t *payload_create(payload_type_t type)
 		case ENCRYPTED:
 		case ENCRYPTED_V1:
 			return (payload_t*)encryption_payload_create(type);
+		case ENCRYPTED_FRAGMENT:
+			return (payload_t*)encrypted_fragment_payload_create();
 		case FRAGMENT_V1:
 			return (payload_t*)fragment_payload_create();
 		default:
@@ -265,6 +271,10 @@ bool payload_is_known(payload_type_t type)
 	{
 		return TRUE;
 	}
+	if (type == ENCRYPTED_FRAGMENT)
+	{
+		return TRUE;
+	}
 	if (type >= SECURITY_ASSOCIATION_V1 && type <= CONFIGURATION_V1)
 	{
 		return TRUE;
@@ -304,3 +314,83 @@ void* payload_get_field(payload_t *payload, encoding_type_t type, u_int skip)
 	}
 	return NULL;
 }
+
+/**
+ * Release or copy all data fields of a payload that point into data, returns
+ * the number of fields
+ */
+static u_int map_data(payload_t *payload, chunk_t data, bool copy)
+{
+	encoding_rule_t *rule;
+	enumerator_t *enumerator;
+	linked_list_t *list;
+	payload_t *current;
+	chunk_t *field;
+	u_int mapped = 0;
+	int i, count;
+
+	count = payload->get_encoding_rules(payload, &rule);
+	for (i = 0; i < count; i++)
+	{
+		switch ((int)rule[i].type)
+		{
+			case SPI:
+			case ATTRIBUTE_VALUE:
+			case ADDRESS:
+			case CHUNK_DATA:
+			case ENCRYPTED_DATA:
+				field = (chunk_t*)((char*)payload + rule[i].offset);
+				if (field->ptr >= data.ptr &&
+					field->ptr + field->len <= data.ptr + data.len)
+				{
+					*field = copy ? chunk_clone(*field) : chunk_empty;
+					mapped++;
+				}
+				break;
+			case PAYLOAD_LIST + PROPOSAL_SUBSTRUCTURE:
+			case PAYLOAD_LIST + PROPOSAL_SUBSTRUCTURE_V1:
+			case PAYLOAD_LIST + TRANSFORM_SUBSTRUCTURE:
+			case PAYLOAD_LIST + TRANSFORM_SUBSTRUCTURE_V1:
+			case PAYLOAD_LIST + TRANSFORM_ATTRIBUTE:
+			case PAYLOAD_LIST + TRANSFORM_ATTRIBUTE_V1:
+			case PAYLOAD_LIST + CONFIGURATION_ATTRIBUTE:
+			case PAYLOAD_LIST + CONFIGURATION_ATTRIBUTE_V1:
+			case PAYLOAD_LIST + TRAFFIC_SELECTOR_SUBSTRUCTURE:
+				list = *(linked_list_t**)((char*)payload + rule[i].offset);
+				enumerator = list->create_enumerator(list);
+				while (enumerator->enumerate(enumerator, &current))
+				{
+					mapped += map_data(current, data, copy);
+				}
+				enumerator->destroy(enumerator);
+				break;
+			default:
+				break;
+		}
+	}
+	return mapped;
+}
+
+/**
+ * See header.
+ */
+u_int payload_release_data(payload_t *payload, chunk_t data)
+{
+	if (data.len)
+	{
+		return map_data(payload, data, FALSE);
+	}
+	return 0;
+}
+
+/**
+ * See header.
+ */
+u_int payload_copy_data(payload_t *payload, chunk_t data)
+{
+	if (data.len)
+	{
+		return map_data(payload, data, TRUE);
+	}
+	return 0;
+}
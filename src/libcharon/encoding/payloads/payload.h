@@ -212,6 +212,11 @@ enum payload_type_t {
 	 */
 	GENERIC_SECURE_PASSWORD_METHOD = 49,
 
+	/**
+	 * Encrypted fragment payload (SKF), RFC 7383.
+	 */
+	ENCRYPTED_FRAGMENT = 53,
+
 #ifdef ME
 	/**
 	 * Identification payload for peers has a value from
@@ -399,4 +404,30 @@ bool payload_is_known(payload_type_t type);
  */
 void* payload_get_field(payload_t *payload, encoding_type_t type, u_int skip);
 
+/**
+ * Release data fields of a payload referencing a buffer it does not own.
+ *
+ * Payloads parsed in zero-copy mode (see parser_t.set_zero_copy()) reference
+ * the parsed buffer directly. Before such a payload gets destroyed, all
+ * fields pointing into that buffer are reset without freeing them. This
+ * includes substructures in payload lists.
+ *
+ * @param payload	payload to release data fields of
+ * @param data		buffer the payload might reference
+ * @return			number of released data fields
+ */
+u_int payload_release_data(payload_t *payload, chunk_t data);
+
+/**
+ * Copy data fields of a payload referencing a buffer it does not own.
+ *
+ * Makes a payload parsed in zero-copy mode self-contained, so it can outlive
+ * the buffer it has been parsed from.
+ *
+ * @param payload	payload to copy data fields of
+ * @param data		buffer the payload might reference
+ * @return			number of copied data fields
+ */
+u_int payload_copy_data(payload_t *payload, chunk_t data);
+
 #endif /** PAYLOAD_H_ @}*/
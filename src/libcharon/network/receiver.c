@@ -413,6 +413,21 @@ static bool drop_ike_sa_init(private_receiver_t *this, message_t *message)
 	return FALSE;
 }
 
+METHOD(receiver_t, receive_esp, void,
+	private_receiver_t *this, packet_t *packet)
+{
+	this->esp_cb_mutex->lock(this->esp_cb_mutex);
+	if (this->esp_cb.cb)
+	{
+		this->esp_cb.cb(this->esp_cb.data, packet);
+	}
+	else
+	{
+		packet->destroy(packet);
+	}
+	this->esp_cb_mutex->unlock(this->esp_cb_mutex);
+}
+
 /**
  * Job callback to receive packets
  */
@@ -474,16 +489,7 @@ static job_requeue_t receive_packets(private_receiver_t *this)
 		}
 		else
 		{	/* this seems to be an ESP packet */
-			this->esp_cb_mutex->lock(this->esp_cb_mutex);
-			if (this->esp_cb.cb)
-			{
-				this->esp_cb.cb(this->esp_cb.data, packet);
-			}
-			else
-			{
-				packet->destroy(packet);
-			}
-			this->esp_cb_mutex->unlock(this->esp_cb_mutex);
+			receive_esp(this, packet);
 			return JOB_REQUEUE_DIRECT;
 		}
 	}
@@ -629,6 +635,7 @@ receiver_t *receiver_create()
 		.public = {
 			.add_esp_cb = _add_esp_cb,
 			.del_esp_cb = _del_esp_cb,
+			.receive_esp = _receive_esp,
 			.destroy = _destroy,
 		},
 		.esp_cb_mutex = mutex_create(MUTEX_TYPE_DEFAULT),
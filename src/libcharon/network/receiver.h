@@ -83,6 +83,16 @@ struct receiver_t {
 	 */
 	void (*del_esp_cb)(receiver_t *this, receiver_esp_cb_t callback);
 
+	/**
+	 * Pass an ESP packet to the registered callback.
+	 *
+	 * This is used by sockets that read UDP encapsulated ESP packets on a
+	 * separate data path, bypassing the IKE receiver thread.
+	 *
+	 * @param packet		ESP packet, gets owned
+	 */
+	void (*receive_esp)(receiver_t *this, packet_t *packet);
+
 	/**
 	 * Destroys a receiver_t object.
 	 */
@@ -59,6 +59,41 @@ struct private_sender_t {
 	 */
 	condvar_t *sent;
 
+	/**
+	 * Queued ESP packets
+	 */
+	linked_list_t *esp;
+
+	/**
+	 * List of ESP packets currently being sent, swapped with esp
+	 */
+	linked_list_t *esp_sending;
+
+	/**
+	 * mutex to synchronize access to esp
+	 */
+	mutex_t *esp_mutex;
+
+	/**
+	 * condvar to signal for ESP packets added to esp
+	 */
+	condvar_t *esp_got;
+
+	/**
+	 * TRUE if the thread sending ESP packets has been started
+	 */
+	bool esp_running;
+
+	/**
+	 * Maximum number of queued ESP packets, 0 for no limit
+	 */
+	u_int esp_limit;
+
+	/**
+	 * Number of ESP packets dropped since the queue was last taken over
+	 */
+	u_int esp_dropped;
+
 	/**
 	 * Delay for sending outgoing packets, to simulate larger RTT
 	 */
@@ -163,6 +198,75 @@ static job_requeue_t send_packets(private_sender_t *this)
 	return JOB_REQUEUE_DIRECT;
 }
 
+/**
+ * Job callback function to send all queued ESP packets
+ */
+static job_requeue_t send_esp_packets(private_sender_t *this)
+{
+	linked_list_t *list;
+	packet_t *packet;
+	bool oldstate;
+	u_int dropped;
+
+	this->esp_mutex->lock(this->esp_mutex);
+	while (this->esp->get_count(this->esp) == 0)
+	{
+		thread_cleanup_push((thread_cleanup_t)this->esp_mutex->unlock,
+							this->esp_mutex);
+		oldstate = thread_cancelability(TRUE);
+
+		this->esp_got->wait(this->esp_got, this->esp_mutex);
+
+		thread_cancelability(oldstate);
+		thread_cleanup_pop(FALSE);
+	}
+	/* take over all queued packets at once, the list is only accessed by
+	 * this thread while sending */
+	list = this->esp;
+	this->esp = this->esp_sending;
+	this->esp_sending = list;
+	dropped = this->esp_dropped;
+	this->esp_dropped = 0;
+	this->esp_mutex->unlock(this->esp_mutex);
+
+	if (dropped)
+	{
+		DBG1(DBG_NET, "ESP send queue full, dropped %u packets", dropped);
+	}
+
+	while (list->remove_first(list, (void**)&packet) == SUCCESS)
+	{
+		charon->socket->send(charon->socket, packet);
+		packet->destroy(packet);
+	}
+	return JOB_REQUEUE_DIRECT;
+}
+
+METHOD(sender_t, send_esp, void,
+	private_sender_t *this, packet_t *packet)
+{
+	this->esp_mutex->lock(this->esp_mutex);
+	if (this->esp_limit &&
+		this->esp->get_count(this->esp) >= this->esp_limit)
+	{	/* drop the packet if the sending thread can't keep up */
+		this->esp_dropped++;
+		this->esp_mutex->unlock(this->esp_mutex);
+		packet->destroy(packet);
+		return;
+	}
+	this->esp->insert_last(this->esp, packet);
+	if (!this->esp_running)
+	{	/* start the thread on demand, only required with userland IPsec */
+		this->esp_running = TRUE;
+		lib->processor->queue_job(lib->processor,
+			(job_t*)callback_job_create_with_prio(
+				(callback_job_cb_t)send_esp_packets, this, NULL,
+				(callback_job_cancel_t)return_false, JOB_PRIO_CRITICAL));
+	}
+	this->esp_got->signal(this->esp_got);
+	this->esp_mutex->unlock(this->esp_mutex);
+}
+
 METHOD(sender_t, flush, void,
 	private_sender_t *this)
 {
@@ -179,9 +283,14 @@ METHOD(sender_t, destroy, void,
 	private_sender_t *this)
 {
 	this->list->destroy_offset(this->list, offsetof(packet_t, destroy));
+	this->esp->destroy_offset(this->esp, offsetof(packet_t, destroy));
+	this->esp_sending->destroy_offset(this->esp_sending,
+									  offsetof(packet_t, destroy));
 	this->got->destroy(this->got);
 	this->sent->destroy(this->sent);
 	this->mutex->destroy(this->mutex);
+	this->esp_got->destroy(this->esp_got);
+	this->esp_mutex->destroy(this->esp_mutex);
 	free(this);
 }
 
@@ -196,6 +305,7 @@ sender_t * sender_create()
 		.public = {
 			.send = _send_,
 			.send_no_marker = _send_no_marker,
+			.send_esp = _send_esp,
 			.flush = _flush,
 			.destroy = _destroy,
 		},
@@ -203,6 +313,12 @@ sender_t * sender_create()
 		.mutex = mutex_create(MUTEX_TYPE_DEFAULT),
 		.got = condvar_create(CONDVAR_TYPE_DEFAULT),
 		.sent = condvar_create(CONDVAR_TYPE_DEFAULT),
+		.esp = linked_list_create(),
+		.esp_sending = linked_list_create(),
+		.esp_mutex = mutex_create(MUTEX_TYPE_DEFAULT),
+		.esp_got = condvar_create(CONDVAR_TYPE_DEFAULT),
+		.esp_limit = lib->settings->get_int(lib->settings,
+								"%s.esp_send_queue", 1024, charon->name),
 		.send_delay = lib->settings->get_int(lib->settings,
 								"%s.send_delay", 0, charon->name),
 		.send_delay_type = lib->settings->get_int(lib->settings,
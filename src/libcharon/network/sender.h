@@ -51,6 +51,17 @@ struct sender_t {
 	 */
 	void (*send_no_marker) (sender_t *this, packet_t *packet);
 
+	/**
+	 * Send a UDP encapsulated ESP packet.
+	 *
+	 * ESP packets are queued separately and sent by a dedicated thread, so
+	 * they don't delay IKE packets queued with send(). If the queue is full
+	 * (charon.esp_send_queue) the packet is dropped.
+	 *
+	 * @param packet	ESP packet to send
+	 */
+	void (*send_esp) (sender_t *this, packet_t *packet);
+
 	/**
 	 * Enforce a flush of the send queue.
 	 *
@@ -15,8 +15,11 @@
 
 #include "dhcp_provider.h"
 
+#include <daemon.h>
 #include <collections/hashtable.h>
 #include <threading/mutex.h>
+#include <threading/condvar.h>
+#include <processing/jobs/callback_job.h>
 
 typedef struct private_dhcp_provider_t private_dhcp_provider_t;
 
@@ -36,16 +39,56 @@ struct private_dhcp_provider_t {
 	hashtable_t *transactions;
 
 	/**
-	 * Lock for transactions
+	 * Pending enrollments, pending_t indexed by IKE_SA unique ID
+	 */
+	hashtable_t *pending;
+
+	/**
+	 * Lock for transactions and pending enrollments
 	 */
 	mutex_t *mutex;
 
+	/**
+	 * Condvar to wait for synchronous enrollments
+	 */
+	condvar_t *condvar;
+
 	/**
 	 * DHCP communication socket
 	 */
 	dhcp_socket_t *socket;
 };
 
+/**
+ * An enrollment in progress
+ */
+typedef struct {
+	/** provider the enrollment belongs to */
+	private_dhcp_provider_t *this;
+	/** IKE_SA deferring its response, NULL if enrolling synchronously */
+	ike_sa_id_t *ike_sa_id;
+	/** unique ID of that IKE_SA */
+	u_int32_t unique;
+	/** TRUE once the enrollment completed */
+	bool done;
+	/** completed transaction, NULL on failure */
+	dhcp_transaction_t *transaction;
+} pending_t;
+
+/**
+ * Data for a job resuming an IKE_SA after enrollment
+ */
+typedef struct {
+	/** provider */
+	private_dhcp_provider_t *this;
+	/** IKE_SA to resume */
+	ike_sa_id_t *ike_sa_id;
+	/** unique ID of that IKE_SA */
+	u_int32_t unique;
+	/** completed enrollment, compared only */
+	pending_t *pending;
+} resume_t;
+
 /**
  * Hashtable hash function
  */
@@ -80,6 +123,182 @@ static uintptr_t hash_transaction(dhcp_transaction_t *transaction)
 						transaction->get_address(transaction));
 }
 
+/**
+ * Destroy a pending enrollment, but not its transaction
+ */
+static void pending_destroy(pending_t *pending)
+{
+	DESTROY_IF(pending->ike_sa_id);
+	free(pending);
+}
+
+/**
+ * Destroy resume job data
+ */
+static void resume_destroy(resume_t *resume)
+{
+	resume->ike_sa_id->destroy(resume->ike_sa_id);
+	free(resume);
+}
+
+/**
+ * Resume the IKE_SA an address has been enrolled for
+ */
+static job_requeue_t resume_ike_sa(resume_t *resume)
+{
+	private_dhcp_provider_t *this = resume->this;
+	pending_t *pending;
+	ike_sa_t *ike_sa;
+
+	ike_sa = charon->ike_sa_manager->checkout(charon->ike_sa_manager,
+											  resume->ike_sa_id);
+	if (ike_sa)
+	{
+		if (ike_sa->resume_response(ike_sa) == DESTROY_ME)
+		{
+			charon->ike_sa_manager->checkin_and_destroy(
+												charon->ike_sa_manager, ike_sa);
+		}
+		else
+		{
+			charon->ike_sa_manager->checkin(charon->ike_sa_manager, ike_sa);
+		}
+	}
+
+	/* release the address if the IKE_SA did not pick it up */
+	this->mutex->lock(this->mutex);
+	pending = this->pending->get(this->pending,
+								 (void*)(uintptr_t)resume->unique);
+	if (pending == resume->pending && pending->done)
+	{
+		this->pending->remove(this->pending, (void*)(uintptr_t)resume->unique);
+	}
+	else
+	{
+		pending = NULL;
+	}
+	this->mutex->unlock(this->mutex);
+	if (pending)
+	{
+		if (pending->transaction)
+		{
+			this->socket->release(this->socket, pending->transaction);
+			pending->transaction->destroy(pending->transaction);
+		}
+		pending_destroy(pending);
+	}
+	return JOB_REQUEUE_NONE;
+}
+
+/**
+ * Callback invoked by the socket once an enrollment completed
+ */
+static void enroll_done(pending_t *pending, dhcp_transaction_t *transaction)
+{
+	private_dhcp_provider_t *this = pending->this;
+	resume_t *resume;
+
+	this->mutex->lock(this->mutex);
+	pending->transaction = transaction;
+	pending->done = TRUE;
+	if (pending->ike_sa_id)
+	{
+		INIT(resume,
+			.this = this,
+			.ike_sa_id = pending->ike_sa_id->clone(pending->ike_sa_id),
+			.unique = pending->unique,
+			.pending = pending,
+		);
+		lib->processor->queue_job(lib->processor,
+			(job_t*)callback_job_create((callback_job_cb_t)resume_ike_sa,
+								resume, (void*)resume_destroy, NULL));
+	}
+	else
+	{
+		this->condvar->broadcast(this->condvar);
+	}
+	this->mutex->unlock(this->mutex);
+}
+
+/**
+ * Enroll an address, blocking until completed
+ */
+static dhcp_transaction_t *enroll_sync(private_dhcp_provider_t *this,
+									   identification_t *id)
+{
+	pending_t pending = {
+		.this = this,
+	};
+
+	this->mutex->lock(this->mutex);
+	if (this->socket->enroll(this->socket, id, (void*)enroll_done, &pending))
+	{
+		while (!pending.done)
+		{
+			this->condvar->wait(this->condvar, this->mutex);
+		}
+	}
+	this->mutex->unlock(this->mutex);
+	return pending.transaction;
+}
+
+/**
+ * Enroll an address for the IKE_SA currently processed. As long as the
+ * enrollment is in progress, the IKE_SA defers its response and no thread
+ * is blocked. IKEv1 can't do that, so we wait for those.
+ */
+static dhcp_transaction_t *enroll(private_dhcp_provider_t *this,
+								  identification_t *id)
+{
+	dhcp_transaction_t *transaction;
+	pending_t *pending;
+	ike_sa_t *ike_sa;
+	u_int32_t unique;
+
+	ike_sa = charon->bus->get_sa(charon->bus);
+	if (!ike_sa || ike_sa->get_version(ike_sa) != IKEV2)
+	{
+		return enroll_sync(this, id);
+	}
+	unique = ike_sa->get_unique_id(ike_sa);
+
+	this->mutex->lock(this->mutex);
+	pending = this->pending->get(this->pending, (void*)(uintptr_t)unique);
+	if (pending)
+	{
+		if (!pending->done)
+		{
+			this->mutex->unlock(this->mutex);
+			ike_sa->set_condition(ike_sa, COND_RESPONSE_DEFERRED, TRUE);
+			return NULL;
+		}
+		this->pending->remove(this->pending, (void*)(uintptr_t)unique);
+		this->mutex->unlock(this->mutex);
+		transaction = pending->transaction;
+		pending_destroy(pending);
+		return transaction;
+	}
+	INIT(pending,
+		.this = this,
+		.ike_sa_id = ike_sa->get_id(ike_sa),
+		.unique = unique,
+	);
+	pending->ike_sa_id = pending->ike_sa_id->clone(pending->ike_sa_id);
+	this->pending->put(this->pending, (void*)(uintptr_t)unique, pending);
+	this->mutex->unlock(this->mutex);
+
+	if (!this->socket->enroll(this->socket, id, (void*)enroll_done, pending))
+	{
+		this->mutex->lock(this->mutex);
+		this->pending->remove(this->pending, (void*)(uintptr_t)unique);
+		this->mutex->unlock(this->mutex);
+		pending_destroy(pending);
+		return NULL;
+	}
+	ike_sa->set_condition(ike_sa, COND_RESPONSE_DEFERRED, TRUE);
+	return NULL;
+}
+
 METHOD(attribute_provider_t, acquire_address, host_t*,
 	private_dhcp_provider_t *this, linked_list_t *pools,
 	identification_t *id, host_t *requested)
@@ -100,7 +319,7 @@ METHOD(attribute_provider_t, acquire_address, host_t*,
 		{
 			continue;
 		}
-		transaction = this->socket->enroll(this->socket, id);
+		transaction = enroll(this, id);
 		if (!transaction)
 		{
 			continue;
@@ -195,6 +414,7 @@ METHOD(dhcp_provider_t, destroy, void,
 {
 	enumerator_t *enumerator;
 	dhcp_transaction_t *value;
+	pending_t *pending;
 	void *key;
 
 	enumerator = this->transactions->create_enumerator(this->transactions);
@@ -204,6 +424,15 @@ METHOD(dhcp_provider_t, destroy, void,
 	}
 	enumerator->destroy(enumerator);
 	this->transactions->destroy(this->transactions);
+	enumerator = this->pending->create_enumerator(this->pending);
+	while (enumerator->enumerate(enumerator, &key, &pending))
+	{
+		DESTROY_IF(pending->transaction);
+		pending_destroy(pending);
+	}
+	enumerator->destroy(enumerator);
+	this->pending->destroy(this->pending);
+	this->condvar->destroy(this->condvar);
 	this->mutex->destroy(this->mutex);
 	free(this);
 }
@@ -226,7 +455,9 @@ dhcp_provider_t *dhcp_provider_create(dhcp_socket_t *socket)
 		},
 		.socket = socket,
 		.mutex = mutex_create(MUTEX_TYPE_DEFAULT),
+		.condvar = condvar_create(CONDVAR_TYPE_DEFAULT),
 		.transactions = hashtable_create(hash, equals, 8),
+		.pending = hashtable_create(hash, equals, 8),
 	);
 
 	return &this->public;
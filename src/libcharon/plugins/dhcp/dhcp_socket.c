@@ -25,10 +25,9 @@
 #include <linux/if_ether.h>
 #include <linux/filter.h>
 
-#include <collections/linked_list.h>
+#include <collections/hashtable.h>
 #include <utils/identification.h>
 #include <threading/mutex.h>
-#include <threading/condvar.h>
 #include <threading/thread.h>
 
 #include <hydra.h>
@@ -57,35 +56,15 @@ struct private_dhcp_socket_t {
 	rng_t *rng;
 
 	/**
-	 * List of transactions in DISCOVER
+	 * Pending transactions, entry_t indexed by transaction ID
 	 */
-	linked_list_t *discover;
-
-	/**
-	 * List of transactions in REQUEST
-	 */
-	linked_list_t *request;
-
-	/**
-	 * List of successfully completed transactions
-	 */
-	linked_list_t *completed;
+	hashtable_t *transactions;
 
 	/**
 	 * Lock for transactions
 	 */
 	mutex_t *mutex;
 
-	/**
-	 * Condvar to wait for transaction completion
-	 */
-	condvar_t *condvar;
-
-	/**
-	 * Threads waiting in condvar
-	 */
-	int waiting;
-
 	/**
 	 * DHCP send socket
 	 */
@@ -180,6 +159,52 @@ typedef struct __attribute__((packed)) {
 	char options[252];
 } dhcp_t;
 
+/**
+ * State of a pending transaction
+ */
+typedef struct {
+	/** the transaction */
+	dhcp_transaction_t *transaction;
+	/** message sent, DHCP_DISCOVER or DHCP_REQUEST */
+	dhcp_message_type_t state;
+	/** number of times the message has been sent */
+	int try;
+	/** callback to invoke once completed */
+	dhcp_enroll_cb_t cb;
+	/** data to pass to cb */
+	void *data;
+} entry_t;
+
+/**
+ * Data for a retransmission timeout job
+ */
+typedef struct {
+	/** socket the transaction belongs to */
+	private_dhcp_socket_t *this;
+	/** transaction ID */
+	u_int32_t id;
+	/** state of the transaction the timeout was scheduled in */
+	dhcp_message_type_t state;
+	/** try the timeout was scheduled for */
+	int try;
+} timeout_t;
+
+/**
+ * Hashtable hash function
+ */
+static u_int hash(void *key)
+{
+	return (uintptr_t)key;
+}
+
+/**
+ * Hashtable equals function
+ */
+static bool equals(void *a, void *b)
+{
+	return a == b;
+}
+
 /**
  * Prepare a DHCP message for a given transaction
  */
@@ -364,61 +389,124 @@ static bool request(private_dhcp_socket_t *this,
 	return TRUE;
 }
 
-METHOD(dhcp_socket_t, enroll, dhcp_transaction_t*,
-	private_dhcp_socket_t *this, identification_t *identity)
+/**
+ * Send the DHCP message of the current state of a transaction
+ */
+static bool transmit(private_dhcp_socket_t *this, entry_t *entry)
 {
-	dhcp_transaction_t *transaction;
-	u_int32_t id;
-	int try;
-
-	if (!this->rng->get_bytes(this->rng, sizeof(id), (u_int8_t*)&id))
+	if (entry->state == DHCP_DISCOVER)
 	{
-		DBG1(DBG_CFG, "DHCP DISCOVER failed, no transaction ID");
-		return NULL;
+		return discover(this, entry->transaction);
 	}
-	transaction = dhcp_transaction_create(id, identity);
+	return request(this, entry->transaction);
+}
+
+/**
+ * Fail a transaction, invoking its callback
+ */
+static void fail(entry_t *entry)
+{
+	entry->transaction->destroy(entry->transaction);
+	entry->cb(entry->data, NULL);
+	free(entry);
+}
+
+static job_requeue_t handle_timeout(timeout_t *timeout);
+
+/**
+ * Schedule a retransmission timeout for the current try of a transaction
+ */
+static void schedule_timeout(private_dhcp_socket_t *this, entry_t *entry)
+{
+	timeout_t *timeout;
+
+	INIT(timeout,
+		.this = this,
+		.id = entry->transaction->get_id(entry->transaction),
+		.state = entry->state,
+		.try = entry->try,
+	);
+	lib->scheduler->schedule_job_ms(lib->scheduler,
+			(job_t*)callback_job_create((callback_job_cb_t)handle_timeout,
+										timeout, free, NULL), 1000 * entry->try);
+}
+
+/**
+ * Retransmit a message of a transaction, or fail it after DHCP_TRIES
+ */
+static job_requeue_t handle_timeout(timeout_t *timeout)
+{
+	private_dhcp_socket_t *this = timeout->this;
+	entry_t *entry;
 
 	this->mutex->lock(this->mutex);
-	this->discover->insert_last(this->discover, transaction);
-	try = 1;
-	while (try <= DHCP_TRIES && discover(this, transaction))
+	entry = this->transactions->get(this->transactions,
+									(void*)(uintptr_t)timeout->id);
+	if (!entry || entry->state != timeout->state || entry->try != timeout->try)
+	{	/* completed or advanced in the meantime */
+		this->mutex->unlock(this->mutex);
+		return JOB_REQUEUE_NONE;
+	}
+	if (++entry->try <= DHCP_TRIES && transmit(this, entry))
 	{
-		if (!this->condvar->timed_wait(this->condvar, this->mutex, 1000 * try) &&
-			this->request->find_first(this->request, NULL,
-									  (void**)&transaction) == SUCCESS)
-		{
-			break;
-		}
-		try++;
+		schedule_timeout(this, entry);
+		this->mutex->unlock(this->mutex);
+		return JOB_REQUEUE_NONE;
 	}
-	if (this->discover->remove(this->discover, transaction, NULL))
+	this->transactions->remove(this->transactions,
+							   (void*)(uintptr_t)timeout->id);
+	this->mutex->unlock(this->mutex);
+
+	if (entry->state == DHCP_DISCOVER)
 	{	/* no OFFER received */
-		this->mutex->unlock(this->mutex);
-		transaction->destroy(transaction);
 		DBG1(DBG_CFG, "DHCP DISCOVER timed out");
-		return NULL;
 	}
+	else
+	{	/* no ACK received */
+		DBG1(DBG_CFG, "DHCP REQUEST timed out");
+	}
+	fail(entry);
+	return JOB_REQUEUE_NONE;
+}
+
+METHOD(dhcp_socket_t, enroll, bool,
+	private_dhcp_socket_t *this, identification_t *identity,
+	dhcp_enroll_cb_t cb, void *data)
+{
+	entry_t *entry;
+	u_int32_t id;
 
-	try = 1;
-	while (try <= DHCP_TRIES && request(this, transaction))
+	this->mutex->lock(this->mutex);
+	do
 	{
-		if (!this->condvar->timed_wait(this->condvar, this->mutex, 1000 * try) &&
-			this->completed->remove(this->completed, transaction, NULL))
+		if (!this->rng->get_bytes(this->rng, sizeof(id), (u_int8_t*)&id))
 		{
-			break;
+			this->mutex->unlock(this->mutex);
+			DBG1(DBG_CFG, "DHCP DISCOVER failed, no transaction ID");
+			return FALSE;
 		}
-		try++;
 	}
-	if (this->request->remove(this->request, transaction, NULL))
-	{	/* no ACK received */
+	while (!id || this->transactions->get(this->transactions,
+										  (void*)(uintptr_t)id));
+
+	INIT(entry,
+		.transaction = dhcp_transaction_create(id, identity),
+		.state = DHCP_DISCOVER,
+		.try = 1,
+		.cb = cb,
+		.data = data,
+	);
+	if (!transmit(this, entry))
+	{
 		this->mutex->unlock(this->mutex);
-		transaction->destroy(transaction);
-		DBG1(DBG_CFG, "DHCP REQUEST timed out");
-		return NULL;
+		entry->transaction->destroy(entry->transaction);
+		free(entry);
+		return FALSE;
 	}
+	this->transactions->put(this->transactions, (void*)(uintptr_t)id, entry);
+	schedule_timeout(this, entry);
 	this->mutex->unlock(this->mutex);
-
-	return transaction;
+	return TRUE;
 }
 
 METHOD(dhcp_socket_t, release, void,
@@ -464,31 +552,23 @@ METHOD(dhcp_socket_t, release, void,
  */
 static void handle_offer(private_dhcp_socket_t *this, dhcp_t *dhcp, int optlen)
 {
-	dhcp_transaction_t *transaction = NULL;
-	enumerator_t *enumerator;
+	dhcp_transaction_t *transaction;
+	entry_t *entry, *failed = NULL;
 	host_t *offer, *server = NULL;
 
 	offer = host_create_from_chunk(AF_INET,
 					chunk_from_thing(dhcp->your_address), 0);
 
 	this->mutex->lock(this->mutex);
-	enumerator = this->discover->create_enumerator(this->discover);
-	while (enumerator->enumerate(enumerator, &transaction))
-	{
-		if (transaction->get_id(transaction) == dhcp->transaction_id)
-		{
-			this->discover->remove_at(this->discover, enumerator);
-			this->request->insert_last(this->request, transaction);
-			break;
-		}
-	}
-	enumerator->destroy(enumerator);
-
-	if (transaction)
+	entry = this->transactions->get(this->transactions,
+									(void*)(uintptr_t)dhcp->transaction_id);
+	if (entry && entry->state == DHCP_DISCOVER)
 	{
 		int optsize, optpos = 0, pos;
 		dhcp_option_t *option;
 
+		transaction = entry->transaction;
+
 		while (optlen > sizeof(dhcp_option_t))
 		{
 			option = (dhcp_option_t*)&dhcp->options[optpos];
@@ -523,9 +603,25 @@ static void handle_offer(private_dhcp_socket_t *this, dhcp_t *dhcp, int optlen)
 		DBG1(DBG_CFG, "received DHCP OFFER %H from %H", offer, server);
 		transaction->set_address(transaction, offer->clone(offer));
 		transaction->set_server(transaction, server);
+
+		entry->state = DHCP_REQUEST;
+		entry->try = 1;
+		if (transmit(this, entry))
+		{
+			schedule_timeout(this, entry);
+		}
+		else
+		{
+			this->transactions->remove(this->transactions,
+								(void*)(uintptr_t)dhcp->transaction_id);
+			failed = entry;
+		}
 	}
 	this->mutex->unlock(this->mutex);
-	this->condvar->broadcast(this->condvar);
+	if (failed)
+	{
+		fail(failed);
+	}
 	offer->destroy(offer);
 }
 
@@ -534,28 +630,32 @@ static void handle_offer(private_dhcp_socket_t *this, dhcp_t *dhcp, int optlen)
  */
 static void handle_ack(private_dhcp_socket_t *this, dhcp_t *dhcp, int optlen)
 {
-	dhcp_transaction_t *transaction;
-	enumerator_t *enumerator;
+	entry_t *entry;
 	host_t *offer;
 
 	offer = host_create_from_chunk(AF_INET,
 						chunk_from_thing(dhcp->your_address), 0);
 
 	this->mutex->lock(this->mutex);
-	enumerator = this->request->create_enumerator(this->request);
-	while (enumerator->enumerate(enumerator, &transaction))
+	entry = this->transactions->get(this->transactions,
+									(void*)(uintptr_t)dhcp->transaction_id);
+	if (entry && entry->state == DHCP_REQUEST)
 	{
-		if (transaction->get_id(transaction) == dhcp->transaction_id)
-		{
-			DBG1(DBG_CFG, "received DHCP ACK for %H", offer);
-			this->request->remove_at(this->request, enumerator);
-			this->completed->insert_last(this->completed, transaction);
-			break;
-		}
+		this->transactions->remove(this->transactions,
+								(void*)(uintptr_t)dhcp->transaction_id);
+	}
+	else
+	{
+		entry = NULL;
 	}
-	enumerator->destroy(enumerator);
 	this->mutex->unlock(this->mutex);
-	this->condvar->broadcast(this->condvar);
+
+	if (entry)
+	{
+		DBG1(DBG_CFG, "received DHCP ACK for %H", offer);
+		entry->cb(entry->data, entry->transaction);
+		free(entry);
+	}
 	offer->destroy(offer);
 }
 
@@ -617,10 +717,10 @@ static job_requeue_t receive_dhcp(private_dhcp_socket_t *this)
 METHOD(dhcp_socket_t, destroy, void,
 	private_dhcp_socket_t *this)
 {
-	while (this->waiting)
-	{
-		this->condvar->signal(this->condvar);
-	}
+	enumerator_t *enumerator;
+	entry_t *entry;
+	void *key;
+
 	if (this->send > 0)
 	{
 		close(this->send);
@@ -629,14 +729,15 @@ METHOD(dhcp_socket_t, destroy, void,
 	{
 		close(this->receive);
 	}
+	enumerator = this->transactions->create_enumerator(this->transactions);
+	while (enumerator->enumerate(enumerator, &key, &entry))
+	{
+		entry->transaction->destroy(entry->transaction);
+		free(entry);
+	}
+	enumerator->destroy(enumerator);
+	this->transactions->destroy(this->transactions);
 	this->mutex->destroy(this->mutex);
-	this->condvar->destroy(this->condvar);
-	this->discover->destroy_offset(this->discover,
-								offsetof(dhcp_transaction_t, destroy));
-	this->request->destroy_offset(this->request,
-								offsetof(dhcp_transaction_t, destroy));
-	this->completed->destroy_offset(this->completed,
-								offsetof(dhcp_transaction_t, destroy));
 	DESTROY_IF(this->rng);
 	DESTROY_IF(this->dst);
 	free(this);
@@ -697,10 +798,7 @@ dhcp_socket_t *dhcp_socket_create()
 		},
 		.rng = lib->crypto->create_rng(lib->crypto, RNG_WEAK),
 		.mutex = mutex_create(MUTEX_TYPE_DEFAULT),
-		.condvar = condvar_create(CONDVAR_TYPE_DEFAULT),
-		.discover = linked_list_create(),
-		.request = linked_list_create(),
-		.completed = linked_list_create(),
+		.transactions = hashtable_create(hash, equals, 8),
 	);
 
 	if (!this->rng)
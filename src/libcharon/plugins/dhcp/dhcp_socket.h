@@ -25,19 +25,33 @@ typedef struct dhcp_socket_t dhcp_socket_t;
 
 #include "dhcp_transaction.h"
 
+/**
+ * Callback function invoked when a DHCP enrollment completes.
+ *
+ * @param data			data passed to enroll()
+ * @param transaction	completed DHCP transaction, NULL on failure
+ */
+typedef void (*dhcp_enroll_cb_t)(void *data, dhcp_transaction_t *transaction);
+
 /**
  * DHCP socket implementation
  */
 struct dhcp_socket_t {
 
 	/**
-	 * Enroll a client address using DHCP.
+	 * Enroll a client address using DHCP, asynchronously.
+	 *
+	 * DISCOVER and REQUEST messages get retransmitted by timers. The callback
+	 * is invoked from a job once the transaction completed or failed, but only
+	 * if the enrollment could be started.
 	 *
 	 * @param identity		peer identity to enroll an address for
-	 * @return				completed DHCP transaction, NULL on failure
+	 * @param cb			callback function invoked with the result
+	 * @param data			data to pass to cb
+	 * @return				TRUE if enrollment started
 	 */
-	dhcp_transaction_t* (*enroll)(dhcp_socket_t *this,
-								  identification_t *identity);
+	bool (*enroll)(dhcp_socket_t *this, identification_t *identity,
+				   dhcp_enroll_cb_t cb, void *data);
 
 	/**
 	 * Release an enrolled DHCP address.
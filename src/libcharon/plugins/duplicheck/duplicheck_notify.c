@@ -24,9 +24,7 @@
 
 #include <daemon.h>
 #include <threading/mutex.h>
-#include <threading/thread.h>
 #include <collections/linked_list.h>
-#include <processing/jobs/callback_job.h>
 
 #define DUPLICHECK_SOCKET IPSEC_PIDDIR "/charon.dck"
 
@@ -104,29 +102,25 @@ static bool open_socket(private_duplicheck_notify_t *this)
 /**
  * Accept duplicheck notification connections
  */
-static job_requeue_t receive(private_duplicheck_notify_t *this)
+static bool on_accept(private_duplicheck_notify_t *this, int fd,
+					  watcher_event_t event)
 {
 	struct sockaddr_un addr;
 	int len = sizeof(addr);
-	uintptr_t fd;
-	bool oldstate;
-
-	oldstate = thread_cancelability(TRUE);
-	fd = accept(this->socket, (struct sockaddr*)&addr, &len);
-	thread_cancelability(oldstate);
 
+	fd = accept(fd, (struct sockaddr*)&addr, &len);
 	if (fd != -1)
 	{
 		this->mutex->lock(this->mutex);
-		this->connected->insert_last(this->connected, (void*)fd);
+		this->connected->insert_last(this->connected, (void*)(uintptr_t)fd);
 		this->mutex->unlock(this->mutex);
-	 }
-	 else
-	 {
-		 DBG1(DBG_CFG, "accepting duplicheck connection failed: %s",
-			  strerror(errno));
-	 }
-	 return JOB_REQUEUE_FAIR;
+	}
+	else
+	{
+		DBG1(DBG_CFG, "accepting duplicheck connection failed: %s",
+			 strerror(errno));
+	}
+	return TRUE;
 }
 
 METHOD(duplicheck_notify_t, send_, void,
@@ -163,6 +157,7 @@ METHOD(duplicheck_notify_t, destroy, void,
 	enumerator_t *enumerator;
 	uintptr_t fd;
 
+	lib->watcher->remove(lib->watcher, this->socket);
 	enumerator = this->connected->create_enumerator(this->connected);
 	while (enumerator->enumerate(enumerator, &fd))
 	{
@@ -195,9 +190,8 @@ duplicheck_notify_t *duplicheck_notify_create()
 		destroy(this);
 		return NULL;
 	}
-	lib->processor->queue_job(lib->processor,
-		(job_t*)callback_job_create_with_prio((callback_job_cb_t)receive, this,
-				NULL, (callback_job_cancel_t)return_false, JOB_PRIO_CRITICAL));
+	lib->watcher->add(lib->watcher, this->socket, WATCHER_READ,
+					  (watcher_cb_t)on_accept, this);
 
 	return &this->public;
 }
@@ -23,10 +23,8 @@
 #include <errno.h>
 
 #include <daemon.h>
-#include <threading/thread.h>
 #include <threading/mutex.h>
 #include <collections/linked_list.h>
-#include <processing/jobs/callback_job.h>
 
 #include "error_notify_msg.h"
 
@@ -146,19 +144,16 @@ METHOD(error_notify_socket_t, notify, void,
 }
 
 /**
- * Accept client connections, dispatch
+ * Accept client connections
  */
-static job_requeue_t accept_(private_error_notify_socket_t *this)
+static bool on_accept(private_error_notify_socket_t *this, int fd,
+					  watcher_event_t event)
 {
 	struct sockaddr_un addr;
-	int fd, len;
-	bool oldstate;
+	int len;
 
 	len = sizeof(addr);
-	oldstate = thread_cancelability(TRUE);
-	fd = accept(this->socket, (struct sockaddr*)&addr, &len);
-	thread_cancelability(oldstate);
-
+	fd = accept(fd, (struct sockaddr*)&addr, &len);
 	if (fd != -1)
 	{
 		this->mutex->lock(this->mutex);
@@ -170,7 +165,7 @@ static job_requeue_t accept_(private_error_notify_socket_t *this)
 		DBG1(DBG_CFG, "accepting notify connection failed: %s",
 			 strerror(errno));
 	}
-	return JOB_REQUEUE_DIRECT;
+	return TRUE;
 }
 
 METHOD(error_notify_socket_t, destroy, void,
@@ -178,6 +173,7 @@ METHOD(error_notify_socket_t, destroy, void,
 {
 	uintptr_t fd;
 
+	lib->watcher->remove(lib->watcher, this->socket);
 	while (this->connected->remove_last(this->connected, (void*)&fd) == SUCCESS)
 	{
 		close(fd);
@@ -211,9 +207,8 @@ error_notify_socket_t *error_notify_socket_create()
 		return NULL;
 	}
 
-	lib->processor->queue_job(lib->processor,
-		(job_t*)callback_job_create_with_prio((callback_job_cb_t)accept_, this,
-				NULL, (callback_job_cancel_t)return_false, JOB_PRIO_CRITICAL));
+	lib->watcher->add(lib->watcher, this->socket, WATCHER_READ,
+					  (watcher_cb_t)on_accept, this);
 
 	return &this->public;
 }
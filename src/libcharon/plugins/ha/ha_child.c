@@ -46,8 +46,29 @@ struct private_ha_child_t {
 	 * Kernel helper
 	 */
 	ha_kernel_t *kernel;
+
+	/**
+	 * journal for warm restarts, if any
+	 */
+	ha_journal_t *journal;
 };
 
+/**
+ * Send a message to the other node and the journal
+ */
+static void push(private_ha_child_t *this, ha_message_t *m)
+{
+	if (this->socket)
+	{
+		this->socket->push(this->socket, m);
+	}
+	if (this->journal)
+	{
+		this->journal->append(this->journal, m);
+	}
+	m->destroy(m);
+}
+
 METHOD(listener_t, child_keys, bool,
 	private_ha_child_t *this, ike_sa_t *ike_sa, child_sa_t *child_sa,
 	bool initiator, diffie_hellman_t *dh, chunk_t nonce_i, chunk_t nonce_r)
@@ -118,18 +139,20 @@ METHOD(listener_t, child_keys, bool,
 	}
 	enumerator->destroy(enumerator);
 
-	seg_i = this->kernel->get_segment_spi(this->kernel,
+	if (this->segments)
+	{
+		seg_i = this->kernel->get_segment_spi(this->kernel,
 			ike_sa->get_my_host(ike_sa), child_sa->get_spi(child_sa, TRUE));
-	seg_o = this->kernel->get_segment_spi(this->kernel,
+		seg_o = this->kernel->get_segment_spi(this->kernel,
 			ike_sa->get_other_host(ike_sa), child_sa->get_spi(child_sa, FALSE));
-	DBG1(DBG_CFG, "handling HA CHILD_SA %s{%d} %#R=== %#R "
-		"(segment in: %d%s, out: %d%s)", child_sa->get_name(child_sa),
-		child_sa->get_reqid(child_sa), local_ts, remote_ts,
-		seg_i, this->segments->is_active(this->segments, seg_i) ? "*" : "",
-		seg_o, this->segments->is_active(this->segments, seg_o) ? "*" : "");
+		DBG1(DBG_CFG, "handling HA CHILD_SA %s{%d} %#R=== %#R "
+			"(segment in: %d%s, out: %d%s)", child_sa->get_name(child_sa),
+			child_sa->get_reqid(child_sa), local_ts, remote_ts,
+			seg_i, this->segments->is_active(this->segments, seg_i) ? "*" : "",
+			seg_o, this->segments->is_active(this->segments, seg_o) ? "*" : "");
+	}
 
-	this->socket->push(this->socket, m);
-	m->destroy(m);
+	push(this, m);
 
 	return TRUE;
 }
@@ -159,8 +182,7 @@ METHOD(listener_t, child_state_change, bool,
 		m->add_attribute(m, HA_IKE_ID, ike_sa->get_id(ike_sa));
 		m->add_attribute(m, HA_INBOUND_SPI,
 						 child_sa->get_spi(child_sa, TRUE));
-		this->socket->push(this->socket, m);
-		m->destroy(m);
+		push(this, m);
 	}
 	return TRUE;
 }
@@ -175,7 +197,8 @@ METHOD(ha_child_t, destroy, void,
  * See header
  */
 ha_child_t *ha_child_create(ha_socket_t *socket, ha_tunnel_t *tunnel,
-							ha_segments_t *segments, ha_kernel_t *kernel)
+							ha_segments_t *segments, ha_kernel_t *kernel,
+							ha_journal_t *journal)
 {
 	private_ha_child_t *this;
 
@@ -191,6 +214,7 @@ ha_child_t *ha_child_create(ha_socket_t *socket, ha_tunnel_t *tunnel,
 		.tunnel = tunnel,
 		.segments = segments,
 		.kernel = kernel,
+		.journal = journal,
 	);
 
 	return &this->public;
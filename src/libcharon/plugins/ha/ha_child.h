@@ -27,6 +27,7 @@ typedef struct ha_child_t ha_child_t;
 #include "ha_tunnel.h"
 #include "ha_segments.h"
 #include "ha_kernel.h"
+#include "ha_journal.h"
 
 #include <daemon.h>
 
@@ -49,13 +50,15 @@ struct ha_child_t {
 /**
  * Create a ha_child instance.
  *
- * @param socket		socket to use for sending synchronization messages
+ * @param socket		socket to use for sending synchronization messages, if any
  * @param tunnel		tunnel securing sync messages, if any
- * @param segments		segment handling
- * @param kernel		kernel helper
+ * @param segments		segment handling, if any
+ * @param kernel		kernel helper, if any
+ * @param journal		journal for warm restarts, if any
  * @return				CHILD listener
  */
 ha_child_t *ha_child_create(ha_socket_t *socket, ha_tunnel_t *tunnel,
-							ha_segments_t *segments, ha_kernel_t *kernel);
+							ha_segments_t *segments, ha_kernel_t *kernel,
+							ha_journal_t *journal);
 
 #endif /** HA_CHILD_ @}*/
@@ -20,6 +20,9 @@
 #include <sa/ikev1/keymat_v1.h>
 #include <processing/jobs/callback_job.h>
 #include <processing/jobs/adopt_children_job.h>
+#include <processing/jobs/rekey_child_sa_job.h>
+#include <collections/hashtable.h>
+#include <collections/linked_list.h>
 
 typedef struct private_ha_dispatcher_t private_ha_dispatcher_t;
 typedef struct ha_diffie_hellman_t ha_diffie_hellman_t;
@@ -58,8 +61,45 @@ struct private_ha_dispatcher_t {
 	 * HA enabled pool
 	 */
 	ha_attribute_t *attr;
+
+	/**
+	 * Journal to restore SAs from
+	 */
+	ha_journal_t *journal;
+
+	/**
+	 * Journaled IKE_SAs not restored yet, restore_group_t
+	 */
+	linked_list_t *pending;
+
+	/**
+	 * Time to wait for missing peer configs of journaled IKE_SAs, in s
+	 */
+	u_int timeout;
+
+	/**
+	 * Monotonic time we stop waiting for missing peer configs
+	 */
+	time_t deadline;
 };
 
+/**
+ * A journaled IKE_SA, including the IKE_SAs it has been rekeyed to
+ */
+typedef struct {
+
+	/**
+	 * Journaled messages, in order, ha_message_t
+	 */
+	linked_list_t *messages;
+
+	/**
+	 * Names of the peer configs the IKE_SAs use, char*
+	 */
+	linked_list_t *configs;
+
+} restore_group_t;
+
 /**
  * DH implementation for HA synced DH values
  */
@@ -120,6 +160,22 @@ static diffie_hellman_t *ha_diffie_hellman_create(chunk_t secret, chunk_t pub)
 	return &this->dh;
 }
 
+/**
+ * Cache a processed message for resynchronization, if we have a cache
+ */
+static void cache_message(private_ha_dispatcher_t *this, ike_sa_t *ike_sa,
+						  ha_message_t *message)
+{
+	if (this->cache)
+	{
+		this->cache->cache(this->cache, ike_sa, message);
+	}
+	else
+	{
+		message->destroy(message);
+	}
+}
+
 /**
  * Process messages of type IKE_ADD
  */
@@ -258,7 +314,7 @@ static void process_ike_add(private_ha_dispatcher_t *this, ha_message_t *message
 			}
 			ike_sa->set_state(ike_sa, IKE_CONNECTING);
 			ike_sa->set_proposal(ike_sa, proposal);
-			this->cache->cache(this->cache, ike_sa, message);
+			cache_message(this, ike_sa, message);
 			message = NULL;
 			charon->ike_sa_manager->checkin(charon->ike_sa_manager, ike_sa);
 		}
@@ -420,7 +476,7 @@ static void process_ike_update(private_ha_dispatcher_t *this,
 				 ike_sa->get_other_host(ike_sa), ike_sa->get_other_id(ike_sa));
 			ike_sa->set_state(ike_sa, IKE_PASSIVE);
 		}
-		if (received_vip)
+		if (received_vip && this->attr)
 		{
 			enumerator_t *pools, *vips;
 			host_t *vip;
@@ -447,7 +503,7 @@ static void process_ike_update(private_ha_dispatcher_t *this,
 			lib->processor->queue_job(lib->processor, (job_t*)
 							adopt_children_job_create(ike_sa->get_id(ike_sa)));
 		}
-		this->cache->cache(this->cache, ike_sa, message);
+		cache_message(this, ike_sa, message);
 		charon->ike_sa_manager->checkin(charon->ike_sa_manager, ike_sa);
 	}
 	else
@@ -493,7 +549,7 @@ static void process_ike_mid(private_ha_dispatcher_t *this,
 		{
 			ike_sa->set_message_id(ike_sa, initiator, mid);
 		}
-		this->cache->cache(this->cache, ike_sa, message);
+		cache_message(this, ike_sa, message);
 		charon->ike_sa_manager->checkin(charon->ike_sa_manager, ike_sa);
 	}
 	else
@@ -546,7 +602,7 @@ static void process_ike_iv(private_ha_dispatcher_t *this, ha_message_t *message)
 				}
 			}
 		}
-		this->cache->cache(this->cache, ike_sa, message);
+		cache_message(this, ike_sa, message);
 		charon->ike_sa_manager->checkin(charon->ike_sa_manager, ike_sa);
 	}
 	else
@@ -582,7 +638,7 @@ static void process_ike_delete(private_ha_dispatcher_t *this,
 	enumerator->destroy(enumerator);
 	if (ike_sa)
 	{
-		this->cache->cache(this->cache, ike_sa, message);
+		cache_message(this, ike_sa, message);
 		charon->ike_sa_manager->checkin_and_destroy(
 						charon->ike_sa_manager, ike_sa);
 	}
@@ -831,16 +887,25 @@ static void process_child_add(private_ha_dispatcher_t *this,
 		return;
 	}
 
-	seg_i = this->kernel->get_segment_spi(this->kernel,
+	if (this->segments)
+	{
+		seg_i = this->kernel->get_segment_spi(this->kernel,
 								ike_sa->get_my_host(ike_sa), inbound_spi);
-	seg_o = this->kernel->get_segment_spi(this->kernel,
+		seg_o = this->kernel->get_segment_spi(this->kernel,
 								ike_sa->get_other_host(ike_sa), outbound_spi);
 
-	DBG1(DBG_CFG, "installed HA CHILD_SA %s{%d} %#R=== %#R "
-		"(segment in: %d%s, out: %d%s)", child_sa->get_name(child_sa),
-		child_sa->get_reqid(child_sa), local_ts, remote_ts,
-		seg_i, this->segments->is_active(this->segments, seg_i) ? "*" : "",
-		seg_o, this->segments->is_active(this->segments, seg_o) ? "*" : "");
+		DBG1(DBG_CFG, "installed HA CHILD_SA %s{%d} %#R=== %#R "
+			"(segment in: %d%s, out: %d%s)", child_sa->get_name(child_sa),
+			child_sa->get_reqid(child_sa), local_ts, remote_ts,
+			seg_i, this->segments->is_active(this->segments, seg_i) ? "*" : "",
+			seg_o, this->segments->is_active(this->segments, seg_o) ? "*" : "");
+	}
+	else
+	{
+		DBG1(DBG_CFG, "installed HA CHILD_SA %s{%d} %#R=== %#R",
+			 child_sa->get_name(child_sa), child_sa->get_reqid(child_sa),
+			 local_ts, remote_ts);
+	}
 	child_sa->add_policies(child_sa, local_ts, remote_ts);
 	local_ts->destroy_offset(local_ts, offsetof(traffic_selector_t, destroy));
 	remote_ts->destroy_offset(remote_ts, offsetof(traffic_selector_t, destroy));
@@ -985,14 +1050,12 @@ static void process_resync(private_ha_dispatcher_t *this,
 }
 
 /**
- * Dispatcher job function
+ * Process a received or restored message
  */
-static job_requeue_t dispatch(private_ha_dispatcher_t *this)
+static void process(private_ha_dispatcher_t *this, ha_message_t *message)
 {
-	ha_message_t *message;
 	ha_message_type_t type;
 
-	message = this->socket->pull(this->socket);
 	type = message->get_type(message);
 	if (type != HA_STATUS)
 	{
@@ -1042,12 +1105,256 @@ static job_requeue_t dispatch(private_ha_dispatcher_t *this)
 			message->destroy(message);
 			break;
 	}
+}
+
+/**
+ * Dispatcher job function
+ */
+static job_requeue_t dispatch(private_ha_dispatcher_t *this)
+{
+	process(this, this->socket->pull(this->socket));
 	return JOB_REQUEUE_DIRECT;
 }
 
+/**
+ * Destroy a restore group, including unprocessed messages
+ */
+static void restore_group_destroy(restore_group_t *group)
+{
+	group->messages->destroy_offset(group->messages,
+									offsetof(ha_message_t, destroy));
+	group->configs->destroy_function(group->configs, free);
+	free(group);
+}
+
+/**
+ * Hashtable hash function for IKE_SA identifiers
+ */
+static u_int hash_id(ike_sa_id_t *key)
+{
+	u_int64_t spi_i, spi_r;
+
+	spi_i = key->get_initiator_spi(key);
+	spi_r = key->get_responder_spi(key);
+	return chunk_hash_inc(chunk_from_thing(spi_i),
+						  chunk_hash(chunk_from_thing(spi_r)));
+}
+
+/**
+ * Hashtable equals function for IKE_SA identifiers
+ */
+static bool equals_id(ike_sa_id_t *a, ike_sa_id_t *b)
+{
+	return a->equals(a, b);
+}
+
+/**
+ * Group the journaled messages by IKE_SA, following rekeyings
+ */
+static linked_list_t *load_groups(private_ha_dispatcher_t *this)
+{
+	ha_message_attribute_t attribute;
+	ha_message_value_t value;
+	enumerator_t *enumerator, *attributes;
+	hashtable_t *groups;
+	linked_list_t *list;
+	restore_group_t *group;
+	ha_message_t *message;
+	ike_sa_id_t *id;
+
+	list = linked_list_create();
+	groups = hashtable_create((hashtable_hash_t)hash_id,
+							  (hashtable_equals_t)equals_id, 128);
+
+	enumerator = this->journal->create_enumerator(this->journal);
+	while (enumerator->enumerate(enumerator, &message))
+	{
+		group = NULL;
+		id = NULL;
+		attributes = message->create_attribute_enumerator(message);
+		while (attributes->enumerate(attributes, &attribute, &value))
+		{
+			switch (attribute)
+			{
+				case HA_IKE_ID:
+					id = value.ike_sa_id->clone(value.ike_sa_id);
+					group = group ?: groups->get(groups, id);
+					break;
+				case HA_IKE_REKEY_ID:
+					group = groups->get(groups, value.ike_sa_id) ?: group;
+					break;
+				case HA_CONFIG_NAME:
+					if (group && message->get_type(message) == HA_IKE_UPDATE)
+					{
+						group->configs->insert_last(group->configs,
+													strdup(value.str));
+					}
+					break;
+				default:
+					break;
+			}
+		}
+		attributes->destroy(attributes);
+
+		if (!group)
+		{
+			INIT(group,
+				.messages = linked_list_create(),
+				.configs = linked_list_create(),
+			);
+			list->insert_last(list, group);
+		}
+		if (id && groups->get(groups, id) != group)
+		{
+			groups->put(groups, id, group);
+			id = NULL;
+		}
+		DESTROY_IF(id);
+		group->messages->insert_last(group->messages, message);
+	}
+	enumerator->destroy(enumerator);
+
+	enumerator = groups->create_enumerator(groups);
+	while (enumerator->enumerate(enumerator, &id, NULL))
+	{
+		id->destroy(id);
+	}
+	enumerator->destroy(enumerator);
+	groups->destroy(groups);
+
+	return list;
+}
+
+/**
+ * Check if the peer configs of a journaled IKE_SA are available
+ */
+static bool has_configs(restore_group_t *group)
+{
+	enumerator_t *enumerator;
+	peer_cfg_t *peer_cfg;
+	char *name;
+	bool found = TRUE;
+
+	enumerator = group->configs->create_enumerator(group->configs);
+	while (found && enumerator->enumerate(enumerator, &name))
+	{
+		peer_cfg = charon->backends->get_peer_cfg_by_name(charon->backends,
+														  name);
+		found = peer_cfg != NULL;
+		DESTROY_IF(peer_cfg);
+	}
+	enumerator->destroy(enumerator);
+	return found;
+}
+
+/**
+ * Activate restored IKE_SAs and rekey their CHILD_SAs
+ */
+static u_int activate(private_ha_dispatcher_t *this)
+{
+	enumerator_t *enumerator, *children;
+	ike_sa_t *ike_sa;
+	child_sa_t *child_sa;
+	u_int count = 0;
+
+	enumerator = charon->ike_sa_manager->create_enumerator(
+												charon->ike_sa_manager, TRUE);
+	while (enumerator->enumerate(enumerator, &ike_sa))
+	{
+		if (ike_sa->get_state(ike_sa) != IKE_PASSIVE)
+		{
+			continue;
+		}
+		ike_sa->set_state(ike_sa, IKE_ESTABLISHED);
+		/* the kernel starts over with the sequence numbers of reinstalled
+		 * CHILD_SAs, so we replace them by fresh ones */
+		children = ike_sa->create_child_sa_enumerator(ike_sa);
+		while (children->enumerate(children, &child_sa))
+		{
+			lib->processor->queue_job(lib->processor,
+					(job_t*)rekey_child_sa_job_create(
+								child_sa->get_reqid(child_sa),
+								child_sa->get_protocol(child_sa),
+								child_sa->get_spi(child_sa, TRUE)));
+		}
+		children->destroy(children);
+		count++;
+	}
+	enumerator->destroy(enumerator);
+	return count;
+}
+
+/**
+ * Restore journaled SAs once their configs are loaded, activate and rekey them
+ */
+static job_requeue_t restore(private_ha_dispatcher_t *this)
+{
+	enumerator_t *enumerator;
+	restore_group_t *group;
+	ha_message_t *message;
+	u_int count;
+
+	if (!this->pending)
+	{
+		this->pending = load_groups(this);
+		this->deadline = time_monotonic(NULL) + this->timeout;
+	}
+
+	enumerator = this->pending->create_enumerator(this->pending);
+	while (enumerator->enumerate(enumerator, &group))
+	{
+		if (has_configs(group))
+		{
+			this->pending->remove_at(this->pending, enumerator);
+			while (group->messages->remove_first(group->messages,
+												 (void**)&message) == SUCCESS)
+			{
+				process(this, message);
+			}
+			restore_group_destroy(group);
+		}
+	}
+	enumerator->destroy(enumerator);
+
+	count = activate(this);
+	if (count)
+	{
+		DBG1(DBG_CFG, "restored %u IKE_SA%s from HA journal",
+			 count, count == 1 ? "" : "s");
+	}
+
+	count = this->pending->get_count(this->pending);
+	if (count)
+	{
+		if (time_monotonic(NULL) < this->deadline)
+		{
+			DBG2(DBG_CFG, "waiting for peer configs of %u journaled IKE_SA%s",
+				 count, count == 1 ? "" : "s");
+			lib->scheduler->schedule_job(lib->scheduler, (job_t*)
+				callback_job_create_with_prio((callback_job_cb_t)restore,
+									this, NULL, NULL, JOB_PRIO_CRITICAL), 1);
+			return JOB_REQUEUE_NONE;
+		}
+		/* as we don't touch them, their records stay in the journal */
+		DBG1(DBG_CFG, "peer configs for %u journaled IKE_SA%s missing, "
+			 "not restored", count, count == 1 ? "" : "s");
+		while (this->pending->remove_first(this->pending,
+										   (void**)&group) == SUCCESS)
+		{
+			restore_group_destroy(group);
+		}
+	}
+	return JOB_REQUEUE_NONE;
+}
+
 METHOD(ha_dispatcher_t, destroy, void,
 	private_ha_dispatcher_t *this)
 {
+	if (this->pending)
+	{
+		this->pending->destroy_function(this->pending,
+										(void*)restore_group_destroy);
+	}
 	free(this);
 }
 
@@ -1056,7 +1363,8 @@ METHOD(ha_dispatcher_t, destroy, void,
  */
 ha_dispatcher_t *ha_dispatcher_create(ha_socket_t *socket,
 									ha_segments_t *segments, ha_cache_t *cache,
-									ha_kernel_t *kernel, ha_attribute_t *attr)
+									ha_kernel_t *kernel, ha_attribute_t *attr,
+									ha_journal_t *journal, u_int timeout)
 {
 	private_ha_dispatcher_t *this;
 
@@ -1070,10 +1378,23 @@ ha_dispatcher_t *ha_dispatcher_create(ha_socket_t *socket,
 		.cache = cache,
 		.kernel = kernel,
 		.attr = attr,
+		.journal = journal,
+		.timeout = timeout,
 	);
-	lib->processor->queue_job(lib->processor,
-		(job_t*)callback_job_create_with_prio((callback_job_cb_t)dispatch, this,
-				NULL, (callback_job_cancel_t)return_false, JOB_PRIO_CRITICAL));
+	if (socket)
+	{
+		lib->processor->queue_job(lib->processor,
+			(job_t*)callback_job_create_with_prio((callback_job_cb_t)dispatch,
+				this, NULL, (callback_job_cancel_t)return_false,
+				JOB_PRIO_CRITICAL));
+	}
+	if (journal)
+	{
+		/* configs might get loaded later, restore() waits for them */
+		lib->scheduler->schedule_job(lib->scheduler, (job_t*)
+			callback_job_create_with_prio((callback_job_cb_t)restore,
+									this, NULL, NULL, JOB_PRIO_CRITICAL), 1);
+	}
 
 	return &this->public;
 }
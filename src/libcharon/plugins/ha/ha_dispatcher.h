@@ -26,6 +26,7 @@
 #include "ha_cache.h"
 #include "ha_kernel.h"
 #include "ha_attribute.h"
+#include "ha_journal.h"
 
 typedef struct ha_dispatcher_t ha_dispatcher_t;
 
@@ -43,15 +44,22 @@ struct ha_dispatcher_t {
 /**
  * Create a ha_dispatcher instance pulling from socket.
  *
- * @param socket		socket to pull messages from
- * @param segments		segments to control based on received messages
- * @param cache			message cache to use for resynchronization
- * @param kernel		kernel helper
- * @param attr			HA enabled pool
+ * If a journal is given, the SAs in it get restored and activated shortly
+ * after startup. IKE_SAs whose peer config is not loaded yet are restored as
+ * soon as it is, or left in the journal after the given timeout.
+ *
+ * @param socket		socket to pull messages from, if any
+ * @param segments		segments to control based on received messages, if any
+ * @param cache			message cache to use for resynchronization, if any
+ * @param kernel		kernel helper, if any
+ * @param attr			HA enabled pool, if any
+ * @param journal		journal to restore SAs from, if any
+ * @param timeout		time to wait for peer configs of journaled SAs, in s
  * @return				dispatcher object
  */
 ha_dispatcher_t *ha_dispatcher_create(ha_socket_t *socket,
 									ha_segments_t *segments, ha_cache_t *cache,
-									ha_kernel_t *kernel, ha_attribute_t *attr);
+									ha_kernel_t *kernel, ha_attribute_t *attr,
+									ha_journal_t *journal, u_int timeout);
 
 #endif /** HA_DISPATCHER_ @}*/
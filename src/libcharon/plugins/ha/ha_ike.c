@@ -44,8 +44,36 @@ struct private_ha_ike_t {
 	 * message cache
 	 */
 	ha_cache_t *cache;
+
+	/**
+	 * journal for warm restarts, if any
+	 */
+	ha_journal_t *journal;
 };
 
+/**
+ * Send a message to the other node and the journal, and cache it
+ */
+static void push(private_ha_ike_t *this, ike_sa_t *ike_sa, ha_message_t *m)
+{
+	if (this->socket)
+	{
+		this->socket->push(this->socket, m);
+	}
+	if (this->journal)
+	{
+		this->journal->append(this->journal, m);
+	}
+	if (this->cache)
+	{
+		this->cache->cache(this->cache, ike_sa, m);
+	}
+	else
+	{
+		m->destroy(m);
+	}
+}
+
 /**
  * Return condition if it is set on ike_sa
  */
@@ -137,8 +165,7 @@ METHOD(listener_t, ike_keys, bool,
 		}
 	}
 
-	this->socket->push(this->socket, m);
-	this->cache->cache(this->cache, ike_sa, m);
+	push(this, ike_sa, m);
 
 	return TRUE;
 }
@@ -217,8 +244,7 @@ METHOD(listener_t, ike_updown, bool,
 		m = ha_message_create(HA_IKE_DELETE);
 		m->add_attribute(m, HA_IKE_ID, ike_sa->get_id(ike_sa));
 	}
-	this->socket->push(this->socket, m);
-	this->cache->cache(this->cache, ike_sa, m);
+	push(this, ike_sa, m);
 	return TRUE;
 }
 
@@ -236,7 +262,19 @@ METHOD(listener_t, ike_state_change, bool,
 	/* delete any remaining cache entry if IKE_SA gets destroyed */
 	if (new == IKE_DESTROYING)
 	{
-		this->cache->delete(this->cache, ike_sa);
+		if (this->cache)
+		{
+			this->cache->delete(this->cache, ike_sa);
+		}
+		if (this->journal && ike_sa->get_state(ike_sa) == IKE_CONNECTING)
+		{	/* remove IKE_SAs that never came up from the journal */
+			ha_message_t *m;
+
+			m = ha_message_create(HA_IKE_DELETE);
+			m->add_attribute(m, HA_IKE_ID, ike_sa->get_id(ike_sa));
+			this->journal->append(this->journal, m);
+			m->destroy(m);
+		}
 	}
 	return TRUE;
 }
@@ -264,8 +302,7 @@ static void sync_vips(private_ha_ike_t *this, ike_sa_t *ike_sa)
 
 	if (m)
 	{
-		this->socket->push(this->socket, m);
-		this->cache->cache(this->cache, ike_sa, m);
+		push(this, ike_sa, m);
 	}
 }
 
@@ -295,8 +332,7 @@ METHOD(listener_t, message_hook, bool,
 			}
 			m->add_attribute(m, HA_IKE_ID, ike_sa->get_id(ike_sa));
 			m->add_attribute(m, HA_MID, message->get_message_id(message) + 1);
-			this->socket->push(this->socket, m);
-			this->cache->cache(this->cache, ike_sa, m);
+			push(this, ike_sa, m);
 		}
 		if (ike_sa->get_state(ike_sa) == IKE_ESTABLISHED &&
 			message->get_exchange_type(message) == IKE_AUTH &&
@@ -323,8 +359,7 @@ METHOD(listener_t, message_hook, bool,
 				m = ha_message_create(HA_IKE_IV);
 				m->add_attribute(m, HA_IKE_ID, ike_sa->get_id(ike_sa));
 				m->add_attribute(m, HA_IV, iv);
-				this->socket->push(this->socket, m);
-				this->cache->cache(this->cache, ike_sa, m);
+				push(this, ike_sa, m);
 			}
 		}
 		if (!incoming && message->get_exchange_type(message) == TRANSACTION)
@@ -357,8 +392,7 @@ METHOD(listener_t, message_hook, bool,
 				}
 				m->add_attribute(m, HA_IKE_ID, ike_sa->get_id(ike_sa));
 				m->add_attribute(m, HA_MID, seq + 1);
-				this->socket->push(this->socket, m);
-				this->cache->cache(this->cache, ike_sa, m);
+				push(this, ike_sa, m);
 			}
 		}
 	}
@@ -375,7 +409,7 @@ METHOD(ha_ike_t, destroy, void,
  * See header
  */
 ha_ike_t *ha_ike_create(ha_socket_t *socket, ha_tunnel_t *tunnel,
-						ha_cache_t *cache)
+						ha_cache_t *cache, ha_journal_t *journal)
 {
 	private_ha_ike_t *this;
 
@@ -393,6 +427,7 @@ ha_ike_t *ha_ike_create(ha_socket_t *socket, ha_tunnel_t *tunnel,
 		.socket = socket,
 		.tunnel = tunnel,
 		.cache = cache,
+		.journal = journal,
 	);
 
 	return &this->public;
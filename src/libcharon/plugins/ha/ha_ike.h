@@ -27,6 +27,7 @@ typedef struct ha_ike_t ha_ike_t;
 #include "ha_tunnel.h"
 #include "ha_segments.h"
 #include "ha_cache.h"
+#include "ha_journal.h"
 
 #include <daemon.h>
 
@@ -49,12 +50,13 @@ struct ha_ike_t {
 /**
  * Create a ha_ike instance.
  *
- * @param socket		socket to use for sending synchronization messages
+ * @param socket		socket to use for sending synchronization messages, if any
  * @param tunnel		tunnel securing sync messages, if any
- * @param cache			message cache
+ * @param cache			message cache, if any
+ * @param journal		journal for warm restarts, if any
  * @return				IKE listener
  */
 ha_ike_t *ha_ike_create(ha_socket_t *socket, ha_tunnel_t *tunnel,
-						ha_cache_t *cache);
+						ha_cache_t *cache, ha_journal_t *journal);
 
 #endif /** HA_IKE_ @}*/
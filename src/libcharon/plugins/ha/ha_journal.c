@@ -0,0 +1,670 @@
+/*
+ * Copyright (C) 2013 HSR Hochschule fuer Technik Rapperswil
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#include "ha_journal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <daemon.h>
+#include <threading/mutex.h>
+#include <collections/hashtable.h>
+#include <collections/linked_list.h>
+
+/**
+ * Magic identifying a journal file, including the format version
+ */
+#define JOURNAL_MAGIC "HAJ1"
+
+/**
+ * Size of the length field preceding each record
+ */
+#define RECORD_LEN_SIZE 4
+
+typedef struct private_ha_journal_t private_ha_journal_t;
+
+/**
+ * Header of a journal file. It is followed by the records, each a 32-bit
+ * length in network order and an encoded HA message.
+ */
+typedef struct {
+	/** magic and format version */
+	char magic[4];
+	/** reserved, zero */
+	u_int32_t reserved;
+	/** bytes used by records following the header */
+	u_int64_t used;
+} journal_header_t;
+
+/**
+ * Private data of an ha_journal_t object.
+ */
+struct private_ha_journal_t {
+
+	/**
+	 * Public ha_journal_t interface.
+	 */
+	ha_journal_t public;
+
+	/**
+	 * Path to the journal file
+	 */
+	char *path;
+
+	/**
+	 * Minimal size of the journal file
+	 */
+	size_t initial;
+
+	/**
+	 * Mapped journal file, NULL if journaling failed
+	 */
+	journal_header_t *header;
+
+	/**
+	 * Size of the mapped journal file
+	 */
+	size_t size;
+
+	/**
+	 * Compacted records found at startup, to restore
+	 */
+	chunk_t restore;
+
+	/**
+	 * Mutex to lock journal
+	 */
+	mutex_t *mutex;
+};
+
+typedef struct entry_t entry_t;
+
+/**
+ * A journal record during compaction
+ */
+typedef struct {
+	/** record, including its length */
+	chunk_t data;
+	/** IKE_SA the record belongs to, the IKE_SA created it for CHILD_SAs */
+	entry_t *entry;
+	/** TRUE if the record got replaced or deleted */
+	bool dropped;
+} record_t;
+
+/**
+ * A journaled IKE_SA during compaction
+ */
+struct entry_t {
+	/** IKE_SA identifier */
+	ike_sa_id_t *id;
+	/** IKE_SA this one has been rekeyed to, if any */
+	entry_t *successor;
+	/** TRUE if the IKE_SA got established */
+	bool updated;
+	/** TRUE if the IKE_SA got deleted */
+	bool deleted;
+	/** TRUE to keep the records of this IKE_SA */
+	bool keep;
+	/** last initiator message ID record */
+	record_t *midi;
+	/** last responder message ID record */
+	record_t *midr;
+	/** last IKEv1 IV record */
+	record_t *iv;
+};
+
+/**
+ * Hashtable hash function for IKE_SA identifiers
+ */
+static u_int hash_id(ike_sa_id_t *key)
+{
+	u_int64_t spi_i, spi_r;
+
+	spi_i = key->get_initiator_spi(key);
+	spi_r = key->get_responder_spi(key);
+	return chunk_hash_inc(chunk_from_thing(spi_i),
+						  chunk_hash(chunk_from_thing(spi_r)));
+}
+
+/**
+ * Hashtable equals function for IKE_SA identifiers
+ */
+static bool equals_id(ike_sa_id_t *a, ike_sa_id_t *b)
+{
+	return a->equals(a, b);
+}
+
+/**
+ * Hashtable hash function for SPIs
+ */
+static u_int hash_spi(void *key)
+{
+	return (uintptr_t)key;
+}
+
+/**
+ * Hashtable equals function for SPIs
+ */
+static bool equals_spi(void *a, void *b)
+{
+	return a == b;
+}
+
+/**
+ * Replace the record stored in slot by a newer one
+ */
+static void replace(record_t **slot, record_t *record)
+{
+	if (*slot)
+	{
+		(*slot)->dropped = TRUE;
+	}
+	*slot = record;
+}
+
+/**
+ * Assign a record to the IKE_SA it refers to, or to an IKE_SA it rekeys
+ */
+static void assign(hashtable_t *entries, hashtable_t *children,
+				   record_t *record, ha_message_t *message)
+{
+	ha_message_attribute_t attribute;
+	ha_message_value_t value;
+	enumerator_t *enumerator;
+	entry_t *entry = NULL, *old = NULL;
+	record_t *child;
+	u_int32_t spi = 0;
+
+	enumerator = message->create_attribute_enumerator(message);
+	while (enumerator->enumerate(enumerator, &attribute, &value))
+	{
+		switch (attribute)
+		{
+			case HA_IKE_ID:
+				entry = entries->get(entries, value.ike_sa_id);
+				if (!entry && message->get_type(message) == HA_IKE_ADD)
+				{
+					INIT(entry,
+						.id = value.ike_sa_id->clone(value.ike_sa_id),
+					);
+					entries->put(entries, entry->id, entry);
+				}
+				break;
+			case HA_IKE_REKEY_ID:
+				old = entries->get(entries, value.ike_sa_id);
+				break;
+			case HA_INBOUND_SPI:
+				spi = value.u32;
+				break;
+			default:
+				break;
+		}
+	}
+	enumerator->destroy(enumerator);
+
+	if (message->get_type(message) == HA_CHILD_DELETE)
+	{	/* the CHILD_SA might have been created by a rekeyed IKE_SA */
+		child = children->remove(children, (void*)(uintptr_t)spi);
+		if (child)
+		{
+			child->dropped = TRUE;
+		}
+	}
+	if (!entry)
+	{
+		record->dropped = TRUE;
+		return;
+	}
+	record->entry = entry;
+	switch (message->get_type(message))
+	{
+		case HA_IKE_ADD:
+			if (old)
+			{
+				old->successor = entry;
+			}
+			break;
+		case HA_IKE_UPDATE:
+			entry->updated = TRUE;
+			break;
+		case HA_IKE_MID_INITIATOR:
+			replace(&entry->midi, record);
+			break;
+		case HA_IKE_MID_RESPONDER:
+			replace(&entry->midr, record);
+			break;
+		case HA_IKE_IV:
+			replace(&entry->iv, record);
+			break;
+		case HA_IKE_DELETE:
+			entry->deleted = TRUE;
+			record->dropped = TRUE;
+			break;
+		case HA_CHILD_ADD:
+			child = children->put(children, (void*)(uintptr_t)spi, record);
+			if (child)
+			{
+				child->dropped = TRUE;
+			}
+			break;
+		default:
+			record->dropped = TRUE;
+			break;
+	}
+}
+
+/**
+ * Get the IKE_SA an IKE_SA has finally been rekeyed to
+ */
+static entry_t *get_head(entry_t *entry)
+{
+	while (entry->successor)
+	{
+		entry = entry->successor;
+	}
+	return entry;
+}
+
+/**
+ * Check if the IKE_SA an IKE_SA has finally been rekeyed to is still alive
+ */
+static bool is_alive(entry_t *entry, bool startup)
+{
+	entry = get_head(entry);
+	/* IKE_SAs not established before a restart can't be restored */
+	return !entry->deleted && (entry->updated || !startup);
+}
+
+/**
+ * Compact the records in data to those required to restore live SAs.
+ *
+ * An IKE_SA is restored from its ADD, UPDATE and last MID/IV records. To
+ * derive the keys of its CHILD_SAs, all IKE_SAs it has been rekeyed from
+ * back to the one that created the oldest of these CHILD_SAs are kept, too.
+ */
+static chunk_t compact(chunk_t data, bool startup)
+{
+	hashtable_t *entries, *children;
+	linked_list_t *records;
+	enumerator_t *enumerator;
+	ha_message_t *message;
+	record_t *record;
+	entry_t *entry;
+	chunk_t compacted;
+	u_int32_t len;
+	size_t total = 0;
+	char *pos;
+
+	entries = hashtable_create((hashtable_hash_t)hash_id,
+							   (hashtable_equals_t)equals_id, 128);
+	children = hashtable_create(hash_spi, equals_spi, 128);
+	records = linked_list_create();
+
+	while (data.len >= RECORD_LEN_SIZE)
+	{
+		len = untoh32(data.ptr);
+		if (len > data.len - RECORD_LEN_SIZE)
+		{
+			DBG1(DBG_CFG, "HA journal truncated, ignoring %u bytes",
+				 (u_int)data.len);
+			break;
+		}
+		INIT(record,
+			.data = chunk_create(data.ptr, RECORD_LEN_SIZE + len),
+		);
+		records->insert_last(records, record);
+		message = ha_message_parse(chunk_skip(record->data, RECORD_LEN_SIZE));
+		if (message)
+		{
+			assign(entries, children, record, message);
+			message->destroy(message);
+		}
+		else
+		{
+			record->dropped = TRUE;
+		}
+		data = chunk_skip(data, record->data.len);
+	}
+
+	enumerator = entries->create_enumerator(entries);
+	while (enumerator->enumerate(enumerator, NULL, &entry))
+	{
+		if (!entry->successor && is_alive(entry, startup))
+		{
+			entry->keep = TRUE;
+		}
+	}
+	enumerator->destroy(enumerator);
+	enumerator = children->create_enumerator(children);
+	while (enumerator->enumerate(enumerator, NULL, &record))
+	{
+		if (is_alive(record->entry, startup))
+		{
+			for (entry = record->entry; entry; entry = entry->successor)
+			{
+				entry->keep = TRUE;
+			}
+		}
+	}
+	enumerator->destroy(enumerator);
+
+	enumerator = records->create_enumerator(records);
+	while (enumerator->enumerate(enumerator, &record))
+	{
+		if (!record->dropped && record->entry->keep)
+		{
+			total += record->data.len;
+		}
+	}
+	enumerator->destroy(enumerator);
+	compacted = chunk_alloc(total);
+	pos = compacted.ptr;
+	while (records->remove_first(records, (void**)&record) == SUCCESS)
+	{
+		if (!record->dropped && record->entry->keep)
+		{
+			memcpy(pos, record->data.ptr, record->data.len);
+			pos += record->data.len;
+		}
+		free(record);
+	}
+	records->destroy(records);
+
+	enumerator = entries->create_enumerator(entries);
+	while (enumerator->enumerate(enumerator, NULL, &entry))
+	{
+		entry->id->destroy(entry->id);
+		free(entry);
+	}
+	enumerator->destroy(enumerator);
+	entries->destroy(entries);
+	children->destroy(children);
+
+	return compacted;
+}
+
+/**
+ * Unmap the journal file
+ */
+static void unmap_journal(private_ha_journal_t *this)
+{
+	if (this->header)
+	{
+		munmap(this->header, this->size);
+		this->header = NULL;
+	}
+}
+
+/**
+ * Atomically replace the journal file by one containing records, and map it
+ */
+static bool write_journal(private_ha_journal_t *this, chunk_t records,
+						  size_t size)
+{
+	journal_header_t header = {
+		.magic = JOURNAL_MAGIC,
+		.used = records.len,
+	};
+	char tmp[PATH_MAX];
+	void *addr;
+	int fd;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", this->path);
+	fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+	if (fd == -1)
+	{
+		DBG1(DBG_CFG, "opening HA journal '%s' failed: %s", tmp,
+			 strerror(errno));
+		return FALSE;
+	}
+	if (write(fd, &header, sizeof(header)) != sizeof(header) ||
+		write(fd, records.ptr, records.len) != records.len ||
+		ftruncate(fd, size) == -1 || fsync(fd) == -1)
+	{
+		DBG1(DBG_CFG, "writing HA journal '%s' failed: %s", tmp,
+			 strerror(errno));
+		close(fd);
+		unlink(tmp);
+		return FALSE;
+	}
+	addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED)
+	{
+		DBG1(DBG_CFG, "mapping HA journal '%s' failed: %s", tmp,
+			 strerror(errno));
+		unlink(tmp);
+		return FALSE;
+	}
+	if (rename(tmp, this->path) == -1)
+	{
+		DBG1(DBG_CFG, "replacing HA journal '%s' failed: %s", this->path,
+			 strerror(errno));
+		munmap(addr, size);
+		unlink(tmp);
+		return FALSE;
+	}
+	this->header = addr;
+	this->size = size;
+	return TRUE;
+}
+
+/**
+ * Compact the mapped journal, making room for at least extra bytes
+ */
+static void compact_journal(private_ha_journal_t *this, size_t extra)
+{
+	chunk_t records;
+	size_t size;
+
+	records = compact(chunk_create((char*)(this->header + 1),
+								   this->header->used), FALSE);
+	size = max(this->size, this->initial);
+	/* grow the journal if compacting frees less than half of it */
+	while (sizeof(journal_header_t) + records.len + extra > size / 2)
+	{
+		size *= 2;
+	}
+	DBG1(DBG_CFG, "compacted HA journal from %u to %u bytes",
+		 (u_int)this->header->used, (u_int)records.len);
+	unmap_journal(this);
+	if (!write_journal(this, records, size))
+	{
+		DBG1(DBG_CFG, "HA journal disabled");
+	}
+	chunk_clear(&records);
+}
+
+/**
+ * Load and compact the records found in an existing journal file
+ */
+static chunk_t load_journal(private_ha_journal_t *this)
+{
+	journal_header_t *header;
+	chunk_t records = chunk_empty;
+	struct stat sb;
+	void *addr;
+	int fd;
+
+	fd = open(this->path, O_RDONLY);
+	if (fd == -1)
+	{
+		if (errno != ENOENT)
+		{
+			DBG1(DBG_CFG, "opening HA journal '%s' failed: %s", this->path,
+				 strerror(errno));
+		}
+		return records;
+	}
+	if (fstat(fd, &sb) == -1 || sb.st_size < sizeof(journal_header_t))
+	{
+		close(fd);
+		return records;
+	}
+	addr = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED)
+	{
+		DBG1(DBG_CFG, "mapping HA journal '%s' failed: %s", this->path,
+			 strerror(errno));
+		return records;
+	}
+	header = addr;
+	if (memeq(header->magic, JOURNAL_MAGIC, sizeof(header->magic)))
+	{
+		records = compact(chunk_create((char*)(header + 1),
+					min(header->used, sb.st_size - sizeof(journal_header_t))),
+					TRUE);
+	}
+	else
+	{
+		DBG1(DBG_CFG, "'%s' is not a HA journal, ignored", this->path);
+	}
+	munmap(addr, sb.st_size);
+	return records;
+}
+
+METHOD(ha_journal_t, append, void,
+	private_ha_journal_t *this, ha_message_t *message)
+{
+	chunk_t data;
+	char *pos;
+
+	data = message->get_encoding(message);
+
+	this->mutex->lock(this->mutex);
+	if (this->header && sizeof(journal_header_t) + this->header->used +
+						RECORD_LEN_SIZE + data.len > this->size)
+	{
+		compact_journal(this, RECORD_LEN_SIZE + data.len);
+	}
+	if (this->header)
+	{
+		pos = (char*)(this->header + 1) + this->header->used;
+		htoun32(pos, data.len);
+		memcpy(pos + RECORD_LEN_SIZE, data.ptr, data.len);
+		/* update the length last, a partial record never gets restored */
+		this->header->used += RECORD_LEN_SIZE + data.len;
+	}
+	this->mutex->unlock(this->mutex);
+}
+
+/**
+ * Enumerator over the records to restore
+ */
+typedef struct {
+	/** implements enumerator_t */
+	enumerator_t public;
+	/** records to restore */
+	chunk_t records;
+	/** remaining records */
+	chunk_t pos;
+} restore_enumerator_t;
+
+METHOD(enumerator_t, restore_enumerate, bool,
+	restore_enumerator_t *this, ha_message_t **message)
+{
+	u_int32_t len;
+
+	while (this->pos.len >= RECORD_LEN_SIZE)
+	{
+		len = untoh32(this->pos.ptr);
+		*message = ha_message_parse(chunk_create(
+								this->pos.ptr + RECORD_LEN_SIZE, len));
+		this->pos = chunk_skip(this->pos, RECORD_LEN_SIZE + len);
+		if (*message)
+		{
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+METHOD(enumerator_t, restore_destroy, void,
+	restore_enumerator_t *this)
+{
+	chunk_clear(&this->records);
+	free(this);
+}
+
+METHOD(ha_journal_t, create_enumerator, enumerator_t*,
+	private_ha_journal_t *this)
+{
+	restore_enumerator_t *enumerator;
+
+	this->mutex->lock(this->mutex);
+	INIT(enumerator,
+		.public = {
+			.enumerate = (void*)_restore_enumerate,
+			.destroy = _restore_destroy,
+		},
+		.records = this->restore,
+		.pos = this->restore,
+	);
+	this->restore = chunk_empty;
+	this->mutex->unlock(this->mutex);
+
+	return &enumerator->public;
+}
+
+METHOD(ha_journal_t, destroy, void,
+	private_ha_journal_t *this)
+{
+	unmap_journal(this);
+	chunk_clear(&this->restore);
+	this->mutex->destroy(this->mutex);
+	free(this->path);
+	free(this);
+}
+
+/**
+ * See header
+ */
+ha_journal_t *ha_journal_create(char *path, size_t size)
+{
+	private_ha_journal_t *this;
+	size_t page;
+
+	page = getpagesize();
+
+	INIT(this,
+		.public = {
+			.append = _append,
+			.create_enumerator = _create_enumerator,
+			.destroy = _destroy,
+		},
+		.path = strdup(path),
+		.initial = max(size / page * page, page),
+		.mutex = mutex_create(MUTEX_TYPE_DEFAULT),
+	);
+
+	this->restore = load_journal(this);
+	size = this->initial;
+	while (sizeof(journal_header_t) + this->restore.len > size / 2)
+	{
+		size *= 2;
+	}
+	if (!write_journal(this, this->restore, size))
+	{
+		destroy(this);
+		return NULL;
+	}
+	DBG1(DBG_CFG, "opened HA journal '%s', %u bytes to restore", path,
+		 (u_int)this->restore.len);
+	return &this->public;
+}
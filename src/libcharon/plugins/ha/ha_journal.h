@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2013 HSR Hochschule fuer Technik Rapperswil
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+/**
+ * @defgroup ha_journal ha_journal
+ * @{ @ingroup ha
+ */
+
+#ifndef HA_JOURNAL_H_
+#define HA_JOURNAL_H_
+
+typedef struct ha_journal_t ha_journal_t;
+
+#include "ha_message.h"
+
+#include <collections/enumerator.h>
+
+/**
+ * Persistent, memory mapped log of HA messages, allows warm restarts.
+ *
+ * Sync messages are appended to a file, which survives a restart of the
+ * daemon. Once full, the journal gets compacted to the messages required to
+ * restore the IKE_SAs and CHILD_SAs still alive.
+ */
+struct ha_journal_t {
+
+	/**
+	 * Append a message to the journal.
+	 *
+	 * @param message		message to append
+	 */
+	void (*append)(ha_journal_t *this, ha_message_t *message);
+
+	/**
+	 * Create an enumerator over the messages found in the journal at startup.
+	 *
+	 * The journaled state can be enumerated only once, it gets released
+	 * when the enumerator is destroyed.
+	 *
+	 * @return				enumerator over ha_message_t*, to destroy by caller
+	 */
+	enumerator_t* (*create_enumerator)(ha_journal_t *this);
+
+	/**
+	 * Destroy a ha_journal_t.
+	 */
+	void (*destroy)(ha_journal_t *this);
+};
+
+/**
+ * Create a ha_journal instance.
+ *
+ * @param path			path to the journal file
+ * @param size			initial size of the journal file, in bytes
+ * @return				journal, NULL if file could not be mapped
+ */
+ha_journal_t *ha_journal_create(char *path, size_t size);
+
+#endif /** HA_JOURNAL_H_ @}*/
@@ -23,6 +23,7 @@
 #include "ha_ctl.h"
 #include "ha_cache.h"
 #include "ha_attribute.h"
+#include "ha_journal.h"
 
 #include <daemon.h>
 #include <hydra.h>
@@ -89,6 +90,11 @@ struct private_ha_plugin_t {
 	 * Attribute provider
 	 */
 	ha_attribute_t *attr;
+
+	/**
+	 * Persistent journal for warm restarts
+	 */
+	ha_journal_t *journal;
 };
 
 METHOD(plugin_t, get_name, char*,
@@ -105,17 +111,30 @@ static bool plugin_cb(private_ha_plugin_t *this,
 {
 	if (reg)
 	{
-		charon->bus->add_listener(charon->bus, &this->segments->listener);
+		if (this->segments)
+		{
+			charon->bus->add_listener(charon->bus, &this->segments->listener);
+		}
 		charon->bus->add_listener(charon->bus, &this->ike->listener);
 		charon->bus->add_listener(charon->bus, &this->child->listener);
-		hydra->attributes->add_provider(hydra->attributes,
-										&this->attr->provider);
+		if (this->attr)
+		{
+			hydra->attributes->add_provider(hydra->attributes,
+											&this->attr->provider);
+		}
 	}
 	else
 	{
-		hydra->attributes->remove_provider(hydra->attributes,
-										   &this->attr->provider);
-		charon->bus->remove_listener(charon->bus, &this->segments->listener);
+		if (this->attr)
+		{
+			hydra->attributes->remove_provider(hydra->attributes,
+											   &this->attr->provider);
+		}
+		if (this->segments)
+		{
+			charon->bus->remove_listener(charon->bus,
+										 &this->segments->listener);
+		}
 		charon->bus->remove_listener(charon->bus, &this->ike->listener);
 		charon->bus->remove_listener(charon->bus, &this->child->listener);
 	}
@@ -140,23 +159,55 @@ METHOD(plugin_t, destroy, void,
 	this->ike->destroy(this->ike);
 	this->child->destroy(this->child);
 	this->dispatcher->destroy(this->dispatcher);
-	this->attr->destroy(this->attr);
-	this->cache->destroy(this->cache);
-	this->segments->destroy(this->segments);
-	this->kernel->destroy(this->kernel);
-	this->socket->destroy(this->socket);
+	DESTROY_IF(this->attr);
+	DESTROY_IF(this->cache);
+	DESTROY_IF(this->segments);
+	DESTROY_IF(this->kernel);
+	DESTROY_IF(this->socket);
 	DESTROY_IF(this->tunnel);
+	DESTROY_IF(this->journal);
 	free(this);
 }
 
+/**
+ * Create a standalone instance, restoring SAs from a journal after restarts
+ */
+static plugin_t *create_standalone(char *journal, size_t size, u_int timeout)
+{
+	private_ha_plugin_t *this;
+
+	INIT(this,
+		.public = {
+			.plugin = {
+				.get_name = _get_name,
+				.get_features = _get_features,
+				.destroy = _destroy,
+			},
+		},
+	);
+
+	this->journal = ha_journal_create(journal, size);
+	if (!this->journal)
+	{
+		free(this);
+		return NULL;
+	}
+	this->dispatcher = ha_dispatcher_create(NULL, NULL, NULL, NULL, NULL,
+											this->journal, timeout);
+	this->ike = ha_ike_create(NULL, NULL, NULL, this->journal);
+	this->child = ha_child_create(NULL, NULL, NULL, NULL, this->journal);
+
+	return &this->public.plugin;
+}
+
 /**
  * Plugin constructor
  */
 plugin_t *ha_plugin_create()
 {
 	private_ha_plugin_t *this;
-	char *local, *remote, *secret;
-	u_int count;
+	char *local, *remote, *secret, *journal;
+	u_int count, size, timeout;
 	bool fifo, monitor, resync;
 
 	local = lib->settings->get_str(lib->settings,
@@ -173,11 +224,25 @@ plugin_t *ha_plugin_create()
 							"%s.plugins.ha.resync", TRUE, charon->name);
 	count = min(SEGMENTS_MAX, lib->settings->get_int(lib->settings,
 							"%s.plugins.ha.segment_count", 1, charon->name));
+	journal = lib->settings->get_str(lib->settings,
+							"%s.plugins.ha.journal", NULL, charon->name);
+	size = lib->settings->get_int(lib->settings,
+							"%s.plugins.ha.journal_size", 16, charon->name);
+	timeout = lib->settings->get_time(lib->settings,
+							"%s.plugins.ha.journal_timeout", 60, charon->name);
 	if (!local || !remote)
 	{
+		if (journal)
+		{
+			return create_standalone(journal, size * 1024 * 1024, timeout);
+		}
 		DBG1(DBG_CFG, "HA config misses local/remote address");
 		return NULL;
 	}
+	if (journal)
+	{
+		DBG1(DBG_CFG, "HA journal is used without local/remote only, ignored");
+	}
 
 	if (!lib->caps->keep(lib->caps, CAP_CHOWN))
 	{	/* required to chown(2) control socket */
@@ -216,10 +281,10 @@ plugin_t *ha_plugin_create()
 	}
 	this->attr = ha_attribute_create(this->kernel, this->segments);
 	this->dispatcher = ha_dispatcher_create(this->socket, this->segments,
-										this->cache, this->kernel, this->attr);
-	this->ike = ha_ike_create(this->socket, this->tunnel, this->cache);
+							this->cache, this->kernel, this->attr, NULL, 0);
+	this->ike = ha_ike_create(this->socket, this->tunnel, this->cache, NULL);
 	this->child = ha_child_create(this->socket, this->tunnel, this->segments,
-								  this->kernel);
+								  this->kernel, NULL);
 
 	return &this->public.plugin;
 }
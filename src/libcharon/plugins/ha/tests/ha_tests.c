@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2013 HSR Hochschule fuer Technik Rapperswil
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#include <unistd.h>
+
+#include "ha_tests.h"
+
+#include <library.h>
+#include <hydra.h>
+#include <daemon.h>
+
+int main()
+{
+	SRunner *sr;
+	int nf;
+
+	/* test cases are forked and there is no cleanup, so disable leak detective.
+	 * if test_suite.h is included leak detective is enabled in test cases */
+	setenv("LEAK_DETECTIVE_DISABLE", "1", 1);
+	/* redirect all output to stderr (to redirect make's stdout to /dev/null) */
+	dup2(2, 1);
+
+	library_init(NULL);
+	/* the HA plugin logs over the bus of the daemon */
+	if (!libhydra_init("ha-tests") || !libcharon_init("ha-tests"))
+	{
+		libcharon_deinit();
+		libhydra_deinit();
+		library_deinit();
+		return EXIT_FAILURE;
+	}
+
+	sr = srunner_create(NULL);
+	srunner_add_suite(sr, ha_journal_suite_create());
+
+	srunner_run_all(sr, CK_NORMAL);
+	nf = srunner_ntests_failed(sr);
+
+	srunner_free(sr);
+	libcharon_deinit();
+	libhydra_deinit();
+	library_deinit();
+
+	return (nf == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
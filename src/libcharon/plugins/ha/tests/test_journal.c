@@ -0,0 +1,410 @@
+/*
+ * Copyright (C) 2013 HSR Hochschule fuer Technik Rapperswil
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#include <test_suite.h>
+
+#include "ha_journal.h"
+
+#include <sa/ike_sa.h>
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+/**
+ * Journal file used by the tests
+ */
+static char path[64];
+
+/**
+ * Journal under test
+ */
+static ha_journal_t *journal;
+
+/**
+ * Expected restored message
+ */
+typedef struct {
+	/** message type */
+	ha_message_type_t type;
+	/** initiator SPI of the IKE_SA */
+	u_int64_t spi;
+	/** inbound CHILD_SA SPI or message ID, if any */
+	u_int32_t value;
+} restored_t;
+
+START_SETUP(setup_journal)
+{
+	snprintf(path, sizeof(path), "/tmp/ha-journal-test.%d", getpid());
+	unlink(path);
+	journal = ha_journal_create(path, 0);
+	ck_assert(journal);
+}
+END_SETUP
+
+START_TEARDOWN(teardown_journal)
+{
+	DESTROY_IF(journal);
+	unlink(path);
+}
+END_TEARDOWN
+
+/**
+ * Append a message referring to an IKE_SA
+ */
+static void append(ha_message_type_t type, u_int64_t spi,
+				   ha_message_attribute_t attribute, u_int64_t value)
+{
+	ha_message_t *message;
+	ike_sa_id_t *id, *rekey;
+
+	message = ha_message_create(type);
+	id = ike_sa_id_create(IKEV2, spi, spi + 1, TRUE);
+	message->add_attribute(message, HA_IKE_ID, id);
+	switch (attribute)
+	{
+		case HA_IKE_REKEY_ID:
+			rekey = ike_sa_id_create(IKEV2, value, value + 1, TRUE);
+			message->add_attribute(message, HA_IKE_REKEY_ID, rekey);
+			rekey->destroy(rekey);
+			break;
+		case HA_INBOUND_SPI:
+		case HA_MID:
+			message->add_attribute(message, attribute, (u_int32_t)value);
+			break;
+		default:
+			break;
+	}
+	journal->append(journal, message);
+	message->destroy(message);
+	id->destroy(id);
+}
+
+/**
+ * Restart the journal and verify the messages to restore
+ */
+static void verify_restored(restored_t *expected, int count)
+{
+	ha_message_attribute_t attribute;
+	ha_message_value_t value;
+	enumerator_t *enumerator, *attributes;
+	ha_message_t *message;
+	int i = 0;
+
+	journal->destroy(journal);
+	journal = ha_journal_create(path, 0);
+	ck_assert(journal);
+
+	enumerator = journal->create_enumerator(journal);
+	while (enumerator->enumerate(enumerator, &message))
+	{
+		ck_assert(i < count);
+		ck_assert_int_eq(message->get_type(message), expected[i].type);
+		attributes = message->create_attribute_enumerator(message);
+		while (attributes->enumerate(attributes, &attribute, &value))
+		{
+			switch (attribute)
+			{
+				case HA_IKE_ID:
+					ck_assert(value.ike_sa_id->get_initiator_spi(
+											value.ike_sa_id) == expected[i].spi);
+					break;
+				case HA_INBOUND_SPI:
+				case HA_MID:
+					ck_assert_int_eq(value.u32, expected[i].value);
+					break;
+				default:
+					break;
+			}
+		}
+		attributes->destroy(attributes);
+		message->destroy(message);
+		i++;
+	}
+	enumerator->destroy(enumerator);
+	ck_assert_int_eq(i, count);
+}
+
+START_TEST(test_empty)
+{
+	verify_restored(NULL, 0);
+}
+END_TEST
+
+START_TEST(test_established)
+{
+	restored_t expected[] = {
+		{ HA_IKE_ADD, 1, 0 },
+		{ HA_IKE_UPDATE, 1, 0 },
+		{ HA_IKE_MID_RESPONDER, 1, 1 },
+		{ HA_CHILD_ADD, 1, 10 },
+		{ HA_IKE_MID_INITIATOR, 1, 3 },
+	};
+
+	append(HA_IKE_ADD, 1, 0, 0);
+	append(HA_IKE_MID_INITIATOR, 1, HA_MID, 1);
+	append(HA_IKE_UPDATE, 1, 0, 0);
+	append(HA_IKE_MID_INITIATOR, 1, HA_MID, 2);
+	append(HA_IKE_MID_RESPONDER, 1, HA_MID, 1);
+	append(HA_CHILD_ADD, 1, HA_INBOUND_SPI, 10);
+	append(HA_IKE_MID_INITIATOR, 1, HA_MID, 3);
+	verify_restored(expected, countof(expected));
+	/* restored records are journaled again */
+	verify_restored(expected, countof(expected));
+}
+END_TEST
+
+START_TEST(test_not_established)
+{
+	restored_t expected[] = {
+		{ HA_IKE_ADD, 2, 0 },
+		{ HA_IKE_UPDATE, 2, 0 },
+	};
+
+	append(HA_IKE_ADD, 1, 0, 0);
+	append(HA_IKE_MID_INITIATOR, 1, HA_MID, 1);
+	append(HA_IKE_ADD, 2, 0, 0);
+	append(HA_IKE_UPDATE, 2, 0, 0);
+	verify_restored(expected, countof(expected));
+}
+END_TEST
+
+START_TEST(test_ike_delete)
+{
+	restored_t expected[] = {
+		{ HA_IKE_ADD, 2, 0 },
+		{ HA_IKE_UPDATE, 2, 0 },
+	};
+
+	append(HA_IKE_ADD, 1, 0, 0);
+	append(HA_IKE_UPDATE, 1, 0, 0);
+	append(HA_CHILD_ADD, 1, HA_INBOUND_SPI, 10);
+	append(HA_IKE_ADD, 2, 0, 0);
+	append(HA_IKE_UPDATE, 2, 0, 0);
+	append(HA_CHILD_DELETE, 1, HA_INBOUND_SPI, 10);
+	append(HA_IKE_DELETE, 1, 0, 0);
+	verify_restored(expected, countof(expected));
+}
+END_TEST
+
+START_TEST(test_child_delete)
+{
+	restored_t expected[] = {
+		{ HA_IKE_ADD, 1, 0 },
+		{ HA_IKE_UPDATE, 1, 0 },
+		{ HA_CHILD_ADD, 1, 11 },
+	};
+
+	append(HA_IKE_ADD, 1, 0, 0);
+	append(HA_IKE_UPDATE, 1, 0, 0);
+	append(HA_CHILD_ADD, 1, HA_INBOUND_SPI, 10);
+	append(HA_CHILD_ADD, 1, HA_INBOUND_SPI, 11);
+	append(HA_CHILD_DELETE, 1, HA_INBOUND_SPI, 10);
+	verify_restored(expected, countof(expected));
+}
+END_TEST
+
+START_TEST(test_rekey_chain)
+{
+	restored_t expected[] = {
+		{ HA_IKE_ADD, 1, 0 },
+		{ HA_IKE_UPDATE, 1, 0 },
+		{ HA_CHILD_ADD, 1, 10 },
+		{ HA_IKE_ADD, 2, 0 },
+		{ HA_IKE_UPDATE, 2, 0 },
+		{ HA_IKE_ADD, 3, 0 },
+		{ HA_IKE_UPDATE, 3, 0 },
+		{ HA_CHILD_ADD, 3, 12 },
+	};
+
+	append(HA_IKE_ADD, 1, 0, 0);
+	append(HA_IKE_UPDATE, 1, 0, 0);
+	append(HA_CHILD_ADD, 1, HA_INBOUND_SPI, 10);
+	append(HA_CHILD_ADD, 1, HA_INBOUND_SPI, 11);
+	append(HA_IKE_ADD, 2, HA_IKE_REKEY_ID, 1);
+	append(HA_IKE_UPDATE, 2, 0, 0);
+	append(HA_IKE_DELETE, 1, 0, 0);
+	append(HA_IKE_ADD, 3, HA_IKE_REKEY_ID, 2);
+	append(HA_IKE_UPDATE, 3, 0, 0);
+	append(HA_IKE_DELETE, 2, 0, 0);
+	/* CHILD_SAs get deleted by the IKE_SA they have been moved to */
+	append(HA_CHILD_DELETE, 3, HA_INBOUND_SPI, 11);
+	append(HA_CHILD_ADD, 3, HA_INBOUND_SPI, 12);
+	/* the IKE_SAs deriving keys of CHILD_SA 10 are kept */
+	verify_restored(expected, countof(expected));
+
+	append(HA_CHILD_DELETE, 3, HA_INBOUND_SPI, 10);
+	verify_restored(&expected[5], 3);
+}
+END_TEST
+
+START_TEST(test_rekey_deleted)
+{
+	append(HA_IKE_ADD, 1, 0, 0);
+	append(HA_IKE_UPDATE, 1, 0, 0);
+	append(HA_CHILD_ADD, 1, HA_INBOUND_SPI, 10);
+	append(HA_IKE_ADD, 2, HA_IKE_REKEY_ID, 1);
+	append(HA_IKE_UPDATE, 2, 0, 0);
+	append(HA_IKE_DELETE, 1, 0, 0);
+	append(HA_IKE_DELETE, 2, 0, 0);
+	verify_restored(NULL, 0);
+}
+END_TEST
+
+/**
+ * Get the number of bytes used by records in the journal file
+ */
+static u_int64_t get_used()
+{
+	struct {
+		char magic[4];
+		u_int32_t reserved;
+		u_int64_t used;
+	} header;
+	FILE *file;
+
+	file = fopen(path, "r");
+	ck_assert(file);
+	ck_assert(fread(&header, sizeof(header), 1, file) == 1);
+	fclose(file);
+	return header.used;
+}
+
+START_TEST(test_truncated)
+{
+	restored_t expected[] = {
+		{ HA_IKE_ADD, 1, 0 },
+		{ HA_IKE_UPDATE, 1, 0 },
+	};
+	u_int64_t used;
+
+	append(HA_IKE_ADD, 1, 0, 0);
+	append(HA_IKE_UPDATE, 1, 0, 0);
+	used = get_used();
+	append(HA_CHILD_ADD, 1, HA_INBOUND_SPI, 10);
+	ck_assert(get_used() > used);
+	journal->destroy(journal);
+	journal = NULL;
+
+	/* a journal cut within the last record, e.g. by a full disk */
+	ck_assert(truncate(path, 16 + used + 6) == 0);
+	journal = ha_journal_create(path, 0);
+	ck_assert(journal);
+	verify_restored(expected, countof(expected));
+}
+END_TEST
+
+START_TEST(test_invalid)
+{
+	FILE *file;
+
+	journal->destroy(journal);
+	journal = NULL;
+	file = fopen(path, "w");
+	ck_assert(file);
+	fprintf(file, "this is not a journal, but long enough for a header\n");
+	fclose(file);
+	journal = ha_journal_create(path, 0);
+	ck_assert(journal);
+	verify_restored(NULL, 0);
+}
+END_TEST
+
+START_TEST(test_compact_full)
+{
+	restored_t expected[] = {
+		{ HA_IKE_ADD, 1, 0 },
+		{ HA_IKE_UPDATE, 1, 0 },
+		{ HA_IKE_MID_INITIATOR, 1, 9999 },
+	};
+	struct stat sb;
+	int i;
+
+	append(HA_IKE_ADD, 1, 0, 0);
+	append(HA_IKE_UPDATE, 1, 0, 0);
+	for (i = 0; i < 10000; i++)
+	{
+		append(HA_IKE_MID_INITIATOR, 1, HA_MID, i);
+	}
+	/* replaced records got compacted away, without growing the file */
+	ck_assert(stat(path, &sb) == 0);
+	ck_assert_int_eq(sb.st_size, getpagesize());
+	verify_restored(expected, countof(expected));
+}
+END_TEST
+
+START_TEST(test_compact_grow)
+{
+	struct stat sb;
+	int i;
+
+	for (i = 0; i < 1000; i++)
+	{
+		append(HA_IKE_ADD, i + 1, 0, 0);
+		append(HA_IKE_UPDATE, i + 1, 0, 0);
+	}
+	/* live records don't get dropped, the journal grows instead */
+	ck_assert(stat(path, &sb) == 0);
+	ck_assert(sb.st_size > getpagesize());
+
+	journal->destroy(journal);
+	journal = ha_journal_create(path, 0);
+	ck_assert(journal);
+	for (i = 0; i < 1000; i++)
+	{
+		append(HA_IKE_DELETE, i + 1, 0, 0);
+	}
+	verify_restored(NULL, 0);
+}
+END_TEST
+
+Suite *ha_journal_suite_create()
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("ha journal");
+
+	tc = tcase_create("restore");
+	tcase_add_checked_fixture(tc, setup_journal, teardown_journal);
+	tcase_add_test(tc, test_empty);
+	tcase_add_test(tc, test_established);
+	tcase_add_test(tc, test_not_established);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("delete");
+	tcase_add_checked_fixture(tc, setup_journal, teardown_journal);
+	tcase_add_test(tc, test_ike_delete);
+	tcase_add_test(tc, test_child_delete);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("rekey");
+	tcase_add_checked_fixture(tc, setup_journal, teardown_journal);
+	tcase_add_test(tc, test_rekey_chain);
+	tcase_add_test(tc, test_rekey_deleted);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("corrupt");
+	tcase_add_checked_fixture(tc, setup_journal, teardown_journal);
+	tcase_add_test(tc, test_truncated);
+	tcase_add_test(tc, test_invalid);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("compact");
+	tcase_add_checked_fixture(tc, setup_journal, teardown_journal);
+	tcase_add_test(tc, test_compact_full);
+	tcase_add_test(tc, test_compact_grow);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -126,7 +126,12 @@ plugin_t *kernel_libipsec_plugin_create()
 		return NULL;
 	}
 
-	this->tun = tun_device_create("ipsec%d");
+	this->tun = tun_device_create_queues("ipsec%d",
+					lib->settings->get_int(lib->settings,
+						"%s.plugins.kernel-libipsec.queues", 1, charon->name),
+					lib->settings->get_bool(lib->settings,
+						"%s.plugins.kernel-libipsec.offload", FALSE,
+						charon->name));
 	if (!this->tun)
 	{
 		DBG1(DBG_KNL, "failed to create TUN device");
@@ -27,6 +27,17 @@
 #include <threading/thread.h>
 #include <processing/jobs/callback_job.h>
 
+/**
+ * Maximum number of packets read from a TUN device at once
+ */
+#define TUN_BURST 32
+
+/**
+ * Maximum number of consecutive read errors considered for the backoff of a
+ * TUN queue, the delay increases quadratically up to one second
+ */
+#define TUN_MAX_ERRORS 10
+
 typedef struct private_kernel_libipsec_router_t private_kernel_libipsec_router_t;
 
 /**
@@ -41,6 +52,18 @@ typedef struct {
 	tun_device_t *tun;
 } tun_entry_t;
 
+/**
+ * Queue of the default TUN device, handled by a dedicated thread
+ */
+typedef struct {
+	/** TUN device */
+	tun_device_t *tun;
+	/** index of the queue */
+	int queue;
+	/** number of consecutive read errors */
+	u_int errors;
+} tun_queue_t;
+
 /**
  * Single instance of the router
  */
@@ -99,7 +122,7 @@ static bool tun_entry_equals(tun_entry_t *a, tun_entry_t *b)
  */
 static void send_esp(void *data, esp_packet_t *packet)
 {
-	charon->sender->send_no_marker(charon->sender, (packet_t*)packet);
+	charon->sender->send_esp(charon->sender, (packet_t*)packet);
 }
 
 /**
@@ -143,8 +166,11 @@ static int collect_fds(private_kernel_libipsec_router_t *this, fd_set *fds)
 	FD_SET(this->notify[0], fds);
 	maxfd = this->notify[0];
 
-	FD_SET(this->tun.fd, fds);
-	maxfd = max(maxfd, this->tun.fd);
+	if (this->tun.fd != -1)
+	{
+		FD_SET(this->tun.fd, fds);
+		maxfd = max(maxfd, this->tun.fd);
+	}
 
 	this->lock->read_lock(this->lock);
 	enumerator = this->tuns->create_enumerator(this->tuns);
@@ -160,26 +186,47 @@ static int collect_fds(private_kernel_libipsec_router_t *this, fd_set *fds)
 }
 
 /**
- * Read and process outbound plaintext packet for the given TUN device
+ * Read a burst of outbound plaintext packets from a queue of a TUN device,
+ * returns the number of valid packets, -1 if reading failed
  */
-static void process_plain(tun_device_t *tun)
+static int read_plain(tun_device_t *tun, int queue, ip_packet_t *packets[])
 {
-	chunk_t raw;
+	chunk_t raw[TUN_BURST];
+	int i, count, valid = 0;
 
-	if (tun->read_packet(tun, &raw))
+	count = tun->read_packets(tun, queue, raw, countof(raw));
+	if (!count)
 	{
-		ip_packet_t *packet;
-
-		packet = ip_packet_create(raw);
-		if (packet)
+		return -1;
+	}
+	for (i = 0; i < count; i++)
+	{
+		packets[valid] = ip_packet_create(raw[i]);
+		if (packets[valid])
 		{
-			ipsec->processor->queue_outbound(ipsec->processor, packet);
+			valid++;
 		}
 		else
 		{
 			DBG1(DBG_KNL, "invalid IP packet read from TUN device");
 		}
 	}
+	return valid;
+}
+
+/**
+ * Read and process outbound plaintext packets for the given TUN device
+ */
+static void process_plain(tun_device_t *tun)
+{
+	ip_packet_t *packets[TUN_BURST];
+	int i, count;
+
+	count = read_plain(tun, 0, packets);
+	for (i = 0; i < count; i++)
+	{
+		ipsec->processor->queue_outbound(ipsec->processor, packets[i]);
+	}
 }
 
 /**
@@ -190,7 +237,7 @@ static void handle_tuns(private_kernel_libipsec_router_t *this, fd_set *fds)
 	enumerator_t *enumerator;
 	tun_entry_t *entry;
 
-	if (FD_ISSET(this->tun.fd, fds))
+	if (this->tun.fd != -1 && FD_ISSET(this->tun.fd, fds))
 	{
 		process_plain(this->tun.tun);
 	}
@@ -238,6 +285,34 @@ static job_requeue_t handle_plain(private_kernel_libipsec_router_t *this)
 	return JOB_REQUEUE_DIRECT;
 }
 
+/**
+ * Job handling outbound plaintext packets of a queue of the default TUN device
+ */
+static job_requeue_t handle_queue(tun_queue_t *queue)
+{
+	ip_packet_t *packets[TUN_BURST];
+	bool oldstate;
+	int count;
+
+	count = read_plain(queue->tun, queue->queue, packets);
+	if (count < 0)
+	{	/* back off instead of spinning if the error persists */
+		queue->errors = min(queue->errors + 1, TUN_MAX_ERRORS);
+		oldstate = thread_cancelability(TRUE);
+		usleep(queue->errors * queue->errors * 10000);
+		thread_cancelability(oldstate);
+		return JOB_REQUEUE_FAIR;
+	}
+	queue->errors = 0;
+	if (!count)
+	{	/* invalid packets only */
+		return JOB_REQUEUE_DIRECT;
+	}
+	/* process them in this thread, so the queues are processed in parallel */
+	ipsec->processor->process_outbound_batch(ipsec->processor, packets, count);
+	return JOB_REQUEUE_DIRECT;
+}
+
 METHOD(kernel_listener_t, tun, bool,
 	private_kernel_libipsec_router_t *this, tun_device_t *tun, bool created)
 {
@@ -321,6 +396,8 @@ static bool set_nonblock(int socket)
 kernel_libipsec_router_t *kernel_libipsec_router_create()
 {
 	private_kernel_libipsec_router_t *this;
+	tun_queue_t *queue;
+	int i, queues;
 
 	INIT(this,
 		.public = {
@@ -344,6 +421,11 @@ kernel_libipsec_router_t *kernel_libipsec_router_create()
 	}
 
 	this->tun.fd = this->tun.tun->get_fd(this->tun.tun);
+	queues = this->tun.tun->get_queues(this->tun.tun);
+	if (queues > 1)
+	{	/* each queue of the default TUN device gets its own thread */
+		this->tun.fd = -1;
+	}
 
 	this->tuns = hashtable_create((hashtable_hash_t)tun_entry_hash,
 								  (hashtable_equals_t)tun_entry_equals, 4);
@@ -359,6 +441,16 @@ kernel_libipsec_router_t *kernel_libipsec_router_create()
 	lib->processor->queue_job(lib->processor,
 			(job_t*)callback_job_create((callback_job_cb_t)handle_plain, this,
 									NULL, (callback_job_cancel_t)return_false));
+	for (i = 0; queues > 1 && i < queues; i++)
+	{
+		INIT(queue,
+			.tun = this->tun.tun,
+			.queue = i,
+		);
+		lib->processor->queue_job(lib->processor,
+			(job_t*)callback_job_create((callback_job_cb_t)handle_queue, queue,
+									free, (callback_job_cancel_t)return_false));
+	}
 
 	router = &this->public;
 	return &this->public;
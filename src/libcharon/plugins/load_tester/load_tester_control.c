@@ -24,13 +24,37 @@
 
 #include <daemon.h>
 #include <collections/hashtable.h>
-#include <threading/thread.h>
 #include <threading/mutex.h>
 #include <threading/condvar.h>
 #include <processing/jobs/callback_job.h>
+#include <sa/ikev2/tasks/ike_dpd.h>
 
 typedef struct private_load_tester_control_t private_load_tester_control_t;
 typedef struct init_listener_t init_listener_t;
+typedef struct storm_listener_t storm_listener_t;
+typedef struct storm_job_t storm_job_t;
+typedef enum storm_t storm_t;
+
+/**
+ * Events triggered on all established load-test IKE_SAs at once
+ */
+enum storm_t {
+	/** rekey all CHILD_SAs */
+	STORM_REKEY_CHILD,
+	/** rekey all IKE_SAs */
+	STORM_REKEY_IKE,
+	/** do a liveness check on all IKE_SAs */
+	STORM_DPD,
+	/** delete all IKE_SAs */
+	STORM_DELETE,
+};
+
+ENUM(storm_names, STORM_REKEY_CHILD, STORM_DELETE,
+	"rekey-child",
+	"rekey-ike",
+	"dpd",
+	"delete",
+);
 
 /**
  * Private data of an load_tester_control_t object.
@@ -84,6 +108,108 @@ struct init_listener_t {
 	condvar_t *condvar;
 };
 
+/**
+ * Listener to follow the progress of a storm
+ */
+struct storm_listener_t {
+
+	/**
+	 * implements listener_t
+	 */
+	listener_t listener;
+
+	/**
+	 * Output stream to log to
+	 */
+	FILE *stream;
+
+	/**
+	 * Triggered event
+	 */
+	storm_t storm;
+
+	/**
+	 * IKE_SAs in the storm by unique ID, with the number of pending events
+	 */
+	hashtable_t *pending;
+
+	/**
+	 * Number of jobs that have been executed to trigger the event
+	 */
+	u_int executed;
+
+	/**
+	 * Number of IKE_SAs the event could not be triggered for
+	 */
+	u_int failed;
+
+	/**
+	 * Number of IKE_SAs that completed the event
+	 */
+	u_int completed;
+
+	/**
+	 * Number of IKE_SAs that got destroyed before completing the event
+	 */
+	u_int aborted;
+
+	/**
+	 * Number of messages sent
+	 */
+	u_int sent;
+
+	/**
+	 * Number of messages received
+	 */
+	u_int received;
+
+	/**
+	 * Number of retransmitted messages
+	 */
+	u_int retransmits;
+
+	/**
+	 * Time the last IKE_SA completed
+	 */
+	timeval_t end;
+
+	/**
+	 * Mutex to lock IKE_SA table and counters
+	 */
+	mutex_t *mutex;
+
+	/**
+	 * Condvar to wait for completion
+	 */
+	condvar_t *condvar;
+
+	/**
+	 * TRUE once the storm has been reported, stream must not be used anymore
+	 */
+	bool done;
+
+	/**
+	 * Reference count, held by storm() and each queued trigger job
+	 */
+	refcount_t ref;
+};
+
+/**
+ * Job data to trigger a storm event on a single IKE_SA
+ */
+struct storm_job_t {
+
+	/**
+	 * Listener of the storm
+	 */
+	storm_listener_t *listener;
+
+	/**
+	 * Unique ID of the IKE_SA
+	 */
+	u_int32_t id;
+};
+
 /**
  * Open load-tester listening socket
  */
@@ -217,24 +343,13 @@ static bool initiate_cb(init_listener_t *this, debug_t group, level_t level,
 /**
  * Initiate load-test, write progress to stream
  */
-static job_requeue_t initiate(FILE *stream)
+static void initiate(FILE *stream, u_int count, u_int delay)
 {
 	init_listener_t *listener;
 	enumerator_t *enumerator;
 	peer_cfg_t *peer_cfg;
 	child_cfg_t *child_cfg;
-	u_int i, count, failed = 0, delay = 0;
-	char buf[16] = "";
-
-	fflush(stream);
-	if (fgets(buf, sizeof(buf), stream) == NULL)
-	{
-		return JOB_REQUEUE_NONE;
-	}
-	if (sscanf(buf, "%u %u", &count, &delay) < 1)
-	{
-		return JOB_REQUEUE_NONE;
-	}
+	u_int i, failed = 0;
 
 	INIT(listener,
 		.listener = {
@@ -308,24 +423,411 @@ static job_requeue_t initiate(FILE *stream)
 	free(listener);
 
 	fprintf(stream, "\n");
+}
+
+/**
+ * Mark a pending event of an IKE_SA in the storm as done, mutex must be held
+ */
+static bool storm_done(storm_listener_t *this, ike_sa_t *ike_sa, bool success)
+{
+	uintptr_t id, pending;
+
+	id = ike_sa->get_unique_id(ike_sa);
+	pending = (uintptr_t)this->pending->get(this->pending, (void*)id);
+	if (!pending)
+	{
+		return FALSE;
+	}
+	if (success && --pending)
+	{
+		this->pending->put(this->pending, (void*)id, (void*)pending);
+		return FALSE;
+	}
+	this->pending->remove(this->pending, (void*)id);
+	if (success)
+	{
+		this->completed++;
+	}
+	else
+	{
+		this->aborted++;
+	}
+	time_monotonic(&this->end);
+	fprintf(this->stream, success ? "+" : "-");
+	fflush(this->stream);
+	this->condvar->signal(this->condvar);
+	return TRUE;
+}
+
+METHOD(listener_t, storm_alert, bool,
+	storm_listener_t *this, ike_sa_t *ike_sa, alert_t alert, va_list args)
+{
+	if (alert == ALERT_RETRANSMIT_SEND && ike_sa)
+	{
+		uintptr_t id;
+
+		id = ike_sa->get_unique_id(ike_sa);
+		this->mutex->lock(this->mutex);
+		if (this->pending->get(this->pending, (void*)id))
+		{
+			this->retransmits++;
+			fprintf(this->stream, "*");
+			fflush(this->stream);
+		}
+		this->mutex->unlock(this->mutex);
+	}
+	return TRUE;
+}
+
+METHOD(listener_t, storm_message, bool,
+	storm_listener_t *this, ike_sa_t *ike_sa, message_t *message,
+	bool incoming, bool plain)
+{
+	uintptr_t id;
+
+	if (plain)
+	{
+		return TRUE;
+	}
+	id = ike_sa->get_unique_id(ike_sa);
+	this->mutex->lock(this->mutex);
+	if (this->pending->get(this->pending, (void*)id))
+	{
+		if (incoming)
+		{
+			this->received++;
+			if (this->storm == STORM_DPD &&
+				!message->get_request(message) &&
+				message->get_exchange_type(message) == INFORMATIONAL)
+			{
+				storm_done(this, ike_sa, TRUE);
+			}
+		}
+		else
+		{
+			this->sent++;
+		}
+	}
+	this->mutex->unlock(this->mutex);
+	return TRUE;
+}
+
+METHOD(listener_t, storm_ike_rekey, bool,
+	storm_listener_t *this, ike_sa_t *old, ike_sa_t *new)
+{
+	if (this->storm == STORM_REKEY_IKE)
+	{
+		this->mutex->lock(this->mutex);
+		storm_done(this, old, TRUE);
+		this->mutex->unlock(this->mutex);
+	}
+	return TRUE;
+}
+
+METHOD(listener_t, storm_child_rekey, bool,
+	storm_listener_t *this, ike_sa_t *ike_sa, child_sa_t *old, child_sa_t *new)
+{
+	if (this->storm == STORM_REKEY_CHILD)
+	{
+		this->mutex->lock(this->mutex);
+		storm_done(this, ike_sa, TRUE);
+		this->mutex->unlock(this->mutex);
+	}
+	return TRUE;
+}
+
+METHOD(listener_t, storm_ike_state_change, bool,
+	storm_listener_t *this, ike_sa_t *ike_sa, ike_sa_state_t state)
+{
+	if (state == IKE_DESTROYING)
+	{
+		this->mutex->lock(this->mutex);
+		storm_done(this, ike_sa, this->storm == STORM_DELETE);
+		this->mutex->unlock(this->mutex);
+	}
+	return TRUE;
+}
+
+/**
+ * Trigger the storm event on a single IKE_SA
+ */
+static job_requeue_t trigger_storm(storm_job_t *job)
+{
+	storm_listener_t *this = job->listener;
+	enumerator_t *enumerator;
+	child_sa_t *child_sa;
+	ike_sa_t *ike_sa;
+	status_t status = FAILED;
+
+	ike_sa = charon->ike_sa_manager->checkout_by_id(charon->ike_sa_manager,
+													job->id, FALSE);
+	if (ike_sa)
+	{
+		switch (this->storm)
+		{
+			case STORM_REKEY_CHILD:
+				status = SUCCESS;
+				enumerator = ike_sa->create_child_sa_enumerator(ike_sa);
+				while (enumerator->enumerate(enumerator, &child_sa))
+				{
+					status = ike_sa->rekey_child_sa(ike_sa,
+									child_sa->get_protocol(child_sa),
+									child_sa->get_spi(child_sa, TRUE));
+					if (status != SUCCESS)
+					{
+						break;
+					}
+				}
+				enumerator->destroy(enumerator);
+				break;
+			case STORM_REKEY_IKE:
+				status = ike_sa->rekey(ike_sa);
+				break;
+			case STORM_DPD:
+				ike_sa->queue_task(ike_sa, (task_t*)ike_dpd_create(TRUE));
+				status = ike_sa->initiate(ike_sa, NULL, 0, NULL, NULL);
+				break;
+			case STORM_DELETE:
+				status = ike_sa->delete(ike_sa);
+				break;
+		}
+		if (status == DESTROY_ME)
+		{
+			charon->ike_sa_manager->checkin_and_destroy(
+											charon->ike_sa_manager, ike_sa);
+		}
+		else
+		{
+			charon->ike_sa_manager->checkin(charon->ike_sa_manager, ike_sa);
+		}
+	}
+
+	this->mutex->lock(this->mutex);
+	this->executed++;
+	if (status != SUCCESS && status != DESTROY_ME && !this->done &&
+		this->pending->remove(this->pending, (void*)(uintptr_t)job->id))
+	{
+		this->failed++;
+		fprintf(this->stream, "!");
+		fflush(this->stream);
+	}
+	this->condvar->signal(this->condvar);
+	this->mutex->unlock(this->mutex);
 
 	return JOB_REQUEUE_NONE;
 }
 
+/**
+ * Release a reference to a storm listener, destroy it with the last one
+ */
+static void storm_listener_destroy(storm_listener_t *this)
+{
+	if (ref_put(&this->ref))
+	{
+		this->pending->destroy(this->pending);
+		this->mutex->destroy(this->mutex);
+		this->condvar->destroy(this->condvar);
+		free(this);
+	}
+}
+
+/**
+ * Destroy a storm job, releasing its reference to the listener
+ */
+static void storm_job_destroy(storm_job_t *job)
+{
+	storm_listener_destroy(job->listener);
+	free(job);
+}
+
+/**
+ * Collect established load-test IKE_SAs we initiated, with the number of
+ * events to wait for on each
+ */
+static void select_ike_sas(storm_listener_t *this, u_int count)
+{
+	enumerator_t *enumerator;
+	ike_sa_t *ike_sa;
+	peer_cfg_t *peer_cfg;
+	uintptr_t id, events;
+
+	enumerator = charon->ike_sa_manager->create_enumerator(
+											charon->ike_sa_manager, TRUE);
+	while (enumerator->enumerate(enumerator, &ike_sa))
+	{
+		if (count && this->pending->get_count(this->pending) >= count)
+		{
+			break;
+		}
+		peer_cfg = ike_sa->get_peer_cfg(ike_sa);
+		if (ike_sa->get_state(ike_sa) != IKE_ESTABLISHED || !peer_cfg ||
+			!streq(peer_cfg->get_name(peer_cfg), "load-test") ||
+			!ike_sa->has_condition(ike_sa, COND_ORIGINAL_INITIATOR))
+		{
+			continue;
+		}
+		if (this->storm == STORM_DPD &&
+			ike_sa->get_version(ike_sa) != IKEV2)
+		{
+			continue;
+		}
+		events = 1;
+		if (this->storm == STORM_REKEY_CHILD)
+		{
+			events = ike_sa->get_child_count(ike_sa);
+			if (!events)
+			{
+				continue;
+			}
+		}
+		id = ike_sa->get_unique_id(ike_sa);
+		this->pending->put(this->pending, (void*)id, (void*)events);
+	}
+	enumerator->destroy(enumerator);
+}
+
+/**
+ * Trigger an event on established load-test IKE_SAs at once, write progress
+ * and statistics to stream
+ */
+static void storm(FILE *stream, storm_t storm, u_int count)
+{
+	storm_listener_t *listener;
+	enumerator_t *enumerator;
+	storm_job_t *job;
+	timeval_t start, deadline;
+	uintptr_t id;
+	u_int total, ms, timeout, stragglers;
+
+	INIT(listener,
+		.listener = {
+			.alert = _storm_alert,
+			.message = _storm_message,
+			.ike_rekey = _storm_ike_rekey,
+			.child_rekey = _storm_child_rekey,
+			.ike_state_change = _storm_ike_state_change,
+		},
+		.stream = stream,
+		.storm = storm,
+		.pending = hashtable_create((void*)hash, (void*)equals, 1024),
+		.mutex = mutex_create(MUTEX_TYPE_DEFAULT),
+		.condvar = condvar_create(CONDVAR_TYPE_DEFAULT),
+		.ref = 1,
+	);
+
+	timeout = lib->settings->get_time(lib->settings,
+						"%s.plugins.load-tester.storm_timeout", 60, charon->name);
+
+	select_ike_sas(listener, count);
+	total = listener->pending->get_count(listener->pending);
+
+	charon->bus->add_listener(charon->bus, &listener->listener);
+	time_monotonic(&start);
+	listener->end = start;
+	deadline = start;
+	deadline.tv_sec += timeout;
+
+	listener->mutex->lock(listener->mutex);
+	enumerator = listener->pending->create_enumerator(listener->pending);
+	while (enumerator->enumerate(enumerator, &id, NULL))
+	{
+		INIT(job,
+			.listener = listener,
+			.id = id,
+		);
+		ref_get(&listener->ref);
+		lib->processor->queue_job(lib->processor,
+			(job_t*)callback_job_create((callback_job_cb_t)trigger_storm,
+						job, (callback_job_cleanup_t)storm_job_destroy, NULL));
+		fprintf(stream, ".");
+	}
+	enumerator->destroy(enumerator);
+	fflush(stream);
+
+	while (listener->executed < total ||
+		   listener->pending->get_count(listener->pending))
+	{
+		if (listener->condvar->timed_wait_abs(listener->condvar,
+											  listener->mutex, deadline))
+		{
+			break;
+		}
+	}
+	/* IKE_SAs that did not complete before the deadline count as failed */
+	stragglers = listener->pending->get_count(listener->pending);
+	enumerator = listener->pending->create_enumerator(listener->pending);
+	while (enumerator->enumerate(enumerator, &id, NULL))
+	{
+		listener->pending->remove_at(listener->pending, enumerator);
+	}
+	enumerator->destroy(enumerator);
+	listener->failed += stragglers;
+	listener->done = TRUE;
+	listener->mutex->unlock(listener->mutex);
+
+	charon->bus->remove_listener(charon->bus, &listener->listener);
+
+	if (stragglers)
+	{
+		DBG1(DBG_CFG, "load-test: %N storm timed out after %us, %u IKE_SAs "
+			 "did not complete", storm_names, storm, timeout, stragglers);
+	}
+
+	ms = (listener->end.tv_sec - start.tv_sec) * 1000 +
+		 (listener->end.tv_usec - start.tv_usec) / 1000;
+	fprintf(stream, "\n%N: %u of %u IKE_SAs completed in %u ms, %u failed, "
+			"%u aborted, %u messages sent, %u received, %u retransmits\n",
+			storm_names, storm, listener->completed, total, ms,
+			listener->failed, listener->aborted, listener->sent,
+			listener->received, listener->retransmits);
+	DBG1(DBG_CFG, "load-test: %N storm on %u IKE_SAs completed in %u ms",
+		 storm_names, storm, total, ms);
+
+	storm_listener_destroy(listener);
+}
+
+/**
+ * Read a load-tester command from stream and process it
+ */
+static job_requeue_t process(FILE *stream)
+{
+	u_int count = 0, delay = 0;
+	char buf[32] = "", name[16];
+	int type;
+
+	fflush(stream);
+	if (fgets(buf, sizeof(buf), stream) == NULL)
+	{
+		return JOB_REQUEUE_NONE;
+	}
+	if (sscanf(buf, "%u %u", &count, &delay) >= 1)
+	{
+		initiate(stream, count, delay);
+	}
+	else if (sscanf(buf, "%15s %u", name, &count) >= 1)
+	{
+		type = enum_from_name(storm_names, name);
+		if (type == -1)
+		{
+			fprintf(stream, "unknown load-test command '%s'\n", name);
+			return JOB_REQUEUE_NONE;
+		}
+		storm(stream, type, count);
+	}
+	return JOB_REQUEUE_NONE;
+}
+
 /**
  * Accept load-tester control connections, dispatch
  */
-static job_requeue_t receive(private_load_tester_control_t *this)
+static bool on_accept(private_load_tester_control_t *this, int fd,
+					  watcher_event_t event)
 {
 	struct sockaddr_un addr;
-	int fd, len = sizeof(addr);
-	bool oldstate;
+	int len = sizeof(addr);
 	FILE *stream;
 
-	oldstate = thread_cancelability(TRUE);
-	fd = accept(this->socket, (struct sockaddr*)&addr, &len);
-	thread_cancelability(oldstate);
-
+	fd = accept(fd, (struct sockaddr*)&addr, &len);
 	if (fd != -1)
 	{
 		stream = fdopen(fd, "r+");
@@ -334,7 +836,7 @@ static job_requeue_t receive(private_load_tester_control_t *this)
 			DBG1(DBG_CFG, "client connected");
 			lib->processor->queue_job(lib->processor,
 				(job_t*)callback_job_create_with_prio(
-					(callback_job_cb_t)initiate, stream, (void*)fclose,
+					(callback_job_cb_t)process, stream, (void*)fclose,
 					(callback_job_cancel_t)return_false, JOB_PRIO_CRITICAL));
 		}
 		else
@@ -342,7 +844,7 @@ static job_requeue_t receive(private_load_tester_control_t *this)
 			close(fd);
 		}
 	}
-	return JOB_REQUEUE_FAIR;
+	return TRUE;
 }
 
 METHOD(load_tester_control_t, destroy, void,
@@ -350,6 +852,7 @@ METHOD(load_tester_control_t, destroy, void,
 {
 	if (this->socket != -1)
 	{
+		lib->watcher->remove(lib->watcher, this->socket);
 		close(this->socket);
 	}
 	free(this);
@@ -370,9 +873,8 @@ load_tester_control_t *load_tester_control_create()
 
 	if (open_socket(this))
 	{
-		lib->processor->queue_job(lib->processor, (job_t*)
-			callback_job_create_with_prio((callback_job_cb_t)receive, this, NULL,
-						(callback_job_cancel_t)return_false, JOB_PRIO_CRITICAL));
+		lib->watcher->add(lib->watcher, this->socket, WATCHER_READ,
+						  (watcher_cb_t)on_accept, this);
 	}
 	else
 	{
@@ -16,11 +16,90 @@
 #include "load_tester_listener.h"
 
 #include <signal.h>
+#include <errno.h>
 
 #include <daemon.h>
+#include <threading/mutex.h>
+#include <collections/hashtable.h>
 #include <processing/jobs/delete_ike_sa_job.h>
 
+/**
+ * Number of linear sub-buckets per power of two in latency histograms
+ */
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+
+/**
+ * Number of buckets in a latency histogram, covering all 64-bit values
+ */
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
 typedef struct private_load_tester_listener_t private_load_tester_listener_t;
+typedef struct histogram_t histogram_t;
+typedef struct timing_t timing_t;
+typedef enum phase_t phase_t;
+
+/**
+ * Phases of an IKE_SA setup we measure the latency for, starting at the time
+ * the first message has been sent
+ */
+enum phase_t {
+	/** response to the first message (IKE_SA_INIT) received */
+	PHASE_INIT,
+	/** IKE_SA established */
+	PHASE_AUTH,
+	/** CHILD_SA installed */
+	PHASE_CHILD,
+	/** number of phases */
+	PHASE_MAX,
+};
+
+/**
+ * Names of the phases, as used in exported statistics
+ */
+static char *phase_names[] = {
+	"init",
+	"auth",
+	"child",
+};
+
+/**
+ * Log-linear histogram of latencies in microseconds, with a relative error
+ * of at most 1/HISTOGRAM_SUB_BUCKETS
+ */
+struct histogram_t {
+
+	/**
+	 * Number of recorded values
+	 */
+	u_int count;
+
+	/**
+	 * Largest recorded value
+	 */
+	u_int64_t max;
+
+	/**
+	 * Number of values per bucket
+	 */
+	u_int buckets[HISTOGRAM_BUCKETS];
+};
+
+/**
+ * Timing of an IKE_SA we initiated
+ */
+struct timing_t {
+
+	/**
+	 * Time the first message has been sent
+	 */
+	timeval_t start;
+
+	/**
+	 * Phases completed
+	 */
+	bool done[PHASE_MAX];
+};
 
 /**
  * Private data of an load_tester_listener_t object
@@ -55,8 +134,352 @@ struct private_load_tester_listener_t {
 	 * Configuration backend
 	 */
 	load_tester_config_t *config;
+
+	/**
+	 * Time the load test started
+	 */
+	timeval_t start;
+
+	/**
+	 * Statistics have been logged on completion
+	 */
+	bool logged;
+
+	/**
+	 * Timings of IKE_SAs in setup, by unique ID
+	 */
+	hashtable_t *timings;
+
+	/**
+	 * Latency histograms of the current interval
+	 */
+	histogram_t interval[PHASE_MAX];
+
+	/**
+	 * Latency histograms since the start of the load test
+	 */
+	histogram_t total[PHASE_MAX];
+
+	/**
+	 * Number of IKE_SAs we initiated that got established in this interval
+	 */
+	u_int interval_established;
+
+	/**
+	 * Number of retransmitted messages in this interval
+	 */
+	u_int interval_retransmits;
+
+	/**
+	 * Number of retransmitted messages since the start of the load test
+	 */
+	u_int retransmits;
+
+	/**
+	 * File to export statistics to, if any
+	 */
+	FILE *stats;
+
+	/**
+	 * Export statistics as JSON instead of CSV
+	 */
+	bool json;
+
+	/**
+	 * Interval to export statistics in, in ms
+	 */
+	u_int stats_interval;
+
+	/**
+	 * Time statistics have been exported last
+	 */
+	timeval_t exported;
+
+	/**
+	 * Mutex to lock timings and statistics
+	 */
+	mutex_t *mutex;
 };
 
+/**
+ * Get the histogram bucket for a value
+ */
+static u_int bucket_index(u_int64_t value)
+{
+	u_int shift;
+
+	if (value < 2 * HISTOGRAM_SUB_BUCKETS)
+	{
+		return value;
+	}
+	shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BITS;
+	return (shift + 1) * HISTOGRAM_SUB_BUCKETS +
+				((value >> shift) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+/**
+ * Get the largest value that falls into a histogram bucket
+ */
+static u_int64_t bucket_value(u_int index)
+{
+	u_int shift;
+
+	if (index < 2 * HISTOGRAM_SUB_BUCKETS)
+	{
+		return index;
+	}
+	shift = index / HISTOGRAM_SUB_BUCKETS - 1;
+	return ((u_int64_t)(HISTOGRAM_SUB_BUCKETS +
+						index % HISTOGRAM_SUB_BUCKETS + 1) << shift) - 1;
+}
+
+/**
+ * Record a value in a histogram
+ */
+static void histogram_add(histogram_t *this, u_int64_t value)
+{
+	this->buckets[bucket_index(value)]++;
+	this->max = max(this->max, value);
+	this->count++;
+}
+
+/**
+ * Get the value below which the given permille of recorded values fall
+ */
+static u_int64_t histogram_percentile(histogram_t *this, u_int permille)
+{
+	u_int i, target, sum = 0;
+
+	target = ((u_int64_t)this->count * permille + 999) / 1000;
+	for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+	{
+		sum += this->buckets[i];
+		if (sum >= max(target, 1))
+		{
+			return min(bucket_value(i), this->max);
+		}
+	}
+	return this->max;
+}
+
+/**
+ * Microseconds elapsed between two timestamps
+ */
+static u_int64_t elapsed_us(timeval_t *from, timeval_t *to)
+{
+	return (u_int64_t)(to->tv_sec - from->tv_sec) * 1000000 +
+		   to->tv_usec - from->tv_usec;
+}
+
+/**
+ * Write the statistics of a histogram as CSV columns or JSON object
+ */
+static void export_histogram(private_load_tester_listener_t *this,
+							 histogram_t *histogram, phase_t phase)
+{
+	double p50, p90, p99, max;
+
+	p50 = histogram_percentile(histogram, 500) / 1000.0;
+	p90 = histogram_percentile(histogram, 900) / 1000.0;
+	p99 = histogram_percentile(histogram, 990) / 1000.0;
+	max = histogram->max / 1000.0;
+	if (this->json)
+	{
+		fprintf(this->stats, ",\"%s\":{\"count\":%u,\"p50\":%.3f,"
+				"\"p90\":%.3f,\"p99\":%.3f,\"max\":%.3f}",
+				phase_names[phase], histogram->count, p50, p90, p99, max);
+	}
+	else
+	{
+		fprintf(this->stats, ",%u,%.3f,%.3f,%.3f,%.3f",
+				histogram->count, p50, p90, p99, max);
+	}
+}
+
+/**
+ * Export the statistics of the current interval, if it is over, and start a
+ * new interval
+ */
+static void export_stats(private_load_tester_listener_t *this, timeval_t *now,
+						 bool force)
+{
+	u_int64_t us;
+	phase_t phase;
+
+	if (!this->stats)
+	{
+		return;
+	}
+	us = elapsed_us(&this->exported, now);
+	if (!force && us < this->stats_interval * 1000ULL)
+	{
+		return;
+	}
+	if (this->json)
+	{
+		fprintf(this->stats, "{\"time\":%.3f,\"established\":%u,"
+				"\"rate\":%.1f,\"retransmits\":%u",
+				elapsed_us(&this->start, now) / 1000000.0,
+				this->interval_established,
+				us ? this->interval_established * 1000000.0 / us : 0.0,
+				this->interval_retransmits);
+	}
+	else
+	{
+		fprintf(this->stats, "%.3f,%u,%.1f,%u",
+				elapsed_us(&this->start, now) / 1000000.0,
+				this->interval_established,
+				us ? this->interval_established * 1000000.0 / us : 0.0,
+				this->interval_retransmits);
+	}
+	for (phase = 0; phase < PHASE_MAX; phase++)
+	{
+		export_histogram(this, &this->interval[phase], phase);
+	}
+	fprintf(this->stats, this->json ? "}\n" : "\n");
+	fflush(this->stats);
+
+	memset(this->interval, 0, sizeof(this->interval));
+	this->interval_established = 0;
+	this->interval_retransmits = 0;
+	this->exported = *now;
+}
+
+/**
+ * Record the completion of a setup phase of an IKE_SA we initiated,
+ * mutex must be held
+ */
+static void record_phase(private_load_tester_listener_t *this,
+						 ike_sa_t *ike_sa, phase_t phase)
+{
+	uintptr_t key = ike_sa->get_unique_id(ike_sa);
+	timing_t *timing;
+	timeval_t now;
+	u_int64_t us;
+
+	time_monotonic(&now);
+	timing = this->timings->get(this->timings, (void*)key);
+	if (timing && !timing->done[phase])
+	{
+		timing->done[phase] = TRUE;
+		us = elapsed_us(&timing->start, &now);
+		histogram_add(&this->interval[phase], us);
+		histogram_add(&this->total[phase], us);
+		if (timing->done[PHASE_AUTH] && timing->done[PHASE_CHILD])
+		{
+			this->timings->remove(this->timings, (void*)key);
+			free(timing);
+		}
+	}
+	export_stats(this, &now, FALSE);
+}
+
+/**
+ * Log setup rate and Diffie-Hellman pool statistics
+ */
+static void log_stats(private_load_tester_listener_t *this)
+{
+	enumerator_t *enumerator;
+	diffie_hellman_group_t group;
+	u_int hits, misses, available, ms, i;
+	timeval_t now;
+
+	this->logged = TRUE;
+	time_monotonic(&now);
+	ms = (now.tv_sec - this->start.tv_sec) * 1000 +
+		 (now.tv_usec - this->start.tv_usec) / 1000;
+	DBG1(DBG_CFG, "load-test: %u IKE_SAs established in %u ms (%u/s)",
+		 this->established, ms, ms ? this->established * 1000 / ms : 0);
+
+	enumerator = lib->dh_pool->create_stats_enumerator(lib->dh_pool);
+	while (enumerator->enumerate(enumerator, &group, &hits, &misses,
+								 &available))
+	{
+		DBG1(DBG_CFG, "load-test: DH pool %N: %u hits, %u misses, "
+			 "%u available", diffie_hellman_group_names, group,
+			 hits, misses, available);
+	}
+	enumerator->destroy(enumerator);
+
+	this->mutex->lock(this->mutex);
+	for (i = 0; i < PHASE_MAX; i++)
+	{
+		histogram_t *histogram = &this->total[i];
+
+		if (histogram->count)
+		{
+			DBG1(DBG_CFG, "load-test: %s latency of %u IKE_SAs: p50 %.3f ms, "
+				 "p90 %.3f ms, p99 %.3f ms, max %.3f ms", phase_names[i],
+				 histogram->count, histogram_percentile(histogram, 500) / 1000.0,
+				 histogram_percentile(histogram, 900) / 1000.0,
+				 histogram_percentile(histogram, 990) / 1000.0,
+				 histogram->max / 1000.0);
+		}
+	}
+	DBG1(DBG_CFG, "load-test: %u retransmits", this->retransmits);
+	export_stats(this, &now, TRUE);
+	this->mutex->unlock(this->mutex);
+}
+
+METHOD(listener_t, message_hook, bool,
+	private_load_tester_listener_t *this, ike_sa_t *ike_sa, message_t *message,
+	bool incoming, bool plain)
+{
+	ike_sa_id_t *id = ike_sa->get_id(ike_sa);
+	uintptr_t key = ike_sa->get_unique_id(ike_sa);
+	timing_t *timing;
+
+	/* use the encoded messages, as they get sent and received */
+	if (plain || !id->is_initiator(id))
+	{
+		return TRUE;
+	}
+	this->mutex->lock(this->mutex);
+	timing = this->timings->get(this->timings, (void*)key);
+	if (!incoming)
+	{
+		if (!timing && ike_sa->get_state(ike_sa) == IKE_CONNECTING)
+		{
+			INIT(timing);
+			time_monotonic(&timing->start);
+			this->timings->put(this->timings, (void*)key, timing);
+		}
+	}
+	else if (timing)
+	{
+		record_phase(this, ike_sa, PHASE_INIT);
+	}
+	this->mutex->unlock(this->mutex);
+	return TRUE;
+}
+
+METHOD(listener_t, alert, bool,
+	private_load_tester_listener_t *this, ike_sa_t *ike_sa,
+	alert_t alert, va_list args)
+{
+	if (alert == ALERT_RETRANSMIT_SEND)
+	{
+		this->mutex->lock(this->mutex);
+		this->retransmits++;
+		this->interval_retransmits++;
+		this->mutex->unlock(this->mutex);
+	}
+	return TRUE;
+}
+
+METHOD(listener_t, child_updown, bool,
+	private_load_tester_listener_t *this, ike_sa_t *ike_sa,
+	child_sa_t *child_sa, bool up)
+{
+	if (up)
+	{
+		this->mutex->lock(this->mutex);
+		record_phase(this, ike_sa, PHASE_CHILD);
+		this->mutex->unlock(this->mutex);
+	}
+	return TRUE;
+}
+
 METHOD(listener_t, ike_updown, bool,
 	private_load_tester_listener_t *this, ike_sa_t *ike_sa, bool up)
 {
@@ -74,9 +497,15 @@ METHOD(listener_t, ike_updown, bool,
 
 		if (id->is_initiator(id))
 		{
+			this->mutex->lock(this->mutex);
+			this->interval_established++;
+			record_phase(this, ike_sa, PHASE_AUTH);
+			this->mutex->unlock(this->mutex);
+
 			if (this->shutdown_on == this->established)
 			{
 				DBG1(DBG_CFG, "load-test complete, raising SIGTERM");
+				log_stats(this);
 				kill(0, SIGTERM);
 			}
 		}
@@ -93,6 +522,12 @@ METHOD(listener_t, ike_state_change, bool,
 {
 	if (state == IKE_DESTROYING)
 	{
+		uintptr_t key = ike_sa->get_unique_id(ike_sa);
+
+		this->mutex->lock(this->mutex);
+		free(this->timings->remove(this->timings, (void*)key));
+		this->mutex->unlock(this->mutex);
+
 		this->config->delete_ip(this->config, ike_sa->get_my_host(ike_sa));
 	}
 	return TRUE;
@@ -107,19 +542,58 @@ METHOD(load_tester_listener_t, get_established, u_int,
 METHOD(load_tester_listener_t, destroy, void,
 	private_load_tester_listener_t *this)
 {
+	enumerator_t *enumerator;
+	timing_t *timing;
+
+	if (!this->logged)
+	{
+		log_stats(this);
+	}
+	enumerator = this->timings->create_enumerator(this->timings);
+	while (enumerator->enumerate(enumerator, NULL, &timing))
+	{
+		free(timing);
+	}
+	enumerator->destroy(enumerator);
+	this->timings->destroy(this->timings);
+	if (this->stats)
+	{
+		fclose(this->stats);
+	}
+	this->mutex->destroy(this->mutex);
 	free(this);
 }
 
+/**
+ * Hashtable hash function for IKE_SA unique IDs
+ */
+static u_int hash(uintptr_t key)
+{
+	return chunk_hash(chunk_from_thing(key));
+}
+
+/**
+ * Hashtable equals function for IKE_SA unique IDs
+ */
+static bool equals(uintptr_t a, uintptr_t b)
+{
+	return a == b;
+}
+
 load_tester_listener_t *load_tester_listener_create(u_int shutdown_on,
 													load_tester_config_t *config)
 {
 	private_load_tester_listener_t *this;
+	char *stats_file;
 
 	INIT(this,
 		.public = {
 			.listener = {
 				.ike_updown = _ike_updown,
 				.ike_state_change = _ike_state_change,
+				.child_updown = _child_updown,
+				.message = _message_hook,
+				.alert = _alert,
 			},
 			.get_established = _get_established,
 			.destroy = _destroy,
@@ -129,7 +603,44 @@ load_tester_listener_t *load_tester_listener_create(u_int shutdown_on,
 					charon->name),
 		.shutdown_on = shutdown_on,
 		.config = config,
+		.timings = hashtable_create((hashtable_hash_t)hash,
+									(hashtable_equals_t)equals, 1024),
+		.json = streq(lib->settings->get_str(lib->settings,
+					"%s.plugins.load-tester.stats_format", "csv",
+					charon->name), "json"),
+		.stats_interval = 1000 * lib->settings->get_int(lib->settings,
+					"%s.plugins.load-tester.stats_interval", 1, charon->name),
+		.mutex = mutex_create(MUTEX_TYPE_DEFAULT),
 	);
 
+	time_monotonic(&this->start);
+	this->exported = this->start;
+
+	stats_file = lib->settings->get_str(lib->settings,
+					"%s.plugins.load-tester.stats_file", NULL, charon->name);
+	if (stats_file)
+	{
+		this->stats = fopen(stats_file, "w");
+		if (!this->stats)
+		{
+			DBG1(DBG_CFG, "opening load-test statistics file '%s' failed: %s",
+				 stats_file, strerror(errno));
+		}
+		else if (!this->json)
+		{
+			phase_t phase;
+
+			fprintf(this->stats, "time,established,rate,retransmits");
+			for (phase = 0; phase < PHASE_MAX; phase++)
+			{
+				char *name = phase_names[phase];
+
+				fprintf(this->stats, ",%s_count,%s_p50,%s_p90,%s_p99,%s_max",
+						name, name, name, name, name);
+			}
+			fprintf(this->stats, "\n");
+		}
+	}
+
 	return &this->public;
 }
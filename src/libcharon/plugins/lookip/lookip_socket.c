@@ -23,10 +23,8 @@
 #include <errno.h>
 
 #include <daemon.h>
-#include <threading/thread.h>
 #include <threading/mutex.h>
 #include <collections/linked_list.h>
-#include <processing/jobs/callback_job.h>
 
 #include "lookip_msg.h"
 
@@ -268,57 +266,6 @@ static bool subscribed(private_lookip_socket_t *this, int fd)
 	return subscribed;
 }
 
-/**
- * Create a fd_set from all bound sockets
- */
-static int build_fds(private_lookip_socket_t *this, fd_set *fds)
-{
-	enumerator_t *enumerator;
-	uintptr_t fd;
-	int maxfd;
-
-	FD_ZERO(fds);
-	FD_SET(this->socket, fds);
-	maxfd = this->socket;
-
-	this->mutex->lock(this->mutex);
-	enumerator = this->connected->create_enumerator(this->connected);
-	while (enumerator->enumerate(enumerator, &fd))
-	{
-		FD_SET(fd, fds);
-		maxfd = max(maxfd, fd);
-	}
-	enumerator->destroy(enumerator);
-	this->mutex->unlock(this->mutex);
-
-	return maxfd + 1;
-}
-
-/**
- * Find the socket select()ed
- */
-static int scan_fds(private_lookip_socket_t *this, fd_set *fds)
-{
-	enumerator_t *enumerator;
-	uintptr_t fd;
-	int selected = -1;
-
-	this->mutex->lock(this->mutex);
-	enumerator = this->connected->create_enumerator(this->connected);
-	while (enumerator->enumerate(enumerator, &fd))
-	{
-		if (FD_ISSET(fd, fds))
-		{
-			selected = fd;
-			break;
-		}
-	}
-	enumerator->destroy(enumerator);
-	this->mutex->unlock(this->mutex);
-
-	return selected;
-}
-
 /**
  * Dispatch from a socket, return TRUE to end communication
  */
@@ -360,69 +307,69 @@ static bool dispatch(private_lookip_socket_t *this, int fd)
 }
 
 /**
- * Accept client connections, dispatch
+ * Read a request from a connected client, dispatch
  */
-static job_requeue_t receive(private_lookip_socket_t *this)
+static bool on_read(private_lookip_socket_t *this, int fd,
+					watcher_event_t event)
 {
-	struct sockaddr_un addr;
-	int fd, maxfd, len;
-	bool oldstate;
-	fd_set fds;
-
-	while (TRUE)
+	if (!dispatch(this, fd))
 	{
-		maxfd = build_fds(this, &fds);
-		oldstate = thread_cancelability(TRUE);
-		if (select(maxfd, &fds, NULL, NULL, NULL) <= 0)
-		{
-			thread_cancelability(oldstate);
-			DBG1(DBG_CFG, "selecting lookip sockets failed: %s",
-				 strerror(errno));
-			break;
-		}
-		thread_cancelability(oldstate);
+		return TRUE;
+	}
+	this->mutex->lock(this->mutex);
+	this->connected->remove(this->connected, (void*)(uintptr_t)fd, NULL);
+	this->mutex->unlock(this->mutex);
+	if (!subscribed(this, fd))
+	{
+		close(fd);
+	}
+	return FALSE;
+}
 
-		if (FD_ISSET(this->socket, &fds))
-		{	/* new connection, accept() */
-			len = sizeof(addr);
-			fd = accept(this->socket, (struct sockaddr*)&addr, &len);
-			if (fd != -1)
-			{
-				this->mutex->lock(this->mutex);
-				this->connected->insert_last(this->connected,
-											 (void*)(uintptr_t)fd);
-				this->mutex->unlock(this->mutex);
-			}
-			else
-			{
-				DBG1(DBG_CFG, "accepting lookip connection failed: %s",
-					 strerror(errno));
-			}
-			continue;
-		}
+/**
+ * Accept client connections, watch them for requests
+ */
+static bool on_accept(private_lookip_socket_t *this, int fd,
+					  watcher_event_t event)
+{
+	struct sockaddr_un addr;
+	int len;
 
-		fd = scan_fds(this, &fds);
-		if (fd == -1)
-		{
-			continue;
-		}
-		if (dispatch(this, fd))
-		{
-			this->mutex->lock(this->mutex);
-			this->connected->remove(this->connected, (void*)(uintptr_t)fd, NULL);
-			this->mutex->unlock(this->mutex);
-			if (!subscribed(this, fd))
-			{
-				close(fd);
-			}
-		}
+	len = sizeof(addr);
+	fd = accept(fd, (struct sockaddr*)&addr, &len);
+	if (fd == -1)
+	{
+		DBG1(DBG_CFG, "accepting lookip connection failed: %s",
+			 strerror(errno));
+		return TRUE;
 	}
-	return JOB_REQUEUE_FAIR;
+	this->mutex->lock(this->mutex);
+	this->connected->insert_last(this->connected, (void*)(uintptr_t)fd);
+	this->mutex->unlock(this->mutex);
+
+	lib->watcher->add(lib->watcher, fd, WATCHER_READ,
+					  (watcher_cb_t)on_read, this);
+	return TRUE;
 }
 
 METHOD(lookip_socket_t, destroy, void,
 	private_lookip_socket_t *this)
 {
+	uintptr_t fd;
+
+	lib->watcher->remove(lib->watcher, this->socket);
+	while (TRUE)
+	{
+		this->mutex->lock(this->mutex);
+		if (this->connected->remove_first(this->connected,
+										  (void**)&fd) != SUCCESS)
+		{
+			this->mutex->unlock(this->mutex);
+			break;
+		}
+		this->mutex->unlock(this->mutex);
+		lib->watcher->remove(lib->watcher, fd);
+	}
 	this->registered->destroy_function(this->registered, (void*)entry_destroy);
 	this->connected->destroy(this->connected);
 	this->mutex->destroy(this->mutex);
@@ -453,9 +400,8 @@ lookip_socket_t *lookip_socket_create(lookip_listener_t *listener)
 		return NULL;
 	}
 
-	lib->processor->queue_job(lib->processor,
-		(job_t*)callback_job_create_with_prio((callback_job_cb_t)receive, this,
-				NULL, (callback_job_cancel_t)return_false, JOB_PRIO_CRITICAL));
+	lib->watcher->add(lib->watcher, this->socket, WATCHER_READ,
+					  (watcher_cb_t)on_accept, this);
 
 	return &this->public;
 }
@@ -30,6 +30,9 @@
 #include <library.h>
 #include <daemon.h>
 #include <threading/thread.h>
+#include <threading/mutex.h>
+#include <threading/condvar.h>
+#include <collections/linked_list.h>
 #include <processing/jobs/callback_job.h>
 
 
@@ -49,8 +52,59 @@ struct private_smp_t {
 	 * XML unix socket fd
 	 */
 	int socket;
+
+	/**
+	 * Accepted connections, as fd cast to void*
+	 */
+	linked_list_t *connections;
+
+	/**
+	 * Mutex to lock connections, running and closing
+	 */
+	mutex_t *mutex;
+
+	/**
+	 * Condvar to signal completion of a request job
+	 */
+	condvar_t *condvar;
+
+	/**
+	 * Number of request jobs currently using a connection
+	 */
+	u_int running;
+
+	/**
+	 * Plugin is getting destroyed, don't use connections anymore
+	 */
+	bool closing;
+
+	/**
+	 * Reference count, held by the plugin and each queued request job
+	 */
+	refcount_t ref;
 };
 
+/**
+ * A request read from a connection, processed in a job
+ */
+typedef struct {
+
+	/**
+	 * Plugin the request belongs to
+	 */
+	private_smp_t *this;
+
+	/**
+	 * Connection the request was read from
+	 */
+	int fd;
+
+	/**
+	 * Request data
+	 */
+	chunk_t data;
+} request_job_t;
+
 ENUM(ike_sa_state_lower_names, IKE_CREATED, IKE_DELETING,
 	"created",
 	"connecting",
@@ -222,6 +276,10 @@ static void request_query_ikesa(xmlTextReaderPtr reader, xmlTextWriterPtr writer
 		xmlTextWriterWriteElement(writer, "role",
 							id->is_initiator(id) ? "initiator" : "responder");
 		xmlTextWriterWriteElement(writer, "peerconfig", ike_sa->get_name(ike_sa));
+		xmlTextWriterWriteFormatElement(writer, "retransmits", "%u",
+							ike_sa->get_statistic(ike_sa, STAT_RETRANSMIT));
+		xmlTextWriterWriteFormatElement(writer, "duplicates", "%u",
+							ike_sa->get_statistic(ike_sa, STAT_DUPLICATE));
 
 		/* <local> */
 		local = ike_sa->get_my_host(ike_sa);
@@ -368,7 +426,7 @@ static bool xml_callback(xmlTextWriterPtr writer, debug_t group, level_t level,
 static void request_control_terminate(xmlTextReaderPtr reader,
 									  xmlTextWriterPtr writer, bool ike)
 {
-	if (xmlTextReaderRead(reader) &&
+	if (xmlTextReaderRead(reader) == 1 &&
 		xmlTextReaderNodeType(reader) == XML_READER_TYPE_TEXT)
 	{
 		const char *str;
@@ -434,7 +492,7 @@ static void request_control_terminate(xmlTextReaderPtr reader,
 static void request_control_initiate(xmlTextReaderPtr reader,
 									  xmlTextWriterPtr writer, bool ike)
 {
-	if (xmlTextReaderRead(reader) &&
+	if (xmlTextReaderRead(reader) == 1 &&
 		xmlTextReaderNodeType(reader) == XML_READER_TYPE_TEXT)
 	{
 		const char *str;
@@ -506,7 +564,7 @@ static void request_query(xmlTextReaderPtr reader, xmlTextWriterPtr writer)
 {
 	/* <query> */
 	xmlTextWriterStartElement(writer, "query");
-	while (xmlTextReaderRead(reader))
+	while (xmlTextReaderRead(reader) == 1)
 	{
 		if (xmlTextReaderNodeType(reader) == XML_READER_TYPE_ELEMENT)
 		{
@@ -533,7 +591,7 @@ static void request_control(xmlTextReaderPtr reader, xmlTextWriterPtr writer)
 {
 	/* <control> */
 	xmlTextWriterStartElement(writer, "control");
-	while (xmlTextReaderRead(reader))
+	while (xmlTextReaderRead(reader) == 1)
 	{
 		if (xmlTextReaderNodeType(reader) == XML_READER_TYPE_ELEMENT)
 		{
@@ -586,7 +644,7 @@ static void request(xmlTextReaderPtr reader, char *id, int fd)
 	xmlTextWriterWriteAttribute(writer, "id", id);
 	xmlTextWriterWriteAttribute(writer, "type", "response");
 
-	while (xmlTextReaderRead(reader))
+	while (xmlTextReaderRead(reader) == 1)
 	{
 		if (xmlTextReaderNodeType(reader) == XML_READER_TYPE_ELEMENT)
 		{
@@ -608,102 +666,164 @@ static void request(xmlTextReaderPtr reader, char *id, int fd)
 }
 
 /**
- * cleanup helper function for open file descriptors
+ * Close an accepted connection
  */
-static void closefdp(int *fd)
+static void close_connection(private_smp_t *this, int fd)
 {
-	close(*fd);
+	int removed;
+
+	this->mutex->lock(this->mutex);
+	removed = this->connections->remove(this->connections,
+										(void*)(uintptr_t)fd, NULL);
+	this->mutex->unlock(this->mutex);
+	if (removed)
+	{	/* otherwise destroy() closes it */
+		close(fd);
+	}
 }
 
+static bool on_read(private_smp_t *this, int fd, watcher_event_t event);
+
 /**
- * read from a opened connection and process it
+ * process a request read from a connection, watch it for the next one
  */
-static job_requeue_t process(int *fdp)
+static job_requeue_t process_request(request_job_t *job)
 {
-	int fd = *fdp;
-	bool oldstate;
-	char buffer[4096];
-	ssize_t len;
+	private_smp_t *this = job->this;
 	xmlTextReaderPtr reader;
 	char *id = NULL, *type = NULL;
 
-	thread_cleanup_push((thread_cleanup_t)closefdp, (void*)&fd);
-	oldstate = thread_cancelability(TRUE);
-	len = read(fd, buffer, sizeof(buffer));
-	thread_cancelability(oldstate);
-	thread_cleanup_pop(FALSE);
-	if (len <= 0)
-	{
-		close(fd);
-		DBG2(DBG_CFG, "SMP XML connection closed");
+	this->mutex->lock(this->mutex);
+	if (this->closing)
+	{	/* the connection is closed or about to be */
+		this->mutex->unlock(this->mutex);
 		return JOB_REQUEUE_NONE;
 	}
-	DBG3(DBG_CFG, "got XML request: %b", buffer, (u_int)len);
+	this->running++;
+	this->mutex->unlock(this->mutex);
 
-	reader = xmlReaderForMemory(buffer, len, NULL, NULL, 0);
+	reader = xmlReaderForMemory(job->data.ptr, job->data.len, NULL, NULL, 0);
 	if (reader == NULL)
 	{
 		DBG1(DBG_CFG, "opening SMP XML reader failed");
-		return JOB_REQUEUE_FAIR;;
 	}
-
-	/* read message type and id */
-	while (xmlTextReaderRead(reader))
+	else
 	{
-		if (xmlTextReaderNodeType(reader) == XML_READER_TYPE_ELEMENT &&
-			streq(xmlTextReaderConstName(reader), "message"))
+		/* read message type and id */
+		while (xmlTextReaderRead(reader) == 1)
 		{
-			id = xmlTextReaderGetAttribute(reader, "id");
-			type = xmlTextReaderGetAttribute(reader, "type");
-			break;
+			if (xmlTextReaderNodeType(reader) == XML_READER_TYPE_ELEMENT &&
+				streq(xmlTextReaderConstName(reader), "message"))
+			{
+				id = xmlTextReaderGetAttribute(reader, "id");
+				type = xmlTextReaderGetAttribute(reader, "type");
+				break;
+			}
 		}
-	}
 
-	/* process message */
-	if (id && type)
-	{
-		if (streq(type, "request"))
-		{
-			request(reader, id, fd);
-		}
-		else
+		/* process message */
+		if (id && type)
 		{
-			/* response(reader, id) */
+			if (streq(type, "request"))
+			{
+				request(reader, id, job->fd);
+			}
+			else
+			{
+				/* response(reader, id) */
+			}
 		}
+		xmlFreeTextReader(reader);
 	}
-	xmlFreeTextReader(reader);
-	return JOB_REQUEUE_FAIR;;
+
+	this->mutex->lock(this->mutex);
+	if (!this->closing)
+	{
+		lib->watcher->add(lib->watcher, job->fd, WATCHER_READ,
+						  (watcher_cb_t)on_read, this);
+	}
+	this->running--;
+	this->condvar->signal(this->condvar);
+	this->mutex->unlock(this->mutex);
+	return JOB_REQUEUE_NONE;
 }
 
 /**
- * accept from XML socket and create jobs to process connections
+ * Release a reference to the plugin, free it with the last one
  */
-static job_requeue_t dispatch(private_smp_t *this)
+static void release(private_smp_t *this)
 {
-	struct sockaddr_un strokeaddr;
-	int fd, *fdp, strokeaddrlen = sizeof(strokeaddr);
-	callback_job_t *job;
-	bool oldstate;
+	if (ref_put(&this->ref))
+	{
+		this->connections->destroy(this->connections);
+		this->condvar->destroy(this->condvar);
+		this->mutex->destroy(this->mutex);
+		free(this);
+	}
+}
 
-	/* wait for connections, but allow thread to terminate */
-	oldstate = thread_cancelability(TRUE);
-	fd = accept(this->socket, (struct sockaddr *)&strokeaddr, &strokeaddrlen);
-	thread_cancelability(oldstate);
+/**
+ * destroy a request job
+ */
+static void request_job_destroy(request_job_t *job)
+{
+	release(job->this);
+	free(job->data.ptr);
+	free(job);
+}
 
-	if (fd < 0)
+/**
+ * read from a opened connection and process it in a job
+ */
+static bool on_read(private_smp_t *this, int fd, watcher_event_t event)
+{
+	request_job_t *job;
+	char buffer[4096];
+	ssize_t len;
+
+	len = read(fd, buffer, sizeof(buffer));
+	if (len <= 0)
 	{
-		DBG1(DBG_CFG, "accepting SMP XML socket failed: %s", strerror(errno));
-		sleep(1);
-		return JOB_REQUEUE_FAIR;;
+		close_connection(this, fd);
+		DBG2(DBG_CFG, "SMP XML connection closed");
+		return FALSE;
 	}
+	DBG3(DBG_CFG, "got XML request: %b", buffer, (u_int)len);
 
-	fdp = malloc_thing(int);
-	*fdp = fd;
-	job = callback_job_create((callback_job_cb_t)process, fdp, free,
-							  (callback_job_cancel_t)return_false);
-	lib->processor->queue_job(lib->processor, (job_t*)job);
+	ref_get(&this->ref);
+	INIT(job,
+		.this = this,
+		.fd = fd,
+		.data = chunk_clone(chunk_create(buffer, len)),
+	);
+	lib->processor->queue_job(lib->processor,
+			(job_t*)callback_job_create((callback_job_cb_t)process_request,
+					job, (callback_job_cleanup_t)request_job_destroy, NULL));
+	/* stop watching until the request is processed, keeps responses in
+	 * order and frees the watcher thread from parsing XML */
+	return FALSE;
+}
+
+/**
+ * accept from XML socket and watch connections for requests
+ */
+static bool on_accept(private_smp_t *this, int fd, watcher_event_t event)
+{
+	struct sockaddr_un strokeaddr;
+	int strokeaddrlen = sizeof(strokeaddr);
 
-	return JOB_REQUEUE_DIRECT;
+	fd = accept(fd, (struct sockaddr *)&strokeaddr, &strokeaddrlen);
+	if (fd < 0)
+	{
+		DBG1(DBG_CFG, "accepting SMP XML socket failed: %s", strerror(errno));
+		return TRUE;
+	}
+	this->mutex->lock(this->mutex);
+	this->connections->insert_last(this->connections, (void*)(uintptr_t)fd);
+	this->mutex->unlock(this->mutex);
+	lib->watcher->add(lib->watcher, fd, WATCHER_READ,
+					  (watcher_cb_t)on_read, this);
+	return TRUE;
 }
 
 METHOD(plugin_t, get_name, char*,
@@ -726,8 +846,28 @@ METHOD(plugin_t, get_features, int,
 METHOD(plugin_t, destroy, void,
 	private_smp_t *this)
 {
+	uintptr_t fd;
+
+	lib->watcher->remove(lib->watcher, this->socket);
 	close(this->socket);
-	free(this);
+
+	/* wait for running request jobs, queued ones won't touch connections */
+	this->mutex->lock(this->mutex);
+	this->closing = TRUE;
+	while (this->running)
+	{
+		this->condvar->wait(this->condvar, this->mutex);
+	}
+	while (this->connections->remove_first(this->connections,
+										   (void**)&fd) == SUCCESS)
+	{	/* removing the watcher waits for active callbacks, which may lock */
+		this->mutex->unlock(this->mutex);
+		lib->watcher->remove(lib->watcher, fd);
+		close(fd);
+		this->mutex->lock(this->mutex);
+	}
+	this->mutex->unlock(this->mutex);
+	release(this);
 }
 
 /*
@@ -788,9 +928,12 @@ plugin_t *smp_plugin_create()
 		return NULL;
 	}
 
-	lib->processor->queue_job(lib->processor,
-		(job_t*)callback_job_create_with_prio((callback_job_cb_t)dispatch, this,
-				NULL, (callback_job_cancel_t)return_false, JOB_PRIO_CRITICAL));
+	this->connections = linked_list_create();
+	this->mutex = mutex_create(MUTEX_TYPE_DEFAULT);
+	this->condvar = condvar_create(CONDVAR_TYPE_DEFAULT);
+	this->ref = 1;
+	lib->watcher->add(lib->watcher, this->socket, WATCHER_READ,
+					  (watcher_cb_t)on_accept, this);
 
 	return &this->public.plugin;
 }
@@ -40,14 +40,25 @@
 #include <netinet/ip.h>
 #include <netinet/udp.h>
 #include <net/if.h>
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+#include <linux/filter.h>
+#endif
 
 #include <hydra.h>
 #include <daemon.h>
 #include <threading/thread.h>
+#include <threading/mutex.h>
+#include <processing/jobs/callback_job.h>
 
 /* Maximum size of a packet */
 #define MAX_PACKET 10000
 
+/* Default number of packets read with a single call on ESP sockets */
+#define ESP_BATCH 32
+
+/* Size of the buffer for ancillary data */
+#define ANCILLARY_SIZE 64
+
 /* these are not defined on some platforms */
 #ifndef SOL_IP
 #define SOL_IP IPPROTO_IP
@@ -73,7 +84,81 @@
 static const struct in6_addr in6addr_any = IN6ADDR_ANY_INIT;
 #endif
 
+#ifndef HAVE_RECVMMSG
+struct mmsghdr {
+	struct msghdr msg_hdr;
+	unsigned int msg_len;
+};
+#endif
+
 typedef struct private_socket_default_socket_t private_socket_default_socket_t;
+typedef struct esp_socket_t esp_socket_t;
+
+/**
+ * Receive buffer of an ESP data path socket, one per batched packet
+ */
+typedef struct {
+
+	/**
+	 * Source address of the packet
+	 */
+	union {
+		struct sockaddr_in in4;
+		struct sockaddr_in6 in6;
+	} src;
+
+	/**
+	 * Ancillary data, for the destination address
+	 */
+	char ancillary[ANCILLARY_SIZE];
+
+	/**
+	 * I/O vector pointing to the packet data
+	 */
+	struct iovec iov;
+
+} esp_buffer_t;
+
+/**
+ * Data path socket for UDP encapsulated ESP packets, bound to the NAT-T port
+ */
+struct esp_socket_t {
+
+	/**
+	 * Socket file descriptor
+	 */
+	int fd;
+
+	/**
+	 * DSCP value set on the socket
+	 */
+	u_int8_t dscp;
+
+	/**
+	 * Number of packets to read at once
+	 */
+	int count;
+
+	/**
+	 * Message headers, one per packet
+	 */
+	struct mmsghdr *msgs;
+
+	/**
+	 * Receive buffers, one per packet
+	 */
+	esp_buffer_t *buffers;
+
+	/**
+	 * Packet data of all buffers
+	 */
+	char *data;
+
+	/**
+	 * Socket this ESP socket belongs to
+	 */
+	private_socket_default_socket_t *socket;
+};
 
 /**
  * Private data of an socket_t object
@@ -135,6 +220,26 @@ struct private_socket_default_socket_t {
 	 */
 	u_int8_t dscp6_natt;
 
+	/**
+	 * IPv4 data path socket for ESP packets (4500 or natt), if any
+	 */
+	esp_socket_t *ipv4_esp;
+
+	/**
+	 * IPv6 data path socket for ESP packets (4500 or natt), if any
+	 */
+	esp_socket_t *ipv6_esp;
+
+	/**
+	 * Number of packets to read at once on ESP sockets, 0 to disable them
+	 */
+	int esp_batch;
+
+	/**
+	 * Serializes sending on the NAT-T sockets if ESP packets share them
+	 */
+	mutex_t *mutex;
+
 	/**
 	 * Maximum packet size to receive
 	 */
@@ -146,6 +251,74 @@ struct private_socket_default_socket_t {
 	bool set_source;
 };
 
+/**
+ * Read the destination address of a received packet from its ancillary data
+ */
+static host_t *get_destination(struct msghdr *msg, u_int16_t port)
+{
+	struct cmsghdr *cmsgptr;
+	host_t *dest = NULL;
+
+	for (cmsgptr = CMSG_FIRSTHDR(msg); cmsgptr != NULL;
+		 cmsgptr = CMSG_NXTHDR(msg, cmsgptr))
+	{
+		if (cmsgptr->cmsg_len == 0)
+		{
+			DBG1(DBG_NET, "error reading ancillary data");
+			return NULL;
+		}
+
+#ifdef HAVE_IN6_PKTINFO
+		if (cmsgptr->cmsg_level == SOL_IPV6 &&
+			cmsgptr->cmsg_type == IPV6_PKTINFO)
+		{
+			struct in6_pktinfo *pktinfo;
+			pktinfo = (struct in6_pktinfo*)CMSG_DATA(cmsgptr);
+			struct sockaddr_in6 dst;
+
+			memset(&dst, 0, sizeof(dst));
+			memcpy(&dst.sin6_addr, &pktinfo->ipi6_addr, sizeof(dst.sin6_addr));
+			dst.sin6_family = AF_INET6;
+			dst.sin6_port = htons(port);
+			dest = host_create_from_sockaddr((sockaddr_t*)&dst);
+		}
+#endif /* HAVE_IN6_PKTINFO */
+		if (cmsgptr->cmsg_level == SOL_IP &&
+#ifdef IP_PKTINFO
+			cmsgptr->cmsg_type == IP_PKTINFO
+#elif defined(IP_RECVDSTADDR)
+			cmsgptr->cmsg_type == IP_RECVDSTADDR
+#else
+			FALSE
+#endif
+			)
+		{
+			struct in_addr *addr;
+			struct sockaddr_in dst;
+
+#ifdef IP_PKTINFO
+			struct in_pktinfo *pktinfo;
+			pktinfo = (struct in_pktinfo*)CMSG_DATA(cmsgptr);
+			addr = &pktinfo->ipi_addr;
+#elif defined(IP_RECVDSTADDR)
+			addr = (struct in_addr*)CMSG_DATA(cmsgptr);
+#endif
+			memset(&dst, 0, sizeof(dst));
+			memcpy(&dst.sin_addr, addr, sizeof(dst.sin_addr));
+
+			dst.sin_family = AF_INET;
+			dst.sin_port = htons(port);
+			dest = host_create_from_sockaddr((sockaddr_t*)&dst);
+		}
+		if (dest)
+		{
+			return dest;
+		}
+	}
+	DBG1(DBG_NET, "error reading IP header");
+	return NULL;
+}
+
 METHOD(socket_t, receiver, status_t,
 	private_socket_default_socket_t *this, packet_t **packet)
 {
@@ -215,9 +388,8 @@ METHOD(socket_t, receiver, status_t,
 	if (selected)
 	{
 		struct msghdr msg;
-		struct cmsghdr *cmsgptr;
 		struct iovec iov;
-		char ancillary[64];
+		char ancillary[ANCILLARY_SIZE];
 		union {
 			struct sockaddr_in in4;
 			struct sockaddr_in6 in6;
@@ -245,66 +417,9 @@ METHOD(socket_t, receiver, status_t,
 		}
 		DBG3(DBG_NET, "received packet %b", buffer, bytes_read);
 
-		/* read ancillary data to get destination address */
-		for (cmsgptr = CMSG_FIRSTHDR(&msg); cmsgptr != NULL;
-			 cmsgptr = CMSG_NXTHDR(&msg, cmsgptr))
-		{
-			if (cmsgptr->cmsg_len == 0)
-			{
-				DBG1(DBG_NET, "error reading ancillary data");
-				return FAILED;
-			}
-
-#ifdef HAVE_IN6_PKTINFO
-			if (cmsgptr->cmsg_level == SOL_IPV6 &&
-				cmsgptr->cmsg_type == IPV6_PKTINFO)
-			{
-				struct in6_pktinfo *pktinfo;
-				pktinfo = (struct in6_pktinfo*)CMSG_DATA(cmsgptr);
-				struct sockaddr_in6 dst;
-
-				memset(&dst, 0, sizeof(dst));
-				memcpy(&dst.sin6_addr, &pktinfo->ipi6_addr, sizeof(dst.sin6_addr));
-				dst.sin6_family = AF_INET6;
-				dst.sin6_port = htons(port);
-				dest = host_create_from_sockaddr((sockaddr_t*)&dst);
-			}
-#endif /* HAVE_IN6_PKTINFO */
-			if (cmsgptr->cmsg_level == SOL_IP &&
-#ifdef IP_PKTINFO
-				cmsgptr->cmsg_type == IP_PKTINFO
-#elif defined(IP_RECVDSTADDR)
-				cmsgptr->cmsg_type == IP_RECVDSTADDR
-#else
-				FALSE
-#endif
-				)
-			{
-				struct in_addr *addr;
-				struct sockaddr_in dst;
-
-#ifdef IP_PKTINFO
-				struct in_pktinfo *pktinfo;
-				pktinfo = (struct in_pktinfo*)CMSG_DATA(cmsgptr);
-				addr = &pktinfo->ipi_addr;
-#elif defined(IP_RECVDSTADDR)
-				addr = (struct in_addr*)CMSG_DATA(cmsgptr);
-#endif
-				memset(&dst, 0, sizeof(dst));
-				memcpy(&dst.sin_addr, addr, sizeof(dst.sin_addr));
-
-				dst.sin_family = AF_INET;
-				dst.sin_port = htons(port);
-				dest = host_create_from_sockaddr((sockaddr_t*)&dst);
-			}
-			if (dest)
-			{
-				break;
-			}
-		}
+		dest = get_destination(&msg, port);
 		if (dest == NULL)
 		{
-			DBG1(DBG_NET, "error reading IP header");
 			return FAILED;
 		}
 		source = host_create_from_sockaddr((sockaddr_t*)&src);
@@ -334,9 +449,11 @@ METHOD(socket_t, sender, status_t,
 	chunk_t data;
 	host_t *src, *dst;
 	struct msghdr msg;
+	int err;
 	struct cmsghdr *cmsg;
 	struct iovec iov;
 	u_int8_t *dscp;
+	esp_socket_t *esp = NULL;
 
 	src = packet->get_source(packet);
 	dst = packet->get_destination(packet);
@@ -370,14 +487,26 @@ METHOD(socket_t, sender, status_t,
 			case AF_INET:
 				skt = this->ipv4_natt;
 				dscp = &this->dscp4_natt;
+				esp = this->ipv4_esp;
 				break;
 			case AF_INET6:
 				skt = this->ipv6_natt;
 				dscp = &this->dscp6_natt;
+				esp = this->ipv6_esp;
 				break;
 			default:
 				return FAILED;
 		}
+		/* ESP packets (no Non-ESP marker) go out over the data path socket */
+		if (esp && data.len >= 4 && untoh32(data.ptr) != 0)
+		{
+			skt = esp->fd;
+			dscp = &esp->dscp;
+		}
+		else
+		{
+			esp = NULL;
+		}
 	}
 	if (skt == -1)
 	{
@@ -387,8 +516,13 @@ METHOD(socket_t, sender, status_t,
 	}
 
 	/* setting DSCP values per-packet in a cmsg seems not to be supported
-	 * on Linux. We instead setsockopt() before sending it, this should be
-	 * safe as only a single thread calls send(). */
+	 * on Linux. We instead setsockopt() before sending it. IKE packets are
+	 * sent by a single thread, as are ESP packets, but the latter use the
+	 * IKE sockets if no data path sockets are open, so we have to lock. */
+	if (!esp)
+	{
+		this->mutex->lock(this->mutex);
+	}
 	if (*dscp != packet->get_dscp(packet))
 	{
 		if (family == AF_INET)
@@ -486,10 +620,15 @@ METHOD(socket_t, sender, status_t,
 	}
 
 	bytes_sent = sendmsg(skt, &msg, 0);
+	err = errno;
+	if (!esp)
+	{
+		this->mutex->unlock(this->mutex);
+	}
 
 	if (bytes_sent != data.len)
 	{
-		DBG1(DBG_NET, "error writing to socket: %s", strerror(errno));
+		DBG1(DBG_NET, "error writing to socket: %s", strerror(err));
 		return FAILED;
 	}
 	return SUCCESS;
@@ -521,7 +660,7 @@ METHOD(socket_t, supported_families, socket_family_t,
  * open a socket to send and receive packets
  */
 static int open_socket(private_socket_default_socket_t *this,
-					   int family, u_int16_t *port)
+					   int family, u_int16_t *port, bool reuseport)
 {
 	int on = TRUE;
 	union {
@@ -572,6 +711,15 @@ static int open_socket(private_socket_default_socket_t *this,
 		close(skt);
 		return -1;
 	}
+#ifdef SO_REUSEPORT
+	if (reuseport &&
+		setsockopt(skt, SOL_SOCKET, SO_REUSEPORT, (void*)&on, sizeof(on)) < 0)
+	{
+		DBG1(DBG_NET, "unable to set SO_REUSEPORT on socket: %s", strerror(errno));
+		close(skt);
+		return -1;
+	}
+#endif
 
 	/* bind the socket */
 	if (bind(skt, &addr.sockaddr, addrlen) < 0)
@@ -649,10 +797,153 @@ static bool use_family(int family)
 }
 
 /**
- * Open a socket pair (normal and NAT traversal) for a given address family
+ * Job callback reading a batch of packets from an ESP data path socket
+ */
+static job_requeue_t receive_esp(esp_socket_t *esp)
+{
+	struct mmsghdr *msg;
+	packet_t *packet;
+	host_t *src, *dst;
+	bool oldstate;
+	int i, count;
+
+	for (i = 0; i < esp->count; i++)
+	{
+		msg = &esp->msgs[i];
+		msg->msg_hdr.msg_namelen = sizeof(esp->buffers[i].src);
+		msg->msg_hdr.msg_controllen = ANCILLARY_SIZE;
+		msg->msg_hdr.msg_flags = 0;
+	}
+
+	oldstate = thread_cancelability(TRUE);
+#ifdef HAVE_RECVMMSG
+	count = recvmmsg(esp->fd, esp->msgs, esp->count, MSG_WAITFORONE, NULL);
+#else /* !HAVE_RECVMMSG */
+	count = recvmsg(esp->fd, &esp->msgs[0].msg_hdr, 0);
+	if (count >= 0)
+	{
+		esp->msgs[0].msg_len = count;
+		count = 1;
+	}
+#endif /* HAVE_RECVMMSG */
+	thread_cancelability(oldstate);
+
+	if (count < 0)
+	{
+		DBG1(DBG_NET, "error reading ESP socket: %s", strerror(errno));
+		return JOB_REQUEUE_FAIR;
+	}
+	for (i = 0; i < count; i++)
+	{
+		msg = &esp->msgs[i];
+		if (msg->msg_hdr.msg_flags & MSG_TRUNC)
+		{
+			DBG1(DBG_NET, "receive buffer too small, packet discarded");
+			continue;
+		}
+		dst = get_destination(&msg->msg_hdr, esp->socket->natt);
+		if (!dst)
+		{
+			continue;
+		}
+		src = host_create_from_sockaddr((sockaddr_t*)&esp->buffers[i].src);
+		packet = packet_create_from_data(src, dst,
+							chunk_clone(chunk_create(esp->buffers[i].iov.iov_base,
+													 msg->msg_len)));
+		charon->receiver->receive_esp(charon->receiver, packet);
+	}
+	return JOB_REQUEUE_DIRECT;
+}
+
+/**
+ * Destroy an ESP data path socket
+ */
+static void esp_socket_destroy(esp_socket_t *esp)
+{
+	close(esp->fd);
+	free(esp->msgs);
+	free(esp->buffers);
+	free(esp->data);
+	free(esp);
+}
+
+/**
+ * Open an ESP data path socket sharing the port of the given NAT-T socket
+ */
+static esp_socket_t *open_esp_socket(private_socket_default_socket_t *this,
+									 int family, int skt_natt, char *label)
+{
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+	/* steer packets to the IKE socket (index 0 in the reuseport group) if they
+	 * start with a Non-ESP marker or are too short (keepalives), all others
+	 * to the ESP socket (index 1). The program is attached before the ESP
+	 * socket joins the group, so no ESP packet is ever distributed randomly */
+	struct sock_filter code[] = {
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 0),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 1),
+		BPF_STMT(BPF_RET | BPF_K, 0),
+		BPF_STMT(BPF_RET | BPF_K, 1),
+	};
+	struct sock_fprog prog = {
+		.len = countof(code),
+		.filter = code,
+	};
+	esp_socket_t *esp;
+	int skt, i;
+
+	if (setsockopt(skt_natt, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+				   &prog, sizeof(prog)) < 0)
+	{
+		DBG1(DBG_NET, "unable to attach ESP filter to %s NAT-T socket: %s",
+			 label, strerror(errno));
+		return NULL;
+	}
+	skt = open_socket(this, family, &this->natt, TRUE);
+	if (skt == -1)
+	{
+		DBG1(DBG_NET, "could not open %s ESP socket", label);
+		return NULL;
+	}
+
+	INIT(esp,
+		.fd = skt,
+		.socket = this,
+#ifdef HAVE_RECVMMSG
+		.count = this->esp_batch,
+#else
+		.count = 1,
+#endif
+	);
+	esp->msgs = calloc(esp->count, sizeof(struct mmsghdr));
+	esp->buffers = calloc(esp->count, sizeof(esp_buffer_t));
+	esp->data = malloc(esp->count * this->max_packet);
+	for (i = 0; i < esp->count; i++)
+	{
+		esp->buffers[i].iov.iov_base = esp->data + i * this->max_packet;
+		esp->buffers[i].iov.iov_len = this->max_packet;
+		esp->msgs[i].msg_hdr.msg_name = &esp->buffers[i].src;
+		esp->msgs[i].msg_hdr.msg_iov = &esp->buffers[i].iov;
+		esp->msgs[i].msg_hdr.msg_iovlen = 1;
+		esp->msgs[i].msg_hdr.msg_control = esp->buffers[i].ancillary;
+	}
+
+	lib->processor->queue_job(lib->processor,
+		(job_t*)callback_job_create_with_prio((callback_job_cb_t)receive_esp,
+			esp, NULL, (callback_job_cancel_t)return_false, JOB_PRIO_CRITICAL));
+	return esp;
+#else /* !SO_ATTACH_REUSEPORT_CBPF */
+	DBG1(DBG_NET, "ESP sockets not supported on this platform");
+	return NULL;
+#endif /* SO_ATTACH_REUSEPORT_CBPF */
+}
+
+/**
+ * Open a socket pair (normal and NAT traversal) for a given address family,
+ * plus an ESP data path socket, if enabled
  */
 static void open_socketpair(private_socket_default_socket_t *this, int family,
-							int *skt, int *skt_natt, char *label)
+							int *skt, int *skt_natt, esp_socket_t **esp,
+							char *label)
 {
 	if (!use_family(family))
 	{
@@ -661,7 +952,7 @@ static void open_socketpair(private_socket_default_socket_t *this, int family,
 		return;
 	}
 
-	*skt = open_socket(this, family, &this->port);
+	*skt = open_socket(this, family, &this->port, FALSE);
 	if (*skt == -1)
 	{
 		*skt_natt = -1;
@@ -669,17 +960,30 @@ static void open_socketpair(private_socket_default_socket_t *this, int family,
 	}
 	else
 	{
-		*skt_natt = open_socket(this, family, &this->natt);
+		*skt_natt = open_socket(this, family, &this->natt,
+								this->esp_batch > 0);
 		if (*skt_natt == -1)
 		{
 			DBG1(DBG_NET, "could not open %s NAT-T socket", label);
 		}
+		else if (this->esp_batch > 0)
+		{
+			*esp = open_esp_socket(this, family, *skt_natt, label);
+		}
 	}
 }
 
 METHOD(socket_t, destroy, void,
 	private_socket_default_socket_t *this)
 {
+	if (this->ipv4_esp)
+	{
+		esp_socket_destroy(this->ipv4_esp);
+	}
+	if (this->ipv6_esp)
+	{
+		esp_socket_destroy(this->ipv6_esp);
+	}
 	if (this->ipv4 != -1)
 	{
 		close(this->ipv4);
@@ -696,6 +1000,7 @@ METHOD(socket_t, destroy, void,
 	{
 		close(this->ipv6_natt);
 	}
+	this->mutex->destroy(this->mutex);
 	free(this);
 }
 
@@ -725,8 +1030,18 @@ socket_default_socket_t *socket_default_socket_create()
 		.set_source = lib->settings->get_bool(lib->settings,
 							"%s.plugins.socket-default.set_source", TRUE,
 							charon->name),
+		.mutex = mutex_create(MUTEX_TYPE_DEFAULT),
 	);
 
+	if (lib->settings->get_bool(lib->settings,
+							"%s.plugins.socket-default.esp_sockets", FALSE,
+							charon->name))
+	{
+		this->esp_batch = max(1, lib->settings->get_int(lib->settings,
+							"%s.plugins.socket-default.esp_batch", ESP_BATCH,
+							charon->name));
+	}
+
 	if (this->port && this->port == this->natt)
 	{
 		DBG1(DBG_NET, "IKE ports can't be equal, will allocate NAT-T "
@@ -750,11 +1065,15 @@ socket_default_socket_t *socket_default_socket_create()
 	 * ports also for IPv4. On OS X, we have to do it the other way round
 	 * for the same effect. */
 #ifdef __APPLE__
-	open_socketpair(this, AF_INET, &this->ipv4, &this->ipv4_natt, "IPv4");
-	open_socketpair(this, AF_INET6, &this->ipv6, &this->ipv6_natt, "IPv6");
+	open_socketpair(this, AF_INET, &this->ipv4, &this->ipv4_natt,
+					&this->ipv4_esp, "IPv4");
+	open_socketpair(this, AF_INET6, &this->ipv6, &this->ipv6_natt,
+					&this->ipv6_esp, "IPv6");
 #else /* !__APPLE__ */
-	open_socketpair(this, AF_INET6, &this->ipv6, &this->ipv6_natt, "IPv6");
-	open_socketpair(this, AF_INET, &this->ipv4, &this->ipv4_natt, "IPv4");
+	open_socketpair(this, AF_INET6, &this->ipv6, &this->ipv6_natt,
+					&this->ipv6_esp, "IPv6");
+	open_socketpair(this, AF_INET, &this->ipv4, &this->ipv4_natt,
+					&this->ipv4_esp, "IPv4");
 #endif /* __APPLE__ */
 
 	if (this->ipv4 == -1 && this->ipv6 == -1)
@@ -19,6 +19,15 @@
 
 #include <daemon.h>
 #include <threading/thread_value.h>
+#include <threading/mutex.h>
+#include <collections/linked_list.h>
+#include <processing/jobs/callback_job.h>
+
+/**
+ * Maximum number of buffered messages, as a multiple of the buffer size,
+ * messages are dropped if the database can't keep up
+ */
+#define BUFFER_LIMIT_FACTOR 16
 
 typedef struct private_sql_logger_t private_sql_logger_t;
 
@@ -33,7 +42,7 @@ struct private_sql_logger_t {
 	sql_logger_t public;
 
 	/**
-	 * database connection
+	 * database connection, NULL after destroy()
 	 */
 	database_t *db;
 
@@ -46,69 +55,342 @@ struct private_sql_logger_t {
 	 * avoid recursive calls by the same thread
 	 */
 	thread_value_t *recursive;
+
+	/**
+	 * buffered log messages, as entry_t
+	 */
+	linked_list_t *buffer;
+
+	/**
+	 * number of messages to buffer, 0 to write them immediately
+	 */
+	u_int buffer_size;
+
+	/**
+	 * number of messages dropped because the buffer was full
+	 */
+	u_int dropped;
+
+	/**
+	 * maximum delay of buffered messages, in ms
+	 */
+	u_int delay;
+
+	/**
+	 * mutex protecting buffer and dropped
+	 */
+	mutex_t *mutex;
+
+	/**
+	 * mutex serializing writes to the database
+	 */
+	mutex_t *flush_mutex;
+
+	/**
+	 * reference count, held by us and each scheduled flush job
+	 */
+	refcount_t ref;
 };
 
-METHOD(logger_t, log_, void,
-	private_sql_logger_t *this, debug_t group, level_t level, int thread,
-	ike_sa_t* ike_sa, const char *message)
+/**
+ * A log message, with the IKE_SA information we log with it
+ */
+typedef struct {
+	/** unique ID of the IKE_SA */
+	u_int32_t unique_id;
+	/** local SPI */
+	u_int64_t local_spi;
+	/** remote SPI */
+	u_int64_t remote_spi;
+	/** are we the original initiator */
+	int initiator;
+	/** local identity type */
+	int local_id_type;
+	/** local identity encoding */
+	chunk_t local_id;
+	/** remote identity type */
+	int remote_id_type;
+	/** remote identity encoding */
+	chunk_t remote_id;
+	/** address family */
+	int family;
+	/** local address */
+	chunk_t local_host;
+	/** remote address */
+	chunk_t remote_host;
+	/** debug group of the message */
+	int group;
+	/** level of the message */
+	int level;
+	/** log message */
+	char *message;
+} entry_t;
+
+/**
+ * Destroy a log entry
+ */
+static void entry_destroy(entry_t *this)
 {
-	if (this->recursive->get(this->recursive))
+	free(this->local_id.ptr);
+	free(this->remote_id.ptr);
+	free(this->local_host.ptr);
+	free(this->remote_host.ptr);
+	free(this->message);
+	free(this);
+}
+
+/**
+ * Create a log entry for a message logged in the context of an IKE_SA
+ */
+static entry_t *entry_create(ike_sa_t *ike_sa, debug_t group, level_t level,
+							 const char *message)
+{
+	identification_t *local_id, *remote_id;
+	host_t *local_host, *remote_host;
+	ike_sa_id_t *id;
+	entry_t *this;
+
+	id = ike_sa->get_id(ike_sa);
+	local_id = ike_sa->get_my_id(ike_sa);
+	remote_id = ike_sa->get_other_id(ike_sa);
+	local_host = ike_sa->get_my_host(ike_sa);
+	remote_host = ike_sa->get_other_host(ike_sa);
+
+	INIT(this,
+		.unique_id = ike_sa->get_unique_id(ike_sa),
+		.initiator = id->is_initiator(id),
+		.local_id_type = local_id->get_type(local_id),
+		.local_id = chunk_clone(local_id->get_encoding(local_id)),
+		.remote_id_type = remote_id->get_type(remote_id),
+		.remote_id = chunk_clone(remote_id->get_encoding(remote_id)),
+		.family = local_host->get_family(local_host),
+		.local_host = chunk_clone(local_host->get_address(local_host)),
+		.remote_host = chunk_clone(remote_host->get_address(remote_host)),
+		.group = group,
+		.level = level,
+		.message = strdup(message),
+	);
+	if (this->initiator)
 	{
-		return;
+		this->local_spi = id->get_initiator_spi(id);
+		this->remote_spi = id->get_responder_spi(id);
 	}
-	this->recursive->set(this->recursive, this->recursive);
+	else
+	{
+		this->local_spi = id->get_responder_spi(id);
+		this->remote_spi = id->get_initiator_spi(id);
+	}
+	return this;
+}
+
+/**
+ * Write log entries to the database, in a single transaction
+ */
+static void write_entries(private_sql_logger_t *this, entry_t **entries,
+						  int count)
+{
+	db_value_t *sas, *logs, *sa, *log;
+	entry_t *entry;
+	int i, j;
 
-	if (ike_sa)
+	sa = sas = malloc(sizeof(db_value_t) * 11 * count);
+	log = logs = malloc(sizeof(db_value_t) * 4 * count);
+	for (i = 0; i < count; i++)
 	{
-		chunk_t local_spi, remote_spi;
-		host_t *local_host, *remote_host;
-		identification_t *local_id, *remote_id;
-		u_int64_t ispi, rspi;
-		ike_sa_id_t *id;
-
-		id = ike_sa->get_id(ike_sa);
-		ispi = id->get_initiator_spi(id);
-		rspi = id->get_responder_spi(id);
-		if (id->is_initiator(id))
+		entry = entries[i];
+		for (j = i + 1; j < count; j++)
+		{	/* only the latest state of an IKE_SA is relevant */
+			if (entries[j]->unique_id == entry->unique_id)
+			{
+				break;
+			}
+		}
+		if (j == count)
 		{
-			local_spi.ptr = (char*)&ispi;
-			remote_spi.ptr = (char*)&rspi;
+			*sa++ = (db_value_t){ .type = DB_BLOB,
+						.value.blob = chunk_from_thing(entry->local_spi) };
+			*sa++ = (db_value_t){ .type = DB_BLOB,
+						.value.blob = chunk_from_thing(entry->remote_spi) };
+			*sa++ = (db_value_t){ .type = DB_INT,
+						.value.i = entry->unique_id };
+			*sa++ = (db_value_t){ .type = DB_INT,
+						.value.i = entry->initiator };
+			*sa++ = (db_value_t){ .type = DB_INT,
+						.value.i = entry->local_id_type };
+			*sa++ = (db_value_t){ .type = DB_BLOB,
+						.value.blob = entry->local_id };
+			*sa++ = (db_value_t){ .type = DB_INT,
+						.value.i = entry->remote_id_type };
+			*sa++ = (db_value_t){ .type = DB_BLOB,
+						.value.blob = entry->remote_id };
+			*sa++ = (db_value_t){ .type = DB_INT,
+						.value.i = entry->family };
+			*sa++ = (db_value_t){ .type = DB_BLOB,
+						.value.blob = entry->local_host };
+			*sa++ = (db_value_t){ .type = DB_BLOB,
+						.value.blob = entry->remote_host };
+		}
+		*log++ = (db_value_t){ .type = DB_BLOB,
+						.value.blob = chunk_from_thing(entry->local_spi) };
+		*log++ = (db_value_t){ .type = DB_INT, .value.i = entry->group };
+		*log++ = (db_value_t){ .type = DB_INT, .value.i = entry->level };
+		*log++ = (db_value_t){ .type = DB_TEXT, .value.text = entry->message };
+	}
+
+	if (this->db->transaction(this->db, FALSE))
+	{
+		if (this->db->execute_batch(this->db, "REPLACE INTO ike_sas ("
+						"local_spi, remote_spi, id, initiator, "
+						"local_id_type, local_id_data, "
+						"remote_id_type, remote_id_data, "
+						"host_family, local_host_data, remote_host_data) "
+						"VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)",
+						(sa - sas) / 11, sas) >= 0 &&
+			this->db->execute_batch(this->db, "INSERT INTO logs ("
+						"local_spi, `signal`, level, msg) "
+						"VALUES (?, ?, ?, ?)", count, logs) >= 0)
+		{
+			this->db->commit(this->db);
 		}
 		else
 		{
-			local_spi.ptr = (char*)&rspi;
-			remote_spi.ptr = (char*)&ispi;
+			this->db->rollback(this->db);
 		}
-		local_spi.len = remote_spi.len = sizeof(ispi);
-		local_id = ike_sa->get_my_id(ike_sa);
-		remote_id = ike_sa->get_other_id(ike_sa);
-		local_host = ike_sa->get_my_host(ike_sa);
-		remote_host = ike_sa->get_other_host(ike_sa);
-
-		this->db->execute(this->db, NULL, "REPLACE INTO ike_sas ("
-						  "local_spi, remote_spi, id, initiator, "
-						  "local_id_type, local_id_data, "
-						  "remote_id_type, remote_id_data, "
-						  "host_family, local_host_data, remote_host_data) "
-						  "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)",
-						  DB_BLOB, local_spi, DB_BLOB, remote_spi,
-						  DB_INT, ike_sa->get_unique_id(ike_sa),
-						  DB_INT, id->is_initiator(id),
-						  DB_INT, local_id->get_type(local_id),
-						  DB_BLOB, local_id->get_encoding(local_id),
-						  DB_INT, remote_id->get_type(remote_id),
-						  DB_BLOB, remote_id->get_encoding(remote_id),
-						  DB_INT, local_host->get_family(local_host),
-						  DB_BLOB, local_host->get_address(local_host),
-						  DB_BLOB, remote_host->get_address(remote_host));
-		this->db->execute(this->db, NULL, "INSERT INTO logs ("
-						  "local_spi, `signal`, level, msg) "
-						  "VALUES (?, ?, ?, ?)",
-						  DB_BLOB, local_spi, DB_INT, group, DB_INT, level,
-						  DB_TEXT, message);
 	}
+	free(sas);
+	free(logs);
+}
 
-	this->recursive->set(this->recursive, NULL);
+/**
+ * Write all buffered log entries to the database
+ */
+static void flush(private_sql_logger_t *this)
+{
+	linked_list_t *buffer;
+	entry_t **entries;
+	u_int dropped;
+	int count, i = 0;
+
+	this->mutex->lock(this->mutex);
+	buffer = this->buffer;
+	this->buffer = linked_list_create();
+	dropped = this->dropped;
+	this->dropped = 0;
+	this->mutex->unlock(this->mutex);
+
+	if (dropped)
+	{
+		DBG1(DBG_CFG, "SQL logger buffer full, dropped %u log messages",
+			 dropped);
+	}
+
+	count = buffer->get_count(buffer);
+	if (count)
+	{
+		entries = malloc(sizeof(entry_t*) * count);
+		while (buffer->remove_first(buffer, (void**)&entries[i]) == SUCCESS)
+		{
+			i++;
+		}
+		this->recursive->set(this->recursive, this->recursive);
+		write_entries(this, entries, count);
+		this->recursive->set(this->recursive, NULL);
+		for (i = 0; i < count; i++)
+		{
+			entry_destroy(entries[i]);
+		}
+		free(entries);
+	}
+	buffer->destroy(buffer);
+}
+
+/**
+ * Release a reference to the logger
+ */
+static void release(private_sql_logger_t *this)
+{
+	if (ref_put(&this->ref))
+	{
+		this->buffer->destroy_function(this->buffer, (void*)entry_destroy);
+		this->recursive->destroy(this->recursive);
+		this->mutex->destroy(this->mutex);
+		this->flush_mutex->destroy(this->flush_mutex);
+		free(this);
+	}
+}
+
+/**
+ * Job flushing the buffer, unless the logger got destroyed in the meantime
+ */
+static job_requeue_t flush_job(private_sql_logger_t *this)
+{
+	this->flush_mutex->lock(this->flush_mutex);
+	if (this->db)
+	{
+		flush(this);
+	}
+	this->flush_mutex->unlock(this->flush_mutex);
+	return JOB_REQUEUE_NONE;
+}
+
+/**
+ * Create a job flushing the buffer
+ */
+static job_t *create_flush_job(private_sql_logger_t *this)
+{
+	ref_get(&this->ref);
+	return (job_t*)callback_job_create((callback_job_cb_t)flush_job, this,
+								(callback_job_cleanup_t)release, NULL);
+}
+
+METHOD(logger_t, log_, void,
+	private_sql_logger_t *this, debug_t group, level_t level, int thread,
+	ike_sa_t* ike_sa, const char *message)
+{
+	entry_t *entry;
+	int count;
+
+	if (!ike_sa || this->recursive->get(this->recursive))
+	{
+		return;
+	}
+	entry = entry_create(ike_sa, group, level, message);
+
+	if (!this->buffer_size)
+	{
+		this->recursive->set(this->recursive, this->recursive);
+		this->flush_mutex->lock(this->flush_mutex);
+		write_entries(this, &entry, 1);
+		this->flush_mutex->unlock(this->flush_mutex);
+		this->recursive->set(this->recursive, NULL);
+		entry_destroy(entry);
+		return;
+	}
+
+	this->mutex->lock(this->mutex);
+	count = this->buffer->get_count(this->buffer);
+	if (count >= this->buffer_size * BUFFER_LIMIT_FACTOR)
+	{	/* a flush is pending, but the database can't keep up */
+		this->dropped++;
+		this->mutex->unlock(this->mutex);
+		entry_destroy(entry);
+		return;
+	}
+	this->buffer->insert_last(this->buffer, entry);
+	count++;
+	this->mutex->unlock(this->mutex);
+
+	/* we never write to the database from the logging thread, as it might
+	 * hold a transaction on the same database */
+	if (count == this->buffer_size)
+	{
+		lib->processor->queue_job(lib->processor, create_flush_job(this));
+	}
+	else if (count == 1)
+	{
+		lib->scheduler->schedule_job_ms(lib->scheduler,
+										create_flush_job(this), this->delay);
+	}
 }
 
 METHOD(logger_t, get_level, level_t,
@@ -120,7 +402,11 @@ METHOD(logger_t, get_level, level_t,
 METHOD(sql_logger_t, destroy, void,
 	private_sql_logger_t *this)
 {
-	free(this);
+	this->flush_mutex->lock(this->flush_mutex);
+	flush(this);
+	this->db = NULL;
+	this->flush_mutex->unlock(this->flush_mutex);
+	release(this);
 }
 
 /**
@@ -142,8 +428,15 @@ sql_logger_t *sql_logger_create(database_t *db)
 		.recursive = thread_value_create(NULL),
 		.level = lib->settings->get_int(lib->settings,
 								"%s.plugins.sql.loglevel", -1, charon->name),
+		.buffer = linked_list_create(),
+		.buffer_size = lib->settings->get_int(lib->settings,
+								"%s.plugins.sql.log_buffer", 32, charon->name),
+		.delay = lib->settings->get_int(lib->settings,
+								"%s.plugins.sql.log_delay", 1000, charon->name),
+		.mutex = mutex_create(MUTEX_TYPE_DEFAULT),
+		.flush_mutex = mutex_create(MUTEX_TYPE_DEFAULT),
+		.ref = 1,
 	);
 
 	return &this->public;
 }
-
@@ -20,6 +20,7 @@
 #include <daemon.h>
 #include <threading/mutex.h>
 #include <utils/lexparser.h>
+#include <collections/hashtable.h>
 
 #include <netdb.h>
 
@@ -40,6 +41,11 @@ struct private_stroke_config_t {
 	 */
 	linked_list_t *list;
 
+	/**
+	 * peer_cfg_t in list, indexed by their peer and IKE parameters
+	 */
+	hashtable_t *peers;
+
 	/**
 	 * mutex to lock config list
 	 */
@@ -1117,13 +1123,63 @@ static child_cfg_t *build_child_cfg(private_stroke_config_t *this,
 	return child_cfg;
 }
 
+/**
+ * Hashtable hash function for peer configs, covers the ike_cfg_t parameters
+ * compared by peer_equals()
+ */
+static u_int peer_hash(peer_cfg_t *peer_cfg)
+{
+	ike_cfg_t *ike_cfg;
+	u_int16_t params[3];
+	u_int hash;
+
+	ike_cfg = peer_cfg->get_ike_cfg(peer_cfg);
+	params[0] = peer_cfg->get_ike_version(peer_cfg);
+	params[1] = ike_cfg->get_my_port(ike_cfg);
+	params[2] = ike_cfg->get_other_port(ike_cfg);
+
+	hash = chunk_hash(chunk_from_thing(params));
+	hash = chunk_hash_inc(chunk_from_str(ike_cfg->get_my_addr(ike_cfg, NULL)),
+						  hash);
+	return chunk_hash_inc(chunk_from_str(ike_cfg->get_other_addr(ike_cfg, NULL)),
+						  hash);
+}
+
+/**
+ * Hashtable equals function for peer configs, a child_cfg_t for a peer config
+ * equal to an existing one is added to the existing one
+ */
+static bool peer_equals(peer_cfg_t *a, peer_cfg_t *b)
+{
+	ike_cfg_t *ike_a, *ike_b;
+
+	ike_a = a->get_ike_cfg(a);
+	ike_b = b->get_ike_cfg(b);
+	return a->equals(a, b) && ike_a->equals(ike_a, ike_b);
+}
+
+/**
+ * Hashtable hash function for connection names
+ */
+static u_int name_hash(char *name)
+{
+	return chunk_hash(chunk_from_str(name));
+}
+
+/**
+ * Hashtable equals function for connection names
+ */
+static bool name_equals(char *a, char *b)
+{
+	return streq(a, b);
+}
+
 METHOD(stroke_config_t, add, void,
 	private_stroke_config_t *this, stroke_msg_t *msg)
 {
-	ike_cfg_t *ike_cfg, *existing_ike;
+	ike_cfg_t *ike_cfg;
 	peer_cfg_t *peer_cfg, *existing;
 	child_cfg_t *child_cfg;
-	enumerator_t *enumerator;
 	bool use_existing = FALSE;
 
 	ike_cfg = build_ike_cfg(this, msg);
@@ -1138,23 +1194,18 @@ METHOD(stroke_config_t, add, void,
 		return;
 	}
 
-	enumerator = create_peer_cfg_enumerator(this, NULL, NULL);
-	while (enumerator->enumerate(enumerator, &existing))
+	this->mutex->lock(this->mutex);
+	existing = this->peers->get(this->peers, peer_cfg);
+	if (existing)
 	{
-		existing_ike = existing->get_ike_cfg(existing);
-		if (existing->equals(existing, peer_cfg) &&
-			existing_ike->equals(existing_ike, peer_cfg->get_ike_cfg(peer_cfg)))
-		{
-			use_existing = TRUE;
-			peer_cfg->destroy(peer_cfg);
-			peer_cfg = existing;
-			peer_cfg->get_ref(peer_cfg);
-			DBG1(DBG_CFG, "added child to existing configuration '%s'",
-				 peer_cfg->get_name(peer_cfg));
-			break;
-		}
+		use_existing = TRUE;
+		peer_cfg->destroy(peer_cfg);
+		peer_cfg = existing;
+		peer_cfg->get_ref(peer_cfg);
+		DBG1(DBG_CFG, "added child to existing configuration '%s'",
+			 peer_cfg->get_name(peer_cfg));
 	}
-	enumerator->destroy(enumerator);
+	this->mutex->unlock(this->mutex);
 
 	child_cfg = build_child_cfg(this, msg);
 	if (!child_cfg)
@@ -1174,17 +1225,22 @@ METHOD(stroke_config_t, add, void,
 		DBG1(DBG_CFG, "added configuration '%s'", msg->add_conn.name);
 		this->mutex->lock(this->mutex);
 		this->list->insert_last(this->list, peer_cfg);
+		this->peers->put(this->peers, peer_cfg, peer_cfg);
 		this->mutex->unlock(this->mutex);
 	}
 }
 
-METHOD(stroke_config_t, del, void,
-	private_stroke_config_t *this, stroke_msg_t *msg)
+/**
+ * Remove all children and peer configs with a name contained in names, in a
+ * single pass over all configs. Names found get added to deleted.
+ */
+static void del_names(private_stroke_config_t *this, hashtable_t *names,
+					  hashtable_t *deleted)
 {
 	enumerator_t *enumerator, *children;
 	peer_cfg_t *peer;
 	child_cfg_t *child;
-	bool deleted = FALSE;
+	char *name;
 
 	this->mutex->lock(this->mutex);
 	enumerator = this->list->create_enumerator(this->list);
@@ -1196,11 +1252,12 @@ METHOD(stroke_config_t, del, void,
 		children = peer->create_child_cfg_enumerator(peer);
 		while (children->enumerate(children, &child))
 		{
-			if (streq(child->get_name(child), msg->del_conn.name))
+			name = names->get(names, child->get_name(child));
+			if (name)
 			{
 				peer->remove_child_cfg(peer, children);
 				child->destroy(child);
-				deleted = TRUE;
+				deleted->put(deleted, name, name);
 			}
 			else
 			{
@@ -1210,24 +1267,71 @@ METHOD(stroke_config_t, del, void,
 		children->destroy(children);
 
 		/* if peer config matches, or has no children anymore, remove it */
-		if (!keep || streq(peer->get_name(peer), msg->del_conn.name))
+		name = names->get(names, peer->get_name(peer));
+		if (!keep || name)
 		{
+			if (name)
+			{
+				deleted->put(deleted, name, name);
+			}
 			this->list->remove_at(this->list, enumerator);
+			this->peers->remove(this->peers, peer);
 			peer->destroy(peer);
-			deleted = TRUE;
 		}
 	}
 	enumerator->destroy(enumerator);
 	this->mutex->unlock(this->mutex);
+}
 
-	if (deleted)
+METHOD(stroke_config_t, del_batch, void,
+	private_stroke_config_t *this, linked_list_t *msgs)
+{
+	enumerator_t *enumerator;
+	hashtable_t *names, *deleted;
+	stroke_msg_t *msg;
+
+	names = hashtable_create((hashtable_hash_t)name_hash,
+							 (hashtable_equals_t)name_equals,
+							 msgs->get_count(msgs));
+	deleted = hashtable_create((hashtable_hash_t)name_hash,
+							   (hashtable_equals_t)name_equals,
+							   msgs->get_count(msgs));
+
+	enumerator = msgs->create_enumerator(msgs);
+	while (enumerator->enumerate(enumerator, &msg))
 	{
-		DBG1(DBG_CFG, "deleted connection '%s'", msg->del_conn.name);
+		names->put(names, msg->del_conn.name, msg->del_conn.name);
 	}
-	else
+	enumerator->destroy(enumerator);
+
+	del_names(this, names, deleted);
+
+	enumerator = msgs->create_enumerator(msgs);
+	while (enumerator->enumerate(enumerator, &msg))
 	{
-		DBG1(DBG_CFG, "connection '%s' not found", msg->del_conn.name);
+		if (deleted->get(deleted, msg->del_conn.name))
+		{
+			DBG1(DBG_CFG, "deleted connection '%s'", msg->del_conn.name);
+		}
+		else
+		{
+			DBG1(DBG_CFG, "connection '%s' not found", msg->del_conn.name);
+		}
 	}
+	enumerator->destroy(enumerator);
+
+	names->destroy(names);
+	deleted->destroy(deleted);
+}
+
+METHOD(stroke_config_t, del, void,
+	private_stroke_config_t *this, stroke_msg_t *msg)
+{
+	linked_list_t *msgs;
+
+	msgs = linked_list_create_with_items(msg, NULL);
+	del_batch(this, msgs);
+	msgs->destroy(msgs);
 }
 
 METHOD(stroke_config_t, set_user_credentials, void,
@@ -1412,6 +1516,7 @@ METHOD(stroke_config_t, destroy, void,
 	private_stroke_config_t *this)
 {
 	this->list->destroy_offset(this->list, offsetof(peer_cfg_t, destroy));
+	this->peers->destroy(this->peers);
 	this->mutex->destroy(this->mutex);
 	free(this);
 }
@@ -1433,10 +1538,13 @@ stroke_config_t *stroke_config_create(stroke_ca_t *ca, stroke_cred_t *cred,
 			},
 			.add = _add,
 			.del = _del,
+			.del_batch = _del_batch,
 			.set_user_credentials = _set_user_credentials,
 			.destroy = _destroy,
 		},
 		.list = linked_list_create(),
+		.peers = hashtable_create((hashtable_hash_t)peer_hash,
+								  (hashtable_equals_t)peer_equals, 32),
 		.mutex = mutex_create(MUTEX_TYPE_RECURSIVE),
 		.ca = ca,
 		.cred = cred,
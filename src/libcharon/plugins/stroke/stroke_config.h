@@ -54,6 +54,14 @@ struct stroke_config_t {
 	 */
 	void (*del)(stroke_config_t *this, stroke_msg_t *msg);
 
+	/**
+	 * Remove multiple configurations from the backend in a single pass.
+	 *
+	 * @param msgs		list of received stroke messages (stroke_msg_t*)
+	 *					containing config names
+	 */
+	void (*del_batch)(stroke_config_t *this, linked_list_t *msgs);
+
 	/**
 	 * Set the username and password for a connection in this backend.
 	 *
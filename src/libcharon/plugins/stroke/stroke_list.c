@@ -193,6 +193,15 @@ static void log_ike_sa(FILE *out, ike_sa_t *ike_sa, bool all)
 					buf+4);
 		}
 
+		if (ike_sa->get_statistic(ike_sa, STAT_RETRANSMIT) ||
+			ike_sa->get_statistic(ike_sa, STAT_DUPLICATE))
+		{
+			fprintf(out, "%12s[%d]: %u retransmits, %u duplicate requests\n",
+					ike_sa->get_name(ike_sa), ike_sa->get_unique_id(ike_sa),
+					ike_sa->get_statistic(ike_sa, STAT_RETRANSMIT),
+					ike_sa->get_statistic(ike_sa, STAT_DUPLICATE));
+		}
+
 		log_task_q(out, ike_sa, TASK_QUEUE_QUEUED, "queued");
 		log_task_q(out, ike_sa, TASK_QUEUE_ACTIVE, "active");
 		log_task_q(out, ike_sa, TASK_QUEUE_PASSIVE, "passive");
@@ -202,7 +211,8 @@ static void log_ike_sa(FILE *out, ike_sa_t *ike_sa, bool all)
 /**
  * log an CHILD_SA to out
  */
-static void log_child_sa(FILE *out, child_sa_t *child_sa, bool all)
+static void log_child_sa(FILE *out, child_sa_t *child_sa, bool all,
+						 bool counters)
 {
 	time_t use_in, use_out, rekey, now;
 	u_int64_t bytes_in, bytes_out, packets_in, packets_out;
@@ -273,24 +283,27 @@ static void log_child_sa(FILE *out, child_sa_t *child_sa, bool all)
 				}
 			}
 
-			child_sa->get_usestats(child_sa, TRUE,
-								   &use_in, &bytes_in, &packets_in);
-			fprintf(out, ", %" PRIu64 " bytes_i", bytes_in);
-			if (use_in)
+			if (counters)
 			{
-				fprintf(out, " (%" PRIu64 " pkt%s, %" PRIu64 "s ago)",
-						packets_in, (packets_in == 1) ? "": "s",
-						(u_int64_t)(now - use_in));
-			}
+				child_sa->get_usestats(child_sa, TRUE,
+									   &use_in, &bytes_in, &packets_in);
+				fprintf(out, ", %" PRIu64 " bytes_i", bytes_in);
+				if (use_in)
+				{
+					fprintf(out, " (%" PRIu64 " pkt%s, %" PRIu64 "s ago)",
+							packets_in, (packets_in == 1) ? "": "s",
+							(u_int64_t)(now - use_in));
+				}
 
-			child_sa->get_usestats(child_sa, FALSE,
-								   &use_out, &bytes_out, &packets_out);
-			fprintf(out, ", %" PRIu64 " bytes_o", bytes_out);
-			if (use_out)
-			{
-				fprintf(out, " (%" PRIu64 " pkt%s, %" PRIu64 "s ago)",
-						packets_out, (packets_out == 1) ? "": "s",
-						(u_int64_t)(now - use_out));
+				child_sa->get_usestats(child_sa, FALSE,
+									   &use_out, &bytes_out, &packets_out);
+				fprintf(out, ", %" PRIu64 " bytes_o", bytes_out);
+				if (use_out)
+				{
+					fprintf(out, " (%" PRIu64 " pkt%s, %" PRIu64 "s ago)",
+							packets_out, (packets_out == 1) ? "": "s",
+							(u_int64_t)(now - use_out));
+				}
 			}
 			fprintf(out, ", rekeying ");
 
@@ -325,6 +338,32 @@ static void log_child_sa(FILE *out, child_sa_t *child_sa, bool all)
 			child_sa->get_traffic_selectors(child_sa, FALSE));
 }
 
+/**
+ * Check if an IKE_SA matches the peer and state filters of a status request
+ */
+static bool ike_sa_matches(ike_sa_t *ike_sa, host_t *host,
+						   identification_t *id, int state)
+{
+	host_t *other_host;
+	identification_t *other_id;
+
+	if (state >= 0 && ike_sa->get_state(ike_sa) != state)
+	{
+		return FALSE;
+	}
+	if (host)
+	{
+		other_host = ike_sa->get_other_host(ike_sa);
+		return other_host && other_host->ip_equals(other_host, host);
+	}
+	if (id)
+	{
+		other_id = ike_sa->get_other_id(ike_sa);
+		return other_id && other_id->matches(other_id, id);
+	}
+	return TRUE;
+}
+
 /**
  * Log a configs local or remote authentication config to out
  */
@@ -452,9 +491,31 @@ METHOD(stroke_list_t, status, void,
 	child_sa_t *child_sa;
 	ike_sa_t *ike_sa;
 	linked_list_t *my_ts, *other_ts;
-	bool first, found = FALSE;
+	bool first, found = FALSE, counters = !msg->status.nocounters;
 	char *name = msg->status.name;
-	u_int half_open;
+	u_int half_open, matched = 0, shown = 0;
+	host_t *peer_host = NULL;
+	identification_t *peer_id = NULL;
+	int state = -1;
+
+	if (msg->status.peer)
+	{
+		peer_host = host_create_from_string(msg->status.peer, 0);
+		if (!peer_host)
+		{
+			peer_id = identification_create_from_string(msg->status.peer);
+		}
+	}
+	if (msg->status.state)
+	{
+		state = enum_from_name(ike_sa_state_names, msg->status.state);
+		if (state < 0)
+		{
+			fprintf(out, "invalid IKE_SA state '%s'\n", msg->status.state);
+			DESTROY_IF(peer_host);
+			return;
+		}
+	}
 
 	if (all)
 	{
@@ -502,6 +563,12 @@ METHOD(stroke_list_t, status, void,
 		}
 		fprintf(out, ", scheduled: %d\n",
 				lib->scheduler->get_job_load(lib->scheduler));
+		if (charon->rekey_limiter->get_rate(charon->rekey_limiter))
+		{
+			fprintf(out, "  rekeyings: %u/s, deferred: %u\n",
+				charon->rekey_limiter->get_rate(charon->rekey_limiter),
+				charon->rekey_limiter->get_queued(charon->rekey_limiter));
+		}
 		fprintf(out, "  loaded plugins: %s\n",
 				lib->plugins->loaded_plugins(lib->plugins));
 
@@ -629,7 +696,7 @@ METHOD(stroke_list_t, status, void,
 			fprintf(out, "Routed Connections:\n");
 			first = FALSE;
 		}
-		log_child_sa(out, child_sa, all);
+		log_child_sa(out, child_sa, all, counters);
 	}
 	enumerator->destroy(enumerator);
 
@@ -642,9 +709,40 @@ METHOD(stroke_list_t, status, void,
 													charon->controller, wait);
 	while (enumerator->enumerate(enumerator, &ike_sa))
 	{
-		bool ike_printed = FALSE;
-		enumerator_t *children = ike_sa->create_child_sa_enumerator(ike_sa);
+		bool ike_printed = FALSE, ike_matches;
+		enumerator_t *children;
+
+		if (!ike_sa_matches(ike_sa, peer_host, peer_id, state))
+		{
+			continue;
+		}
+		ike_matches = name == NULL || streq(name, ike_sa->get_name(ike_sa));
+		if (!ike_matches)
+		{
+			children = ike_sa->create_child_sa_enumerator(ike_sa);
+			while (children->enumerate(children, (void**)&child_sa))
+			{
+				if (streq(name, child_sa->get_name(child_sa)))
+				{
+					ike_matches = TRUE;
+					break;
+				}
+			}
+			children->destroy(children);
+		}
+		if (!ike_matches || matched++ < msg->status.offset)
+		{
+			continue;
+		}
+		if (msg->status.limit && shown == msg->status.limit)
+		{
+			fprintf(out, "  more IKE_SAs, continue with offset %u\n",
+					msg->status.offset + shown);
+			break;
+		}
+		shown++;
 
+		children = ike_sa->create_child_sa_enumerator(ike_sa);
 		if (name == NULL || streq(name, ike_sa->get_name(ike_sa)))
 		{
 			log_ike_sa(out, ike_sa, all);
@@ -662,16 +760,21 @@ METHOD(stroke_list_t, status, void,
 					found = TRUE;
 					ike_printed = TRUE;
 				}
-				log_child_sa(out, child_sa, all);
+				log_child_sa(out, child_sa, all, counters);
 			}
 		}
 		children->destroy(children);
+		/* stream results to the client instead of buffering them */
+		fflush(out);
 	}
 	enumerator->destroy(enumerator);
+	DESTROY_IF(peer_host);
+	DESTROY_IF(peer_id);
 
 	if (!found)
 	{
-		if (name)
+		if (name || msg->status.peer || msg->status.state ||
+			msg->status.offset)
 		{
 			fprintf(out, "  no match\n");
 		}
@@ -44,6 +44,9 @@ struct stroke_list_t {
 	/**
 	 * Log status information to stroke console.
 	 *
+	 * IKE_SAs are filtered by the options in the status message and written
+	 * to the console one by one, as they are enumerated.
+	 *
 	 * @param msg		stroke message
 	 * @param out		stroke console stream
 	 * @param all		TRUE for "statusall"
@@ -27,8 +27,6 @@
 #include <hydra.h>
 #include <daemon.h>
 #include <threading/mutex.h>
-#include <threading/thread.h>
-#include <threading/condvar.h>
 #include <collections/linked_list.h>
 #include <processing/jobs/callback_job.h>
 
@@ -75,11 +73,6 @@ struct private_stroke_socket_t {
 	 */
 	mutex_t *mutex;
 
-	/**
-	 * condvar to signal the arrival or completion of commands
-	 */
-	condvar_t *condvar;
-
 	/**
 	 * the number of currently handled commands
 	 */
@@ -381,6 +374,19 @@ static void stroke_status(private_stroke_socket_t *this,
 						  stroke_msg_t *msg, FILE *out, bool all, bool wait)
 {
 	pop_string(msg, &(msg->status.name));
+	if (msg->type == STR_STATUS_FILTER)
+	{
+		pop_string(msg, &(msg->status.peer));
+		pop_string(msg, &(msg->status.state));
+	}
+	else
+	{	/* older clients send uninitialized data for the filter options */
+		msg->status.peer = NULL;
+		msg->status.state = NULL;
+		msg->status.offset = 0;
+		msg->status.limit = 0;
+		msg->status.nocounters = 0;
+	}
 
 	this->list->status(this->list, msg, out, all, wait);
 }
@@ -627,6 +633,28 @@ static void stroke_job_context_destroy(stroke_job_context_t *this)
 	free(this);
 }
 
+static job_requeue_t process(stroke_job_context_t *ctx);
+
+/**
+ * Queue jobs for pending stroke commands, if concurrency limit allows,
+ * mutex must be held
+ */
+static void handle_queued(private_stroke_socket_t *this)
+{
+	stroke_job_context_t *ctx;
+
+	while (this->handling < this->max_concurrent &&
+		   this->commands->remove_first(this->commands,
+										(void**)&ctx) == SUCCESS)
+	{
+		this->handling++;
+		lib->processor->queue_job(lib->processor,
+			(job_t*)callback_job_create_with_prio((callback_job_cb_t)process,
+					ctx, (void*)stroke_job_context_destroy, NULL,
+					JOB_PRIO_HIGH));
+	}
+}
+
 /**
  * called to signal the completion of a command
  */
@@ -634,50 +662,59 @@ static inline job_requeue_t job_processed(private_stroke_socket_t *this)
 {
 	this->mutex->lock(this->mutex);
 	this->handling--;
-	this->condvar->signal(this->condvar);
+	handle_queued(this);
 	this->mutex->unlock(this->mutex);
 	return JOB_REQUEUE_NONE;
 }
 
 /**
- * process a stroke request from the socket pointed by "fd"
+ * Read a complete stroke message from the socket, NULL on failure or if the
+ * client closed the connection
  */
-static job_requeue_t process(stroke_job_context_t *ctx)
+static stroke_msg_t *read_msg(int strokefd)
 {
 	stroke_msg_t *msg;
 	u_int16_t msg_length;
 	ssize_t bytes_read;
-	FILE *out;
-	private_stroke_socket_t *this = ctx->this;
-	int strokefd = ctx->fd;
 
 	/* peek the length */
-	bytes_read = recv(strokefd, &msg_length, sizeof(msg_length), MSG_PEEK);
+	bytes_read = recv(strokefd, &msg_length, sizeof(msg_length),
+					  MSG_PEEK | MSG_WAITALL);
+	if (bytes_read == 0)
+	{
+		return NULL;
+	}
 	if (bytes_read != sizeof(msg_length))
 	{
 		DBG1(DBG_CFG, "reading length of stroke message failed: %s",
 			 strerror(errno));
-		return job_processed(this);
+		return NULL;
+	}
+	if (msg_length < offsetof(stroke_msg_t, buffer))
+	{
+		DBG1(DBG_CFG, "invalid stroke message length %u", msg_length);
+		return NULL;
 	}
 
 	/* read message */
-	msg = alloca(msg_length);
-	bytes_read = recv(strokefd, msg, msg_length, 0);
+	msg = malloc(msg_length);
+	bytes_read = recv(strokefd, msg, msg_length, MSG_WAITALL);
 	if (bytes_read != msg_length)
 	{
 		DBG1(DBG_CFG, "reading stroke message failed: %s", strerror(errno));
-		return job_processed(this);
-	}
-
-	out = fdopen(strokefd, "w+");
-	if (out == NULL)
-	{
-		DBG1(DBG_CFG, "opening stroke output channel failed: %s", strerror(errno));
-		return job_processed(this);
+		free(msg);
+		return NULL;
 	}
-
 	DBG3(DBG_CFG, "stroke message %b", (void*)msg, msg_length);
+	return msg;
+}
 
+/**
+ * Handle a single stroke message
+ */
+static void handle_msg(private_stroke_socket_t *this, stroke_msg_t *msg,
+					   FILE *out)
+{
 	switch (msg->type)
 	{
 		case STR_INITIATE:
@@ -707,6 +744,9 @@ static job_requeue_t process(stroke_job_context_t *ctx)
 		case STR_STATUS_ALL_NOBLK:
 			stroke_status(this, msg, out, TRUE, FALSE);
 			break;
+		case STR_STATUS_FILTER:
+			stroke_status(this, msg, out, msg->status.all, !msg->status.noblk);
+			break;
 		case STR_ADD_CONN:
 			stroke_add_conn(this, msg);
 			break;
@@ -753,58 +793,123 @@ static job_requeue_t process(stroke_job_context_t *ctx)
 			DBG1(DBG_CFG, "received unknown stroke");
 			break;
 	}
-	fclose(out);
-	/* fclose() closes underlying FD */
-	ctx->fd = 0;
-	return job_processed(this);
 }
 
 /**
- * Handle queued stroke commands
+ * Delete the connections of a list of queued STR_DEL_CONN messages at once
  */
-static job_requeue_t handle(private_stroke_socket_t *this)
+static void flush_del_conns(private_stroke_socket_t *this, linked_list_t *msgs)
 {
-	stroke_job_context_t *ctx;
-	callback_job_t *job;
-	bool oldstate;
+	stroke_msg_t *msg;
 
-	this->mutex->lock(this->mutex);
-	thread_cleanup_push((thread_cleanup_t)this->mutex->unlock, this->mutex);
-	oldstate = thread_cancelability(TRUE);
-	while (this->commands->get_count(this->commands) == 0 ||
-		   this->handling >= this->max_concurrent)
+	if (msgs->get_count(msgs))
 	{
-		this->condvar->wait(this->condvar, this->mutex);
+		this->config->del_batch(this->config, msgs);
+		while (msgs->remove_first(msgs, (void**)&msg) == SUCCESS)
+		{
+			this->attribute->del_dns(this->attribute, msg);
+			this->handler->del_attributes(this->handler, msg);
+			free(msg);
+		}
+	}
+}
+
+/**
+ * Handle all stroke messages following a STR_BATCH message until the client
+ * closes its end of the connection. Consecutive deletions of connections are
+ * applied in a single pass over the configuration.
+ */
+static void stroke_batch(private_stroke_socket_t *this, int strokefd,
+						 FILE *out)
+{
+	linked_list_t *deleted;
+	stroke_msg_t *msg;
+	u_int count = 0;
+
+	deleted = linked_list_create();
+	while ((msg = read_msg(strokefd)))
+	{
+		count++;
+		if (msg->type == STR_DEL_CONN)
+		{
+			pop_string(msg, &msg->del_conn.name);
+			DBG1(DBG_CFG, "received stroke: delete connection '%s'",
+				 msg->del_conn.name);
+			deleted->insert_last(deleted, msg);
+			continue;
+		}
+		flush_del_conns(this, deleted);
+		if (msg->type == STR_BATCH)
+		{
+			DBG1(DBG_CFG, "received nested stroke batch, ignored");
+		}
+		else
+		{
+			handle_msg(this, msg, out);
+		}
+		free(msg);
+		fflush(out);
+	}
+	flush_del_conns(this, deleted);
+	deleted->destroy(deleted);
+	DBG1(DBG_CFG, "processed batch of %u stroke messages", count);
+}
+
+/**
+ * process a stroke request from the socket pointed by "fd"
+ */
+static job_requeue_t process(stroke_job_context_t *ctx)
+{
+	stroke_msg_t *msg;
+	FILE *out;
+	private_stroke_socket_t *this = ctx->this;
+	int strokefd = ctx->fd;
+
+	msg = read_msg(strokefd);
+	if (!msg)
+	{
+		return job_processed(this);
+	}
+
+	out = fdopen(strokefd, "w+");
+	if (out == NULL)
+	{
+		DBG1(DBG_CFG, "opening stroke output channel failed: %s", strerror(errno));
+		free(msg);
+		return job_processed(this);
 	}
-	thread_cancelability(oldstate);
-	this->commands->remove_first(this->commands, (void**)&ctx);
-	this->handling++;
-	thread_cleanup_pop(TRUE);
-	job = callback_job_create_with_prio((callback_job_cb_t)process, ctx,
-			(void*)stroke_job_context_destroy, NULL, JOB_PRIO_HIGH);
-	lib->processor->queue_job(lib->processor, (job_t*)job);
-	return JOB_REQUEUE_DIRECT;
+
+	if (msg->type == STR_BATCH)
+	{
+		stroke_batch(this, strokefd, out);
+	}
+	else
+	{
+		handle_msg(this, msg, out);
+	}
+	free(msg);
+	fclose(out);
+	/* fclose() closes underlying FD */
+	ctx->fd = 0;
+	return job_processed(this);
 }
 
 /**
  * Accept stroke commands and queue them to be handled
  */
-static job_requeue_t receive(private_stroke_socket_t *this)
+static bool on_accept(private_stroke_socket_t *this, int fd,
+					  watcher_event_t event)
 {
 	struct sockaddr_un strokeaddr;
 	int strokeaddrlen = sizeof(strokeaddr);
 	int strokefd;
-	bool oldstate;
 	stroke_job_context_t *ctx;
 
-	oldstate = thread_cancelability(TRUE);
-	strokefd = accept(this->socket, (struct sockaddr *)&strokeaddr, &strokeaddrlen);
-	thread_cancelability(oldstate);
-
+	strokefd = accept(fd, (struct sockaddr *)&strokeaddr, &strokeaddrlen);
 	if (strokefd < 0)
 	{
 		DBG1(DBG_CFG, "accepting stroke connection failed: %s", strerror(errno));
-		return JOB_REQUEUE_FAIR;
+		return TRUE;
 	}
 
 	INIT(ctx,
@@ -813,10 +918,10 @@ static job_requeue_t receive(private_stroke_socket_t *this)
 	);
 	this->mutex->lock(this->mutex);
 	this->commands->insert_last(this->commands, ctx);
-	this->condvar->signal(this->condvar);
+	handle_queued(this);
 	this->mutex->unlock(this->mutex);
 
-	return JOB_REQUEUE_FAIR;
+	return TRUE;
 }
 
 /**
@@ -867,8 +972,8 @@ static bool open_socket(private_stroke_socket_t *this)
 METHOD(stroke_socket_t, destroy, void,
 	private_stroke_socket_t *this)
 {
+	lib->watcher->remove(lib->watcher, this->socket);
 	this->commands->destroy_function(this->commands, (void*)stroke_job_context_destroy);
-	this->condvar->destroy(this->condvar);
 	this->mutex->destroy(this->mutex);
 	lib->credmgr->remove_set(lib->credmgr, &this->ca->set);
 	lib->credmgr->remove_set(lib->credmgr, &this->cred->set);
@@ -916,7 +1021,6 @@ stroke_socket_t *stroke_socket_create()
 	this->counter = stroke_counter_create();
 
 	this->mutex = mutex_create(MUTEX_TYPE_DEFAULT);
-	this->condvar = condvar_create(CONDVAR_TYPE_DEFAULT);
 	this->commands = linked_list_create();
 	this->max_concurrent = lib->settings->get_int(lib->settings,
 					"%s.plugins.stroke.max_concurrent", MAX_CONCURRENT_DEFAULT,
@@ -929,13 +1033,8 @@ stroke_socket_t *stroke_socket_create()
 	hydra->attributes->add_handler(hydra->attributes, &this->handler->handler);
 	charon->bus->add_listener(charon->bus, &this->counter->listener);
 
-	lib->processor->queue_job(lib->processor,
-		(job_t*)callback_job_create_with_prio((callback_job_cb_t)receive, this,
-				NULL, (callback_job_cancel_t)return_false, JOB_PRIO_CRITICAL));
-
-	lib->processor->queue_job(lib->processor,
-		(job_t*)callback_job_create_with_prio((callback_job_cb_t)handle, this,
-				NULL, (callback_job_cancel_t)return_false, JOB_PRIO_CRITICAL));
+	lib->watcher->add(lib->watcher, this->socket, WATCHER_READ,
+					  (watcher_cb_t)on_accept, this);
 
 	return &this->public;
 }
@@ -23,8 +23,8 @@
 #include <errno.h>
 
 #include <daemon.h>
-#include <threading/thread.h>
-#include <processing/jobs/callback_job.h>
+#include <threading/mutex.h>
+#include <collections/linked_list.h>
 
 #include "whitelist_msg.h"
 
@@ -49,6 +49,16 @@ struct private_whitelist_control_t {
 	 * Whitelist unix socket file descriptor
 	 */
 	int socket;
+
+	/**
+	 * Accepted connections, as fd cast to void*
+	 */
+	linked_list_t *connections;
+
+	/**
+	 * Mutex to lock connections
+	 */
+	mutex_t *mutex;
 };
 
 /**
@@ -148,55 +158,70 @@ static void dispatch(private_whitelist_control_t *this,
 }
 
 /**
- * Accept whitelist control connections, dispatch
+ * Read a message from a whitelist control connection, dispatch
  */
-static job_requeue_t receive(private_whitelist_control_t *this)
+static bool on_read(private_whitelist_control_t *this, int fd,
+					watcher_event_t event)
 {
-	struct sockaddr_un addr;
-	int fd, len = sizeof(addr);
 	whitelist_msg_t msg;
-	bool oldstate;
-
-	oldstate = thread_cancelability(TRUE);
-	fd = accept(this->socket, (struct sockaddr*)&addr, &len);
-	thread_cancelability(oldstate);
+	int len;
 
-	if (fd != -1)
+	len = recv(fd, &msg, sizeof(msg), 0);
+	if (len == sizeof(msg))
 	{
-		while (TRUE)
-		{
-			oldstate = thread_cancelability(TRUE);
-			len = recv(fd, &msg, sizeof(msg), 0);
-			thread_cancelability(oldstate);
-
-			if (len == sizeof(msg))
-			{
-				dispatch(this, fd, &msg);
-			}
-			else
-			{
-				if (len != 0)
-				{
-					DBG1(DBG_CFG, "receiving whitelist msg failed: %s",
-						 strerror(errno));
-				}
-				break;
-			}
-		}
-		close(fd);
+		dispatch(this, fd, &msg);
+		return TRUE;
 	}
-	else
+	if (len != 0)
+	{
+		DBG1(DBG_CFG, "receiving whitelist msg failed: %s", strerror(errno));
+	}
+	this->mutex->lock(this->mutex);
+	this->connections->remove(this->connections, (void*)(uintptr_t)fd, NULL);
+	this->mutex->unlock(this->mutex);
+	close(fd);
+	return FALSE;
+}
+
+/**
+ * Accept whitelist control connections
+ */
+static bool on_accept(private_whitelist_control_t *this, int fd,
+					  watcher_event_t event)
+{
+	struct sockaddr_un addr;
+	int len = sizeof(addr);
+
+	fd = accept(fd, (struct sockaddr*)&addr, &len);
+	if (fd == -1)
 	{
 		DBG1(DBG_CFG, "accepting whitelist connection failed: %s",
 			 strerror(errno));
+		return TRUE;
 	}
-	return JOB_REQUEUE_FAIR;
+	this->mutex->lock(this->mutex);
+	this->connections->insert_last(this->connections, (void*)(uintptr_t)fd);
+	this->mutex->unlock(this->mutex);
+	lib->watcher->add(lib->watcher, fd, WATCHER_READ,
+					  (watcher_cb_t)on_read, this);
+	return TRUE;
 }
 
 METHOD(whitelist_control_t, destroy, void,
 	private_whitelist_control_t *this)
 {
+	uintptr_t fd;
+
+	lib->watcher->remove(lib->watcher, this->socket);
 	close(this->socket);
+	while (this->connections->remove_first(this->connections,
+										   (void**)&fd) == SUCCESS)
+	{
+		lib->watcher->remove(lib->watcher, fd);
+		close(fd);
+	}
+	this->connections->destroy(this->connections);
+	this->mutex->destroy(this->mutex);
 	free(this);
 }
 
@@ -219,10 +244,11 @@ whitelist_control_t *whitelist_control_create(whitelist_listener_t *listener)
 		free(this);
 		return NULL;
 	}
+	this->connections = linked_list_create();
+	this->mutex = mutex_create(MUTEX_TYPE_DEFAULT);
 
-	lib->processor->queue_job(lib->processor,
-		(job_t*)callback_job_create_with_prio((callback_job_cb_t)receive, this,
-				NULL, (callback_job_cancel_t)return_false, JOB_PRIO_CRITICAL));
+	lib->watcher->add(lib->watcher, this->socket, WATCHER_READ,
+					  (watcher_cb_t)on_accept, this);
 
 	return &this->public;
 }
@@ -43,6 +43,11 @@ struct private_rekey_child_sa_job_t {
 	 * inbound SPI of the CHILD_SA
 	 */
 	u_int32_t spi;
+
+	/**
+	 * TRUE if the rekeying has been deferred by the rekey limiter
+	 */
+	bool deferred;
 };
 
 METHOD(job_t, destroy, void,
@@ -55,6 +60,8 @@ METHOD(job_t, execute, job_requeue_t,
 	private_rekey_child_sa_job_t *this)
 {
 	ike_sa_t *ike_sa;
+	child_sa_t *child_sa;
+	u_int32_t delay = 0;
 
 	ike_sa = charon->ike_sa_manager->checkout_by_id(charon->ike_sa_manager,
 													this->reqid, TRUE);
@@ -65,9 +72,36 @@ METHOD(job_t, execute, job_requeue_t,
 	}
 	else
 	{
-		ike_sa->rekey_child_sa(ike_sa, this->protocol, this->spi);
+		if (!this->deferred)
+		{
+			child_sa = ike_sa->get_child_sa(ike_sa, this->protocol,
+											this->spi, TRUE);
+			if (child_sa)
+			{
+				delay = charon->rekey_limiter->admit(charon->rekey_limiter,
+									child_sa->get_lifetime(child_sa, TRUE));
+			}
+		}
+		if (delay)
+		{
+			DBG2(DBG_JOB, "deferring rekeying of CHILD_SA with reqid %d by "
+				 "%u ms", this->reqid, delay);
+		}
+		else
+		{
+			ike_sa->rekey_child_sa(ike_sa, this->protocol, this->spi);
+		}
 		charon->ike_sa_manager->checkin(charon->ike_sa_manager, ike_sa);
 	}
+	if (delay)
+	{
+		this->deferred = TRUE;
+		return JOB_RESCHEDULE_MS(delay);
+	}
+	if (this->deferred)
+	{
+		charon->rekey_limiter->release(charon->rekey_limiter);
+	}
 	return JOB_REQUEUE_NONE;
 }
 
@@ -37,6 +37,11 @@ struct private_rekey_ike_sa_job_t {
 	 * force reauthentication of the peer (full IKE_SA setup)
 	 */
 	bool reauth;
+
+	/**
+	 * TRUE if the rekeying has been deferred by the rekey limiter
+	 */
+	bool deferred;
 };
 
 METHOD(job_t, destroy, void,
@@ -51,6 +56,7 @@ METHOD(job_t, execute, job_requeue_t,
 {
 	ike_sa_t *ike_sa;
 	status_t status = SUCCESS;
+	u_int32_t delay = 0;
 
 	ike_sa = charon->ike_sa_manager->checkout(charon->ike_sa_manager,
 											  this->ike_sa_id);
@@ -60,7 +66,17 @@ METHOD(job_t, execute, job_requeue_t,
 	}
 	else
 	{
-		if (this->reauth)
+		if (!this->deferred)
+		{
+			delay = charon->rekey_limiter->admit(charon->rekey_limiter,
+								ike_sa->get_statistic(ike_sa, STAT_DELETE));
+		}
+		if (delay)
+		{
+			DBG2(DBG_JOB, "deferring %s of IKE_SA by %u ms",
+				 this->reauth ? "reauthentication" : "rekeying", delay);
+		}
+		else if (this->reauth)
 		{
 			status = ike_sa->reauth(ike_sa);
 		}
@@ -78,6 +94,15 @@ METHOD(job_t, execute, job_requeue_t,
 			charon->ike_sa_manager->checkin(charon->ike_sa_manager, ike_sa);
 		}
 	}
+	if (delay)
+	{
+		this->deferred = TRUE;
+		return JOB_RESCHEDULE_MS(delay);
+	}
+	if (this->deferred)
+	{
+		charon->rekey_limiter->release(charon->rekey_limiter);
+	}
 	return JOB_REQUEUE_NONE;
 }
 
@@ -216,6 +216,11 @@ struct private_ike_sa_t {
 	 */
 	u_int32_t keepalive_interval;
 
+	/**
+	 * Maximum size of fragment data when sending fragmented IKEv2 messages
+	 */
+	size_t fragment_size;
+
 	/**
 	 * interval for retries during initiation (e.g. if DNS resolution failed),
 	 * 0 to disable (default)
@@ -990,6 +995,64 @@ METHOD(ike_sa_t, generate_message, status_t,
 	return status;
 }
 
+/**
+ * Generate a message and wrap the resulting packet in an enumerator
+ */
+static status_t generate_single(private_ike_sa_t *this, message_t *message,
+								enumerator_t **packets)
+{
+	packet_t *packet;
+	status_t status;
+
+	status = generate_message(this, message, &packet);
+	if (status == SUCCESS)
+	{
+		*packets = enumerator_create_single(packet, NULL);
+	}
+	return status;
+}
+
+METHOD(ike_sa_t, generate_message_fragmented, status_t,
+	private_ike_sa_t *this, message_t *message, enumerator_t **packets)
+{
+	enumerator_t *fragments;
+	linked_list_t *list;
+	packet_t *packet;
+	status_t status;
+	size_t size;
+
+	if (message->is_encoded(message) ||
+		this->version == IKEV1 || !this->ike_cfg ||
+		this->ike_cfg->fragmentation(this->ike_cfg) == FRAGMENTATION_NO ||
+		!supports_extension(this, EXT_IKE_FRAGMENTATION) ||
+		message->get_exchange_type(message) == IKE_SA_INIT)
+	{
+		return generate_single(this, message, packets);
+	}
+
+	this->stats[STAT_OUTBOUND] = time_monotonic(NULL);
+	message->set_ike_sa_id(message, this->ike_sa_id);
+	charon->bus->message(charon->bus, message, FALSE, TRUE);
+	/* the non-ESP marker reduces the space available when floated */
+	size = this->fragment_size - (has_condition(this, COND_NAT_ANY) ? 4 : 0);
+	status = message->fragment(message, this->keymat, size, &fragments);
+	if (status != SUCCESS)
+	{
+		return status;
+	}
+	list = linked_list_create();
+	while (fragments->enumerate(fragments, &packet))
+	{
+		set_dscp(this, packet);
+		list->insert_last(list, packet);
+	}
+	fragments->destroy(fragments);
+	charon->bus->message(charon->bus, message, FALSE, FALSE);
+	*packets = enumerator_create_cleaner(list->create_enumerator(list),
+										 (void*)list->destroy, list);
+	return SUCCESS;
+}
+
 METHOD(ike_sa_t, set_kmaddress, void,
 	private_ike_sa_t *this, host_t *local, host_t *remote)
 {
@@ -1717,6 +1780,17 @@ METHOD(ike_sa_t, reestablish, status_t,
 	return status;
 }
 
+METHOD(ike_sa_t, resume_response, status_t,
+	private_ike_sa_t *this)
+{
+	if (!has_condition(this, COND_RESPONSE_DEFERRED))
+	{
+		return SUCCESS;
+	}
+	set_condition(this, COND_RESPONSE_DEFERRED, FALSE);
+	return this->task_manager->resume_response(this->task_manager);
+}
+
 METHOD(ike_sa_t, retransmit, status_t,
 	private_ike_sa_t *this, u_int32_t message_id)
 {
@@ -2239,6 +2313,7 @@ ike_sa_t * ike_sa_create(ike_sa_id_t *ike_sa_id, bool initiator,
 			.clear_peer_addresses = _clear_peer_addresses,
 			.has_mapping_changed = _has_mapping_changed,
 			.retransmit = _retransmit,
+			.resume_response = _resume_response,
 			.delete = _delete_,
 			.destroy = _destroy,
 			.send_dpd = _send_dpd,
@@ -2259,6 +2334,7 @@ ike_sa_t * ike_sa_create(ike_sa_id_t *ike_sa_id, bool initiator,
 			.roam = _roam,
 			.inherit = _inherit,
 			.generate_message = _generate_message,
+			.generate_message_fragmented = _generate_message_fragmented,
 			.reset = _reset,
 			.get_unique_id = _get_unique_id,
 			.add_virtual_ip = _add_virtual_ip,
@@ -2305,6 +2381,8 @@ ike_sa_t * ike_sa_create(ike_sa_id_t *ike_sa_id, bool initiator,
 							"%s.keep_alive", KEEPALIVE_INTERVAL, charon->name),
 		.retry_initiate_interval = lib->settings->get_time(lib->settings,
 							"%s.retry_initiate_interval", 0, charon->name),
+		.fragment_size = lib->settings->get_int(lib->settings,
+							"%s.fragment_size", MAX_FRAGMENT_SIZE, charon->name),
 		.flush_auth_cfg = lib->settings->get_bool(lib->settings,
 							"%s.flush_auth_cfg", FALSE, charon->name),
 	);
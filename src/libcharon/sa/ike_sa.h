@@ -65,6 +65,16 @@ typedef struct ike_sa_t ike_sa_t;
  */
 #define RETRY_JITTER 20
 
+/**
+ * Maximum size of fragment data when sending fragmented IKEv1 or IKEv2
+ * messages (currently the same is used for IPv4 and IPv6, even though the
+ * latter has a higher minimum datagram size).
+ * 576 (= min. IPv4) - 20 (= IP header) - 8 (= UDP header) -
+ *  - 28 (= IKE header) - 8 (= fragment header) = 512
+ * This is reduced by 4 in case of NAT-T (due to the non-ESP marker).
+ */
+#define MAX_FRAGMENT_SIZE 512
+
 /**
  * Extensions (or optional features) the peer supports
  */
@@ -128,7 +138,7 @@ enum ike_extension_t {
 	EXT_NATT_DRAFT_02_03 = (1<<10),
 
 	/**
-	 * peer support proprietary IKE fragmentation
+	 * peer supports proprietary IKEv1 or standardized IKEv2 fragmentation
 	 */
 	EXT_IKE_FRAGMENTATION = (1<<11),
 };
@@ -192,6 +202,11 @@ enum ike_condition_t {
 	 * This IKE_SA is currently being reauthenticated
 	 */
 	COND_REAUTHENTICATING = (1<<10),
+
+	/**
+	 * Response to the current request is deferred, see resume_response()
+	 */
+	COND_RESPONSE_DEFERRED = (1<<11),
 };
 
 /**
@@ -210,6 +225,10 @@ enum statistic_t {
 	STAT_INBOUND,
 	/** Timestamp of last outbound IKE packet */
 	STAT_OUTBOUND,
+	/** Number of retransmitted requests */
+	STAT_RETRANSMIT,
+	/** Number of retransmitted requests received, answered from cache */
+	STAT_DUPLICATE,
 
 	STAT_MAX
 };
@@ -786,6 +805,25 @@ struct ike_sa_t {
 	status_t (*generate_message) (ike_sa_t *this, message_t *message,
 								  packet_t **packet);
 
+	/**
+	 * Generate an IKE message, fragmented if supported and required.
+	 *
+	 * IKEv2 messages protected by an encryption payload get split into
+	 * encrypted fragments (RFC 7383) if the peer supports fragmentation,
+	 * it is enabled in the config and the message exceeds the configured
+	 * fragment size. Otherwise a single packet is generated.
+	 *
+	 * @param message		message to generate
+	 * @param packets		enumerator over generated packets (packet_t*),
+	 *						each enumerated packet gets owned by the caller
+	 * @return
+	 *						- SUCCESS
+	 *						- FAILED
+	 *						- DESTROY_ME if this IKE_SA MUST be deleted
+	 */
+	status_t (*generate_message_fragmented)(ike_sa_t *this, message_t *message,
+											enumerator_t **packets);
+
 	/**
 	 * Retransmits a request.
 	 *
@@ -796,6 +834,20 @@ struct ike_sa_t {
 	 */
 	status_t (*retransmit) (ike_sa_t *this, u_int32_t message_id);
 
+	/**
+	 * Resume building a response deferred while processing a request.
+	 *
+	 * A task may set COND_RESPONSE_DEFERRED while building a response, e.g.
+	 * if an attribute provider acquires a virtual IP asynchronously. The
+	 * response is not sent and the tasks are called again to complete it once
+	 * the component that deferred it calls this method.
+	 *
+	 * @return
+	 *						- SUCCESS if response sent, or none deferred
+	 *						- DESTROY_ME if this IKE_SA MUST be deleted
+	 */
+	status_t (*resume_response)(ike_sa_t *this);
+
 	/**
 	 * Sends a DPD request to the peer.
 	 *
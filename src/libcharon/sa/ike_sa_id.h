@@ -77,7 +77,10 @@ struct ike_sa_id_t {
 	 * Check if two ike_sa_id_t objects are equal.
 	 *
 	 * Two ike_sa_id_t objects are equal if version and both SPI values match.
-	 * The role is not compared.
+	 * For IKEv2 the role has to match too, so that the initiator and responder
+	 * of an IKE_SA can be distinguished when both are handled by the same
+	 * daemon. The role is not compared for IKEv1, as it is not encoded in
+	 * IKEv1 messages.
 	 *
 	 * @param other				ike_sa_id_t object to check if equal
 	 * @return					TRUE if given ike_sa_id_t are equal,
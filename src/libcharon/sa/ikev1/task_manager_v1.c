@@ -55,15 +55,6 @@
  */
 #define MAX_PACKET 10000
 
-/**
- * Maximum size of fragment data when sending packets (currently the same is
- * used for IPv4 and IPv6, even though the latter has a higher minimum datagram
- * size).  576 (= min. IPv4) - 20 (= IP header) - 8 (= UDP header) -
- *  - 28 (= IKE header) - 8 (= fragment header) = 512
- * This is reduced by 4 in case of NAT-T (due to the non-ESP marker).
- */
-#define MAX_FRAGMENT_SIZE 512
-
 /**
  * First sequence number of responding packets.
  *
@@ -2011,6 +2002,7 @@ task_manager_v1_t *task_manager_v1_create(ike_sa_t *ike_sa)
 				.queue_dpd = _queue_dpd,
 				.initiate = _initiate,
 				.retransmit = _retransmit,
+				.resume_response = (void*)return_success,
 				.incr_mid = _incr_mid,
 				.reset = _reset,
 				.adopt_tasks = _adopt_tasks,
@@ -80,7 +80,7 @@ METHOD(keymat_t, get_version, ike_version_t,
 METHOD(keymat_t, create_dh, diffie_hellman_t*,
 	private_keymat_v2_t *this, diffie_hellman_group_t group)
 {
-	return lib->crypto->create_dh(lib->crypto, group);
+	return lib->dh_pool->get(lib->dh_pool, group);
 }
 
 METHOD(keymat_t, create_nonce_gen, nonce_gen_t*,
@@ -37,6 +37,7 @@
 #include <sa/ikev2/tasks/child_delete.h>
 #include <encoding/payloads/delete_payload.h>
 #include <encoding/payloads/unknown_payload.h>
+#include <encoding/payloads/encryption_payload.h>
 #include <processing/jobs/retransmit_job.h>
 #include <processing/jobs/delete_ike_sa_job.h>
 
@@ -89,9 +90,19 @@ struct private_task_manager_t {
 		u_int32_t mid;
 
 		/**
-		 * packet for retransmission
+		 * packet(s) for retransmission
 		 */
-		packet_t *packet;
+		linked_list_t *packets;
+
+		/**
+		 * Response deferred by a task, if any
+		 */
+		message_t *deferred;
+
+		/**
+		 * Task that deferred the response
+		 */
+		task_t *task;
 
 	} responding;
 
@@ -110,9 +121,9 @@ struct private_task_manager_t {
 		u_int retransmitted;
 
 		/**
-		 * packet for retransmission
+		 * packet(s) for retransmission
 		 */
-		packet_t *packet;
+		linked_list_t *packets;
 
 		/**
 		 * type of the initated exchange
@@ -136,6 +147,11 @@ struct private_task_manager_t {
 	 */
 	linked_list_t *passive_tasks;
 
+	/**
+	 * Message being reassembled from received fragments, if any
+	 */
+	message_t *defrag;
+
 	/**
 	 * the task manager has been reset
 	 */
@@ -191,6 +207,8 @@ static void flush(private_task_manager_t *this)
 	flush_queue(this, TASK_QUEUE_QUEUED);
 	flush_queue(this, TASK_QUEUE_PASSIVE);
 	flush_queue(this, TASK_QUEUE_ACTIVE);
+	DESTROY_IF(this->responding.deferred);
+	this->responding.deferred = NULL;
 }
 
 /**
@@ -218,10 +236,84 @@ static bool activate_task(private_task_manager_t *this, task_type_t type)
 	return found;
 }
 
+/**
+ * Destroy all packets in the given list
+ */
+static void clear_packets(linked_list_t *packets)
+{
+	packet_t *packet;
+
+	while (packets->remove_last(packets, (void**)&packet) == SUCCESS)
+	{
+		packet->destroy(packet);
+	}
+}
+
+/**
+ * Send copies of all packets in the given list, optionally to other hosts
+ */
+static void send_packets(private_task_manager_t *this, linked_list_t *packets,
+						 host_t *src, host_t *dst)
+{
+	enumerator_t *enumerator;
+	packet_t *packet, *clone;
+
+	enumerator = packets->create_enumerator(packets);
+	while (enumerator->enumerate(enumerator, &packet))
+	{
+		/* the clone shares the packet data, no copy is made */
+		clone = packet->clone(packet);
+		if (src)
+		{
+			clone->set_source(clone, src->clone(src));
+		}
+		if (dst)
+		{
+			clone->set_destination(clone, dst->clone(dst));
+		}
+		charon->sender->send(charon->sender, clone);
+	}
+	enumerator->destroy(enumerator);
+}
+
+/**
+ * Generate the given message, fragmented if necessary, and store the
+ * resulting packet(s) in the given list
+ */
+static status_t generate_message(private_task_manager_t *this,
+								 message_t *message, linked_list_t *packets)
+{
+	enumerator_t *fragments;
+	packet_t *packet;
+	status_t status;
+
+	status = this->ike_sa->generate_message_fragmented(this->ike_sa, message,
+													   &fragments);
+	if (status == SUCCESS)
+	{
+		while (fragments->enumerate(fragments, &packet))
+		{
+			packets->insert_last(packets, packet);
+		}
+		fragments->destroy(fragments);
+	}
+	return status;
+}
+
+/**
+ * Increment a counter type statistic of the IKE_SA
+ */
+static void count_statistic(private_task_manager_t *this, statistic_t kind)
+{
+	this->ike_sa->set_statistic(this->ike_sa, kind,
+						this->ike_sa->get_statistic(this->ike_sa, kind) + 1);
+}
+
 METHOD(task_manager_t, retransmit, status_t,
 	private_task_manager_t *this, u_int32_t message_id)
 {
-	if (this->initiating.packet && message_id == this->initiating.mid)
+	if (this->initiating.packets->get_count(this->initiating.packets) &&
+		message_id == this->initiating.mid)
 	{
 		u_int32_t timeout;
 		job_t *job;
@@ -230,6 +322,8 @@ METHOD(task_manager_t, retransmit, status_t,
 		task_t *task;
 		ike_mobike_t *mobike = NULL;
 
+		this->initiating.packets->get_first(this->initiating.packets,
+											(void**)&packet);
 		/* check if we are retransmitting a MOBIKE routability check */
 		enumerator = this->active_tasks->create_enumerator(this->active_tasks);
 		while (enumerator->enumerate(enumerator, (void*)&task))
@@ -258,7 +352,7 @@ METHOD(task_manager_t, retransmit, status_t,
 				DBG1(DBG_IKE, "giving up after %d retransmits",
 					 this->initiating.retransmitted - 1);
 				charon->bus->alert(charon->bus, ALERT_RETRANSMIT_SEND_TIMEOUT,
-								   this->initiating.packet);
+								   packet);
 				return DESTROY_ME;
 			}
 
@@ -266,11 +360,10 @@ METHOD(task_manager_t, retransmit, status_t,
 			{
 				DBG1(DBG_IKE, "retransmit %d of request with message ID %d",
 					 this->initiating.retransmitted, message_id);
-				charon->bus->alert(charon->bus, ALERT_RETRANSMIT_SEND,
-								   this->initiating.packet);
+				charon->bus->alert(charon->bus, ALERT_RETRANSMIT_SEND, packet);
+				count_statistic(this, STAT_RETRANSMIT);
 			}
-			packet = this->initiating.packet->clone(this->initiating.packet);
-			charon->sender->send(charon->sender, packet);
+			send_packets(this, this->initiating.packets, NULL, NULL);
 		}
 		else
 		{	/* for routeability checks, we use a more aggressive behavior */
@@ -290,7 +383,7 @@ METHOD(task_manager_t, retransmit, status_t,
 				DBG1(DBG_IKE, "path probing attempt %d",
 					 this->initiating.retransmitted);
 			}
-			mobike->transmit(mobike, this->initiating.packet);
+			mobike->transmit(mobike, packet);
 		}
 
 		this->initiating.retransmitted++;
@@ -494,8 +587,7 @@ METHOD(task_manager_t, initiate, status_t,
 	/* update exchange type if a task changed it */
 	this->initiating.type = message->get_exchange_type(message);
 
-	status = this->ike_sa->generate_message(this->ike_sa, message,
-											&this->initiating.packet);
+	status = generate_message(this, message, this->initiating.packets);
 	if (status != SUCCESS)
 	{
 		/* message generation failed. There is nothing more to do than to
@@ -565,8 +657,7 @@ static status_t process_response(private_task_manager_t *this,
 
 	this->initiating.mid++;
 	this->initiating.type = EXCHANGE_TYPE_UNDEFINED;
-	this->initiating.packet->destroy(this->initiating.packet);
-	this->initiating.packet = NULL;
+	clear_packets(this->initiating.packets);
 
 	return initiate(this);
 }
@@ -622,33 +713,30 @@ static bool handle_collisions(private_task_manager_t *this, task_t *task)
 }
 
 /**
- * build a response depending on the "passive" task list
+ * complete a response with the "passive" task list and send it, starting at
+ * the task that deferred it if resuming
  */
-static status_t build_response(private_task_manager_t *this, message_t *request)
+static status_t complete_response(private_task_manager_t *this,
+								  message_t *message, task_t *resume)
 {
 	enumerator_t *enumerator;
-	task_t *task;
-	message_t *message;
-	host_t *me, *other;
+	task_t *task, *deferred = NULL;
 	bool delete = FALSE, hook = FALSE;
 	ike_sa_id_t *id = NULL;
 	u_int64_t responder_spi;
 	status_t status;
 
-	me = request->get_destination(request);
-	other = request->get_source(request);
-
-	message = message_create(IKEV2_MAJOR_VERSION, IKEV2_MINOR_VERSION);
-	message->set_exchange_type(message, request->get_exchange_type(request));
-	/* send response along the path the request came in */
-	message->set_source(message, me->clone(me));
-	message->set_destination(message, other->clone(other));
-	message->set_message_id(message, this->responding.mid);
-	message->set_request(message, FALSE);
-
 	enumerator = this->passive_tasks->create_enumerator(this->passive_tasks);
 	while (enumerator->enumerate(enumerator, (void*)&task))
 	{
+		if (resume)
+		{
+			if (task != resume)
+			{	/* already built before the response got deferred */
+				continue;
+			}
+			resume = NULL;
+		}
 		switch (task->build(task, message))
 		{
 			case SUCCESS:
@@ -660,6 +748,12 @@ static status_t build_response(private_task_manager_t *this, message_t *request)
 				}
 				break;
 			case NEED_MORE:
+				if (this->ike_sa->has_condition(this->ike_sa,
+												COND_RESPONSE_DEFERRED))
+				{	/* task completes the response later */
+					deferred = task;
+					break;
+				}
 				/* processed, but task needs another exchange */
 				if (handle_collisions(this, task))
 				{
@@ -676,19 +770,30 @@ static status_t build_response(private_task_manager_t *this, message_t *request)
 				delete = TRUE;
 				break;
 		}
-		if (delete)
+		if (delete || deferred)
 		{
 			break;
 		}
 	}
 	enumerator->destroy(enumerator);
 
+	if (deferred)
+	{
+		DBG1(DBG_IKE, "deferring %N response", exchange_type_names,
+			 message->get_exchange_type(message));
+		/* don't retransmit the previous response while deferred */
+		clear_packets(this->responding.packets);
+		this->responding.deferred = message;
+		this->responding.task = deferred;
+		return SUCCESS;
+	}
+
 	/* RFC 5996, section 2.6 mentions that in the event of a failure during
 	 * IKE_SA_INIT the responder's SPI will be 0 in the response, while it
 	 * actually explicitly allows it to be non-zero.  Since we use the responder
 	 * SPI to create hashes in the IKE_SA manager we can only set the SPI to
 	 * zero temporarily, otherwise checking the SA in would fail. */
-	if (delete && request->get_exchange_type(request) == IKE_SA_INIT)
+	if (delete && message->get_exchange_type(message) == IKE_SA_INIT)
 	{
 		id = this->ike_sa->get_id(this->ike_sa);
 		responder_spi = id->get_responder_spi(id);
@@ -696,10 +801,8 @@ static status_t build_response(private_task_manager_t *this, message_t *request)
 	}
 
 	/* message complete, send it */
-	DESTROY_IF(this->responding.packet);
-	this->responding.packet = NULL;
-	status = this->ike_sa->generate_message(this->ike_sa, message,
-											&this->responding.packet);
+	clear_packets(this->responding.packets);
+	status = generate_message(this, message, this->responding.packets);
 	message->destroy(message);
 	if (id)
 	{
@@ -711,8 +814,7 @@ static status_t build_response(private_task_manager_t *this, message_t *request)
 		return DESTROY_ME;
 	}
 
-	charon->sender->send(charon->sender,
-						 this->responding.packet->clone(this->responding.packet));
+	send_packets(this, this->responding.packets, NULL, NULL);
 	if (delete)
 	{
 		if (hook)
@@ -724,6 +826,49 @@ static status_t build_response(private_task_manager_t *this, message_t *request)
 	return SUCCESS;
 }
 
+/**
+ * build a response depending on the "passive" task list
+ */
+static status_t build_response(private_task_manager_t *this, message_t *request)
+{
+	message_t *message;
+	host_t *me, *other;
+
+	me = request->get_destination(request);
+	other = request->get_source(request);
+
+	message = message_create(IKEV2_MAJOR_VERSION, IKEV2_MINOR_VERSION);
+	message->set_exchange_type(message, request->get_exchange_type(request));
+	/* send response along the path the request came in */
+	message->set_source(message, me->clone(me));
+	message->set_destination(message, other->clone(other));
+	message->set_message_id(message, this->responding.mid);
+	message->set_request(message, FALSE);
+
+	return complete_response(this, message, NULL);
+}
+
+METHOD(task_manager_t, resume_response, status_t,
+	private_task_manager_t *this)
+{
+	message_t *message;
+
+	message = this->responding.deferred;
+	if (!message)
+	{
+		return SUCCESS;
+	}
+	this->responding.deferred = NULL;
+	DBG1(DBG_IKE, "resuming deferred %N response", exchange_type_names,
+		 message->get_exchange_type(message));
+	if (complete_response(this, message, this->responding.task) != SUCCESS)
+	{
+		flush(this);
+		return DESTROY_ME;
+	}
+	return SUCCESS;
+}
+
 /**
  * handle an incoming request message
  */
@@ -987,15 +1132,14 @@ static void send_notify_response(private_task_manager_t *this,
 }
 
 /**
- * Parse the given message and verify that it is valid.
+ * Check a parsed message for unsupported critical payloads and handle the
+ * result of parsing it, invalid requests get answered with a notify.
  */
-static status_t parse_message(private_task_manager_t *this, message_t *msg)
+static status_t check_parsed(private_task_manager_t *this, message_t *msg,
+							 status_t status)
 {
-	status_t status;
 	u_int8_t type = 0;
 
-	status = msg->parse_body(msg, this->ike_sa->get_keymat(this->ike_sa));
-
 	if (status == SUCCESS)
 	{	/* check for unsupported critical payloads */
 		enumerator_t *enumerator;
@@ -1077,21 +1221,26 @@ static status_t parse_message(private_task_manager_t *this, message_t *msg)
 	return status;
 }
 
+/**
+ * Parse the given message and verify that it is valid.
+ */
+static status_t parse_message(private_task_manager_t *this, message_t *msg)
+{
+	status_t status;
+
+	status = msg->parse_body(msg, this->ike_sa->get_keymat(this->ike_sa));
+	return check_parsed(this, msg, status);
+}
 
-METHOD(task_manager_t, process_message, status_t,
-	private_task_manager_t *this, message_t *msg)
+
+/**
+ * Process a parsed and verified message
+ */
+static status_t process_verified(private_task_manager_t *this, message_t *msg)
 {
 	host_t *me, *other;
-	status_t status;
 	u_int32_t mid;
 
-	charon->bus->message(charon->bus, msg, TRUE, FALSE);
-	status = parse_message(this, msg);
-	if (status != SUCCESS)
-	{
-		return status;
-	}
-
 	me = msg->get_destination(msg);
 	other = msg->get_source(msg);
 
@@ -1163,20 +1312,22 @@ METHOD(task_manager_t, process_message, status_t,
 			}
 			this->responding.mid++;
 		}
-		else if ((mid == this->responding.mid - 1) && this->responding.packet)
+		else if ((mid == this->responding.mid - 1) &&
+				 this->responding.deferred)
+		{
+			DBG1(DBG_IKE, "received retransmit of request with ID %d, "
+				 "response is deferred", mid);
+			count_statistic(this, STAT_DUPLICATE);
+		}
+		else if ((mid == this->responding.mid - 1) &&
+				 this->responding.packets->get_count(this->responding.packets))
 		{
-			packet_t *clone;
-			host_t *host;
-
 			DBG1(DBG_IKE, "received retransmit of request with ID %d, "
 				 "retransmitting response", mid);
 			charon->bus->alert(charon->bus, ALERT_RETRANSMIT_RECEIVE, msg);
-			clone = this->responding.packet->clone(this->responding.packet);
-			host = msg->get_destination(msg);
-			clone->set_source(clone, host->clone(host));
-			host = msg->get_source(msg);
-			clone->set_destination(clone, host->clone(host));
-			charon->sender->send(charon->sender, clone);
+			count_statistic(this, STAT_DUPLICATE);
+			send_packets(this, this->responding.packets,
+						 msg->get_destination(msg), msg->get_source(msg));
 		}
 		else
 		{
@@ -1222,6 +1373,100 @@ METHOD(task_manager_t, process_message, status_t,
 	return SUCCESS;
 }
 
+/**
+ * Handle a received encrypted fragment, process the message once complete
+ */
+static status_t handle_fragment(private_task_manager_t *this, message_t *msg)
+{
+	encrypted_fragment_payload_t *fragment;
+	message_t *defrag;
+	status_t status;
+	u_int32_t mid;
+
+	mid = msg->get_request(msg) ? this->responding.mid : this->initiating.mid;
+	if (msg->get_message_id(msg) != mid)
+	{	/* retransmits and unexpected messages are handled by looking at the
+		 * first fragment only */
+		fragment = (encrypted_fragment_payload_t*)msg->get_payload(msg,
+														ENCRYPTED_FRAGMENT);
+		if (fragment->get_fragment_number(fragment) == 1)
+		{
+			return process_verified(this, msg);
+		}
+		return SUCCESS;
+	}
+
+	if (this->defrag &&
+		(this->defrag->get_message_id(this->defrag) != mid ||
+		 this->defrag->get_request(this->defrag) != msg->get_request(msg)))
+	{
+		this->defrag->destroy(this->defrag);
+		this->defrag = NULL;
+	}
+	if (!this->defrag)
+	{
+		this->defrag = message_create_defrag(msg);
+		if (!this->defrag)
+		{
+			return FAILED;
+		}
+	}
+	status = this->defrag->add_fragment(this->defrag, msg);
+	switch (status)
+	{
+		case NEED_MORE:
+			return SUCCESS;
+		case SUCCESS:
+		case PARSE_ERROR:
+		case VERIFY_ERROR:
+		case NOT_SUPPORTED:
+			/* the reassembled message gets handled like an unfragmented one,
+			 * invalid requests are answered and advance the message ID */
+			defrag = this->defrag;
+			this->defrag = NULL;
+			status = check_parsed(this, defrag, status);
+			if (status == SUCCESS)
+			{
+				status = process_verified(this, defrag);
+			}
+			defrag->destroy(defrag);
+			return status;
+		default:
+			DBG1(DBG_IKE, "reassembling fragmented %N %s with message ID %u "
+				 "failed", exchange_type_names, msg->get_exchange_type(msg),
+				 msg->get_request(msg) ? "request" : "response", mid);
+			this->defrag->destroy(this->defrag);
+			this->defrag = NULL;
+			return status;
+	}
+}
+
+METHOD(task_manager_t, process_message, status_t,
+	private_task_manager_t *this, message_t *msg)
+{
+	status_t status;
+
+	charon->bus->message(charon->bus, msg, TRUE, FALSE);
+	status = parse_message(this, msg);
+	if (status != SUCCESS)
+	{
+		return status;
+	}
+	if (msg->get_payload(msg, ENCRYPTED_FRAGMENT))
+	{
+		if (!this->ike_sa->supports_extension(this->ike_sa,
+											  EXT_IKE_FRAGMENTATION))
+		{
+			DBG1(DBG_IKE, "ignoring fragmented %N %s, fragmentation not "
+				 "negotiated", exchange_type_names, msg->get_exchange_type(msg),
+				 msg->get_request(msg) ? "request" : "response");
+			return FAILED;
+		}
+		return handle_fragment(this, msg);
+	}
+	return process_verified(this, msg);
+}
+
 METHOD(task_manager_t, queue_task, void,
 	private_task_manager_t *this, task_t *task)
 {
@@ -1432,10 +1677,12 @@ METHOD(task_manager_t, reset, void,
 	task_t *task;
 
 	/* reset message counters and retransmit packets */
-	DESTROY_IF(this->responding.packet);
-	DESTROY_IF(this->initiating.packet);
-	this->responding.packet = NULL;
-	this->initiating.packet = NULL;
+	clear_packets(this->responding.packets);
+	clear_packets(this->initiating.packets);
+	DESTROY_IF(this->defrag);
+	this->defrag = NULL;
+	DESTROY_IF(this->responding.deferred);
+	this->responding.deferred = NULL;
 	if (initiate != UINT_MAX)
 	{
 		this->initiating.mid = initiate;
@@ -1490,8 +1737,11 @@ METHOD(task_manager_t, destroy, void,
 	this->queued_tasks->destroy(this->queued_tasks);
 	this->passive_tasks->destroy(this->passive_tasks);
 
-	DESTROY_IF(this->responding.packet);
-	DESTROY_IF(this->initiating.packet);
+	this->responding.packets->destroy_offset(this->responding.packets,
+											 offsetof(packet_t, destroy));
+	this->initiating.packets->destroy_offset(this->initiating.packets,
+											 offsetof(packet_t, destroy));
+	DESTROY_IF(this->defrag);
 	free(this);
 }
 
@@ -1518,6 +1768,7 @@ task_manager_v2_t *task_manager_v2_create(ike_sa_t *ike_sa)
 				.queue_dpd = _queue_dpd,
 				.initiate = _initiate,
 				.retransmit = _retransmit,
+				.resume_response = _resume_response,
 				.incr_mid = _incr_mid,
 				.reset = _reset,
 				.adopt_tasks = _adopt_tasks,
@@ -1529,6 +1780,8 @@ task_manager_v2_t *task_manager_v2_create(ike_sa_t *ike_sa)
 		},
 		.ike_sa = ike_sa,
 		.initiating.type = EXCHANGE_TYPE_UNDEFINED,
+		.initiating.packets = linked_list_create(),
+		.responding.packets = linked_list_create(),
 		.queued_tasks = linked_list_create(),
 		.active_tasks = linked_list_create(),
 		.passive_tasks = linked_list_create(),
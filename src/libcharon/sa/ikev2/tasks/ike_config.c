@@ -357,6 +357,11 @@ METHOD(task_t, build_r, status_t,
 
 			found = hydra->attributes->acquire_address(hydra->attributes,
 													   pools, id, requested);
+			if (!found && this->ike_sa->has_condition(this->ike_sa,
+												COND_RESPONSE_DEFERRED))
+			{	/* provider acquires an address asynchronously */
+				break;
+			}
 			if (found)
 			{
 				DBG1(DBG_IKE, "assigning virtual IP %H to peer '%Y'", found, id);
@@ -376,6 +381,23 @@ METHOD(task_t, build_r, status_t,
 		}
 		enumerator->destroy(enumerator);
 
+		if (this->ike_sa->has_condition(this->ike_sa, COND_RESPONSE_DEFERRED))
+		{
+			DBG1(DBG_IKE, "virtual IP for '%Y' pending, deferring response", id);
+			/* release what we got so far, we query all pools again */
+			while (vips->remove_last(vips, (void**)&requested) == SUCCESS)
+			{
+				hydra->attributes->release_address(hydra->attributes, pools,
+												   requested, id);
+				requested->destroy(requested);
+			}
+			this->ike_sa->clear_virtual_ips(this->ike_sa, FALSE);
+			DESTROY_IF(cp);
+			vips->destroy(vips);
+			pools->destroy(pools);
+			return NEED_MORE;
+		}
+
 		if (this->vips->get_count(this->vips) && !vips->get_count(vips))
 		{
 			DBG1(DBG_IKE, "no virtual IP found, sending %N",
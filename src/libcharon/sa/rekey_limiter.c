@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2013 HSR Hochschule fuer Technik Rapperswil
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#include "rekey_limiter.h"
+
+#include <daemon.h>
+#include <threading/mutex.h>
+
+/**
+ * Default time before hard expiry in which SAs get rekeyed regardless of the
+ * budget, in s
+ */
+#define DEFAULT_URGENT 60
+
+typedef struct private_rekey_limiter_t private_rekey_limiter_t;
+
+/**
+ * Private data of a rekey_limiter_t object.
+ */
+struct private_rekey_limiter_t {
+
+	/**
+	 * Public rekey_limiter_t interface.
+	 */
+	rekey_limiter_t public;
+
+	/**
+	 * Rekeyings per second, 0 for no limit
+	 */
+	u_int rate;
+
+	/**
+	 * Window to randomly defer rekeyings in, in s
+	 */
+	u_int window;
+
+	/**
+	 * Time before hard expiry in which we don't defer rekeyings, in s
+	 */
+	u_int urgent;
+
+	/**
+	 * Next free slot to start a rekeying, monotonic time in us
+	 */
+	u_int64_t next;
+
+	/**
+	 * Number of deferred rekeyings
+	 */
+	u_int queued;
+
+	/**
+	 * Mutex to lock slot and counter
+	 */
+	mutex_t *mutex;
+};
+
+METHOD(rekey_limiter_t, admit, u_int32_t,
+	private_rekey_limiter_t *this, time_t expire)
+{
+	u_int64_t now, slot, start, latest = ~0ULL;
+	timeval_t tv;
+	u_int32_t delay;
+
+	if (!this->rate && !this->window)
+	{
+		return 0;
+	}
+	time_monotonic(&tv);
+	now = tv.tv_sec * 1000000ULL + tv.tv_usec;
+	if (expire)
+	{
+		latest = expire > this->urgent ? expire - this->urgent : 0;
+		latest *= 1000000ULL;
+	}
+
+	this->mutex->lock(this->mutex);
+	slot = max(now, this->next);
+	if (this->rate)
+	{
+		this->next = slot + 1000000 / this->rate;
+	}
+	start = slot;
+	if (this->window)
+	{
+		start += this->window * 1000000ULL * (random() / (RAND_MAX + 1.0));
+	}
+	/* SAs close to expiry use up their slot, but don't wait for it */
+	start = min(start, max(now, latest));
+	delay = (start - now + 999) / 1000;
+	if (delay)
+	{
+		this->queued++;
+	}
+	this->mutex->unlock(this->mutex);
+
+	return delay;
+}
+
+METHOD(rekey_limiter_t, release, void,
+	private_rekey_limiter_t *this)
+{
+	this->mutex->lock(this->mutex);
+	if (this->queued)
+	{
+		this->queued--;
+	}
+	this->mutex->unlock(this->mutex);
+}
+
+METHOD(rekey_limiter_t, get_queued, u_int,
+	private_rekey_limiter_t *this)
+{
+	u_int queued;
+
+	this->mutex->lock(this->mutex);
+	queued = this->queued;
+	this->mutex->unlock(this->mutex);
+
+	return queued;
+}
+
+METHOD(rekey_limiter_t, get_rate, u_int,
+	private_rekey_limiter_t *this)
+{
+	return this->rate;
+}
+
+METHOD(rekey_limiter_t, destroy, void,
+	private_rekey_limiter_t *this)
+{
+	this->mutex->destroy(this->mutex);
+	free(this);
+}
+
+/**
+ * See header
+ */
+rekey_limiter_t *rekey_limiter_create()
+{
+	private_rekey_limiter_t *this;
+
+	INIT(this,
+		.public = {
+			.admit = _admit,
+			.release = _release,
+			.get_queued = _get_queued,
+			.get_rate = _get_rate,
+			.destroy = _destroy,
+		},
+		.rate = lib->settings->get_int(lib->settings,
+							"%s.rekey_limiter.rate", 0, charon->name),
+		.window = lib->settings->get_time(lib->settings,
+							"%s.rekey_limiter.window", 0, charon->name),
+		.urgent = lib->settings->get_time(lib->settings,
+							"%s.rekey_limiter.urgent", DEFAULT_URGENT,
+							charon->name),
+		.mutex = mutex_create(MUTEX_TYPE_DEFAULT),
+	);
+
+	return &this->public;
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2013 HSR Hochschule fuer Technik Rapperswil
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+/**
+ * @defgroup rekey_limiter rekey_limiter
+ * @{ @ingroup sa
+ */
+
+#ifndef REKEY_LIMITER_H_
+#define REKEY_LIMITER_H_
+
+#include <library.h>
+
+typedef struct rekey_limiter_t rekey_limiter_t;
+
+/**
+ * Admission control for IKE_SA and CHILD_SA rekeyings.
+ *
+ * Rekeying jobs ask the limiter before they start a rekeying. To keep the
+ * number of rekeyings per second within the configured budget, the limiter
+ * assigns each rekeying the next free slot and returns the time to defer it
+ * by. Optionally, rekeyings are additionally deferred by a random delay within
+ * a window, to break up bursts of SAs established at the same time. SAs close
+ * to their hard expiry get rekeyed immediately, but still use up the budget.
+ */
+struct rekey_limiter_t {
+
+	/**
+	 * Admit a rekeying, or get the time to defer it by.
+	 *
+	 * If a rekeying is deferred, release() has to be called when it gets
+	 * started after the returned time.
+	 *
+	 * @param expire		monotonic time the SA hard expires, 0 for never
+	 * @return				time in ms to defer rekeying, 0 to start it now
+	 */
+	u_int32_t (*admit)(rekey_limiter_t *this, time_t expire);
+
+	/**
+	 * Release a previously deferred rekeying, once it gets started.
+	 */
+	void (*release)(rekey_limiter_t *this);
+
+	/**
+	 * Get the number of currently deferred rekeyings.
+	 *
+	 * @return				number of deferred rekeyings
+	 */
+	u_int (*get_queued)(rekey_limiter_t *this);
+
+	/**
+	 * Get the configured number of rekeyings per second.
+	 *
+	 * @return				rekeyings per second, 0 if not limited
+	 */
+	u_int (*get_rate)(rekey_limiter_t *this);
+
+	/**
+	 * Destroy a rekey_limiter_t.
+	 */
+	void (*destroy)(rekey_limiter_t *this);
+};
+
+/**
+ * Create a rekey_limiter instance.
+ *
+ * @return			rekey_limiter_t object
+ */
+rekey_limiter_t *rekey_limiter_create();
+
+#endif /** REKEY_LIMITER_H_ @}*/
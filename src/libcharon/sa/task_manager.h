@@ -201,6 +201,19 @@ struct task_manager_t {
 	 */
 	status_t (*retransmit) (task_manager_t *this, u_int32_t message_id);
 
+	/**
+	 * Resume building a response deferred by a task.
+	 *
+	 * Tasks defer a response by setting COND_RESPONSE_DEFERRED on the IKE_SA
+	 * and returning NEED_MORE from build(). Resuming calls build() again on
+	 * the deferring task and the tasks following it, and sends the response.
+	 *
+	 * @return
+	 *						- SUCCESS if response sent, or none deferred
+	 *						- DESTROY_ME if IKE_SA must be destroyed
+	 */
+	status_t (*resume_response)(task_manager_t *this);
+
 	/**
 	 * Migrate all tasks from other to this.
 	 *
@@ -0,0 +1,324 @@
+/*
+ * Copyright (C) 2013 HSR Hochschule fuer Technik Rapperswil
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#include <test_suite.h>
+
+#include <daemon.h>
+#include <encoding/message.h>
+#include <encoding/generator.h>
+#include <encoding/payloads/encryption_payload.h>
+#include <encoding/payloads/vendor_id_payload.h>
+
+/**
+ * Data of the vendor ID payload in the reassembled message
+ */
+static u_char vid[100];
+
+/**
+ * Generated payload data that gets fragmented
+ */
+static chunk_t content;
+
+/**
+ * Message used to reassemble the fragments
+ */
+static message_t *defrag;
+
+/**
+ * Configured maximum packet size, restored after each test
+ */
+static int max_packet;
+
+/**
+ * Generate the plain content of a fragmented message, a single vendor ID
+ * payload
+ */
+static chunk_t generate_content()
+{
+	vendor_id_payload_t *payload;
+	generator_t *generator;
+	u_int32_t *lenpos;
+	chunk_t data;
+
+	payload = vendor_id_payload_create_data(VENDOR_ID,
+											chunk_clone(chunk_from_thing(vid)));
+	generator = generator_create();
+	generator->generate_payload(generator, &payload->payload_interface);
+	data = chunk_clone(generator->get_chunk(generator, &lenpos));
+	generator->destroy(generator);
+	payload->destroy(payload);
+	return data;
+}
+
+/**
+ * Create a message containing the given part of the content as fragment
+ */
+static message_t *create_fragment_data(u_int32_t mid, u_int16_t num,
+									   u_int16_t total, chunk_t data)
+{
+	encrypted_fragment_payload_t *fragment;
+	ike_sa_id_t *id;
+	message_t *message;
+
+	message = message_create(IKEV2_MAJOR_VERSION, IKEV2_MINOR_VERSION);
+	id = ike_sa_id_create(IKEV2_MAJOR_VERSION, 1, 2, FALSE);
+	message->set_ike_sa_id(message, id);
+	id->destroy(id);
+	message->set_exchange_type(message, INFORMATIONAL);
+	message->set_message_id(message, mid);
+	message->set_request(message, TRUE);
+	fragment = encrypted_fragment_payload_create_from_data(num, total, data);
+	if (num == 1)
+	{
+		fragment->encrypted.payload_interface.set_next_type(
+							&fragment->encrypted.payload_interface, VENDOR_ID);
+	}
+	message->add_payload(message, &fragment->encrypted.payload_interface);
+	return message;
+}
+
+/**
+ * Create fragment num of total, splitting the content into equal parts
+ */
+static message_t *create_fragment(u_int16_t num, u_int16_t total)
+{
+	size_t len;
+
+	len = content.len / total + (content.len % total ? 1 : 0);
+	return create_fragment_data(1, num, total,
+		chunk_create(content.ptr + (num - 1) * len,
+					 min(len, content.len - (num - 1) * len)));
+}
+
+/**
+ * Add fragment num of total to the reassembled message
+ */
+static status_t add_fragment(u_int16_t num, u_int16_t total)
+{
+	message_t *fragment;
+	status_t status;
+
+	fragment = create_fragment(num, total);
+	if (!defrag)
+	{
+		defrag = message_create_defrag(fragment);
+		ck_assert(defrag);
+	}
+	status = defrag->add_fragment(defrag, fragment);
+	fragment->destroy(fragment);
+	return status;
+}
+
+/**
+ * Check that the reassembled message contains the original content
+ */
+static void assert_reassembled()
+{
+	vendor_id_payload_t *payload;
+
+	ck_assert_int_eq(defrag->get_message_id(defrag), 1);
+	ck_assert(defrag->get_request(defrag));
+	ck_assert_int_eq(defrag->get_exchange_type(defrag), INFORMATIONAL);
+	payload = (vendor_id_payload_t*)defrag->get_payload(defrag, VENDOR_ID);
+	ck_assert(payload);
+	ck_assert(chunk_equals(payload->get_data(payload),
+						   chunk_from_thing(vid)));
+}
+
+START_SETUP(setup_defrag)
+{
+	memset(vid, 0x42, sizeof(vid));
+	content = generate_content();
+	defrag = NULL;
+	max_packet = lib->settings->get_int(lib->settings, "%s.max_packet",
+										10000, charon->name);
+}
+END_SETUP
+
+START_TEARDOWN(teardown_defrag)
+{
+	DESTROY_IF(defrag);
+	chunk_free(&content);
+	lib->settings->set_int(lib->settings, "%s.max_packet", max_packet,
+						   charon->name);
+}
+END_TEARDOWN
+
+START_TEST(test_not_fragment)
+{
+	message_t *message;
+
+	message = message_create(IKEV2_MAJOR_VERSION, IKEV2_MINOR_VERSION);
+	ck_assert(message_create_defrag(message) == NULL);
+	message->destroy(message);
+}
+END_TEST
+
+START_TEST(test_single)
+{
+	ck_assert_int_eq(add_fragment(1, 1), SUCCESS);
+	assert_reassembled();
+}
+END_TEST
+
+START_TEST(test_in_order)
+{
+	ck_assert_int_eq(add_fragment(1, 3), NEED_MORE);
+	ck_assert_int_eq(add_fragment(2, 3), NEED_MORE);
+	ck_assert_int_eq(add_fragment(3, 3), SUCCESS);
+	assert_reassembled();
+}
+END_TEST
+
+START_TEST(test_reverse_order)
+{
+	ck_assert_int_eq(add_fragment(3, 3), NEED_MORE);
+	ck_assert_int_eq(add_fragment(2, 3), NEED_MORE);
+	ck_assert_int_eq(add_fragment(1, 3), SUCCESS);
+	assert_reassembled();
+}
+END_TEST
+
+START_TEST(test_mixed_order)
+{
+	ck_assert_int_eq(add_fragment(2, 4), NEED_MORE);
+	ck_assert_int_eq(add_fragment(4, 4), NEED_MORE);
+	ck_assert_int_eq(add_fragment(1, 4), NEED_MORE);
+	ck_assert_int_eq(add_fragment(3, 4), SUCCESS);
+	assert_reassembled();
+}
+END_TEST
+
+START_TEST(test_duplicate)
+{
+	ck_assert_int_eq(add_fragment(2, 3), NEED_MORE);
+	ck_assert_int_eq(add_fragment(2, 3), NEED_MORE);
+	ck_assert_int_eq(add_fragment(1, 3), NEED_MORE);
+	ck_assert_int_eq(add_fragment(1, 3), NEED_MORE);
+	ck_assert_int_eq(add_fragment(2, 3), NEED_MORE);
+	ck_assert_int_eq(add_fragment(3, 3), SUCCESS);
+	assert_reassembled();
+}
+END_TEST
+
+START_TEST(test_total_increased)
+{
+	/* the sender switched to a smaller fragment size, start over */
+	ck_assert_int_eq(add_fragment(1, 2), NEED_MORE);
+	ck_assert_int_eq(add_fragment(1, 3), NEED_MORE);
+	ck_assert_int_eq(add_fragment(2, 3), NEED_MORE);
+	ck_assert_int_eq(add_fragment(3, 3), SUCCESS);
+	assert_reassembled();
+}
+END_TEST
+
+START_TEST(test_total_decreased)
+{
+	/* fragments with fewer total fragments are stale and get ignored */
+	ck_assert_int_eq(add_fragment(1, 3), NEED_MORE);
+	ck_assert_int_eq(add_fragment(2, 2), NEED_MORE);
+	ck_assert_int_eq(add_fragment(2, 3), NEED_MORE);
+	ck_assert_int_eq(add_fragment(1, 2), NEED_MORE);
+	ck_assert_int_eq(add_fragment(3, 3), SUCCESS);
+	assert_reassembled();
+}
+END_TEST
+
+START_TEST(test_too_large)
+{
+	lib->settings->set_int(lib->settings, "%s.max_packet", content.len / 2,
+						   charon->name);
+	ck_assert_int_eq(add_fragment(1, 3), NEED_MORE);
+	ck_assert_int_eq(add_fragment(2, 3), FAILED);
+	/* the fragments received so far are dropped */
+	ck_assert_int_eq(add_fragment(3, 3), NEED_MORE);
+}
+END_TEST
+
+START_TEST(test_max_size)
+{
+	lib->settings->set_int(lib->settings, "%s.max_packet", content.len,
+						   charon->name);
+	ck_assert_int_eq(add_fragment(1, 3), NEED_MORE);
+	ck_assert_int_eq(add_fragment(2, 3), NEED_MORE);
+	ck_assert_int_eq(add_fragment(3, 3), SUCCESS);
+	assert_reassembled();
+}
+END_TEST
+
+START_TEST(test_other_message)
+{
+	message_t *fragment;
+
+	ck_assert_int_eq(add_fragment(1, 2), NEED_MORE);
+	fragment = create_fragment_data(2, 2, 2, content);
+	ck_assert_int_eq(defrag->add_fragment(defrag, fragment), INVALID_ARG);
+	fragment->destroy(fragment);
+}
+END_TEST
+
+START_TEST(test_parse_error)
+{
+	message_t *fragment;
+
+	/* cut off the end of the vendor ID payload */
+	fragment = create_fragment_data(1, 1, 1, chunk_create(content.ptr, 20));
+	defrag = message_create_defrag(fragment);
+	ck_assert(defrag);
+	ck_assert_int_eq(defrag->add_fragment(defrag, fragment), PARSE_ERROR);
+	fragment->destroy(fragment);
+}
+END_TEST
+
+Suite *message_suite_create()
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("message");
+
+	tc = tcase_create("add_fragment order");
+	tcase_add_checked_fixture(tc, setup_defrag, teardown_defrag);
+	tcase_add_test(tc, test_not_fragment);
+	tcase_add_test(tc, test_single);
+	tcase_add_test(tc, test_in_order);
+	tcase_add_test(tc, test_reverse_order);
+	tcase_add_test(tc, test_mixed_order);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("add_fragment duplicates");
+	tcase_add_checked_fixture(tc, setup_defrag, teardown_defrag);
+	tcase_add_test(tc, test_duplicate);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("add_fragment total");
+	tcase_add_checked_fixture(tc, setup_defrag, teardown_defrag);
+	tcase_add_test(tc, test_total_increased);
+	tcase_add_test(tc, test_total_decreased);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("add_fragment size");
+	tcase_add_checked_fixture(tc, setup_defrag, teardown_defrag);
+	tcase_add_test(tc, test_too_large);
+	tcase_add_test(tc, test_max_size);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("add_fragment invalid");
+	tcase_add_checked_fixture(tc, setup_defrag, teardown_defrag);
+	tcase_add_test(tc, test_other_message);
+	tcase_add_test(tc, test_parse_error);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -0,0 +1,407 @@
+/*
+ * Copyright (C) 2013 HSR Hochschule fuer Technik Rapperswil
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#include <test_suite.h>
+
+#include <encoding/parser.h>
+#include <encoding/generator.h>
+#include <encoding/payloads/id_payload.h>
+#include <encoding/payloads/cert_payload.h>
+#include <encoding/payloads/certreq_payload.h>
+#include <encoding/payloads/auth_payload.h>
+#include <encoding/payloads/sa_payload.h>
+#include <encoding/payloads/ts_payload.h>
+#include <encoding/payloads/notify_payload.h>
+#include <encoding/payloads/ke_payload.h>
+#include <encoding/payloads/nonce_payload.h>
+#include <encoding/payloads/delete_payload.h>
+#include <encoding/payloads/vendor_id_payload.h>
+#include <encoding/payloads/cp_payload.h>
+#include <encoding/payloads/eap_payload.h>
+
+/**
+ * Number of data fields in the IKE_AUTH request built by build_ike_auth():
+ * IDi, CERT, IDr, AUTH, the ESP SPI and the start and end address of the two
+ * traffic selectors
+ */
+#define IKE_AUTH_DATA_FIELDS 9
+
+/**
+ * Generated payloads to parse
+ */
+static chunk_t data;
+
+/**
+ * Type of the first generated payload
+ */
+static payload_type_t first;
+
+/**
+ * Create a chunk of the given length filled with a pattern
+ */
+static chunk_t pattern(size_t len)
+{
+	chunk_t chunk;
+
+	chunk = chunk_alloc(len);
+	memset(chunk.ptr, 0x42, len);
+	return chunk;
+}
+
+/**
+ * Generate the given payloads, destroys them
+ */
+static void generate(linked_list_t *payloads)
+{
+	generator_t *generator;
+	payload_t *payload, *next;
+	u_int32_t *lenpos;
+
+	generator = generator_create();
+	payloads->get_first(payloads, (void**)&payload);
+	first = payload->get_type(payload);
+	while (payloads->remove_first(payloads, (void**)&payload) == SUCCESS)
+	{
+		next = NULL;
+		payloads->get_first(payloads, (void**)&next);
+		payload->set_next_type(payload,
+							   next ? next->get_type(next) : NO_PAYLOAD);
+		generator->generate_payload(generator, payload);
+		payload->destroy(payload);
+	}
+	data = chunk_clone(generator->get_chunk(generator, &lenpos));
+	generator->destroy(generator);
+	payloads->destroy(payloads);
+}
+
+/**
+ * Build the payloads of a typical IKE_AUTH request
+ */
+static linked_list_t *build_ike_auth()
+{
+	linked_list_t *payloads, *list;
+	identification_t *id;
+	proposal_t *proposal;
+	auth_payload_t *auth;
+	chunk_t chunk;
+
+	payloads = linked_list_create();
+
+	id = identification_create_from_string("carol@strongswan.org");
+	payloads->insert_last(payloads,
+					id_payload_create_from_identification(ID_INITIATOR, id));
+	id->destroy(id);
+	payloads->insert_last(payloads,
+					cert_payload_create_custom(CERTIFICATE,
+										ENC_X509_SIGNATURE, pattern(1200)));
+	id = identification_create_from_string("moon.strongswan.org");
+	payloads->insert_last(payloads,
+					id_payload_create_from_identification(ID_RESPONDER, id));
+	id->destroy(id);
+
+	auth = auth_payload_create();
+	auth->set_auth_method(auth, AUTH_RSA);
+	chunk = pattern(256);
+	auth->set_data(auth, chunk);
+	chunk_free(&chunk);
+	payloads->insert_last(payloads, auth);
+
+	proposal = proposal_create_from_string(PROTO_ESP, "aes128-sha256");
+	proposal->set_spi(proposal, htonl(0xc0c0c0c0));
+	payloads->insert_last(payloads, sa_payload_create_from_proposal_v2(proposal));
+	proposal->destroy(proposal);
+
+	list = linked_list_create();
+	list->insert_last(list, traffic_selector_create_from_cidr("10.1.0.0/16",
+															  0, 0, 65535));
+	payloads->insert_last(payloads,
+					ts_payload_create_from_traffic_selectors(TRUE, list));
+	payloads->insert_last(payloads,
+					ts_payload_create_from_traffic_selectors(FALSE, list));
+	list->destroy_offset(list, offsetof(traffic_selector_t, destroy));
+
+	payloads->insert_last(payloads,
+					notify_payload_create_from_protocol_and_type(NOTIFY,
+										PROTO_NONE, INITIAL_CONTACT));
+	payloads->insert_last(payloads,
+					notify_payload_create_from_protocol_and_type(NOTIFY,
+										PROTO_NONE, MOBIKE_SUPPORTED));
+	payloads->insert_last(payloads,
+					notify_payload_create_from_protocol_and_type(NOTIFY,
+										PROTO_NONE, NO_ADDITIONAL_ADDRESSES));
+	return payloads;
+}
+
+/**
+ * Build at least one of each IKEv2 payload that contains data
+ */
+static linked_list_t *build_all()
+{
+	linked_list_t *payloads;
+	certreq_payload_t *certreq;
+	notify_payload_t *notify;
+	delete_payload_t *delete;
+	cp_payload_t *cp;
+	ke_payload_t *ke;
+	nonce_payload_t *nonce;
+	eap_payload_t *eap;
+	chunk_t chunk;
+
+	payloads = build_ike_auth();
+
+	ke = ke_payload_create(KEY_EXCHANGE);
+	payloads->insert_last(payloads, ke);
+	nonce = nonce_payload_create(NONCE);
+	chunk = pattern(32);
+	nonce->set_nonce(nonce, chunk);
+	chunk_free(&chunk);
+	payloads->insert_last(payloads, nonce);
+
+	certreq = certreq_payload_create_type(CERT_X509);
+	chunk = pattern(20);
+	certreq->add_keyid(certreq, chunk);
+	chunk_free(&chunk);
+	payloads->insert_last(payloads, certreq);
+
+	notify = notify_payload_create_from_protocol_and_type(NOTIFY, PROTO_ESP,
+														  REKEY_SA);
+	notify->set_spi(notify, htonl(0xc1c1c1c1));
+	payloads->insert_last(payloads, notify);
+	notify = notify_payload_create_from_protocol_and_type(NOTIFY, PROTO_NONE,
+														  COOKIE);
+	chunk = pattern(16);
+	notify->set_notification_data(notify, chunk);
+	chunk_free(&chunk);
+	payloads->insert_last(payloads, notify);
+
+	delete = delete_payload_create(DELETE, PROTO_ESP);
+	delete->add_spi(delete, htonl(0xc2c2c2c2));
+	delete->add_spi(delete, htonl(0xc3c3c3c3));
+	payloads->insert_last(payloads, delete);
+
+	chunk = pattern(16);
+	payloads->insert_last(payloads,
+					vendor_id_payload_create_data(VENDOR_ID, chunk));
+
+	cp = cp_payload_create_type(CONFIGURATION, CFG_REPLY);
+	chunk = chunk_from_chars(10,3,0,1);
+	cp->add_attribute(cp, configuration_attribute_create_chunk(
+						CONFIGURATION_ATTRIBUTE, INTERNAL_IP4_ADDRESS, chunk));
+	chunk = chunk_from_chars(10,3,0,254);
+	cp->add_attribute(cp, configuration_attribute_create_chunk(
+						CONFIGURATION_ATTRIBUTE, INTERNAL_IP4_DNS, chunk));
+	/* the generator keeps the attribute format of the last transform
+	 * attribute, so generate configuration attributes before the SA */
+	payloads->insert_first(payloads, cp);
+
+	chunk = chunk_from_chars(0x02,0x01,0x00,0x05,0x01);
+	eap = eap_payload_create_data(chunk);
+	payloads->insert_last(payloads, eap);
+
+	return payloads;
+}
+
+/**
+ * Parse all generated payloads
+ */
+static linked_list_t *parse(bool zero_copy)
+{
+	linked_list_t *payloads;
+	payload_type_t type;
+	payload_t *payload;
+	parser_t *parser;
+
+	payloads = linked_list_create();
+	parser = parser_create(data);
+	parser->set_zero_copy(parser, zero_copy);
+	type = first;
+	while (type != NO_PAYLOAD)
+	{
+		ck_assert(parser->parse_payload(parser, type, &payload) == SUCCESS);
+		ck_assert(payload->verify(payload) == SUCCESS);
+		payloads->insert_last(payloads, payload);
+		type = payload->get_next_type(payload);
+	}
+	parser->destroy(parser);
+	return payloads;
+}
+
+/**
+ * Destroy parsed payloads, releasing references to the generated data
+ */
+static u_int destroy_parsed(linked_list_t *payloads)
+{
+	payload_t *payload;
+	u_int released = 0;
+
+	while (payloads->remove_first(payloads, (void**)&payload) == SUCCESS)
+	{
+		released += payload_release_data(payload, data);
+		payload->destroy(payload);
+	}
+	payloads->destroy(payloads);
+	return released;
+}
+
+/**
+ * Copy the generated data referenced by parsed payloads
+ */
+static u_int copy_parsed(linked_list_t *payloads)
+{
+	enumerator_t *enumerator;
+	payload_t *payload;
+	u_int copied = 0;
+
+	enumerator = payloads->create_enumerator(payloads);
+	while (enumerator->enumerate(enumerator, &payload))
+	{
+		copied += payload_copy_data(payload, data);
+	}
+	enumerator->destroy(enumerator);
+	return copied;
+}
+
+/**
+ * Generate parsed payloads again
+ */
+static chunk_t regenerate(linked_list_t *payloads)
+{
+	enumerator_t *enumerator;
+	generator_t *generator;
+	payload_t *payload;
+	u_int32_t *lenpos;
+	chunk_t chunk;
+
+	generator = generator_create();
+	enumerator = payloads->create_enumerator(payloads);
+	while (enumerator->enumerate(enumerator, &payload))
+	{
+		generator->generate_payload(generator, payload);
+	}
+	enumerator->destroy(enumerator);
+	chunk = chunk_clone(generator->get_chunk(generator, &lenpos));
+	generator->destroy(generator);
+	return chunk;
+}
+
+START_TEST(test_ike_auth_references)
+{
+	linked_list_t *payloads;
+	enumerator_t *enumerator;
+	payload_t *payload;
+	chunk_t *field;
+
+	generate(build_ike_auth());
+	payloads = parse(TRUE);
+	enumerator = payloads->create_enumerator(payloads);
+	while (enumerator->enumerate(enumerator, &payload))
+	{
+		field = payload_get_field(payload, CHUNK_DATA, 0);
+		if (field && field->len)
+		{
+			ck_assert(field->ptr >= data.ptr &&
+					  field->ptr + field->len <= data.ptr + data.len);
+		}
+	}
+	enumerator->destroy(enumerator);
+	destroy_parsed(payloads);
+	chunk_free(&data);
+}
+END_TEST
+
+START_TEST(test_ike_auth_allocations)
+{
+	linked_list_t *payloads;
+
+	generate(build_ike_auth());
+
+	/* when copying, the parser allocates every data field */
+	payloads = parse(FALSE);
+	ck_assert_int_eq(copy_parsed(payloads), 0);
+	ck_assert_int_eq(destroy_parsed(payloads), 0);
+
+	/* in zero-copy mode, none of them, they all reference the input */
+	payloads = parse(TRUE);
+	ck_assert_int_eq(copy_parsed(payloads), IKE_AUTH_DATA_FIELDS);
+	ck_assert_int_eq(destroy_parsed(payloads), 0);
+
+	payloads = parse(TRUE);
+	ck_assert_int_eq(destroy_parsed(payloads), IKE_AUTH_DATA_FIELDS);
+	chunk_free(&data);
+}
+END_TEST
+
+START_TEST(test_copy_data)
+{
+	linked_list_t *payloads;
+	chunk_t copied, referenced;
+
+	/* payload_copy_data() has to copy every field the parser referenced in
+	 * zero-copy mode. If a payload gets a data field outside of the encoding
+	 * rules it handles, the payload keeps referencing the parsed data. */
+	generate(build_all());
+	payloads = parse(FALSE);
+	copied = regenerate(payloads);
+	destroy_parsed(payloads);
+
+	payloads = parse(TRUE);
+	ck_assert(copy_parsed(payloads) > 0);
+	memset(data.ptr, 0, data.len);
+	referenced = regenerate(payloads);
+	ck_assert(chunk_equals(copied, referenced));
+
+	chunk_free(&data);
+	payloads->destroy_offset(payloads, offsetof(payload_t, destroy));
+	chunk_free(&copied);
+	chunk_free(&referenced);
+}
+END_TEST
+
+START_TEST(test_release_data)
+{
+	linked_list_t *payloads;
+	u_int referenced;
+
+	/* payloads parsed in zero-copy mode must not reference the parsed data
+	 * after releasing it, destroying them would free it otherwise */
+	generate(build_all());
+	payloads = parse(TRUE);
+	referenced = copy_parsed(payloads);
+	destroy_parsed(payloads);
+
+	payloads = parse(TRUE);
+	ck_assert_int_eq(destroy_parsed(payloads), referenced);
+	chunk_free(&data);
+}
+END_TEST
+
+Suite *parser_suite_create()
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("parser");
+
+	tc = tcase_create("zero-copy IKE_AUTH");
+	tcase_add_test(tc, test_ike_auth_references);
+	tcase_add_test(tc, test_ike_auth_allocations);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("zero-copy encoding rules");
+	tcase_add_test(tc, test_copy_data);
+	tcase_add_test(tc, test_release_data);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -51,24 +51,12 @@ bool replace_pool = FALSE;
 static void del(char *name);
 static void do_args(int argc, char *argv[]);
 
-/**
- * nesting counter for database transaction functions
- */
-int nested_transaction = 0;
-
 /**
  * start a database transaction
  */
 static void begin_transaction()
 {
-	if (db->get_driver(db) == DB_SQLITE)
-	{
-		if (!nested_transaction)
-		{
-			db->execute(db, NULL, "BEGIN EXCLUSIVE TRANSACTION");
-		}
-		++nested_transaction;
-	}
+	db->transaction(db, TRUE);
 }
 
 /**
@@ -76,14 +64,7 @@ static void begin_transaction()
  */
 static void commit_transaction()
 {
-	if (db->get_driver(db) == DB_SQLITE)
-	{
-		--nested_transaction;
-		if (!nested_transaction)
-		{
-			db->execute(db, NULL, "END TRANSACTION");
-		}
-	}
+	db->commit(db);
 }
 
 /**
@@ -370,7 +351,7 @@ static void add(char *name, host_t *start, host_t *end, int timeout)
 	id = create_pool(name, start_addr, end_addr, timeout);
 	printf("allocating %d addresses... ", count);
 	fflush(stdout);
-	/* run population in a transaction for sqlite */
+	/* run population in a single transaction */
 	begin_transaction();
 	while (TRUE)
 	{
@@ -449,7 +430,7 @@ static void add_addresses(char *pool, char *path, int timeout)
 	host_t *addr;
 	FILE *file;
 
-	/* run population in a transaction for sqlite */
+	/* run population in a single transaction */
 	begin_transaction();
 
 	addr = host_create_from_string("%any", 0);
@@ -606,7 +587,7 @@ static void resize(char *name, host_t *end)
 
 	printf("allocating %d new addresses... ", count);
 	fflush(stdout);
-	/* run population in a transaction for sqlite */
+	/* run population in a single transaction */
 	begin_transaction();
 	while (count-- > 0)
 	{
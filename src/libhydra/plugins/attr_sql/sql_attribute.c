@@ -131,6 +131,7 @@ static host_t* check_lease(private_sql_attribute_t *this, char *name,
 		chunk_t address;
 		enumerator_t *e;
 		time_t now = time(NULL);
+		int hits;
 
 		e = this->db->query(this->db,
 				"SELECT id, address FROM addresses "
@@ -144,10 +145,15 @@ static host_t* check_lease(private_sql_attribute_t *this, char *name,
 		address = chunk_clonea(address);
 		e->destroy(e);
 
-		if (this->db->execute(this->db, NULL,
+		hits = this->db->execute(this->db, NULL,
 				"UPDATE addresses SET acquired = ?, released = 0 "
 				"WHERE id = ? AND identity = ? AND released != 0",
-				DB_UINT, now, DB_UINT, id, DB_UINT, identity) > 0)
+				DB_UINT, now, DB_UINT, id, DB_UINT, identity);
+		if (hits < 0)
+		{	/* the transaction failed, don't retry within it */
+			break;
+		}
+		if (hits > 0)
 		{
 			host_t *host;
 
@@ -222,6 +228,10 @@ static host_t* get_lease(private_sql_attribute_t *this, char *name,
 						"WHERE id = ? AND identity = 0",
 						DB_UINT, now, DB_UINT, identity, DB_UINT, id);
 		}
+		if (hits < 0)
+		{	/* the transaction failed, don't retry within it */
+			break;
+		}
 		if (hits > 0)
 		{
 			host_t *host;
@@ -249,6 +259,12 @@ METHOD(attribute_provider_t, acquire_address, host_t*,
 	char *name;
 	int family;
 
+	/* commit all lookups and updates at once, serializable so the selected
+	 * candidates are not taken by others before we update them */
+	if (!this->db->transaction(this->db, TRUE))
+	{
+		return NULL;
+	}
 	identity = get_identity(this, id);
 	if (identity)
 	{
@@ -288,6 +304,11 @@ METHOD(attribute_provider_t, acquire_address, host_t*,
 			enumerator->destroy(enumerator);
 		}
 	}
+	if (!this->db->commit(this->db))
+	{
+		DESTROY_IF(address);
+		address = NULL;
+	}
 	return address;
 }
 
@@ -303,6 +324,10 @@ METHOD(attribute_provider_t, release_address, bool,
 	int family;
 
 	family = address->get_family(address);
+	if (!this->db->transaction(this->db, TRUE))
+	{
+		return FALSE;
+	}
 	enumerator = pools->create_enumerator(pools);
 	while (enumerator->enumerate(enumerator, &name))
 	{
@@ -331,7 +356,7 @@ METHOD(attribute_provider_t, release_address, bool,
 	}
 	enumerator->destroy(enumerator);
 
-	return found;
+	return this->db->commit(this->db) && found;
 }
 
 METHOD(attribute_provider_t, create_attribute_enumerator, enumerator_t*,
@@ -346,7 +371,7 @@ METHOD(attribute_provider_t, create_attribute_enumerator, enumerator_t*,
 		u_int count;
 		char *name;
 
-		this->db->execute(this->db, NULL, "BEGIN EXCLUSIVE TRANSACTION");
+		this->db->transaction(this->db, TRUE);
 
 		/* in a first step check for attributes that match name and id */
 		if (id)
@@ -418,7 +443,7 @@ METHOD(attribute_provider_t, create_attribute_enumerator, enumerator_t*,
 			pool_enumerator->destroy(pool_enumerator);
 		}
 
-		this->db->execute(this->db, NULL, "END TRANSACTION");
+		this->db->commit(this->db);
 
 		/* lastly try to find global attributes */
 		if (!attr_enumerator)
@@ -16,10 +16,72 @@
 #include "imv_os_database.h"
 
 #include <utils/debug.h>
+#include <threading/mutex.h>
+#include <threading/rwlock.h>
+#include <collections/hashtable.h>
+#include <collections/linked_list.h>
 
 #include <string.h>
 
+/**
+ * Default interval in seconds to check the versions of a product for changes
+ */
+#define INDEX_REFRESH_DEFAULT 30
+
 typedef struct private_imv_os_database_t private_imv_os_database_t;
+typedef struct stamp_t stamp_t;
+typedef struct version_t version_t;
+typedef struct package_t package_t;
+typedef struct product_t product_t;
+
+/**
+ * Summary of the versions of a product, changes if any version gets added,
+ * updated or removed
+ */
+struct stamp_t {
+	/** number of versions */
+	int count;
+	/** checksum over all indexed columns of the versions */
+	u_int32_t hash;
+};
+
+/**
+ * Acceptable version of a package
+ */
+struct version_t {
+	/** release string, "*" matches any release */
+	char *release;
+	/** security update */
+	int security;
+	/** blacklisted release */
+	int blacklist;
+};
+
+/**
+ * Package with its acceptable versions for a product
+ */
+struct package_t {
+	/** package name */
+	char *name;
+	/** versions, as version_t, in database order */
+	linked_list_t *versions;
+};
+
+/**
+ * In-memory index of the packages of a product
+ */
+struct product_t {
+	/** product name */
+	char *name;
+	/** primary key of the product */
+	int pid;
+	/** packages, package_t indexed by name */
+	hashtable_t *packages;
+	/** summary of the versions the index has been loaded from */
+	stamp_t stamp;
+	/** time of the last check for changes */
+	time_t checked;
+};
 
 /**
  * Private data of a imv_os_database_t object.
@@ -37,138 +99,363 @@ struct private_imv_os_database_t {
 	 */
 	database_t *db;
 
+	/**
+	 * Indexed products, product_t indexed by name
+	 */
+	hashtable_t *products;
+
+	/**
+	 * Lock for products and their packages
+	 */
+	rwlock_t *lock;
+
+	/**
+	 * Mutex serializing (re-)loads of products
+	 */
+	mutex_t *mutex;
+
+	/**
+	 * Interval in seconds to check products for changes
+	 */
+	u_int refresh;
+
 };
 
+/**
+ * Hash function for names
+ */
+static u_int hash(char *key)
+{
+	return chunk_hash(chunk_create(key, strlen(key)));
+}
+
+/**
+ * Comparison function for names
+ */
+static bool equals(char *key, char *other_key)
+{
+	return streq(key, other_key);
+}
+
+/**
+ * Destroy a version_t
+ */
+static void version_destroy(version_t *this)
+{
+	free(this->release);
+	free(this);
+}
+
+/**
+ * Destroy all packages of an index
+ */
+static void packages_destroy(hashtable_t *packages)
+{
+	enumerator_t *enumerator;
+	package_t *package;
+
+	enumerator = packages->create_enumerator(packages);
+	while (enumerator->enumerate(enumerator, NULL, &package))
+	{
+		package->versions->destroy_function(package->versions,
+											(void*)version_destroy);
+		free(package->name);
+		free(package);
+	}
+	enumerator->destroy(enumerator);
+	packages->destroy(packages);
+}
+
+/**
+ * Destroy a product_t
+ */
+static void product_destroy(product_t *this)
+{
+	packages_destroy(this->packages);
+	free(this->name);
+	free(this);
+}
+
+/**
+ * Get the summary of the versions of a product
+ */
+static bool get_stamp(private_imv_os_database_t *this, int pid, stamp_t *stamp)
+{
+	enumerator_t *e;
+	char *release;
+	int id, package, security, blacklist;
+
+	/* in-place updates of a release don't change any aggregate, so hash the
+	 * columns of all versions, which is still cheaper than a reload */
+	e = this->db->query(this->db,
+				"SELECT id, package, release, security, blacklist "
+				"FROM versions WHERE product = ? ORDER BY id", DB_INT, pid,
+				DB_INT, DB_INT, DB_TEXT, DB_INT, DB_INT);
+	if (!e)
+	{
+		return FALSE;
+	}
+	*stamp = (stamp_t){};
+	while (e->enumerate(e, &id, &package, &release, &security, &blacklist))
+	{
+		stamp->hash = chunk_hash_inc(chunk_from_thing(id), stamp->hash);
+		stamp->hash = chunk_hash_inc(chunk_from_thing(package), stamp->hash);
+		stamp->hash = chunk_hash_inc(chunk_from_str(release), stamp->hash);
+		stamp->hash = chunk_hash_inc(chunk_from_thing(security), stamp->hash);
+		stamp->hash = chunk_hash_inc(chunk_from_thing(blacklist), stamp->hash);
+		stamp->count++;
+	}
+	e->destroy(e);
+	return TRUE;
+}
+
+/**
+ * Load the packages and versions of a product into a new index
+ */
+static hashtable_t *load_packages(private_imv_os_database_t *this, int pid)
+{
+	hashtable_t *packages;
+	enumerator_t *e;
+	package_t *package;
+	version_t *version;
+	char *name, *release;
+	int security, blacklist;
+
+	e = this->db->query(this->db,
+				"SELECT p.name, v.release, v.security, v.blacklist "
+				"FROM versions AS v JOIN packages AS p ON v.package = p.id "
+				"WHERE v.product = ? ORDER BY v.id", DB_INT, pid,
+				DB_TEXT, DB_TEXT, DB_INT, DB_INT);
+	if (!e)
+	{
+		return NULL;
+	}
+	packages = hashtable_create((hashtable_hash_t)hash,
+								(hashtable_equals_t)equals, 1024);
+	while (e->enumerate(e, &name, &release, &security, &blacklist))
+	{
+		package = packages->get(packages, name);
+		if (!package)
+		{
+			INIT(package,
+				.name = strdup(name),
+				.versions = linked_list_create(),
+			);
+			packages->put(packages, package->name, package);
+		}
+		INIT(version,
+			.release = strdup(release),
+			.security = security,
+			.blacklist = blacklist,
+		);
+		package->versions->insert_last(package->versions, version);
+	}
+	e->destroy(e);
+	return packages;
+}
+
+/**
+ * Load the index of a product or reload it if its versions changed
+ */
+static status_t update_product(private_imv_os_database_t *this, char *name)
+{
+	product_t *product;
+	hashtable_t *packages, *swap;
+	enumerator_t *e;
+	stamp_t stamp;
+	time_t now;
+	int pid;
+
+	/* the index only gets modified while holding the mutex */
+	this->mutex->lock(this->mutex);
+	now = time_monotonic(NULL);
+	product = this->products->get(this->products, name);
+	if (product)
+	{
+		if (this->refresh && now - product->checked < this->refresh)
+		{	/* checked by another thread in the meantime */
+			this->mutex->unlock(this->mutex);
+			return SUCCESS;
+		}
+		pid = product->pid;
+	}
+	else
+	{
+		/* Get primary key of product */
+		e = this->db->query(this->db,
+					"SELECT id FROM products WHERE name = ?",
+					DB_TEXT, name, DB_INT);
+		if (!e)
+		{
+			this->mutex->unlock(this->mutex);
+			return FAILED;
+		}
+		if (!e->enumerate(e, &pid))
+		{
+			e->destroy(e);
+			this->mutex->unlock(this->mutex);
+			return NOT_FOUND;
+		}
+		e->destroy(e);
+	}
+	if (!get_stamp(this, pid, &stamp))
+	{
+		this->mutex->unlock(this->mutex);
+		return FAILED;
+	}
+	if (product && memeq(&product->stamp, &stamp, sizeof(stamp)))
+	{
+		this->lock->write_lock(this->lock);
+		product->checked = now;
+		this->lock->unlock(this->lock);
+		this->mutex->unlock(this->mutex);
+		return SUCCESS;
+	}
+
+	packages = load_packages(this, pid);
+	if (!packages)
+	{
+		this->mutex->unlock(this->mutex);
+		return FAILED;
+	}
+	DBG1(DBG_IMV, "%sloaded %d '%s' packages", product ? "re" : "",
+		 packages->get_count(packages), name);
+
+	this->lock->write_lock(this->lock);
+	if (product)
+	{
+		swap = product->packages;
+		product->packages = packages;
+		packages = swap;
+	}
+	else
+	{
+		INIT(product,
+			.name = strdup(name),
+			.pid = pid,
+			.packages = packages,
+		);
+		packages = NULL;
+		this->products->put(this->products, product->name, product);
+	}
+	product->stamp = stamp;
+	product->checked = now;
+	this->lock->unlock(this->lock);
+	this->mutex->unlock(this->mutex);
+
+	if (packages)
+	{
+		packages_destroy(packages);
+	}
+	return SUCCESS;
+}
+
 METHOD(imv_os_database_t, check_packages, status_t,
 	private_imv_os_database_t *this, imv_os_state_t *state,
 	enumerator_t *package_enumerator)
 {
-	char *product, *package, *release, *cur_release;
+	char *product_name, *package_name, *release;
 	chunk_t name, version;
 	os_type_t os_type;
-	int pid, gid, security, blacklist;
+	product_t *product;
+	package_t *package;
+	version_t *cur, *match;
 	int count = 0, count_ok = 0, count_no_match = 0, count_blacklist = 0;
 	enumerator_t *e;
-	status_t status = SUCCESS;
-	bool found, match;
+	status_t status;
 
-	product = state->get_info(state, &os_type, NULL, NULL);
+	product_name = state->get_info(state, &os_type, NULL, NULL);
 
 	if (os_type == OS_TYPE_ANDROID)
 	{
 		/*no package dependency on Android version */
-		product = enum_to_name(os_type_names, os_type);
+		product_name = enum_to_name(os_type_names, os_type);
 	}
-	DBG1(DBG_IMV, "processing installed '%s' packages", product);
+	DBG1(DBG_IMV, "processing installed '%s' packages", product_name);
 
-	/* Get primary key of product */
-	e = this->db->query(this->db,
-				"SELECT id FROM products WHERE name = ?",
-				DB_TEXT, product, DB_INT);
-	if (!e)
-	{
-	}
-	if (!e->enumerate(e, &pid))
+	this->lock->read_lock(this->lock);
+	product = this->products->get(this->products, product_name);
+	if (!product || !this->refresh ||
+		time_monotonic(NULL) - product->checked >= this->refresh)
 	{
-		e->destroy(e);
-		return NOT_FOUND;
+		this->lock->unlock(this->lock);
+		status = update_product(this, product_name);
+		if (status != SUCCESS)
+		{
+			return status;
+		}
+		this->lock->read_lock(this->lock);
+		product = this->products->get(this->products, product_name);
 	}
-	e->destroy(e);
 
+	/* evaluate all packages against the index in a single pass */
 	while (package_enumerator->enumerate(package_enumerator, &name, &version))
 	{
 		/* Convert package name chunk to a string */
-		package = strndup(name.ptr, name.len);
+		package_name = strndup(name.ptr, name.len);
 		count++;
 
-		/* Get primary key of package */
-		e = this->db->query(this->db,
-					"SELECT id FROM packages WHERE name = ?",
-					DB_TEXT, package, DB_INT);
-		if (!e)
+		package = product->packages->get(product->packages, package_name);
+		if (!package)
 		{
-			free(package);
-			return FAILED;
-		}
-		if (!e->enumerate(e, &gid))
-		{
-			/* package not present in database for any product - skip */
+			/* package not present in database for this product - skip */
 			if (os_type == OS_TYPE_ANDROID)
 			{
 				DBG2(DBG_IMV, "package '%s' (%.*s) not found",
-					 package, version.len, version.ptr);
+					 package_name, version.len, version.ptr);
 			}
-			free(package);
-			e->destroy(e);
+			free(package_name);
 			continue;
 		}
-		e->destroy(e);
 
 		/* Convert package version chunk to a string */
 		release = strndup(version.ptr, version.len);
 
 		/* Enumerate over all acceptable versions */
-		e = this->db->query(this->db,
-				"SELECT release, security, blacklist FROM versions "
-				"WHERE product = ? AND package = ?",
-				DB_INT, pid, DB_INT, gid, DB_TEXT, DB_INT, DB_INT);
-		if (!e)
+		match = NULL;
+		e = package->versions->create_enumerator(package->versions);
+		while (e->enumerate(e, &cur))
 		{
-			free(package);
-			free(release);
-			return FAILED;
-		}
-		found = FALSE;
-		match = FALSE;
-
-		while (e->enumerate(e, &cur_release, &security, &blacklist))
-		{
-			found = TRUE;
-			if (streq(release, cur_release) || streq("*", cur_release))
+			if (streq(release, cur->release) || streq("*", cur->release))
 			{
-				match = TRUE;
+				match = cur;
 				break;
 			}
 		}
 		e->destroy(e);
 
-		if (found)
+		if (match)
 		{
-			if (match)
+			if (match->blacklist)
 			{
-				if (blacklist)
-				{
-					DBG2(DBG_IMV, "package '%s' (%s) is blacklisted",
-								   package, release);
-					count_blacklist++;
-					state->add_bad_package(state, package,
-										   OS_PACKAGE_STATE_BLACKLIST);
-				}
-				else
-				{
-					DBG2(DBG_IMV, "package '%s' (%s)%s is ok", package, release,
-								   security ? " [s]" : "");
-					count_ok++;
-				}
+				DBG2(DBG_IMV, "package '%s' (%s) is blacklisted",
+							   package_name, release);
+				count_blacklist++;
+				state->add_bad_package(state, package_name,
+									   OS_PACKAGE_STATE_BLACKLIST);
 			}
 			else
 			{
-				DBG1(DBG_IMV, "package '%s' (%s) no match", package, release);
-				count_no_match++;
-				state->add_bad_package(state, package,
-									   OS_PACKAGE_STATE_SECURITY);
+				DBG2(DBG_IMV, "package '%s' (%s)%s is ok", package_name,
+							   release, match->security ? " [s]" : "");
+				count_ok++;
 			}
 		}
 		else
 		{
-			/* package not present in database for this product - skip */
+			DBG1(DBG_IMV, "package '%s' (%s) no match", package_name, release);
+			count_no_match++;
+			state->add_bad_package(state, package_name,
+								   OS_PACKAGE_STATE_SECURITY);
 		}
-		free(package);
+		free(package_name);
 		free(release);
 	}
+	this->lock->unlock(this->lock);
+
 	state->set_count(state, count, count_no_match, count_blacklist, count_ok);
 
-	return status;
+	return SUCCESS;
 }
 
 METHOD(imv_os_database_t, set_device_info, void,
@@ -185,6 +472,18 @@ METHOD(imv_os_database_t, set_device_info, void,
 METHOD(imv_os_database_t, destroy, void,
 	private_imv_os_database_t *this)
 {
+	enumerator_t *enumerator;
+	product_t *product;
+
+	enumerator = this->products->create_enumerator(this->products);
+	while (enumerator->enumerate(enumerator, NULL, &product))
+	{
+		product_destroy(product);
+	}
+	enumerator->destroy(enumerator);
+	this->products->destroy(this->products);
+	this->lock->destroy(this->lock);
+	this->mutex->destroy(this->mutex);
 	free(this);
 }
 
@@ -207,6 +506,13 @@ imv_os_database_t *imv_os_database_create(imv_database_t *imv_db)
 			.destroy = _destroy,
 		},
 		.db = imv_db->get_database(imv_db),
+		.products = hashtable_create((hashtable_hash_t)hash,
+									 (hashtable_equals_t)equals, 8),
+		.lock = rwlock_create(RWLOCK_TYPE_DEFAULT),
+		.mutex = mutex_create(MUTEX_TYPE_DEFAULT),
+		.refresh = lib->settings->get_int(lib->settings,
+							"libimcv.plugins.imv-os.index_refresh",
+							INDEX_REFRESH_DEFAULT),
 	);
 
 	return &this->public;
@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) 2013 HSR Hochschule fuer Technik Rapperswil
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "imv_os_database.h"
+#include "imv_os_state.h"
+
+#include <library.h>
+#include <utils/debug.h>
+#include <ietf/ietf_attr_installed_packages.h>
+
+/**
+ * Name and version of the generated product
+ */
+#define PRODUCT_NAME	"Debian"
+#define PRODUCT_VERSION	"7.0"
+
+static void usage()
+{
+	printf("usage: imv_os_speed file packages assessments\n");
+	printf("  creates a SQLite IMV database in file (which gets overwritten)\n");
+	printf("  with versions of the given number of packages, and measures\n");
+	printf("  how fast the OS IMV assesses a generated list of installed\n");
+	printf("  packages, with up-to-date, outdated, blacklisted and unknown\n");
+	printf("  packages.\n");
+	exit(1);
+}
+
+/**
+ * Tables used by the OS IMV, see src/libimcv/imv/tables.sql
+ */
+static char *schema[] = {
+	"CREATE TABLE products ("
+	"  id INTEGER PRIMARY KEY AUTOINCREMENT, name TEXT NOT NULL)",
+	"CREATE TABLE packages ("
+	"  id INTEGER NOT NULL PRIMARY KEY AUTOINCREMENT,"
+	"  name TEXT NOT NULL, blacklist INTEGER DEFAULT 0)",
+	"CREATE INDEX packages_name ON packages (name)",
+	"CREATE TABLE versions ("
+	"  id INTEGER NOT NULL PRIMARY KEY AUTOINCREMENT,"
+	"  package INTEGER NOT NULL REFERENCES packages(id),"
+	"  product INTEGER NOT NULL REFERENCES products(id),"
+	"  release TEXT NOT NULL, security INTEGER DEFAULT 0,"
+	"  blacklist INTEGER DEFAULT 0, time INTEGER DEFAULT 0)",
+	"CREATE INDEX versions_release ON versions (release)",
+	"CREATE INDEX versions_package_product ON versions (package, product)",
+};
+
+/**
+ * Create the tables and add two versions of each package, every 20th package
+ * additionally has a blacklisted version
+ */
+static bool setup(database_t *db, int packages)
+{
+	char name[32], release[32];
+	int i, pid, gid;
+
+	for (i = 0; i < countof(schema); i++)
+	{
+		if (db->execute(db, NULL, schema[i]) < 0)
+		{
+			return FALSE;
+		}
+	}
+	if (db->execute(db, &pid, "INSERT INTO products (name) VALUES (?)",
+					DB_TEXT, PRODUCT_NAME " " PRODUCT_VERSION) != 1 ||
+		!db->transaction(db, FALSE))
+	{
+		return FALSE;
+	}
+	for (i = 0; i < packages; i++)
+	{
+		snprintf(name, sizeof(name), "package%d", i);
+		if (db->execute(db, &gid, "INSERT INTO packages (name) VALUES (?)",
+						DB_TEXT, name) != 1)
+		{
+			db->rollback(db);
+			return FALSE;
+		}
+		snprintf(release, sizeof(release), "1.0-%d", i);
+		db->execute(db, NULL, "INSERT INTO versions (package, product, "
+					"release, time) VALUES (?, ?, ?, ?)", DB_INT, gid,
+					DB_INT, pid, DB_TEXT, release, DB_UINT, time(NULL));
+		snprintf(release, sizeof(release), "1.1-%d", i);
+		db->execute(db, NULL, "INSERT INTO versions (package, product, "
+					"release, security, time) VALUES (?, ?, ?, 1, ?)",
+					DB_INT, gid, DB_INT, pid, DB_TEXT, release,
+					DB_UINT, time(NULL));
+		if (i % 20 == 0)
+		{
+			db->execute(db, NULL, "INSERT INTO versions (package, product, "
+						"release, blacklist, time) VALUES (?, ?, '0.9', 1, ?)",
+						DB_INT, gid, DB_INT, pid, DB_UINT, time(NULL));
+		}
+	}
+	return db->commit(db);
+}
+
+/**
+ * Build the installed packages of an endpoint, with 5% blacklisted, 5%
+ * outdated and 10% packages unknown to the database
+ */
+static ietf_attr_installed_packages_t *installed(int packages)
+{
+	ietf_attr_installed_packages_t *attr;
+	char name[32], release[32];
+	int i;
+
+	attr = (ietf_attr_installed_packages_t*)
+						ietf_attr_installed_packages_create();
+	for (i = 0; i < packages; i++)
+	{
+		snprintf(name, sizeof(name), "package%d", i);
+		if (i % 20 == 0)
+		{
+			snprintf(release, sizeof(release), "0.9");
+		}
+		else if (i % 20 == 10)
+		{
+			snprintf(release, sizeof(release), "0.8-%d", i);
+		}
+		else
+		{
+			snprintf(release, sizeof(release), "1.1-%d", i);
+		}
+		attr->add(attr, chunk_from_str(name), chunk_from_str(release));
+	}
+	for (i = 0; i < packages / 10; i++)
+	{
+		snprintf(name, sizeof(name), "local%d", i);
+		attr->add(attr, chunk_from_str(name), chunk_from_str("1.0"));
+	}
+	return attr;
+}
+
+/**
+ * Current time in ms
+ */
+static double now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+int main(int argc, char *argv[])
+{
+	ietf_attr_installed_packages_t *attr;
+	imv_database_t *imv_db;
+	imv_os_database_t *os_db;
+	imv_os_state_t *state;
+	enumerator_t *e;
+	char uri[512];
+	double start, first = 0, ms;
+	int packages, assessments, count, count_update, count_blacklist, count_ok;
+	int i, failed = 0;
+
+	if (argc < 4)
+	{
+		usage();
+	}
+	packages = atoi(argv[2]);
+	assessments = atoi(argv[3]);
+	if (packages <= 0 || assessments <= 0)
+	{
+		usage();
+	}
+
+	library_init(NULL);
+	atexit(library_deinit);
+	/* the IMV logs each outdated package */
+	dbg_default_set_level(0);
+	lib->plugins->load(lib->plugins,
+			lib->settings->get_str(lib->settings, "attest.load", "sqlite"));
+
+	unlink(argv[1]);
+	snprintf(uri, sizeof(uri), "sqlite://%s", argv[1]);
+	imv_db = imv_database_create(uri, NULL);
+	if (!imv_db)
+	{
+		fprintf(stderr, "opening database %s failed\n", uri);
+		return 1;
+	}
+	if (!setup(imv_db->get_database(imv_db), packages))
+	{
+		fprintf(stderr, "creating OS IMV tables failed\n");
+		imv_db->destroy(imv_db);
+		return 1;
+	}
+	os_db = imv_os_database_create(imv_db);
+	attr = installed(packages);
+
+	start = now();
+	for (i = 0; i < assessments; i++)
+	{
+		state = (imv_os_state_t*)imv_os_state_create(i);
+		state->set_info(state, OS_TYPE_DEBIAN, chunk_from_str(PRODUCT_NAME),
+						chunk_from_str(PRODUCT_VERSION));
+		e = attr->create_enumerator(attr);
+		if (os_db->check_packages(os_db, state, e) != SUCCESS)
+		{
+			failed++;
+		}
+		e->destroy(e);
+		state->get_count(state, &count, &count_update, &count_blacklist,
+						 &count_ok);
+		if (count_update != (packages + 9) / 20 ||
+			count_blacklist != (packages + 19) / 20)
+		{
+			failed++;
+		}
+		state->interface.destroy(&state->interface);
+		if (i == 0)
+		{
+			first = now() - start;
+		}
+	}
+	ms = now() - start;
+
+	printf("%d packages: first assessment %.3fms, %d assessments in %.0fms, "
+		   "%.0f assessments/s, %.3fms per assessment, %d failed\n",
+		   count, first, assessments, ms, assessments * 1000.0 / ms,
+		   ms / assessments, failed);
+
+	attr->pa_tnc_attribute.destroy(&attr->pa_tnc_attribute);
+	os_db->destroy(os_db);
+	imv_db->destroy(imv_db);
+	return failed != 0;
+}
@@ -181,25 +181,23 @@ static void send_outbound(private_ipsec_processor_t *this,
 }
 
 /**
- * Processes outbound packets
+ * Encrypts and sends an outbound packet
  */
-static job_requeue_t process_outbound(private_ipsec_processor_t *this)
+static void encrypt_outbound(private_ipsec_processor_t *this,
+							 ip_packet_t *packet)
 {
 	ipsec_policy_t *policy;
 	esp_packet_t *esp_packet;
-	ip_packet_t *packet;
 	ipsec_sa_t *sa;
 	host_t *src, *dst;
 
-	packet = (ip_packet_t*)this->outbound_queue->dequeue(this->outbound_queue);
-
 	policy = ipsec->policies->find_by_packet(ipsec->policies, packet, FALSE);
 	if (!policy)
 	{
 		DBG2(DBG_ESP, "no matching outbound IPsec policy for %H == %H",
 			 packet->get_source(packet), packet->get_destination(packet));
 		packet->destroy(packet);
-		return JOB_REQUEUE_DIRECT;
+		return;
 	}
 
 	sa = ipsec->sas->checkout_by_reqid(ipsec->sas, policy->get_reqid(policy),
@@ -210,7 +208,7 @@ static job_requeue_t process_outbound(private_ipsec_processor_t *this)
 			 "dropping packet", policy->get_reqid(policy));
 		packet->destroy(packet);
 		policy->destroy(policy);
-		return JOB_REQUEUE_DIRECT;
+		return;
 	}
 	src = sa->get_source(sa);
 	dst = sa->get_destination(sa);
@@ -222,12 +220,23 @@ static job_requeue_t process_outbound(private_ipsec_processor_t *this)
 		ipsec->sas->checkin(ipsec->sas, sa);
 		esp_packet->destroy(esp_packet);
 		policy->destroy(policy);
-		return JOB_REQUEUE_DIRECT;
+		return;
 	}
 	/* TODO-IPSEC: update policy/sa counters? */
 	ipsec->sas->checkin(ipsec->sas, sa);
 	policy->destroy(policy);
 	send_outbound(this, esp_packet);
+}
+
+/**
+ * Processes outbound packets
+ */
+static job_requeue_t process_outbound(private_ipsec_processor_t *this)
+{
+	ip_packet_t *packet;
+
+	packet = (ip_packet_t*)this->outbound_queue->dequeue(this->outbound_queue);
+	encrypt_outbound(this, packet);
 	return JOB_REQUEUE_DIRECT;
 }
 
@@ -243,6 +252,17 @@ METHOD(ipsec_processor_t, queue_outbound, void,
 	this->outbound_queue->enqueue(this->outbound_queue, packet);
 }
 
+METHOD(ipsec_processor_t, process_outbound_batch, void,
+	private_ipsec_processor_t *this, ip_packet_t *packets[], int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+	{
+		encrypt_outbound(this, packets[i]);
+	}
+}
+
 METHOD(ipsec_processor_t, register_inbound, void,
 	private_ipsec_processor_t *this, ipsec_inbound_cb_t cb, void *data)
 {
@@ -305,6 +325,7 @@ ipsec_processor_t *ipsec_processor_create()
 		.public = {
 			.queue_inbound = _queue_inbound,
 			.queue_outbound = _queue_outbound,
+			.process_outbound_batch = _process_outbound_batch,
 			.register_inbound = _register_inbound,
 			.unregister_inbound = _unregister_inbound,
 			.register_outbound = _register_outbound,
@@ -64,6 +64,21 @@ struct ipsec_processor_t {
 	 */
 	void (*queue_outbound)(ipsec_processor_t *this, ip_packet_t *packet);
 
+	/**
+	 * Process a batch of outbound plaintext IP packets in the calling thread.
+	 *
+	 * Other than with queue_outbound(), the packets are not handed over to
+	 * the single thread processing queued packets. Callers reading from
+	 * multiple sources in separate threads (e.g. the queues of a TUN device)
+	 * therefore process packets in parallel, while the packets of each
+	 * source stay in order.
+	 *
+	 * @param packets		plaintext IP packets, get owned
+	 * @param count			number of packets
+	 */
+	void (*process_outbound_batch)(ipsec_processor_t *this,
+								   ip_packet_t *packets[], int count);
+
 	/**
 	 * Register the callback used to deliver inbound plaintext packets.
 	 *
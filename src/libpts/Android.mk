@@ -17,6 +17,7 @@ libpts_la_SOURCES := \
 	pts/pts_file_meta.h pts/pts_file_meta.c \
 	pts/pts_file_type.h pts/pts_file_type.c \
 	pts/pts_meas_algo.h pts/pts_meas_algo.c \
+	pts/pts_meas_cache.h pts/pts_meas_cache.c \
 	pts/components/pts_component.h \
 	pts/components/pts_component_manager.h pts/components/pts_component_manager.c \
 	pts/components/pts_comp_evidence.h pts/components/pts_comp_evidence.c \
@@ -30,6 +30,11 @@
  */
 pts_component_manager_t *pts_components;
 
+/**
+ * Cache of PTS file measurements
+ */
+pts_meas_cache_t *pts_meas_cache;
+
 /**
  * Reference count for IMC/IMV instances
  */
@@ -49,6 +54,9 @@ bool libpts_init(void)
 		imcv_pa_tnc_attributes->add_vendor(imcv_pa_tnc_attributes, PEN_TCG,
 							tcg_attr_create_from_data, tcg_attr_names);
 
+		pts_meas_cache = pts_meas_cache_create(
+					lib->settings->get_int(lib->settings,
+						"libimcv.plugins.imc-attestation.meas_cache_size", 4096));
 		pts_components = pts_component_manager_create();
 		pts_components->add_vendor(pts_components, PEN_TCG,
 					pts_tcg_comp_func_names, PTS_TCG_QUALIFIER_TYPE_SIZE,
@@ -84,6 +92,8 @@ void libpts_deinit(void)
 		pts_components->remove_vendor(pts_components, PEN_TCG);
 		pts_components->remove_vendor(pts_components, PEN_ITA);
 		pts_components->destroy(pts_components);
+		pts_meas_cache->destroy(pts_meas_cache);
+		pts_meas_cache = NULL;
 
 		if (!imcv_pa_tnc_attributes)
 		{
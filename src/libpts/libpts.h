@@ -26,6 +26,7 @@
 #define LIBPTS_H_
 
 #include "pts/components/pts_component_manager.h"
+#include "pts/pts_meas_cache.h"
 
 #include <library.h>
 
@@ -46,4 +47,9 @@ void libpts_deinit(void);
  */
 extern pts_component_manager_t* pts_components;
 
+/**
+ * Cache of PTS file measurements
+ */
+extern pts_meas_cache_t* pts_meas_cache;
+
 #endif /** LIBPTS_H_ @}*/
@@ -15,12 +15,19 @@
 
 #include "pts_file_meas.h"
 
+#include "libpts.h"
+
 #include <collections/linked_list.h>
 #include <utils/debug.h>
+#include <threading/mutex.h>
+#include <threading/condvar.h>
+#include <processing/jobs/callback_job.h>
 
 #include <sys/stat.h>
 #include <libgen.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 typedef struct private_pts_file_meas_t private_pts_file_meas_t;
 
@@ -235,49 +242,233 @@ pts_file_meas_t *pts_file_meas_create(u_int16_t request_id)
 }
 
 /**
- * Hash a file with a given absolute pathname
+ * Size of the blocks files get read in for hashing
+ */
+#define READ_BUFFER (256 * 1024)
+
+/**
+ * Default maximum number of threads hashing the files of a directory
+ */
+#define MEAS_THREADS_DEFAULT 4
+
+/**
+ * File to measure
+ */
+typedef struct {
+	/** name to report */
+	char *filename;
+	/** absolute pathname */
+	char *pathname;
+	/** measurement */
+	chunk_t measurement;
+	/** TRUE if measured successfully */
+	bool success;
+} file_t;
+
+/**
+ * Files measured in parallel
+ */
+typedef struct {
+	/** files to measure */
+	file_t *files;
+	/** number of files */
+	int count;
+	/** index of the next file to measure */
+	int next;
+	/** hash algorithm */
+	hash_algorithm_t alg;
+	/** number of bytes hashed */
+	u_int64_t bytes;
+	/** number of threads currently measuring files */
+	int running;
+	/** mutex to lock this object */
+	mutex_t *mutex;
+	/** signals threads done measuring */
+	condvar_t *condvar;
+	/** reference count, held by the caller and each queued job */
+	refcount_t ref;
+} measure_t;
+
+/**
+ * Hash a file with a given absolute pathname, and cache the measurement
  */
-static bool hash_file(hasher_t *hasher, char *pathname, u_char *hash)
+static bool hash_file(hasher_t *hasher, hash_algorithm_t alg, char *pathname,
+					  u_char *buffer, u_char *hash, u_int64_t *bytes)
 {
-	u_char buffer[4096];
-	size_t bytes_read;
-	bool success = TRUE;
-	FILE *file;
+	struct stat st, after;
+	ssize_t len;
+	bool success = FALSE;
+	int fd;
 
-	file = fopen(pathname, "rb");
-	if (!file)
+	fd = open(pathname, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0)
 	{
 		DBG1(DBG_PTS,"  file '%s' can not be opened, %s", pathname,
 			 strerror(errno));
+		if (fd >= 0)
+		{
+			close(fd);
+		}
+		return FALSE;
+	}
+#ifdef POSIX_FADV_SEQUENTIAL
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+	if (!hasher->reset(hasher))
+	{
+		DBG1(DBG_PTS, "  hasher reset error");
+		close(fd);
 		return FALSE;
 	}
 	while (TRUE)
 	{
-		bytes_read = fread(buffer, 1, sizeof(buffer), file);
-		if (bytes_read > 0)
+		len = read(fd, buffer, READ_BUFFER);
+		if (len < 0)
 		{
-			if (!hasher->get_hash(hasher, chunk_create(buffer, bytes_read), NULL))
+			if (errno == EINTR)
 			{
-				DBG1(DBG_PTS, "  hasher increment error");
-				success = FALSE;
-				break;
+				continue;
 			}
+			DBG1(DBG_PTS, "  reading file '%s' failed, %s", pathname,
+				 strerror(errno));
+			break;
 		}
-		else
+		if (len == 0)
 		{
-			if (!hasher->get_hash(hasher, chunk_empty, hash))
+			success = hasher->get_hash(hasher, chunk_empty, hash);
+			if (!success)
 			{
 				DBG1(DBG_PTS, "  hasher finalize error");
-				success = FALSE;
 			}
 			break;
 		}
+		if (!hasher->get_hash(hasher, chunk_create(buffer, len), NULL))
+		{
+			DBG1(DBG_PTS, "  hasher increment error");
+			break;
+		}
+		*bytes += len;
 	}
-	fclose(file);
+	/* don't cache the measurement of a file modified while hashed */
+	if (success && pts_meas_cache && fstat(fd, &after) == 0 &&
+		after.st_size == st.st_size && after.st_mtime == st.st_mtime &&
+		after.st_ctime == st.st_ctime)
+	{
+		pts_meas_cache->put(pts_meas_cache, &st, alg,
+						chunk_create(hash, hasher->get_hash_size(hasher)));
+	}
+	close(fd);
 
 	return success;
 }
 
+/**
+ * Measure files until none are left, used by jobs and the caller alike
+ */
+static job_requeue_t measure_files(measure_t *this)
+{
+	hasher_t *hasher;
+	u_int64_t bytes = 0;
+	u_char *buffer;
+	file_t *file;
+
+	this->mutex->lock(this->mutex);
+	if (this->next == this->count)
+	{	/* files might be gone already if we got executed late */
+		this->mutex->unlock(this->mutex);
+		return JOB_REQUEUE_NONE;
+	}
+	this->running++;
+	this->mutex->unlock(this->mutex);
+
+	hasher = lib->crypto->create_hasher(lib->crypto, this->alg);
+	buffer = malloc(READ_BUFFER);
+	while (hasher)
+	{
+		this->mutex->lock(this->mutex);
+		if (this->next == this->count)
+		{
+			this->mutex->unlock(this->mutex);
+			break;
+		}
+		file = &this->files[this->next++];
+		this->mutex->unlock(this->mutex);
+
+		file->success = hash_file(hasher, this->alg, file->pathname, buffer,
+								  file->measurement.ptr, &bytes);
+	}
+	free(buffer);
+	DESTROY_IF(hasher);
+
+	this->mutex->lock(this->mutex);
+	this->bytes += bytes;
+	this->running--;
+	this->condvar->broadcast(this->condvar);
+	this->mutex->unlock(this->mutex);
+	return JOB_REQUEUE_NONE;
+}
+
+/**
+ * Release a reference to a measure_t
+ */
+static void measure_destroy(measure_t *this)
+{
+	if (ref_put(&this->ref))
+	{
+		this->condvar->destroy(this->condvar);
+		this->mutex->destroy(this->mutex);
+		free(this);
+	}
+}
+
+/**
+ * Measure the given files, in parallel with idle threads if there are many
+ */
+static u_int64_t measure(file_t *files, int count, hash_algorithm_t alg)
+{
+	measure_t *this;
+	u_int64_t bytes;
+	int threads, i;
+
+	INIT(this,
+		.files = files,
+		.count = count,
+		.alg = alg,
+		.mutex = mutex_create(MUTEX_TYPE_DEFAULT),
+		.condvar = condvar_create(CONDVAR_TYPE_DEFAULT),
+		.ref = 1,
+	);
+
+	threads = lib->settings->get_int(lib->settings,
+					"libimcv.plugins.imc-attestation.meas_threads",
+					MEAS_THREADS_DEFAULT);
+	threads = min(threads, (int)lib->processor->get_idle_threads(
+														lib->processor));
+	threads = min(threads, count - 1);
+	for (i = 0; i < threads; i++)
+	{
+		ref_get(&this->ref);
+		lib->processor->queue_job(lib->processor,
+				(job_t*)callback_job_create((callback_job_cb_t)measure_files,
+					this, (void*)measure_destroy,
+					(callback_job_cancel_t)return_false));
+	}
+	/* we measure files ourselves, too, and only wait for jobs that actually
+	 * started measuring, as busy threads might not execute ours in time */
+	measure_files(this);
+
+	this->mutex->lock(this->mutex);
+	while (this->running)
+	{
+		this->condvar->wait(this->condvar, this->mutex);
+	}
+	bytes = this->bytes;
+	this->mutex->unlock(this->mutex);
+	measure_destroy(this);
+
+	return bytes;
+}
+
 /**
  * See header
  */
@@ -288,12 +479,14 @@ pts_file_meas_t *pts_file_meas_create_from_path(u_int16_t request_id,
 	private_pts_file_meas_t *this;
 	hash_algorithm_t hash_alg;
 	hasher_t *hasher;
-	u_char hash[HASH_SIZE_SHA384];
-	chunk_t measurement;
-	char* filename;
+	file_t *files, *file;
+	size_t hash_size;
+	u_int64_t bytes;
+	u_int hits, misses;
+	int count = 0, cached = 0, size = 16, i, j;
 	bool success = TRUE;
 
-	/* Create a hasher and a hash measurement buffer */
+	/* Check hash algorithm availability */
 	hash_alg = pts_meas_algo_to_hash(alg);
 	hasher = lib->crypto->create_hasher(lib->crypto, hash_alg);
 	if (!hasher)
@@ -301,9 +494,10 @@ pts_file_meas_t *pts_file_meas_create_from_path(u_int16_t request_id,
 		DBG1(DBG_PTS, "hasher %N not available", hash_algorithm_names, hash_alg);
 		return NULL;
 	}
-	measurement = chunk_create(hash, hasher->get_hash_size(hasher));
-	this = (private_pts_file_meas_t*)pts_file_meas_create(request_id);
+	hash_size = hasher->get_hash_size(hasher);
+	hasher->destroy(hasher);
 
+	files = malloc(size * sizeof(file_t));
 	if (is_dir)
 	{
 		enumerator_t *enumerator;
@@ -315,39 +509,86 @@ pts_file_meas_t *pts_file_meas_create_from_path(u_int16_t request_id,
 		{
 			DBG1(DBG_PTS, "  directory '%s' can not be opened, %s", pathname,
 				 strerror(errno));
-			success = FALSE;
-			goto end;
+			free(files);
+			return NULL;
 		}
 		while (enumerator->enumerate(enumerator, &rel_name, &abs_name, &st))
 		{
 			/* measure regular files only */
 			if (S_ISREG(st.st_mode) && *rel_name != '.')
 			{
-				if (!hash_file(hasher, abs_name, hash))
+				if (count == size)
 				{
-					continue;
+					size *= 2;
+					files = realloc(files, size * sizeof(file_t));
 				}
-				filename = use_rel_name ? rel_name : abs_name;
-				DBG2(DBG_PTS, "  %#B for '%s'", &measurement, filename);
-				add(this, filename, measurement);
+				files[count++] = (file_t){
+					.filename = strdup(use_rel_name ? rel_name : abs_name),
+					.pathname = strdup(abs_name),
+					.measurement = chunk_alloc(hash_size),
+				};
+				file = &files[count - 1];
+				file->success = pts_meas_cache &&
+						pts_meas_cache->get(pts_meas_cache, &st, hash_alg,
+											file->measurement);
 			}
 		}
 		enumerator->destroy(enumerator);
 	}
 	else
 	{
-		if (!hash_file(hasher, pathname, hash))
+		struct stat st;
+
+		files[count++] = (file_t){
+			.filename = strdup(use_rel_name ? basename(pathname) : pathname),
+			.pathname = strdup(pathname),
+			.measurement = chunk_alloc(hash_size),
+		};
+		files[0].success = pts_meas_cache && stat(pathname, &st) == 0 &&
+						pts_meas_cache->get(pts_meas_cache, &st, hash_alg,
+											files[0].measurement);
+	}
+
+	/* sort files already measured to the front and measure the others */
+	for (i = 0, j = 0; i < count; i++)
+	{
+		if (files[i].success)
+		{
+			file_t tmp = files[j];
+
+			files[j++] = files[i];
+			files[i] = tmp;
+		}
+	}
+	cached = j;
+	bytes = measure(files + cached, count - cached, hash_alg);
+
+	this = (private_pts_file_meas_t*)pts_file_meas_create(request_id);
+	for (i = 0; i < count; i++)
+	{
+		file = &files[i];
+		if (file->success)
+		{
+			DBG2(DBG_PTS, "  %#B for '%s'", &file->measurement, file->filename);
+			add(this, file->filename, file->measurement);
+		}
+		else if (!is_dir)
 		{
 			success = FALSE;
-			goto end;
 		}
-		filename = use_rel_name ? basename(pathname) : pathname;
-		DBG2(DBG_PTS, "  %#B for '%s'", &measurement, filename);
-		add(this, filename, measurement);
+		free(file->filename);
+		free(file->pathname);
+		free(file->measurement.ptr);
 	}
+	free(files);
 
-end:
-	hasher->destroy(hasher);
+	if (pts_meas_cache)
+	{
+		pts_meas_cache->get_stats(pts_meas_cache, &hits, &misses);
+		DBG1(DBG_PTS, "measured %d files, %d cached, %llu bytes hashed, "
+			 "cache hit ratio %u%%", count, cached, bytes,
+			 hits + misses ? hits * 100 / (hits + misses) : 0);
+	}
 	if (success)
 	{
 		return &this->public;
@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2013 HSR Hochschule fuer Technik Rapperswil
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#include "pts_meas_cache.h"
+
+#include <collections/hashtable.h>
+#include <collections/linked_list.h>
+#include <threading/mutex.h>
+
+#include <time.h>
+
+typedef struct private_pts_meas_cache_t private_pts_meas_cache_t;
+typedef struct cache_key_t cache_key_t;
+typedef struct entry_t entry_t;
+
+/**
+ * Private data of a pts_meas_cache_t object.
+ */
+struct private_pts_meas_cache_t {
+
+	/**
+	 * Public pts_meas_cache_t interface.
+	 */
+	pts_meas_cache_t public;
+
+	/**
+	 * Cached measurements, entry_t indexed by cache_key_t
+	 */
+	hashtable_t *entries;
+
+	/**
+	 * Cached measurements, entry_t in insertion order
+	 */
+	linked_list_t *list;
+
+	/**
+	 * Maximum number of cached measurements
+	 */
+	u_int max_entries;
+
+	/**
+	 * Number of cache hits
+	 */
+	u_int hits;
+
+	/**
+	 * Number of cache misses
+	 */
+	u_int misses;
+
+	/**
+	 * Mutex to lock cache
+	 */
+	mutex_t *mutex;
+};
+
+/**
+ * Identifies the contents of a file
+ */
+struct cache_key_t {
+	u_int64_t dev;
+	u_int64_t ino;
+	u_int64_t size;
+	u_int64_t mtime;
+	u_int64_t ctime;
+	u_int64_t alg;
+};
+
+/**
+ * Cached measurement
+ */
+struct entry_t {
+	cache_key_t key;
+	chunk_t measurement;
+};
+
+/**
+ * Build the key of a file
+ */
+static void build_key(cache_key_t *key, struct stat *st, hash_algorithm_t alg)
+{
+	*key = (cache_key_t){
+		.dev = st->st_dev,
+		.ino = st->st_ino,
+		.size = st->st_size,
+		.mtime = st->st_mtime,
+		.ctime = st->st_ctime,
+		.alg = alg,
+	};
+}
+
+/**
+ * Hash function for cache_key_t
+ */
+static u_int hash(cache_key_t *key)
+{
+	return chunk_hash(chunk_create((u_char*)key, sizeof(cache_key_t)));
+}
+
+/**
+ * Comparison function for cache_key_t
+ */
+static bool equals(cache_key_t *key, cache_key_t *other_key)
+{
+	return memeq(key, other_key, sizeof(cache_key_t));
+}
+
+/**
+ * Destroy an entry_t
+ */
+static void entry_destroy(entry_t *this)
+{
+	free(this->measurement.ptr);
+	free(this);
+}
+
+METHOD(pts_meas_cache_t, get, bool,
+	private_pts_meas_cache_t *this, struct stat *st, hash_algorithm_t alg,
+	chunk_t measurement)
+{
+	entry_t *entry;
+	cache_key_t key;
+
+	build_key(&key, st, alg);
+
+	this->mutex->lock(this->mutex);
+	entry = this->entries->get(this->entries, &key);
+	if (entry && entry->measurement.len == measurement.len)
+	{
+		memcpy(measurement.ptr, entry->measurement.ptr, measurement.len);
+		this->hits++;
+	}
+	else
+	{
+		entry = NULL;
+		this->misses++;
+	}
+	this->mutex->unlock(this->mutex);
+
+	return entry != NULL;
+}
+
+METHOD(pts_meas_cache_t, put, void,
+	private_pts_meas_cache_t *this, struct stat *st, hash_algorithm_t alg,
+	chunk_t measurement)
+{
+	entry_t *entry;
+
+	if (!this->max_entries || st->st_mtime >= time(NULL) - 1 ||
+		st->st_ctime >= time(NULL) - 1)
+	{
+		return;
+	}
+	INIT(entry,
+		.measurement = chunk_clone(measurement),
+	);
+	build_key(&entry->key, st, alg);
+
+	this->mutex->lock(this->mutex);
+	if (this->entries->get(this->entries, &entry->key))
+	{	/* measured concurrently */
+		this->mutex->unlock(this->mutex);
+		entry_destroy(entry);
+		return;
+	}
+	if (this->list->get_count(this->list) >= this->max_entries)
+	{
+		entry_t *oldest;
+
+		if (this->list->remove_first(this->list, (void**)&oldest) == SUCCESS)
+		{
+			this->entries->remove(this->entries, &oldest->key);
+			entry_destroy(oldest);
+		}
+	}
+	this->entries->put(this->entries, &entry->key, entry);
+	this->list->insert_last(this->list, entry);
+	this->mutex->unlock(this->mutex);
+}
+
+METHOD(pts_meas_cache_t, get_stats, void,
+	private_pts_meas_cache_t *this, u_int *hits, u_int *misses)
+{
+	this->mutex->lock(this->mutex);
+	*hits = this->hits;
+	*misses = this->misses;
+	this->mutex->unlock(this->mutex);
+}
+
+METHOD(pts_meas_cache_t, destroy, void,
+	private_pts_meas_cache_t *this)
+{
+	this->list->destroy_function(this->list, (void*)entry_destroy);
+	this->entries->destroy(this->entries);
+	this->mutex->destroy(this->mutex);
+	free(this);
+}
+
+/**
+ * See header
+ */
+pts_meas_cache_t *pts_meas_cache_create(u_int max_entries)
+{
+	private_pts_meas_cache_t *this;
+
+	INIT(this,
+		.public = {
+			.get = _get,
+			.put = _put,
+			.get_stats = _get_stats,
+			.destroy = _destroy,
+		},
+		.entries = hashtable_create((hashtable_hash_t)hash,
+									(hashtable_equals_t)equals, 128),
+		.list = linked_list_create(),
+		.max_entries = max_entries,
+		.mutex = mutex_create(MUTEX_TYPE_DEFAULT),
+	);
+
+	return &this->public;
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2013 HSR Hochschule fuer Technik Rapperswil
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+/**
+ * @defgroup pts_meas_cache pts_meas_cache
+ * @{ @ingroup pts
+ */
+
+#ifndef PTS_MEAS_CACHE_H_
+#define PTS_MEAS_CACHE_H_
+
+typedef struct pts_meas_cache_t pts_meas_cache_t;
+
+#include <library.h>
+
+#include <sys/stat.h>
+
+/**
+ * Caches file measurements between attestations.
+ *
+ * Measurements are keyed by device, inode, size, modification and change
+ * time of a file, so a file gets hashed again as soon as any of them changes.
+ */
+struct pts_meas_cache_t {
+
+	/**
+	 * Look up the cached measurement of a file.
+	 *
+	 * @param st			stat() information of the file
+	 * @param alg			hash algorithm of the measurement
+	 * @param measurement	buffer receiving the measurement
+	 * @return				TRUE if the measurement has been found
+	 */
+	bool (*get)(pts_meas_cache_t *this, struct stat *st, hash_algorithm_t alg,
+				chunk_t measurement);
+
+	/**
+	 * Cache the measurement of a file.
+	 *
+	 * Files modified within the last second are not cached, as a subsequent
+	 * modification could leave their stat() information unchanged.
+	 *
+	 * @param st			stat() information of the file while measured
+	 * @param alg			hash algorithm of the measurement
+	 * @param measurement	measurement to cache
+	 */
+	void (*put)(pts_meas_cache_t *this, struct stat *st, hash_algorithm_t alg,
+				chunk_t measurement);
+
+	/**
+	 * Get the number of cache hits and misses so far.
+	 *
+	 * @param hits			number of cache hits
+	 * @param misses		number of cache misses
+	 */
+	void (*get_stats)(pts_meas_cache_t *this, u_int *hits, u_int *misses);
+
+	/**
+	 * Destroys a pts_meas_cache_t object.
+	 */
+	void (*destroy)(pts_meas_cache_t *this);
+};
+
+/**
+ * Create a pts_meas_cache_t object.
+ *
+ * @param max_entries		maximum number of cached measurements
+ */
+pts_meas_cache_t *pts_meas_cache_create(u_int max_entries);
+
+#endif /** PTS_MEAS_CACHE_H_ @}*/
@@ -0,0 +1,539 @@
+/*
+ * Copyright (C) 2013 HSR Hochschule fuer Technik Rapperswil
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#include "concurrent_hashtable.h"
+
+#include <threading/rwlock.h>
+
+/** The maximum capacity of a segment (MUST be a power of 2) */
+#define MAX_CAPACITY (1 << 30)
+
+/** The minimum capacity of a segment (MUST be a power of 2) */
+#define MIN_CAPACITY 8
+
+/** The default number of segments (MUST be a power of 2) */
+#define DEFAULT_SEGMENTS 16
+
+/** The maximum number of segments (MUST be a power of 2) */
+#define MAX_SEGMENTS 1024
+
+/** Assumed size of a cache line, segments are padded to it */
+#define CACHE_LINE_SIZE 64
+
+typedef struct slot_t slot_t;
+
+/**
+ * An entry in the open addressing table of a segment
+ */
+struct slot_t {
+
+	/**
+	 * Key of a hash table item, NULL if the slot is empty.
+	 */
+	void *key;
+
+	/**
+	 * Value of a hash table item.
+	 */
+	void *value;
+
+	/**
+	 * Cached (mixed) hash, used to skip comparisons and in case of a resize.
+	 */
+	u_int hash;
+};
+
+typedef struct segment_t segment_t;
+
+/**
+ * An independently locked part of the hash table
+ */
+struct segment_t {
+
+	/**
+	 * Lock for this segment.
+	 */
+	rwlock_t *lock;
+
+	/**
+	 * The actual table.
+	 */
+	slot_t *slots;
+
+	/**
+	 * The current capacity of the table (always a power of 2).
+	 */
+	u_int capacity;
+
+	/**
+	 * The current mask to calculate the slot index (capacity - 1).
+	 */
+	u_int mask;
+
+	/**
+	 * The number of items in this segment.
+	 */
+	u_int count;
+
+	/**
+	 * Avoid false sharing of the segments' locks and counters.
+	 */
+	u_char pad[CACHE_LINE_SIZE - 2 * sizeof(void*) - 3 * sizeof(u_int)];
+};
+
+typedef struct private_concurrent_hashtable_t private_concurrent_hashtable_t;
+
+/**
+ * Private data of a concurrent_hashtable_t object.
+ */
+struct private_concurrent_hashtable_t {
+
+	/**
+	 * Public part of hash table.
+	 */
+	concurrent_hashtable_t public;
+
+	/**
+	 * The segments.
+	 */
+	segment_t *segments;
+
+	/**
+	 * The number of segments (always a power of 2).
+	 */
+	u_int count;
+
+	/**
+	 * The shift to get the segment index from the upper bits of a hash.
+	 */
+	u_int shift;
+
+	/**
+	 * The hashing function.
+	 */
+	hashtable_hash_t hash;
+
+	/**
+	 * The equality function.
+	 */
+	hashtable_equals_t equals;
+};
+
+typedef struct private_enumerator_t private_enumerator_t;
+
+/**
+ * hash table enumerator implementation
+ */
+struct private_enumerator_t {
+
+	/**
+	 * implements enumerator interface
+	 */
+	enumerator_t enumerator;
+
+	/**
+	 * associated hash table
+	 */
+	private_concurrent_hashtable_t *table;
+
+	/**
+	 * current segment index
+	 */
+	u_int segment;
+
+	/**
+	 * next slot index in the current segment
+	 */
+	u_int slot;
+
+	/**
+	 * TRUE if the current segment is locked
+	 */
+	bool locked;
+};
+
+/**
+ * Get the next power of 2 >= n, limited to max
+ */
+static u_int get_power_of_two(u_int n, u_int max)
+{
+	u_int p = 1;
+
+	while (p < n && p < max)
+	{
+		p <<= 1;
+	}
+	return p;
+}
+
+/**
+ * Mix the bits of a user provided hash, as both the upper bits (segment) and
+ * lower bits (slot) are used
+ */
+static inline u_int mix(u_int hash)
+{
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6b;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35;
+	hash ^= hash >> 16;
+	return hash;
+}
+
+/**
+ * Get the hash of a key and the segment it belongs to
+ */
+static inline segment_t *get_segment(private_concurrent_hashtable_t *this,
+									 void *key, u_int *hash)
+{
+	*hash = mix(this->hash(key));
+	if (this->shift >= 32)
+	{
+		return this->segments;
+	}
+	return &this->segments[*hash >> this->shift];
+}
+
+/**
+ * Find the slot of a key, or the empty slot it would be stored in
+ */
+static inline u_int find_slot(segment_t *segment, void *key, u_int hash,
+							  hashtable_equals_t equals)
+{
+	u_int i = hash & segment->mask;
+
+	while (segment->slots[i].key)
+	{
+		if (segment->slots[i].hash == hash && equals(key, segment->slots[i].key))
+		{
+			break;
+		}
+		i = (i + 1) & segment->mask;
+	}
+	return i;
+}
+
+/**
+ * Allocate the table of a segment
+ */
+static void init_slots(segment_t *segment, u_int capacity)
+{
+	segment->capacity = capacity;
+	segment->mask = capacity - 1;
+	segment->slots = calloc(capacity, sizeof(slot_t));
+}
+
+/**
+ * Double the capacity of a segment if another item exceeds a load factor of
+ * 0.75, returns TRUE if it got resized
+ */
+static bool grow_segment(segment_t *segment)
+{
+	slot_t *old_slots;
+	u_int old_capacity, i, j;
+
+	if (segment->capacity >= MAX_CAPACITY ||
+		segment->count + 1 <= segment->capacity / 4 * 3)
+	{
+		return FALSE;
+	}
+	old_slots = segment->slots;
+	old_capacity = segment->capacity;
+	init_slots(segment, old_capacity << 1);
+
+	for (i = 0; i < old_capacity; i++)
+	{
+		if (old_slots[i].key)
+		{
+			j = old_slots[i].hash & segment->mask;
+			while (segment->slots[j].key)
+			{
+				j = (j + 1) & segment->mask;
+			}
+			segment->slots[j] = old_slots[i];
+		}
+	}
+	free(old_slots);
+	return TRUE;
+}
+
+/**
+ * Add or replace an item, segment has to be write-locked
+ */
+static void *put_internal(private_concurrent_hashtable_t *this,
+						  segment_t *segment, void *key, void *value,
+						  u_int hash, bool replace)
+{
+	void *old_value;
+	u_int i;
+
+	i = find_slot(segment, key, hash, this->equals);
+	if (segment->slots[i].key)
+	{
+		old_value = segment->slots[i].value;
+		if (replace)
+		{
+			segment->slots[i].key = key;
+			segment->slots[i].value = value;
+		}
+		return old_value;
+	}
+	if (grow_segment(segment))
+	{
+		i = find_slot(segment, key, hash, this->equals);
+	}
+	segment->slots[i] = (slot_t){
+		.key = key,
+		.value = value,
+		.hash = hash,
+	};
+	segment->count++;
+	return NULL;
+}
+
+METHOD(concurrent_hashtable_t, put, void*,
+	private_concurrent_hashtable_t *this, void *key, void *value)
+{
+	segment_t *segment;
+	void *old_value;
+	u_int hash;
+
+	segment = get_segment(this, key, &hash);
+	segment->lock->write_lock(segment->lock);
+	old_value = put_internal(this, segment, key, value, hash, TRUE);
+	segment->lock->unlock(segment->lock);
+	return old_value;
+}
+
+METHOD(concurrent_hashtable_t, put_if_absent, void*,
+	private_concurrent_hashtable_t *this, void *key, void *value)
+{
+	segment_t *segment;
+	void *old_value;
+	u_int hash;
+
+	segment = get_segment(this, key, &hash);
+	segment->lock->write_lock(segment->lock);
+	old_value = put_internal(this, segment, key, value, hash, FALSE);
+	segment->lock->unlock(segment->lock);
+	return old_value;
+}
+
+/**
+ * Look up a value with the given equals function
+ */
+static inline void *get_internal(private_concurrent_hashtable_t *this,
+								 void *key, hashtable_equals_t equals)
+{
+	segment_t *segment;
+	void *value = NULL;
+	u_int hash, i;
+
+	segment = get_segment(this, key, &hash);
+	segment->lock->read_lock(segment->lock);
+	if (segment->count)
+	{
+		i = find_slot(segment, key, hash, equals);
+		value = segment->slots[i].value;
+	}
+	segment->lock->unlock(segment->lock);
+	return value;
+}
+
+METHOD(concurrent_hashtable_t, get, void*,
+	private_concurrent_hashtable_t *this, void *key)
+{
+	return get_internal(this, key, this->equals);
+}
+
+METHOD(concurrent_hashtable_t, get_match, void*,
+	private_concurrent_hashtable_t *this, void *key, hashtable_equals_t match)
+{
+	return get_internal(this, key, match);
+}
+
+METHOD(concurrent_hashtable_t, remove_, void*,
+	private_concurrent_hashtable_t *this, void *key)
+{
+	segment_t *segment;
+	void *value = NULL;
+	u_int hash, i, j, k;
+
+	segment = get_segment(this, key, &hash);
+	segment->lock->write_lock(segment->lock);
+	i = find_slot(segment, key, hash, this->equals);
+	if (segment->slots[i].key)
+	{
+		value = segment->slots[i].value;
+		segment->count--;
+
+		/* shift following items of the same cluster back, unless that moves
+		 * them before their ideal slot, so lookups need no tombstones */
+		for (j = (i + 1) & segment->mask; segment->slots[j].key;
+			 j = (j + 1) & segment->mask)
+		{
+			k = segment->slots[j].hash & segment->mask;
+			if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+			{
+				continue;
+			}
+			segment->slots[i] = segment->slots[j];
+			i = j;
+		}
+		segment->slots[i] = (slot_t){};
+	}
+	segment->lock->unlock(segment->lock);
+	return value;
+}
+
+METHOD(concurrent_hashtable_t, get_count, u_int,
+	private_concurrent_hashtable_t *this)
+{
+	u_int count = 0, i;
+
+	for (i = 0; i < this->count; i++)
+	{
+		this->segments[i].lock->read_lock(this->segments[i].lock);
+		count += this->segments[i].count;
+		this->segments[i].lock->unlock(this->segments[i].lock);
+	}
+	return count;
+}
+
+METHOD(enumerator_t, enumerate, bool,
+	private_enumerator_t *this, void **key, void **value)
+{
+	segment_t *segment;
+
+	while (this->segment < this->table->count)
+	{
+		segment = &this->table->segments[this->segment];
+		if (!this->locked)
+		{
+			segment->lock->read_lock(segment->lock);
+			this->locked = TRUE;
+		}
+		while (this->slot < segment->capacity)
+		{
+			if (segment->slots[this->slot].key)
+			{
+				if (key)
+				{
+					*key = segment->slots[this->slot].key;
+				}
+				if (value)
+				{
+					*value = segment->slots[this->slot].value;
+				}
+				this->slot++;
+				return TRUE;
+			}
+			this->slot++;
+		}
+		segment->lock->unlock(segment->lock);
+		this->locked = FALSE;
+		this->segment++;
+		this->slot = 0;
+	}
+	return FALSE;
+}
+
+METHOD(enumerator_t, enumerator_destroy, void,
+	private_enumerator_t *this)
+{
+	segment_t *segment;
+
+	if (this->locked)
+	{
+		segment = &this->table->segments[this->segment];
+		segment->lock->unlock(segment->lock);
+	}
+	free(this);
+}
+
+METHOD(concurrent_hashtable_t, create_enumerator, enumerator_t*,
+	private_concurrent_hashtable_t *this)
+{
+	private_enumerator_t *enumerator;
+
+	INIT(enumerator,
+		.enumerator = {
+			.enumerate = (void*)_enumerate,
+			.destroy = _enumerator_destroy,
+		},
+		.table = this,
+	);
+	return &enumerator->enumerator;
+}
+
+METHOD(concurrent_hashtable_t, destroy, void,
+	private_concurrent_hashtable_t *this)
+{
+	u_int i;
+
+	for (i = 0; i < this->count; i++)
+	{
+		this->segments[i].lock->destroy(this->segments[i].lock);
+		free(this->segments[i].slots);
+	}
+	free_align(this->segments);
+	free(this);
+}
+
+/*
+ * Described in header.
+ */
+concurrent_hashtable_t *concurrent_hashtable_create(hashtable_hash_t hash,
+							hashtable_equals_t equals, u_int capacity,
+							u_int segments)
+{
+	private_concurrent_hashtable_t *this;
+	u_int i, bits = 0;
+
+	INIT(this,
+		.public = {
+			.put = _put,
+			.put_if_absent = _put_if_absent,
+			.get = _get,
+			.get_match = _get_match,
+			.remove = _remove_,
+			.get_count = _get_count,
+			.create_enumerator = _create_enumerator,
+			.destroy = _destroy,
+		},
+		.count = get_power_of_two(segments ?: DEFAULT_SEGMENTS, MAX_SEGMENTS),
+		.hash = hash,
+		.equals = equals,
+	);
+
+	while ((1 << bits) < this->count)
+	{
+		bits++;
+	}
+	this->shift = 32 - bits;
+
+	/* the capacity is shared by all segments, at a load factor of 0.75 */
+	capacity = get_power_of_two(capacity / this->count / 3 * 4 + 1,
+								MAX_CAPACITY);
+	/* the padding only avoids false sharing if segments are aligned */
+	this->segments = malloc_align(this->count * sizeof(segment_t),
+								  CACHE_LINE_SIZE);
+	memset(this->segments, 0, this->count * sizeof(segment_t));
+	for (i = 0; i < this->count; i++)
+	{
+		this->segments[i].lock = rwlock_create(RWLOCK_TYPE_DEFAULT);
+		init_slots(&this->segments[i], max(capacity, MIN_CAPACITY));
+	}
+	return &this->public;
+}
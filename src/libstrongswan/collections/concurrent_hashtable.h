@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2013 HSR Hochschule fuer Technik Rapperswil
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+/**
+ * @defgroup concurrent_hashtable concurrent_hashtable
+ * @{ @ingroup collections
+ */
+
+#ifndef CONCURRENT_HASHTABLE_H_
+#define CONCURRENT_HASHTABLE_H_
+
+#include <collections/hashtable.h>
+
+typedef struct concurrent_hashtable_t concurrent_hashtable_t;
+
+/**
+ * Class implementing a synchronized hash table.
+ *
+ * The table is split into segments selected by the hash of a key, each
+ * protected by its own read-write lock, so lookups never block each other and
+ * modifications only block operations on the same segment. Within a segment
+ * items are stored in an open addressing table using linear probing, which
+ * avoids allocating memory for each item.
+ *
+ * The table only synchronizes its own state: a value returned by get() might
+ * get removed by another thread at any time, so the lifetime of values has to
+ * be managed by the user (e.g. with reference counting). Keys must not be
+ * NULL.
+ */
+struct concurrent_hashtable_t {
+
+	/**
+	 * Create an enumerator over the hash table key/value pairs.
+	 *
+	 * Each segment is read-locked while it is enumerated, so the hash table
+	 * must not be modified by the enumerating thread, and items added or
+	 * removed concurrently might or might not get enumerated.
+	 *
+	 * @return			enumerator over (void *key, void *value)
+	 */
+	enumerator_t *(*create_enumerator) (concurrent_hashtable_t *this);
+
+	/**
+	 * Adds the given value with the given key to the hash table, if there
+	 * exists no entry with that key. NULL is returned in this case.
+	 * Otherwise the existing value is replaced and the function returns the
+	 * old value.
+	 *
+	 * @param key		the key to store
+	 * @param value		the value to store
+	 * @return			NULL if no item was replaced, the old value otherwise
+	 */
+	void *(*put) (concurrent_hashtable_t *this, void *key, void *value);
+
+	/**
+	 * Adds the given value with the given key to the hash table, if there
+	 * exists no entry with that key.
+	 *
+	 * Unlike a get() followed by a put() this is atomic.
+	 *
+	 * @param key		the key to store
+	 * @param value		the value to store
+	 * @return			NULL if the value was added, the existing value
+	 *					otherwise
+	 */
+	void *(*put_if_absent) (concurrent_hashtable_t *this, void *key,
+							void *value);
+
+	/**
+	 * Returns the value with the given key, if the hash table contains such an
+	 * entry, otherwise NULL is returned.
+	 *
+	 * @param key		the key of the requested value
+	 * @return			the value, NULL if not found
+	 */
+	void *(*get) (concurrent_hashtable_t *this, void *key);
+
+	/**
+	 * Returns the value with a matching key, if the hash table contains such an
+	 * entry, otherwise NULL is returned.
+	 *
+	 * Same as hashtable_t.get_match().
+	 *
+	 * @param key		the key to match against
+	 * @param match		match function to be used when comparing keys
+	 * @return			the value, NULL if not found
+	 */
+	void *(*get_match) (concurrent_hashtable_t *this, void *key,
+						hashtable_equals_t match);
+
+	/**
+	 * Removes the value with the given key from the hash table and returns the
+	 * removed value (or NULL if no such value existed).
+	 *
+	 * @param key		the key of the value to remove
+	 * @return			the removed value, NULL if not found
+	 */
+	void *(*remove) (concurrent_hashtable_t *this, void *key);
+
+	/**
+	 * Gets the number of items in the hash table.
+	 *
+	 * @return			number of items
+	 */
+	u_int (*get_count) (concurrent_hashtable_t *this);
+
+	/**
+	 * Destroys a hash table object.
+	 */
+	void (*destroy) (concurrent_hashtable_t *this);
+
+};
+
+/**
+ * Creates an empty synchronized hash table object.
+ *
+ * @param hash			hash function
+ * @param equals		equals function
+ * @param capacity		initial capacity
+ * @param segments		number of segments (rounded up to a power of 2),
+ *						0 for a default
+ * @return				concurrent_hashtable_t object.
+ */
+concurrent_hashtable_t *concurrent_hashtable_create(hashtable_hash_t hash,
+							hashtable_equals_t equals, u_int capacity,
+							u_int segments);
+
+#endif /** CONCURRENT_HASHTABLE_H_ @}*/
@@ -20,6 +20,8 @@
 
 #include "linked_list.h"
 
+#include <utils/slab.h>
+
 typedef struct element_t element_t;
 
 /**
@@ -53,7 +55,7 @@ struct element_t {
 element_t *element_create(void *value)
 {
 	element_t *this;
-	INIT(this,
+	INIT_SLAB(this,
 		.value = value,
 	);
 	return this;
@@ -142,15 +144,21 @@ METHOD(enumerator_t, enumerate, bool,
 	return TRUE;
 }
 
+METHOD(enumerator_t, enumerator_destroy, void,
+	private_enumerator_t *this)
+{
+	slab_free(this, sizeof(*this));
+}
+
 METHOD(linked_list_t, create_enumerator, enumerator_t*,
 	private_linked_list_t *this)
 {
 	private_enumerator_t *enumerator;
 
-	INIT(enumerator,
+	INIT_SLAB(enumerator,
 		.enumerator = {
 			.enumerate = (void*)_enumerate,
-			.destroy = (void*)free,
+			.destroy = _enumerator_destroy,
 		},
 		.list = this,
 	);
@@ -212,7 +220,7 @@ static element_t* remove_element(private_linked_list_t *this,
 
 	next = element->next;
 	previous = element->previous;
-	free(element);
+	slab_free(element, sizeof(*element));
 	if (next)
 	{
 		next->previous = previous;
@@ -502,7 +510,7 @@ METHOD(linked_list_t, destroy, void,
 		/* values are not destroyed so memory leaks are possible
 		 * if list is not empty when deleting */
 	}
-	free(this);
+	slab_free(this, sizeof(*this));
 }
 
 METHOD(linked_list_t, destroy_offset, void,
@@ -515,10 +523,10 @@ METHOD(linked_list_t, destroy_offset, void,
 		void (**method)(void*) = current->value + offset;
 		(*method)(current->value);
 		next = current->next;
-		free(current);
+		slab_free(current, sizeof(*current));
 		current = next;
 	}
-	free(this);
+	slab_free(this, sizeof(*this));
 }
 
 METHOD(linked_list_t, destroy_function, void,
@@ -530,10 +538,10 @@ METHOD(linked_list_t, destroy_function, void,
 	{
 		fn(current->value);
 		next = current->next;
-		free(current);
+		slab_free(current, sizeof(*current));
 		current = next;
 	}
-	free(this);
+	slab_free(this, sizeof(*this));
 }
 
 /*
@@ -543,7 +551,7 @@ linked_list_t *linked_list_create()
 {
 	private_linked_list_t *this;
 
-	INIT(this,
+	INIT_SLAB(this,
 		.public = {
 			.get_count = _get_count,
 			.create_enumerator = _create_enumerator,
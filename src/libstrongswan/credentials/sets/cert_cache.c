@@ -19,17 +19,22 @@
 #include <sched.h>
 
 #include <library.h>
+#include <utils/debug.h>
 #include <threading/rwlock.h>
-#include <collections/linked_list.h>
+#include <collections/hashtable.h>
 
-/** cache size, a power of 2 for fast modulo */
-#define CACHE_SIZE 32
+/** default number of cached relations */
+#define CACHE_SIZE 1024
+
+/** maximum number of segments, a power of 2 */
+#define MAX_SEGMENTS 16
 
 /** attempts to acquire a cache lock */
 #define REPLACE_TRIES 5
 
 typedef struct private_cert_cache_t private_cert_cache_t;
 typedef struct relation_t relation_t;
+typedef struct segment_t segment_t;
 
 /**
  * A trusted relation between subject and issuer
@@ -52,14 +57,65 @@ struct relation_t {
 	signature_scheme_t scheme;
 
 	/**
-	 * Cache hits
+	 * Hash over subject and issuer, see hash_relation()
 	 */
-	u_int hits;
+	u_int hash;
 
 	/**
-	 * Lock for this relation
+	 * Relation used since the clock hand passed it
+	 */
+	bool referenced;
+};
+
+/**
+ * A part of the cache, selected by the hash of a relation
+ */
+struct segment_t {
+
+	/**
+	 * Lock for this segment
 	 */
 	rwlock_t *lock;
+
+	/**
+	 * Relations in this segment, relation_t => relation_t
+	 */
+	hashtable_t *index;
+
+	/**
+	 * Slots holding the relations, for the clock eviction
+	 */
+	relation_t **slots;
+
+	/**
+	 * Number of slots
+	 */
+	u_int size;
+
+	/**
+	 * Number of used slots
+	 */
+	u_int count;
+
+	/**
+	 * Current clock hand position
+	 */
+	u_int hand;
+
+	/**
+	 * Number of cache hits
+	 */
+	refcount_t hits;
+
+	/**
+	 * Number of cache misses
+	 */
+	refcount_t misses;
+
+	/**
+	 * Number of evicted relations
+	 */
+	refcount_t evictions;
 };
 
 /**
@@ -73,67 +129,149 @@ struct private_cert_cache_t {
 	cert_cache_t public;
 
 	/**
-	 * array of trusted subject-issuer relations
+	 * segments of the cache
 	 */
-	relation_t relations[CACHE_SIZE];
+	segment_t *segments;
+
+	/**
+	 * number of segments
+	 */
+	u_int count;
 };
 
 /**
- * Cache relation in a free slot/replace an other
+ * Hash function for relations
  */
-static void cache(private_cert_cache_t *this,
-				  certificate_t *subject, certificate_t *issuer,
-				  signature_scheme_t scheme)
+static u_int relation_hash(relation_t *rel)
 {
-	relation_t *rel;
-	int i, offset, try;
-	u_int total_hits = 0;
+	return rel->hash;
+}
+
+/**
+ * Equals function for relations
+ */
+static bool relation_equals(relation_t *a, relation_t *b)
+{
+	return a->issuer->equals(a->issuer, b->issuer) &&
+		   a->subject->equals(a->subject, b->subject);
+}
+
+/**
+ * Hash a certificate incrementally, over its subject, start of validity and
+ * public key fingerprint. Unlike its DER encoding, these are available for all
+ * certificate types and don't get allocated. Certificates with the same hash
+ * are compared with equals().
+ */
+static u_int hash_cert(certificate_t *cert, u_int hash)
+{
+	identification_t *id;
+	public_key_t *public;
+	time_t not_before = 0;
+	chunk_t fp;
 
-	/* check for a unused relation slot first */
-	for (i = 0; i < CACHE_SIZE; i++)
+	id = cert->get_subject(cert);
+	if (id)
 	{
-		rel = &this->relations[i];
+		hash = chunk_hash_inc(id->get_encoding(id), hash);
+	}
+	cert->get_validity(cert, NULL, &not_before, NULL);
+	hash = chunk_hash_inc(chunk_from_thing(not_before), hash);
+	public = cert->get_public_key(cert);
+	if (public)
+	{
+		if (public->get_fingerprint(public, KEYID_PUBKEY_SHA1, &fp))
+		{
+			hash = chunk_hash_inc(fp, hash);
+		}
+		public->destroy(public);
+	}
+	return hash;
+}
 
-		if (!rel->subject && rel->lock->try_write_lock(rel->lock))
+/**
+ * Calculate the hash of a subject-issuer relation
+ */
+static u_int hash_relation(certificate_t *subject, certificate_t *issuer)
+{
+	return hash_cert(issuer, hash_cert(subject, 0));
+}
+
+/**
+ * Get the segment for a hash. The hashtable in the segment uses the lower
+ * bits of the hash, so we use the upper bits to select the segment.
+ */
+static segment_t *get_segment(private_cert_cache_t *this, u_int hash)
+{
+	return &this->segments[(hash >> 24) & (this->count - 1)];
+}
+
+/**
+ * Destroy a relation
+ */
+static void relation_destroy(relation_t *rel)
+{
+	rel->subject->destroy(rel->subject);
+	rel->issuer->destroy(rel->issuer);
+	free(rel);
+}
+
+/**
+ * Cache relation in a free slot or replace one not recently used, segment
+ * must be write locked
+ */
+static void cache_locked(segment_t *segment, relation_t *key,
+						 signature_scheme_t scheme)
+{
+	relation_t *rel;
+	u_int slot;
+
+	if (segment->index->get(segment->index, key))
+	{	/* cached concurrently */
+		return;
+	}
+	if (segment->count < segment->size)
+	{
+		slot = segment->count++;
+	}
+	else
+	{	/* advance the clock hand to a relation not used since its last pass */
+		while (segment->slots[segment->hand]->referenced)
 		{
-			/* double-check having lock */
-			if (!rel->subject)
-			{
-				rel->subject = subject->get_ref(subject);
-				rel->issuer = issuer->get_ref(issuer);
-				rel->scheme = scheme;
-				return rel->lock->unlock(rel->lock);
-			}
-			rel->lock->unlock(rel->lock);
+			segment->slots[segment->hand]->referenced = FALSE;
+			segment->hand = (segment->hand + 1) % segment->size;
 		}
-		total_hits += rel->hits;
+		slot = segment->hand;
+		segment->hand = (segment->hand + 1) % segment->size;
+		rel = segment->slots[slot];
+		segment->index->remove(segment->index, rel);
+		relation_destroy(rel);
+		ref_get(&segment->evictions);
 	}
-	/* run several attempts to replace a random slot, never block. */
+	INIT(rel,
+		.subject = key->subject->get_ref(key->subject),
+		.issuer = key->issuer->get_ref(key->issuer),
+		.scheme = scheme,
+		.hash = key->hash,
+	);
+	segment->slots[slot] = rel;
+	segment->index->put(segment->index, rel, rel);
+}
+
+/**
+ * Cache a relation, never blocks to avoid deadlocks with enumerators
+ */
+static void cache(segment_t *segment, relation_t *key,
+				  signature_scheme_t scheme)
+{
+	int try;
+
 	for (try = 0; try < REPLACE_TRIES; try++)
 	{
-		/* replace a random relation */
-		offset = random();
-		for (i = 0; i < CACHE_SIZE; i++)
+		if (segment->lock->try_write_lock(segment->lock))
 		{
-			rel = &this->relations[(i + offset) % CACHE_SIZE];
-
-			if (rel->hits > total_hits / CACHE_SIZE)
-			{	/* skip often used slots */
-				continue;
-			}
-			if (rel->lock->try_write_lock(rel->lock))
-			{
-				if (rel->subject)
-				{
-					rel->subject->destroy(rel->subject);
-					rel->issuer->destroy(rel->issuer);
-				}
-				rel->subject = subject->get_ref(subject);
-				rel->issuer = issuer->get_ref(issuer);
-				rel->scheme = scheme;
-				rel->hits = 0;
-				return rel->lock->unlock(rel->lock);
-			}
+			cache_locked(segment, key, scheme);
+			segment->lock->unlock(segment->lock);
+			return;
 		}
 		/* give other threads a chance to release locks */
 		sched_yield();
@@ -144,44 +282,38 @@ METHOD(cert_cache_t, issued_by, bool,
 	private_cert_cache_t *this, certificate_t *subject, certificate_t *issuer,
 	signature_scheme_t *schemep)
 {
-	relation_t *found = NULL, *current;
+	relation_t *found, key = {
+		.subject = subject,
+		.issuer = issuer,
+		.hash = hash_relation(subject, issuer),
+	};
+	segment_t *segment;
 	signature_scheme_t scheme;
-	int i;
 
-	for (i = 0; i < CACHE_SIZE; i++)
+	segment = get_segment(this, key.hash);
+	segment->lock->read_lock(segment->lock);
+	found = segment->index->get(segment->index, &key);
+	if (found)
 	{
-		current = &this->relations[i];
-
-		current->lock->read_lock(current->lock);
-		if (current->subject)
+		/* written with a read lock, but not critical */
+		found->referenced = TRUE;
+		if (schemep)
 		{
-			/* check for equal issuer */
-			if (issuer->equals(issuer, current->issuer))
-			{
-				/* reuse issuer instance in cache() */
-				issuer = current->issuer;
-				if (subject->equals(subject, current->subject))
-				{
-					/* write hit counter is not locked, but not critical */
-					current->hits++;
-					found = current;;
-					if (schemep)
-					{
-						*schemep = current->scheme;
-					}
-				}
-			}
-		}
-		current->lock->unlock(current->lock);
-		if (found)
-		{
-			return TRUE;
+			*schemep = found->scheme;
 		}
 	}
+	segment->lock->unlock(segment->lock);
+	if (found)
+	{
+		ref_get(&segment->hits);
+		return TRUE;
+	}
+	ref_get(&segment->misses);
+
 	/* no cache hit, check and cache signature */
 	if (subject->issued_by(subject, issuer, &scheme))
 	{
-		cache(this, subject, issuer, scheme);
+		cache(segment, &key, scheme);
 		if (schemep)
 		{
 			*schemep = scheme;
@@ -204,68 +336,78 @@ typedef struct {
 	/** ID to get a cert for */
 	identification_t *id;
 	/** cache */
-	relation_t *relations;
-	/** current position in array cache */
+	private_cert_cache_t *cache;
+	/** current segment */
+	int segment;
+	/** current slot in segment */
 	int index;
-	/** currently locked relation */
+	/** currently locked segment */
 	int locked;
 } cert_enumerator_t;
 
 /**
- * filter function for certs enumerator
+ * Check if a cached relation matches the enumerator parameters
  */
-static bool cert_enumerate(cert_enumerator_t *this, certificate_t **out)
+static bool cert_matches(cert_enumerator_t *this, relation_t *rel)
 {
 	public_key_t *public;
-	relation_t *rel;
+	bool match = FALSE;
 
-	if (this->locked >= 0)
+	/* CRL lookup is done using issuer/authkeyidentifier */
+	if (this->key == KEY_ANY && this->id &&
+		(this->cert == CERT_ANY || this->cert == CERT_X509_CRL) &&
+		rel->subject->get_type(rel->subject) == CERT_X509_CRL &&
+		rel->subject->has_issuer(rel->subject, this->id))
 	{
-		rel = &this->relations[this->locked];
-		rel->lock->unlock(rel->lock);
-		this->locked = -1;
+		return TRUE;
+	}
+	if ((this->cert == CERT_ANY ||
+		 rel->subject->get_type(rel->subject) == this->cert) &&
+		(!this->id || rel->subject->has_subject(rel->subject, this->id)))
+	{
+		if (this->key == KEY_ANY)
+		{
+			return TRUE;
+		}
+		public = rel->subject->get_public_key(rel->subject);
+		if (public)
+		{
+			match = public->get_type(public) == this->key;
+			public->destroy(public);
+		}
 	}
+	return match;
+}
+
+/**
+ * filter function for certs enumerator
+ */
+static bool cert_enumerate(cert_enumerator_t *this, certificate_t **out)
+{
+	segment_t *segment;
+	relation_t *rel;
 
-	while (++this->index < CACHE_SIZE)
+	while (this->segment < this->cache->count)
 	{
-		rel = &this->relations[this->index];
-		rel->lock->read_lock(rel->lock);
-		this->locked = this->index;
-		if (rel->subject)
+		segment = &this->cache->segments[this->segment];
+		if (this->locked != this->segment)
 		{
-			/* CRL lookup is done using issuer/authkeyidentifier */
-			if (this->key == KEY_ANY && this->id &&
-				(this->cert == CERT_ANY || this->cert == CERT_X509_CRL) &&
-				rel->subject->get_type(rel->subject) == CERT_X509_CRL &&
-				rel->subject->has_issuer(rel->subject, this->id))
+			segment->lock->read_lock(segment->lock);
+			this->locked = this->segment;
+		}
+		while (++this->index < segment->count)
+		{
+			rel = segment->slots[this->index];
+			if (cert_matches(this, rel))
 			{
 				*out = rel->subject;
 				return TRUE;
 			}
-			if ((this->cert == CERT_ANY ||
-				 rel->subject->get_type(rel->subject) == this->cert) &&
-				(!this->id || rel->subject->has_subject(rel->subject, this->id)))
-			{
-				if (this->key == KEY_ANY)
-				{
-					*out = rel->subject;
-					return TRUE;
-				}
-				public = rel->subject->get_public_key(rel->subject);
-				if (public)
-				{
-					if (public->get_type(public) == this->key)
-					{
-						public->destroy(public);
-						*out = rel->subject;
-						return TRUE;
-					}
-					public->destroy(public);
-				}
-			}
 		}
+		segment->lock->unlock(segment->lock);
 		this->locked = -1;
-		rel->lock->unlock(rel->lock);
+		this->segment++;
+		this->index = -1;
 	}
 	return FALSE;
 }
@@ -275,12 +417,12 @@ static bool cert_enumerate(cert_enumerator_t *this, certificate_t **out)
  */
 static void cert_enumerator_destroy(cert_enumerator_t *this)
 {
-	relation_t *rel;
+	segment_t *segment;
 
 	if (this->locked >= 0)
 	{
-		rel = &this->relations[this->locked];
-		rel->lock->unlock(rel->lock);
+		segment = &this->cache->segments[this->locked];
+		segment->lock->unlock(segment->lock);
 	}
 	free(this);
 }
@@ -295,76 +437,81 @@ METHOD(credential_set_t, create_enumerator, enumerator_t*,
 	{
 		return NULL;
 	}
-	enumerator = malloc_thing(cert_enumerator_t);
-	enumerator->public.enumerate = (void*)cert_enumerate;
-	enumerator->public.destroy = (void*)cert_enumerator_destroy;
-	enumerator->cert = cert;
-	enumerator->key = key;
-	enumerator->id = id;
-	enumerator->relations = this->relations;
-	enumerator->index = -1;
-	enumerator->locked = -1;
-
+	INIT(enumerator,
+		.public = {
+			.enumerate = (void*)cert_enumerate,
+			.destroy = (void*)cert_enumerator_destroy,
+		},
+		.cert = cert,
+		.key = key,
+		.id = id,
+		.cache = this,
+		.index = -1,
+		.locked = -1,
+	);
 	return &enumerator->public;
 }
 
 METHOD(cert_cache_t, flush, void,
 	private_cert_cache_t *this, certificate_type_t type)
 {
+	segment_t *segment;
 	relation_t *rel;
-	int i;
+	u_int i, j, hits = 0, misses = 0, evictions = 0, count = 0;
 
-	for (i = 0; i < CACHE_SIZE; i++)
+	for (i = 0; i < this->count; i++)
 	{
-		rel = &this->relations[i];
-		if (!rel->subject)
+		segment = &this->segments[i];
+		segment->lock->write_lock(segment->lock);
+		for (j = 0; j < segment->count; j++)
 		{
-			continue;
-		}
-		/* check with cheap read lock first */
-		if (type != CERT_ANY)
-		{
-			rel->lock->read_lock(rel->lock);
-			if (!rel->subject || type != rel->subject->get_type(rel->subject))
+			rel = segment->slots[j];
+			if (type == CERT_ANY || type == rel->subject->get_type(rel->subject))
 			{
-				rel->lock->unlock(rel->lock);
-				continue;
+				segment->index->remove(segment->index, rel);
+				relation_destroy(rel);
+				segment->slots[j] = NULL;
 			}
-			rel->lock->unlock(rel->lock);
 		}
-		/* double check in write lock */
-		rel->lock->write_lock(rel->lock);
-		if (rel->subject)
+		/* compact the remaining relations */
+		segment->hand = 0;
+		for (j = 0; j < segment->count; j++)
 		{
-			if (type == CERT_ANY || type == rel->subject->get_type(rel->subject))
+			if (segment->slots[j])
 			{
-				rel->subject->destroy(rel->subject);
-				rel->issuer->destroy(rel->issuer);
-				rel->subject = NULL;
-				rel->issuer = NULL;
-				rel->hits = 0;
+				segment->slots[segment->hand++] = segment->slots[j];
 			}
 		}
-		rel->lock->unlock(rel->lock);
+		segment->count = segment->hand;
+		segment->hand = 0;
+		count += segment->count;
+		hits += segment->hits;
+		misses += segment->misses;
+		evictions += segment->evictions;
+		segment->lock->unlock(segment->lock);
 	}
+	DBG2(DBG_LIB, "flushed certificate cache, %u relations kept, %u hits, "
+		 "%u misses, %u evictions", count, hits, misses, evictions);
 }
 
 METHOD(cert_cache_t, destroy, void,
 	private_cert_cache_t *this)
 {
-	relation_t *rel;
-	int i;
+	segment_t *segment;
+	u_int i, j;
 
-	for (i = 0; i < CACHE_SIZE; i++)
+	for (i = 0; i < this->count; i++)
 	{
-		rel = &this->relations[i];
-		if (rel->subject)
+		segment = &this->segments[i];
+		for (j = 0; j < segment->count; j++)
 		{
-			rel->subject->destroy(rel->subject);
-			rel->issuer->destroy(rel->issuer);
+			relation_destroy(segment->slots[j]);
 		}
-		rel->lock->destroy(rel->lock);
+		segment->index->destroy(segment->index);
+		segment->lock->destroy(segment->lock);
+		free(segment->slots);
 	}
+	free(this->segments);
 	free(this);
 }
 
@@ -374,7 +521,8 @@ METHOD(cert_cache_t, destroy, void,
 cert_cache_t *cert_cache_create()
 {
 	private_cert_cache_t *this;
-	int i;
+	segment_t *segment;
+	int size, i;
 
 	INIT(this,
 		.public = {
@@ -389,14 +537,28 @@ cert_cache_t *cert_cache_create()
 			.flush = _flush,
 			.destroy = _destroy,
 		},
+		.count = MAX_SEGMENTS,
 	);
 
-	for (i = 0; i < CACHE_SIZE; i++)
+	size = lib->settings->get_int(lib->settings,
+								  "libstrongswan.cert_cache_size", CACHE_SIZE);
+	size = max(size, 1);
+	while (this->count > 1 && this->count > (u_int)size)
+	{
+		this->count /= 2;
+	}
+	size = (size + this->count - 1) / this->count;
+
+	this->segments = calloc(this->count, sizeof(segment_t));
+	for (i = 0; i < this->count; i++)
 	{
-		this->relations[i].subject = NULL;
-		this->relations[i].issuer = NULL;
-		this->relations[i].hits = 0;
-		this->relations[i].lock = rwlock_create(RWLOCK_TYPE_DEFAULT);
+		segment = &this->segments[i];
+		segment->lock = rwlock_create(RWLOCK_TYPE_DEFAULT);
+		segment->index = hashtable_create((hashtable_hash_t)relation_hash,
+										  (hashtable_equals_t)relation_equals,
+										  size);
+		segment->slots = calloc(size, sizeof(relation_t*));
+		segment->size = size;
 	}
 
 	return &this->public;
@@ -31,7 +31,8 @@ typedef struct cert_cache_t cert_cache_t;
  * This cache serves all certificates seen in its issued_by method
  * and serves them as untrusted through the credential set interface. Further,
  * it caches valid subject-issuer relationships to speed up the issued_by
- * method.
+ * method. The number of cached relationships is limited, relationships not
+ * used recently get replaced if the cache is full.
  */
 struct cert_cache_t {
 
@@ -720,7 +720,7 @@ METHOD(crypto_tester_t, test_hasher, bool,
 	enumerator = this->hasher->create_enumerator(this->hasher);
 	while (enumerator->enumerate(enumerator, &vector))
 	{
-		hasher_t *hasher;
+		hasher_t *hasher, *clone = NULL;
 		chunk_t data, hash;
 
 		if (vector->alg != alg)
@@ -791,9 +791,45 @@ METHOD(crypto_tester_t, test_hasher, bool,
 				goto failure;
 			}
 		}
+		/* continue from a cloned and a restored state, if supported */
+		if (data.len > 1)
+		{
+			if (!hasher->get_hash(hasher, chunk_create(data.ptr, 1), NULL))
+			{
+				goto failure;
+			}
+			clone = hasher->clone(hasher);
+			if (clone)
+			{
+				memset(hash.ptr, 0, hash.len);
+				if (!hasher->get_hash(hasher, chunk_skip(data, 1), hash.ptr) ||
+					!memeq(vector->hash, hash.ptr, hash.len))
+				{
+					goto failure;
+				}
+				memset(hash.ptr, 0, hash.len);
+				if (!hasher->restore(hasher, clone) ||
+					!hasher->get_hash(hasher, chunk_skip(data, 1), hash.ptr) ||
+					!memeq(vector->hash, hash.ptr, hash.len))
+				{
+					goto failure;
+				}
+				memset(hash.ptr, 0, hash.len);
+				if (!clone->get_hash(clone, chunk_skip(data, 1), hash.ptr) ||
+					!memeq(vector->hash, hash.ptr, hash.len))
+				{
+					goto failure;
+				}
+			}
+			else if (!hasher->reset(hasher))
+			{
+				goto failure;
+			}
+		}
 
 		failed = FALSE;
 failure:
+		DESTROY_IF(clone);
 		hasher->destroy(hasher);
 		chunk_free(&hash);
 		if (failed)
@@ -0,0 +1,288 @@
+/*
+ * Copyright (C) 2013 HSR Hochschule fuer Technik Rapperswil
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#include "dh_pool.h"
+
+#include <library.h>
+#include <utils/debug.h>
+#include <threading/mutex.h>
+#include <collections/linked_list.h>
+#include <processing/jobs/callback_job.h>
+
+/**
+ * Delay in ms before retrying a refill if higher priority jobs are queued
+ */
+#define REFILL_BACKOFF 100
+
+typedef struct private_dh_pool_t private_dh_pool_t;
+
+/**
+ * Private data of a dh_pool_t object.
+ */
+struct private_dh_pool_t {
+
+	/**
+	 * Public interface
+	 */
+	dh_pool_t public;
+
+	/**
+	 * Pools per DH group, as entry_t
+	 */
+	linked_list_t *entries;
+
+	/**
+	 * Number of key pairs to keep per group, 0 to disable
+	 */
+	u_int size;
+
+	/**
+	 * Mutex to lock entries
+	 */
+	mutex_t *mutex;
+};
+
+/**
+ * Pool of key pairs for a single DH group
+ */
+typedef struct {
+	/** DH group of this pool */
+	diffie_hellman_group_t group;
+	/** precomputed key pairs, diffie_hellman_t */
+	linked_list_t *dhs;
+	/** TRUE if a refill job is queued or running */
+	bool refilling;
+	/** TRUE if the group is not supported, do not try to refill */
+	bool unsupported;
+	/** number of key pairs taken from the pool */
+	u_int hits;
+	/** number of key pairs created inline */
+	u_int misses;
+	/** back reference to pool */
+	private_dh_pool_t *pool;
+} entry_t;
+
+/**
+ * Destroy a pool entry
+ */
+static void entry_destroy(entry_t *entry)
+{
+	entry->dhs->destroy_offset(entry->dhs, offsetof(diffie_hellman_t, destroy));
+	free(entry);
+}
+
+/**
+ * Check if jobs with a higher priority than ours are waiting
+ */
+static bool busy()
+{
+	job_priority_t prio;
+
+	for (prio = JOB_PRIO_CRITICAL; prio < JOB_PRIO_LOW; prio++)
+	{
+		if (lib->processor->get_job_load(lib->processor, prio))
+		{
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/**
+ * Precompute a single key pair, requeue until the pool is full
+ */
+static job_requeue_t refill(entry_t *entry)
+{
+	private_dh_pool_t *this = entry->pool;
+	diffie_hellman_t *dh;
+
+	if (busy())
+	{	/* don't steal CPU from higher priority jobs, retry later */
+		return JOB_RESCHEDULE_MS(REFILL_BACKOFF);
+	}
+
+	dh = lib->crypto->create_dh(lib->crypto, entry->group);
+
+	this->mutex->lock(this->mutex);
+	if (!dh)
+	{
+		DBG1(DBG_LIB, "DH group %N not supported, disabling pool",
+			 diffie_hellman_group_names, entry->group);
+		entry->unsupported = TRUE;
+		entry->refilling = FALSE;
+		this->mutex->unlock(this->mutex);
+		return JOB_REQUEUE_NONE;
+	}
+	entry->dhs->insert_last(entry->dhs, dh);
+	if (entry->dhs->get_count(entry->dhs) < this->size)
+	{
+		this->mutex->unlock(this->mutex);
+		return JOB_REQUEUE_FAIR;
+	}
+	DBG2(DBG_LIB, "DH pool for %N filled with %u key pairs",
+		 diffie_hellman_group_names, entry->group, this->size);
+	entry->refilling = FALSE;
+	this->mutex->unlock(this->mutex);
+	return JOB_REQUEUE_NONE;
+}
+
+/**
+ * Find or create the pool entry for a group, mutex must be held
+ */
+static entry_t *get_entry(private_dh_pool_t *this,
+						  diffie_hellman_group_t group)
+{
+	enumerator_t *enumerator;
+	entry_t *entry, *found = NULL;
+
+	enumerator = this->entries->create_enumerator(this->entries);
+	while (enumerator->enumerate(enumerator, &entry))
+	{
+		if (entry->group == group)
+		{
+			found = entry;
+			break;
+		}
+	}
+	enumerator->destroy(enumerator);
+
+	if (!found)
+	{
+		INIT(found,
+			.group = group,
+			.dhs = linked_list_create(),
+			.pool = this,
+		);
+		this->entries->insert_last(this->entries, found);
+	}
+	return found;
+}
+
+METHOD(dh_pool_t, get, diffie_hellman_t*,
+	private_dh_pool_t *this, diffie_hellman_group_t group)
+{
+	diffie_hellman_t *dh = NULL;
+	entry_t *entry;
+
+	if (!this->size || group == MODP_NONE || group == MODP_CUSTOM)
+	{
+		return lib->crypto->create_dh(lib->crypto, group);
+	}
+
+	this->mutex->lock(this->mutex);
+	entry = get_entry(this, group);
+	if (entry->unsupported)
+	{
+		this->mutex->unlock(this->mutex);
+		return lib->crypto->create_dh(lib->crypto, group);
+	}
+	/* removing the key pair from the pool enforces single-use */
+	if (entry->dhs->remove_first(entry->dhs, (void**)&dh) == SUCCESS)
+	{
+		entry->hits++;
+	}
+	else
+	{
+		entry->misses++;
+	}
+	if (!entry->refilling)
+	{
+		entry->refilling = TRUE;
+		lib->processor->queue_job(lib->processor,
+			(job_t*)callback_job_create_with_prio((callback_job_cb_t)refill,
+									entry, NULL, NULL, JOB_PRIO_LOW));
+	}
+	this->mutex->unlock(this->mutex);
+
+	if (!dh)
+	{
+		dh = lib->crypto->create_dh(lib->crypto, group);
+	}
+	return dh;
+}
+
+/**
+ * Filter function for stats enumerator
+ */
+static bool stats_filter(void *data, entry_t **entry,
+						 diffie_hellman_group_t *group, void *i1, u_int *hits,
+						 void *i2, u_int *misses, void *i3, u_int *available)
+{
+	*group = (*entry)->group;
+	*hits = (*entry)->hits;
+	*misses = (*entry)->misses;
+	*available = (*entry)->dhs->get_count((*entry)->dhs);
+	return TRUE;
+}
+
+METHOD(dh_pool_t, create_stats_enumerator, enumerator_t*,
+	private_dh_pool_t *this)
+{
+	this->mutex->lock(this->mutex);
+	return enumerator_create_filter(
+						this->entries->create_enumerator(this->entries),
+						(void*)stats_filter, this->mutex,
+						(void*)this->mutex->unlock);
+}
+
+METHOD(dh_pool_t, flush, void,
+	private_dh_pool_t *this)
+{
+	enumerator_t *enumerator;
+	diffie_hellman_t *dh;
+	entry_t *entry;
+
+	this->mutex->lock(this->mutex);
+	enumerator = this->entries->create_enumerator(this->entries);
+	while (enumerator->enumerate(enumerator, &entry))
+	{
+		while (entry->dhs->remove_last(entry->dhs, (void**)&dh) == SUCCESS)
+		{
+			dh->destroy(dh);
+		}
+	}
+	enumerator->destroy(enumerator);
+	this->mutex->unlock(this->mutex);
+}
+
+METHOD(dh_pool_t, destroy, void,
+	private_dh_pool_t *this)
+{
+	this->entries->destroy_function(this->entries, (void*)entry_destroy);
+	this->mutex->destroy(this->mutex);
+	free(this);
+}
+
+/**
+ * See header
+ */
+dh_pool_t *dh_pool_create()
+{
+	private_dh_pool_t *this;
+
+	INIT(this,
+		.public = {
+			.get = _get,
+			.create_stats_enumerator = _create_stats_enumerator,
+			.flush = _flush,
+			.destroy = _destroy,
+		},
+		.entries = linked_list_create(),
+		.size = lib->settings->get_int(lib->settings,
+									   "libstrongswan.dh_pool.size", 0),
+		.mutex = mutex_create(MUTEX_TYPE_DEFAULT),
+	);
+
+	return &this->public;
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2013 HSR Hochschule fuer Technik Rapperswil
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+/**
+ * @defgroup dh_pool dh_pool
+ * @{ @ingroup crypto
+ */
+
+#ifndef DH_POOL_H_
+#define DH_POOL_H_
+
+typedef struct dh_pool_t dh_pool_t;
+
+#include <crypto/diffie_hellman.h>
+#include <collections/enumerator.h>
+
+/**
+ * Pool of precomputed Diffie-Hellman key pairs.
+ *
+ * Creating a diffie_hellman_t generates the private value and computes the
+ * public value, which is the expensive part of a DH exchange. This pool keeps
+ * a number of such objects per DH group, created in advance by low priority
+ * jobs while the processor has nothing better to do.
+ *
+ * Each pooled object is handed out exactly once and removed from the pool,
+ * so a key pair is never used for more than a single exchange.
+ *
+ * The pool is disabled (i.e. get() just creates a new object) unless
+ * libstrongswan.dh_pool.size is set.
+ */
+struct dh_pool_t {
+
+	/**
+	 * Get a Diffie-Hellman object for the given group.
+	 *
+	 * If a precomputed key pair is available it is returned, otherwise a
+	 * new one is created inline. In both cases the pool gets refilled in
+	 * the background.
+	 *
+	 * @param group			Diffie-Hellman group
+	 * @return				diffie_hellman_t object, NULL if not supported
+	 */
+	diffie_hellman_t* (*get)(dh_pool_t *this, diffie_hellman_group_t group);
+
+	/**
+	 * Create an enumerator over pool statistics.
+	 *
+	 * The enumerator enumerates over:
+	 * diffie_hellman_group_t group, u_int hits, u_int misses, u_int available
+	 *
+	 * @return				enumerator over pool statistics
+	 */
+	enumerator_t* (*create_stats_enumerator)(dh_pool_t *this);
+
+	/**
+	 * Destroy all precomputed key pairs.
+	 *
+	 * Must be called before the plugins providing DH groups get unloaded.
+	 */
+	void (*flush)(dh_pool_t *this);
+
+	/**
+	 * Destroy a dh_pool_t, including all pooled key pairs.
+	 */
+	void (*destroy)(dh_pool_t *this);
+};
+
+/**
+ * Create a dh_pool_t instance.
+ *
+ * @return					Diffie-Hellman key pair pool
+ */
+dh_pool_t *dh_pool_create();
+
+#endif /** DH_POOL_H_ @}*/
@@ -118,6 +118,27 @@ struct hasher_t {
 	 */
 	bool (*reset)(hasher_t *this) __attribute__((warn_unused_result));
 
+	/**
+	 * Create a copy of the hasher, including the state of the data appended
+	 * so far.
+	 *
+	 * The copy may be used to continue hashing independently of this
+	 * hasher, or to later restore the current state with restore(), e.g. to
+	 * precompute the hash of a common prefix.
+	 *
+	 * @return			cloned hasher, NULL if not supported
+	 */
+	hasher_t* (*clone)(hasher_t *this);
+
+	/**
+	 * Restore the state of this hasher from a copy created with clone().
+	 *
+	 * @param other		clone of this hasher to copy the state from
+	 * @return			TRUE if state restored, FALSE if not supported
+	 */
+	bool (*restore)(hasher_t *this,
+					hasher_t *other) __attribute__((warn_unused_result));
+
 	/**
 	 * Destroys a hasher object.
 	 */
@@ -23,8 +23,10 @@
 
 typedef enum db_type_t db_type_t;
 typedef enum db_driver_t db_driver_t;
+typedef struct db_value_t db_value_t;
 typedef struct database_t database_t;
 
+#include <utils/chunk.h>
 #include <collections/enumerator.h>
 
 /**
@@ -45,6 +47,22 @@ enum db_type_t {
 	DB_NULL,
 };
 
+/**
+ * A typed value to bind to a placeholder, as used by execute_batch()
+ */
+struct db_value_t {
+	/** type of the value */
+	db_type_t type;
+	/** value, as defined by type, unused for DB_NULL */
+	union {
+		int i;
+		u_int u;
+		char *text;
+		chunk_t blob;
+		double d;
+	} value;
+};
+
 /**
  * Database implementation type.
  */
@@ -111,6 +129,54 @@ struct database_t {
 	 */
 	int (*execute)(database_t *this, int *rowid, char *sql, ...);
 
+	/**
+	 * Execute a query which does not return rows for a batch of rows.
+	 *
+	 * The statement is prepared once and executed for each row of values,
+	 * in a single transaction. If possible, implementations combine the
+	 * rows of an INSERT or REPLACE statement ending in a VALUES clause to
+	 * multi-row statements.
+	 *
+	 * @param sql		sql string, containing '?' placeholders for one row
+	 * @param rows		number of rows
+	 * @param values	rows * placeholders values, row by row
+	 * @return			number of affected rows, < 0 on failure (rolled back)
+	 */
+	int (*execute_batch)(database_t *this, char *sql, int rows,
+						 db_value_t *values);
+
+	/**
+	 * Start a transaction.
+	 *
+	 * Queries and statements run by the calling thread until commit() or
+	 * rollback() see the changes of the transaction, other threads don't.
+	 * A serializable transaction locks out other writers from the start,
+	 * use it for SELECT followed by an INSERT/UPDATE depending on the result.
+	 *
+	 * Transactions may be nested, but commit() or rollback() have to be
+	 * called for each successful call of this method. Only the outermost
+	 * transaction is actually committed, and it gets rolled back instead if
+	 * any of the nested ones was rolled back.
+	 *
+	 * @param serializable	TRUE to create a serializable transaction
+	 * @return				TRUE if transaction started
+	 */
+	bool (*transaction)(database_t *this, bool serializable);
+
+	/**
+	 * Commit the transaction started by the calling thread.
+	 *
+	 * @return				TRUE if transaction committed
+	 */
+	bool (*commit)(database_t *this);
+
+	/**
+	 * Roll back the transaction started by the calling thread.
+	 *
+	 * @return				TRUE if transaction rolled back
+	 */
+	bool (*rollback)(database_t *this);
+
 	/**
 	 * Get the database implementation type.
 	 *
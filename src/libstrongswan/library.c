@@ -82,7 +82,9 @@ void library_deinit()
 
 	this->public.scheduler->destroy(this->public.scheduler);
 	this->public.processor->destroy(this->public.processor);
+	this->public.dh_pool->destroy(this->public.dh_pool);
 	this->public.plugins->destroy(this->public.plugins);
+	this->public.watcher->destroy(this->public.watcher);
 	this->public.hosts->destroy(this->public.hosts);
 	this->public.settings->destroy(this->public.settings);
 	this->public.credmgr->destroy(this->public.credmgr);
@@ -266,6 +268,8 @@ bool library_init(char *settings)
 	this->public.db = database_factory_create();
 	this->public.processor = processor_create();
 	this->public.scheduler = scheduler_create();
+	this->public.watcher = watcher_create();
+	this->public.dh_pool = dh_pool_create();
 	this->public.plugins = plugin_loader_create();
 
 	if (!check_memwipe())
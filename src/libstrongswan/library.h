@@ -92,7 +92,9 @@
 #include "networking/host_resolver.h"
 #include "processing/processor.h"
 #include "processing/scheduler.h"
+#include "processing/watcher.h"
 #include "crypto/crypto_factory.h"
+#include "crypto/dh_pool.h"
 #include "crypto/proposal/proposal_keywords.h"
 #include "fetcher/fetcher_manager.h"
 #include "resolver/resolver_manager.h"
@@ -151,6 +153,11 @@ struct library_t {
 	 */
 	crypto_factory_t *crypto;
 
+	/**
+	 * pool of precomputed Diffie-Hellman key pairs
+	 */
+	dh_pool_t *dh_pool;
+
 	/**
 	 * credential constructor registry and factory
 	 */
@@ -196,6 +203,11 @@ struct library_t {
 	 */
 	scheduler_t *scheduler;
 
+	/**
+	 * watch file descriptors for events, dispatching callbacks as jobs
+	 */
+	watcher_t *watcher;
+
 	/**
 	 * resolve hosts by DNS name
 	 */
@@ -19,6 +19,7 @@
 #include "host.h"
 
 #include <utils/debug.h>
+#include <utils/slab.h>
 #include <library.h>
 
 #define IPV4_LEN	 4
@@ -238,7 +239,7 @@ METHOD(host_t, clone_, host_t*,
 {
 	private_host_t *new;
 
-	new = malloc_thing(private_host_t);
+	new = slab_alloc(sizeof(private_host_t));
 	memcpy(new, this, sizeof(private_host_t));
 
 	return &new->public;
@@ -302,7 +303,7 @@ static bool equals(private_host_t *this, private_host_t *other)
 METHOD(host_t, destroy, void,
 	private_host_t *this)
 {
-	free(this);
+	slab_free(this, sizeof(*this));
 }
 
 /**
@@ -312,7 +313,7 @@ static private_host_t *host_create_empty(void)
 {
 	private_host_t *this;
 
-	INIT(this,
+	INIT_SLAB(this,
 		.public = {
 			.get_sockaddr = _get_sockaddr,
 			.get_sockaddr_len = _get_sockaddr_len,
@@ -442,7 +443,7 @@ host_t *host_create_from_sockaddr(sockaddr_t *sockaddr)
 		default:
 			break;
 	}
-	free(this);
+	slab_free(this, sizeof(*this));
 	return NULL;
 }
 
@@ -634,6 +635,6 @@ host_t *host_create_any(int family)
 		default:
 			break;
 	}
-	free(this);
+	slab_free(this, sizeof(*this));
 	return NULL;
 }
@@ -18,6 +18,18 @@
 #include "packet.h"
 
 typedef struct private_packet_t private_packet_t;
+typedef struct shared_data_t shared_data_t;
+
+/**
+ * Reference counter for packet data shared between clones.
+ */
+struct shared_data_t {
+
+	/**
+	 * Number of packets referencing the data
+	 */
+	refcount_t refcount;
+};
 
 /**
  * Private data of an packet_t object.
@@ -49,6 +61,11 @@ struct private_packet_t {
 	  */
 	chunk_t data;
 
+	/**
+	 * reference counter if data is shared with clones, NULL if exclusive
+	 */
+	shared_data_t *shared;
+
 	/**
 	 * actual chunk returned from get_data, adjusted when skip_bytes is called
 	 */
@@ -87,10 +104,23 @@ METHOD(packet_t, get_data, chunk_t,
 	return this->adjusted_data;
 }
 
+/**
+ * Release the (possibly shared) packet data
+ */
+static void release_data(private_packet_t *this)
+{
+	if (!this->shared || ref_put(&this->shared->refcount))
+	{
+		free(this->data.ptr);
+		free(this->shared);
+	}
+	this->shared = NULL;
+}
+
 METHOD(packet_t, set_data, void,
 	private_packet_t *this, chunk_t data)
 {
-	free(this->data.ptr);
+	release_data(this);
 	this->adjusted_data = this->data = data;
 }
 
@@ -116,31 +146,40 @@ METHOD(packet_t, destroy, void,
 {
 	DESTROY_IF(this->source);
 	DESTROY_IF(this->destination);
-	free(this->data.ptr);
+	release_data(this);
 	free(this);
 }
 
 METHOD(packet_t, clone_, packet_t*,
 	private_packet_t *this)
 {
-	packet_t *other;
+	private_packet_t *other;
 
-	other = packet_create();
+	other = (private_packet_t*)packet_create();
 	if (this->destination)
 	{
-		other->set_destination(other,
-							   this->destination->clone(this->destination));
+		other->destination = this->destination->clone(this->destination);
 	}
 	if (this->source)
 	{
-		other->set_source(other, this->source->clone(this->source));
+		other->source = this->source->clone(this->source);
 	}
 	if (this->data.ptr)
-	{
-		other->set_data(other, chunk_clone(this->adjusted_data));
+	{	/* share the data instead of copying it, the clone references it
+		 * without skipped bytes */
+		if (!this->shared)
+		{
+			INIT(this->shared,
+				.refcount = 1,
+			);
+		}
+		ref_get(&this->shared->refcount);
+		other->shared = this->shared;
+		other->data = this->data;
+		other->adjusted_data = this->adjusted_data;
 	}
-	other->set_dscp(other, this->dscp);
-	return other;
+	other->dscp = this->dscp;
+	return &other->public;
 }
 
 /**
@@ -71,6 +71,9 @@ struct packet_t {
 	/**
 	 * Set the data in the packet.
 	 *
+	 * If the current data is shared with clones of this packet, only the
+	 * reference to it is released.
+	 *
 	 * @param data		chunk with data to set (gets owned)
 	 */
 	void (*set_data)(packet_t *packet, chunk_t data);
@@ -103,6 +106,10 @@ struct packet_t {
 	/**
 	 * Clones a packet_t object.
 	 *
+	 * The packet data is not copied but shared between the clones using a
+	 * reference counter. It therefore must not be modified in-place after
+	 * cloning, use set_data() to replace it instead.
+	 *
 	 * @note Data is cloned without skipped bytes.
 	 *
 	 * @param clone		clone of the packet
@@ -33,6 +33,8 @@
 #include <sys/kern_control.h>
 #elif defined(__linux__)
 #include <linux/if_tun.h>
+#include <linux/virtio_net.h>
+#include <sys/uio.h>
 #else
 #include <net/if_tun.h>
 #endif
@@ -45,8 +47,50 @@
 
 #define TUN_DEFAULT_MTU 1500
 
+/* maximum size of a segmentation offload packet */
+#define TUN_MAX_OFFLOAD 65535
+
 typedef struct private_tun_device_t private_tun_device_t;
 
+/**
+ * A queue of a TUN device
+ */
+typedef struct {
+
+	/**
+	 * File descriptor of this queue
+	 */
+	int fd;
+
+#ifdef IFF_VNET_HDR
+	/**
+	 * Header of the offload packet in buf
+	 */
+	struct virtio_net_hdr hdr;
+
+	/**
+	 * Buffer for offload packets
+	 */
+	u_char *buf;
+
+	/**
+	 * Length of the offload packet in buf
+	 */
+	size_t len;
+
+	/**
+	 * Length of the IP and TCP headers of the offload packet
+	 */
+	size_t hlen;
+
+	/**
+	 * Offset of the next segment's payload in buf, 0 if none pending
+	 */
+	size_t offset;
+#endif /* IFF_VNET_HDR */
+
+} tun_queue_t;
+
 struct private_tun_device_t {
 
 	/**
@@ -55,10 +99,25 @@ struct private_tun_device_t {
 	tun_device_t public;
 
 	/**
-	 * The TUN device's file descriptor
+	 * The TUN device's file descriptor (that of the first queue)
 	 */
 	int tunfd;
 
+	/**
+	 * Queues of the TUN device
+	 */
+	tun_queue_t *queues;
+
+	/**
+	 * Number of queues
+	 */
+	int count;
+
+	/**
+	 * TRUE if offloads are enabled (packets are prefixed with a vnet header)
+	 */
+	bool offload;
+
 	/**
 	 * Name of the TUN device
 	 */
@@ -220,6 +279,22 @@ METHOD(tun_device_t, get_fd, int,
 	return this->tunfd;
 }
 
+METHOD(tun_device_t, get_queues, int,
+	private_tun_device_t *this)
+{
+	return this->count;
+}
+
+METHOD(tun_device_t, get_queue_fd, int,
+	private_tun_device_t *this, int queue)
+{
+	if (queue < 0 || queue >= this->count)
+	{
+		return -1;
+	}
+	return this->queues[queue].fd;
+}
+
 METHOD(tun_device_t, write_packet, bool,
 	private_tun_device_t *this, chunk_t packet)
 {
@@ -231,7 +306,27 @@ METHOD(tun_device_t, write_packet, bool,
 	u_int32_t proto = htonl(AF_INET);
 	packet = chunk_cata("cc", chunk_from_thing(proto), packet);
 #endif
-	s = write(this->tunfd, packet.ptr, packet.len);
+#ifdef IFF_VNET_HDR
+	if (this->offload)
+	{	/* no offloads for packets we write */
+		struct virtio_net_hdr hdr;
+		struct iovec iov[] = {
+			{ .iov_base = &hdr, .iov_len = sizeof(hdr), },
+			{ .iov_base = packet.ptr, .iov_len = packet.len, },
+		};
+
+		memset(&hdr, 0, sizeof(hdr));
+		s = writev(this->tunfd, iov, countof(iov));
+		if (s > 0)
+		{
+			s -= sizeof(hdr);
+		}
+	}
+	else
+#endif /* IFF_VNET_HDR */
+	{
+		s = write(this->tunfd, packet.ptr, packet.len);
+	}
 	if (s < 0)
 	{
 		DBG1(DBG_LIB, "failed to write packet to TUN device %s: %s",
@@ -245,49 +340,308 @@ METHOD(tun_device_t, write_packet, bool,
 	return TRUE;
 }
 
-METHOD(tun_device_t, read_packet, bool,
-	private_tun_device_t *this, chunk_t *packet)
+#ifdef IFF_VNET_HDR
+
+/**
+ * Add data to a one's complement sum as used for Internet checksums
+ */
+static u_int32_t checksum_add(u_int32_t sum, u_char *data, size_t len)
+{
+	while (len > 1)
+	{
+		sum += (data[0] << 8) | data[1];
+		data += 2;
+		len -= 2;
+	}
+	if (len)
+	{
+		sum += data[0] << 8;
+	}
+	return sum;
+}
+
+/**
+ * Fold a one's complement sum to a 16-bit checksum
+ */
+static u_int16_t checksum_fold(u_int32_t sum)
+{
+	while (sum >> 16)
+	{
+		sum = (sum & 0xffff) + (sum >> 16);
+	}
+	return ~sum;
+}
+
+/**
+ * Complete a partial checksum the kernel left to us
+ */
+static void complete_checksum(chunk_t packet, u_int16_t start,
+							  u_int16_t offset)
+{
+	u_int16_t sum;
+
+	if (start + offset + sizeof(sum) > packet.len)
+	{
+		return;
+	}
+	/* the checksum field contains the sum of the pseudo header */
+	sum = checksum_fold(checksum_add(0, packet.ptr + start,
+									 packet.len - start));
+	if (sum == 0 && offset == 6)
+	{	/* a zero UDP checksum means none, transmit all ones instead */
+		sum = 0xffff;
+	}
+	htoun16(packet.ptr + start + offset, sum);
+}
+
+/**
+ * Create the next segments of a TCP segmentation offload packet
+ *
+ * Each segment is copied to its own buffer, as the headers get modified per
+ * segment and callers take ownership of the (contiguous) packet data.
+ */
+static int segment(tun_queue_t *queue, chunk_t packets[], int count)
+{
+	u_char *ip, *tcp, flags = 0x01 | 0x08 /* FIN | PSH */;
+	u_int16_t mss = queue->hdr.gso_size, l4 = queue->hdr.csum_start;
+	u_int32_t sum;
+	size_t len, index;
+	int i;
+
+	for (i = 0; i < count && queue->offset < queue->len; i++)
+	{
+		len = min(mss, queue->len - queue->offset);
+		index = (queue->offset - queue->hlen) / mss;
+
+		packets[i] = chunk_alloc(queue->hlen + len);
+		memcpy(packets[i].ptr, queue->buf, queue->hlen);
+		memcpy(packets[i].ptr + queue->hlen, queue->buf + queue->offset, len);
+		ip = packets[i].ptr;
+		tcp = ip + l4;
+
+		if ((ip[0] >> 4) == 4)
+		{
+			htoun16(ip + 2, queue->hlen + len);
+			htoun16(ip + 4, untoh16(ip + 4) + index);
+			memset(ip + 10, 0, 2);
+			htoun16(ip + 10, checksum_fold(checksum_add(0, ip,
+													(ip[0] & 0x0f) * 4)));
+			sum = checksum_add(0, ip + 12, 8);
+		}
+		else
+		{
+			htoun16(ip + 4, queue->hlen + len - 40);
+			sum = checksum_add(0, ip + 8, 32);
+		}
+		htoun32(tcp + 4, untoh32(tcp + 4) + queue->offset - queue->hlen);
+		if (queue->offset + len < queue->len)
+		{
+			tcp[13] &= ~flags;
+		}
+		if (index)
+		{	/* CWR only on the first segment */
+			tcp[13] &= ~0x80;
+		}
+		memset(tcp + 16, 0, 2);
+		sum += IPPROTO_TCP + queue->hlen - l4 + len;
+		sum = checksum_add(sum, tcp, queue->hlen - l4 + len);
+		htoun16(tcp + 16, checksum_fold(sum));
+
+		queue->offset += len;
+	}
+	if (queue->offset >= queue->len)
+	{
+		queue->offset = 0;
+	}
+	return i;
+}
+
+/**
+ * Prepare splitting a TCP segmentation offload packet read to a queue
+ */
+static bool start_segmentation(tun_queue_t *queue)
+{
+	u_int16_t l4 = queue->hdr.csum_start;
+
+	switch (queue->hdr.gso_type & ~VIRTIO_NET_HDR_GSO_ECN)
+	{
+		case VIRTIO_NET_HDR_GSO_TCPV4:
+		case VIRTIO_NET_HDR_GSO_TCPV6:
+			break;
+		default:
+			DBG1(DBG_LIB, "unsupported offload type %d on TUN device",
+				 queue->hdr.gso_type);
+			return FALSE;
+	}
+	if (!queue->hdr.gso_size || l4 + 20 > queue->len)
+	{
+		DBG1(DBG_LIB, "invalid offload packet read from TUN device");
+		return FALSE;
+	}
+	queue->hlen = l4 + (queue->buf[l4 + 12] >> 4) * 4;
+	if (queue->hlen >= queue->len)
+	{
+		DBG1(DBG_LIB, "invalid offload packet read from TUN device");
+		return FALSE;
+	}
+	queue->offset = queue->hlen;
+	return TRUE;
+}
+
+#endif /* IFF_VNET_HDR */
+
+/**
+ * Wait until a queue gets readable
+ */
+static bool wait_queue(private_tun_device_t *this, tun_queue_t *queue)
 {
-	ssize_t len;
 	fd_set set;
 	bool old;
+	int ret;
 
 	FD_ZERO(&set);
-	FD_SET(this->tunfd, &set);
+	FD_SET(queue->fd, &set);
 
 	old = thread_cancelability(TRUE);
-	len = select(this->tunfd + 1, &set, NULL, NULL, NULL);
+	ret = select(queue->fd + 1, &set, NULL, NULL, NULL);
 	thread_cancelability(old);
 
-	if (len < 0)
+	if (ret < 0)
 	{
 		DBG1(DBG_LIB, "select on TUN device %s failed: %s", this->if_name,
 			 strerror(errno));
 		return FALSE;
 	}
-	/* FIXME: this is quite expensive for lots of small packets, copy from
-	 * local buffer instead? */
-	*packet = chunk_alloc(get_mtu(this));
-	len = read(this->tunfd, packet->ptr, packet->len);
+	return TRUE;
+}
+
+/**
+ * Read from a queue without blocking, returns the number of packets read
+ * (multiple segments for offload packets), 0 if none available, -1 on error
+ */
+static int read_queue(private_tun_device_t *this, tun_queue_t *queue,
+					  chunk_t packets[], int count)
+{
+	ssize_t len;
+
+#ifdef IFF_VNET_HDR
+	if (this->offload)
+	{
+		struct iovec iov[] = {
+			{ .iov_base = &queue->hdr, .iov_len = sizeof(queue->hdr), },
+			{ .iov_base = queue->buf, .iov_len = TUN_MAX_OFFLOAD, },
+		};
+
+		len = readv(queue->fd, iov, countof(iov));
+		if (len < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				return 0;
+			}
+			DBG1(DBG_LIB, "reading from TUN device %s failed: %s",
+				 this->if_name, strerror(errno));
+			return -1;
+		}
+		if (len <= sizeof(queue->hdr))
+		{
+			return 0;
+		}
+		queue->len = len - sizeof(queue->hdr);
+		if (queue->hdr.gso_type != VIRTIO_NET_HDR_GSO_NONE)
+		{
+			if (!start_segmentation(queue))
+			{
+				return 0;
+			}
+			return segment(queue, packets, count);
+		}
+		packets[0] = chunk_clone(chunk_create(queue->buf, queue->len));
+		if (queue->hdr.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM)
+		{
+			complete_checksum(packets[0], queue->hdr.csum_start,
+							  queue->hdr.csum_offset);
+		}
+		return 1;
+	}
+#endif /* IFF_VNET_HDR */
+
+	packets[0] = chunk_alloc(get_mtu(this));
+	len = read(queue->fd, packets[0].ptr, packets[0].len);
 	if (len < 0)
 	{
+		chunk_free(&packets[0]);
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+		{
+			return 0;
+		}
 		DBG1(DBG_LIB, "reading from TUN device %s failed: %s", this->if_name,
 			 strerror(errno));
-		chunk_free(packet);
-		return FALSE;
+		return -1;
 	}
-	packet->len = len;
+	packets[0].len = len;
 #ifdef __APPLE__
 	/* UTUN's prepend packets with a 32-bit protocol number */
-	packet->len -= sizeof(u_int32_t);
-	memmove(packet->ptr, packet->ptr + sizeof(u_int32_t), packet->len);
+	packets[0].len -= sizeof(u_int32_t);
+	memmove(packets[0].ptr, packets[0].ptr + sizeof(u_int32_t),
+			packets[0].len);
 #endif
-	return TRUE;
+	return 1;
+}
+
+METHOD(tun_device_t, read_packets, int,
+	private_tun_device_t *this, int queue, chunk_t packets[], int count)
+{
+	tun_queue_t *current;
+	int total = 0, ret;
+
+	if (queue < 0 || queue >= this->count)
+	{
+		return 0;
+	}
+	current = &this->queues[queue];
+
+	while (total < count)
+	{
+#ifdef IFF_VNET_HDR
+		if (current->offset)
+		{	/* return pending segments of an offload packet first */
+			total += segment(current, packets + total, count - total);
+			continue;
+		}
+#endif /* IFF_VNET_HDR */
+		ret = read_queue(this, current, packets + total, count - total);
+		if (ret < 0)
+		{
+			break;
+		}
+		if (ret == 0)
+		{
+			if (total)
+			{	/* no more packets available, return what we have */
+				break;
+			}
+			if (!wait_queue(this, current))
+			{
+				return 0;
+			}
+		}
+		total += ret;
+	}
+	return total;
+}
+
+METHOD(tun_device_t, read_packet, bool,
+	private_tun_device_t *this, chunk_t *packet)
+{
+	return read_packets(this, 0, packet, 1) == 1;
 }
 
 METHOD(tun_device_t, destroy, void,
 	private_tun_device_t *this)
 {
+	int i;
+
 	if (this->tunfd > 0)
 	{
 		close(this->tunfd);
@@ -306,14 +660,83 @@ METHOD(tun_device_t, destroy, void,
 		}
 #endif /* __FreeBSD__ */
 	}
+	for (i = 1; i < this->count; i++)
+	{
+		if (this->queues[i].fd != -1)
+		{
+			close(this->queues[i].fd);
+		}
+	}
+#ifdef IFF_VNET_HDR
+	for (i = 0; i < this->count; i++)
+	{
+		free(this->queues[i].buf);
+	}
+#endif /* IFF_VNET_HDR */
 	if (this->sock > 0)
 	{
 		close(this->sock);
 	}
 	DESTROY_IF(this->address);
+	free(this->queues);
 	free(this);
 }
 
+#ifdef IFF_TUN
+
+/**
+ * Get the flags to configure the TUN device with
+ */
+static short get_flags(private_tun_device_t *this)
+{
+	short flags = IFF_TUN | IFF_NO_PI;
+
+#ifdef IFF_MULTI_QUEUE
+	if (this->count > 1)
+	{
+		flags |= IFF_MULTI_QUEUE;
+	}
+#endif /* IFF_MULTI_QUEUE */
+#ifdef IFF_VNET_HDR
+	if (this->offload)
+	{
+		flags |= IFF_VNET_HDR;
+	}
+#endif /* IFF_VNET_HDR */
+	return flags;
+}
+
+/**
+ * Attach the additional queues to the TUN device
+ */
+static bool open_queues(private_tun_device_t *this)
+{
+	struct ifreq ifr;
+	int i;
+
+	for (i = 1; i < this->count; i++)
+	{
+		this->queues[i].fd = open("/dev/net/tun", O_RDWR);
+		if (this->queues[i].fd < 0)
+		{
+			DBG1(DBG_LIB, "failed to open /dev/net/tun: %s", strerror(errno));
+			return FALSE;
+		}
+		memset(&ifr, 0, sizeof(ifr));
+		ifr.ifr_flags = get_flags(this);
+		strncpy(ifr.ifr_name, this->if_name, IFNAMSIZ);
+		if (ioctl(this->queues[i].fd, TUNSETIFF, (void*)&ifr) < 0)
+		{
+			DBG1(DBG_LIB, "failed to attach queue %d to TUN device %s: %s", i,
+				 this->if_name, strerror(errno));
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+#endif /* IFF_TUN */
+
 /**
  * Initialize the tun device
  */
@@ -384,7 +807,7 @@ static bool init_tun(private_tun_device_t *this, const char *name_tmpl)
 	memset(&ifr, 0, sizeof(ifr));
 
 	/* TUN device, no packet info */
-	ifr.ifr_flags = IFF_TUN | IFF_NO_PI;
+	ifr.ifr_flags = get_flags(this);
 
 	strncpy(ifr.ifr_name, this->if_name, IFNAMSIZ);
 	if (ioctl(this->tunfd, TUNSETIFF, (void*)&ifr) < 0)
@@ -394,6 +817,20 @@ static bool init_tun(private_tun_device_t *this, const char *name_tmpl)
 		return FALSE;
 	}
 	strncpy(this->if_name, ifr.ifr_name, IFNAMSIZ);
+
+#ifdef IFF_VNET_HDR
+	if (this->offload &&
+		ioctl(this->tunfd, TUNSETOFFLOAD, TUN_F_CSUM | TUN_F_TSO4 | TUN_F_TSO6))
+	{	/* we still get (and have to handle) vnet headers */
+		DBG1(DBG_LIB, "failed to enable offloads on TUN device: %s",
+			 strerror(errno));
+	}
+#endif /* IFF_VNET_HDR */
+	if (!open_queues(this))
+	{
+		close(this->tunfd);
+		return FALSE;
+	}
 	return TRUE;
 
 #else /* !IFF_TUN */
@@ -428,21 +865,58 @@ static bool init_tun(private_tun_device_t *this, const char *name_tmpl)
 #endif /* !__APPLE__ */
 }
 
+/**
+ * Set O_NONBLOCK on the given file descriptor
+ */
+static bool set_nonblock(int fd)
+{
+	int flags = fcntl(fd, F_GETFL);
+	return flags != -1 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1;
+}
+
 /*
  * Described in header
  */
 tun_device_t *tun_device_create(const char *name_tmpl)
+{
+	return tun_device_create_queues(name_tmpl, 1, FALSE);
+}
+
+/*
+ * Described in header
+ */
+tun_device_t *tun_device_create_queues(const char *name_tmpl, int queues,
+									   bool offload)
 {
 	private_tun_device_t *this;
+	int i;
+
+#ifndef IFF_MULTI_QUEUE
+	if (queues > 1)
+	{
+		DBG1(DBG_LIB, "multiple TUN queues not supported, using one");
+	}
+	queues = 1;
+#endif /* IFF_MULTI_QUEUE */
+#ifndef IFF_VNET_HDR
+	if (offload)
+	{
+		DBG1(DBG_LIB, "offloads on TUN devices not supported");
+	}
+	offload = FALSE;
+#endif /* IFF_VNET_HDR */
 
 	INIT(this,
 		.public = {
 			.read_packet = _read_packet,
+			.read_packets = _read_packets,
 			.write_packet = _write_packet,
 			.get_mtu = _get_mtu,
 			.set_mtu = _set_mtu,
 			.get_name = _get_name,
 			.get_fd = _get_fd,
+			.get_queues = _get_queues,
+			.get_queue_fd = _get_queue_fd,
 			.set_address = _set_address,
 			.get_address = _get_address,
 			.up = _up,
@@ -450,14 +924,42 @@ tun_device_t *tun_device_create(const char *name_tmpl)
 		},
 		.tunfd = -1,
 		.sock = -1,
+		.count = max(queues, 1),
+		.offload = offload,
 	);
 
-	if (!init_tun(this, name_tmpl))
+	this->queues = calloc(this->count, sizeof(tun_queue_t));
+	for (i = 0; i < this->count; i++)
 	{
-		free(this);
+		this->queues[i].fd = -1;
+#ifdef IFF_VNET_HDR
+		if (this->offload)
+		{
+			this->queues[i].buf = malloc(TUN_MAX_OFFLOAD);
+		}
+#endif /* IFF_VNET_HDR */
+	}
+
+	if (!init_tun(this, name_tmpl))
+	{	/* the main file descriptor is closed if this fails */
+		this->tunfd = -1;
+		destroy(this);
 		return NULL;
 	}
-	DBG1(DBG_LIB, "created TUN device: %s", this->if_name);
+	this->queues[0].fd = this->tunfd;
+	for (i = 0; i < this->count; i++)
+	{
+		if (!set_nonblock(this->queues[i].fd))
+		{
+			DBG1(DBG_LIB, "failed to set TUN device %s non-blocking",
+				 this->if_name);
+			destroy(this);
+			return NULL;
+		}
+	}
+	DBG1(DBG_LIB, "created TUN device: %s (%d queue%s%s)", this->if_name,
+		 this->count, this->count == 1 ? "" : "s",
+		 this->offload ? ", offloads" : "");
 
 	this->sock = socket(AF_INET, SOCK_DGRAM, 0);
 	if (this->sock < 0)
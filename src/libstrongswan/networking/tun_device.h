@@ -48,6 +48,24 @@ struct tun_device_t {
 	 */
 	bool (*read_packet)(tun_device_t *this, chunk_t *packet);
 
+	/**
+	 * Read a burst of packets from a queue of the TUN device
+	 *
+	 * Blocks until a packet is available, then reads as many packets as are
+	 * available without blocking, up to count. If offloads are enabled, large
+	 * segmentation offload packets are split into segments, segments not
+	 * fitting into packets are returned by the next call.
+	 *
+	 * @note This call is a thread cancellation point.
+	 *
+	 * @param queue			queue to read from, 0 to get_queues() - 1
+	 * @param packets		array receiving the allocated packets
+	 * @param count			number of elements in packets
+	 * @return				number of packets read, 0 on failure
+	 */
+	int (*read_packets)(tun_device_t *this, int queue, chunk_t packets[],
+						int count);
+
 	/**
 	 * Write a packet to the TUN device
 	 *
@@ -109,6 +127,21 @@ struct tun_device_t {
 	 */
 	int (*get_fd)(tun_device_t *this);
 
+	/**
+	 * Get the number of queues of this TUN device.
+	 *
+	 * @return				number of queues, at least 1
+	 */
+	int (*get_queues)(tun_device_t *this);
+
+	/**
+	 * Get the file descriptor of a queue of this TUN device.
+	 *
+	 * @param queue			queue, 0 to get_queues() - 1
+	 * @return				file descriptor of the queue
+	 */
+	int (*get_queue_fd)(tun_device_t *this, int queue);
+
 	/**
 	 * Destroy a tun_device_t
 	 */
@@ -124,4 +157,23 @@ struct tun_device_t {
  */
 tun_device_t *tun_device_create(const char *name_tmpl);
 
+/**
+ * Create a TUN device with multiple queues, optionally using offloads.
+ *
+ * Each queue has its own file descriptor, the kernel distributes packets among
+ * them by flow, so that all packets of a flow are read from the same queue.
+ * If multiple queues are not supported, a single queue is created.
+ *
+ * With offloads enabled the kernel may hand over large TCP segmentation
+ * offload packets and packets with partial checksums (IFF_VNET_HDR), which
+ * read_packets() splits into segments and completes.
+ *
+ * @param name_tmpl			name template, defaults to "tun%d" if not given
+ * @param queues			number of queues to create
+ * @param offload			TRUE to enable checksum and segmentation offloads
+ * @return					TUN device
+ */
+tun_device_t *tun_device_create_queues(const char *name_tmpl, int queues,
+									   bool offload);
+
 #endif /** TUN_DEVICE_H_ @}*/
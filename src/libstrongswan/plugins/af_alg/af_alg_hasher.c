@@ -152,6 +152,8 @@ af_alg_hasher_t *af_alg_hasher_create(hash_algorithm_t algo)
 				.allocate_hash = _allocate_hash,
 				.get_hash_size = _get_hash_size,
 				.reset = _reset,
+				.clone = (void*)return_null,
+				.restore = (void*)return_false,
 				.destroy = _destroy,
 			},
 		},
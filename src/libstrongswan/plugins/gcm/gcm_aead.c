@@ -15,8 +15,6 @@
 
 #include "gcm_aead.h"
 
-#include <limits.h>
-
 #define BLOCK_SIZE 16
 #define NONCE_SIZE 12
 #define IV_SIZE 8
@@ -50,100 +48,78 @@ struct private_gcm_aead_t {
 	char salt[SALT_SIZE];
 
 	/**
-	 * GHASH subkey H
+	 * Multiples of GHASH subkey H for all 4-bit values, upper 64 bits
+	 */
+	u_int64_t hh[16];
+
+	/**
+	 * Multiples of GHASH subkey H for all 4-bit values, lower 64 bits
 	 */
-	char h[BLOCK_SIZE];
+	u_int64_t hl[16];
 };
 
 /**
- * Find a suiteable word size and network order conversion functions
+ * Reduction of the four bits shifted out of a block, times 2^48
  */
-#if ULONG_MAX == 18446744073709551615UL && defined(htobe64)
-#	define htobeword htobe64
-#	define bewordtoh be64toh
-#	define SHIFT_WORD_TYPE u_int64_t
-#else
-#	define htobeword htonl
-#	define bewordtoh ntohl
-#	define SHIFT_WORD_TYPE u_int32_t
-#endif
+static const u_int16_t last4[16] = {
+	0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0, 0x48c0, 0x54e0,
+	0xe100, 0xfd20, 0xd940, 0xc560, 0x9180, 0x8da0, 0xa9c0, 0xb5e0,
+};
 
 /**
- * Bitshift a block right by one bit
+ * Multiply the block in xh/xl by H in GF128, using 4-bit Shoup tables
  */
-static void sr_block(char *block)
+static inline void mult_h(private_gcm_aead_t *this,
+						  u_int64_t *xh, u_int64_t *xl)
 {
+	u_int64_t zh = 0, zl = 0, x;
+	u_int8_t nibble, rem;
 	int i;
-	SHIFT_WORD_TYPE *word = (SHIFT_WORD_TYPE*)block;
 
-	for (i = 0; i < BLOCK_SIZE / sizeof(*word); i++)
-	{
-		word[i] = bewordtoh(word[i]);
-	}
-	for (i = BLOCK_SIZE / sizeof(*word) - 1; i >= 0; i--)
+	/* process the nibbles from the last to the first one */
+	for (i = 0; i < BLOCK_SIZE * 2; i++)
 	{
-		word[i] >>= 1;
-		if (i != 0)
+		x = i < BLOCK_SIZE ? *xl : *xh;
+		nibble = (x >> ((i % BLOCK_SIZE) * 4)) & 0x0f;
+		if (i)
 		{
-			word[i] |= word[i - 1] << (sizeof(*word) * 8 - 1);
+			rem = zl & 0x0f;
+			zl = (zh << 60) | (zl >> 4);
+			zh = (zh >> 4) ^ ((u_int64_t)last4[rem] << 48);
 		}
+		zh ^= this->hh[nibble];
+		zl ^= this->hl[nibble];
 	}
-	for (i = 0; i < BLOCK_SIZE / sizeof(*word); i++)
-	{
-		word[i] = htobeword(word[i]);
-	}
+	*xh = zh;
+	*xl = zl;
 }
 
 /**
- * Naive implementation of block multiplication in GF128, no tables
+ * GHASH function, updates y with x, which gets padded with zeros
  */
-static void mult_block(char *x, char *y, char *res)
+static void ghash(private_gcm_aead_t *this, chunk_t x, char *y)
 {
-	char z[BLOCK_SIZE], v[BLOCK_SIZE], r;
-	int bit, byte;
+	u_int64_t yh, yl;
+	char last[BLOCK_SIZE];
 
-	r = 0xE1;
-	memset(z, 0, BLOCK_SIZE);
-	memcpy(v, y, BLOCK_SIZE);
+	yh = untoh64(y);
+	yl = untoh64(y + 8);
 
-	for (byte = 0; byte < BLOCK_SIZE; byte++)
+	while (x.len)
 	{
-		for (bit = 7; bit >= 0; bit--)
+		if (x.len < BLOCK_SIZE)
 		{
-			if (x[byte] & (1 << bit))
-			{
-				memxor(z, v, BLOCK_SIZE);
-			}
-			if (v[BLOCK_SIZE - 1] & 0x01)
-			{
-				sr_block(v);
-				v[0] ^= r;
-			}
-			else
-			{
-				sr_block(v);
-			}
+			memset(last, 0, BLOCK_SIZE);
+			memcpy(last, x.ptr, x.len);
+			x = chunk_from_thing(last);
 		}
-	}
-	memcpy(res, z, BLOCK_SIZE);
-}
-
-/**
- * GHASH function
- */
-static void ghash(private_gcm_aead_t *this, chunk_t x, char *res)
-{
-	char y[BLOCK_SIZE];
-
-	memset(y, 0, BLOCK_SIZE);
-
-	while (x.len)
-	{
-		memxor(y, x.ptr, BLOCK_SIZE);
-		mult_block(y, this->h, y);
+		yh ^= untoh64(x.ptr);
+		yl ^= untoh64(x.ptr + 8);
+		mult_h(this, &yh, &yl);
 		x = chunk_skip(x, BLOCK_SIZE);
 	}
-	memcpy(res, y, BLOCK_SIZE);
+	htoun64(y, yh);
+	htoun64(y + 8, yl);
 }
 
 /**
@@ -182,17 +158,46 @@ static void create_j(private_gcm_aead_t *this, char *iv, char *j)
 }
 
 /**
- * Create GHASH subkey H
+ * Create GHASH subkey H and precompute its multiples
  */
-static bool create_h(private_gcm_aead_t *this, char *h)
+static bool create_h(private_gcm_aead_t *this)
 {
-	char zero[BLOCK_SIZE];
+	char zero[BLOCK_SIZE], h[BLOCK_SIZE];
+	u_int64_t vh, vl;
+	int i, j;
 
 	memset(zero, 0, BLOCK_SIZE);
 	memset(h, 0, BLOCK_SIZE);
 
-	return this->crypter->encrypt(this->crypter, chunk_create(h, BLOCK_SIZE),
-								  chunk_from_thing(zero), NULL);
+	if (!this->crypter->encrypt(this->crypter, chunk_create(h, BLOCK_SIZE),
+								chunk_from_thing(zero), NULL))
+	{
+		return FALSE;
+	}
+	vh = untoh64(h);
+	vl = untoh64(h + 8);
+	memwipe(h, BLOCK_SIZE);
+
+	/* the bit order in GHASH is reversed, so H is the entry for 8 */
+	this->hh[0] = this->hl[0] = 0;
+	this->hh[8] = vh;
+	this->hl[8] = vl;
+	for (i = 4; i > 0; i >>= 1)
+	{
+		vl = (vh << 63) | (vl >> 1);
+		vh = (vh >> 1) ^ ((this->hl[i * 2] & 0x01) ? 0xe100000000000000ULL : 0);
+		this->hh[i] = vh;
+		this->hl[i] = vl;
+	}
+	for (i = 2; i <= 8; i *= 2)
+	{
+		for (j = 1; j < i; j++)
+		{
+			this->hh[i + j] = this->hh[i] ^ this->hh[j];
+			this->hl[i + j] = this->hl[i] ^ this->hl[j];
+		}
+	}
+	return TRUE;
 }
 
 /**
@@ -219,40 +224,16 @@ static bool crypt(private_gcm_aead_t *this, char *j, chunk_t in, chunk_t out)
 static bool create_icv(private_gcm_aead_t *this, chunk_t assoc, chunk_t crypt,
 					   char *j, char *icv)
 {
-	size_t assoc_pad, crypt_pad;
-	chunk_t chunk;
-	char s[BLOCK_SIZE], *pos;
-
-	assoc_pad = (BLOCK_SIZE - (assoc.len % BLOCK_SIZE)) % BLOCK_SIZE;
-	crypt_pad = (BLOCK_SIZE - (crypt.len % BLOCK_SIZE)) % BLOCK_SIZE;
-
-	/* concatenate data to a new chunk */
-	chunk = chunk_alloc(assoc.len + assoc_pad +
-						crypt.len + crypt_pad + BLOCK_SIZE);
-	pos = chunk.ptr;
-	/* add associated data */
-	memcpy(pos, assoc.ptr, assoc.len);
-	pos += assoc.len;
-	memset(pos, 0, assoc_pad);
-	pos += assoc_pad;
-	/* add encrypted data */
-	memcpy(pos, crypt.ptr, crypt.len);
-	pos += crypt.len;
-	memset(pos, 0, crypt_pad);
-	pos += crypt_pad;
-	/* write associated len */
-	memset(pos, 0, 4);
-	pos += 4;
-	htoun32(pos, assoc.len * 8);
-	pos += 4;
-	/* write encrypted length */
-	memset(pos, 0, 4);
-	pos += 4;
-	htoun32(pos, crypt.len * 8);
-	pos += 4;
-
-	ghash(this, chunk, s);
-	free(chunk.ptr);
+	char s[BLOCK_SIZE], len[BLOCK_SIZE];
+
+	/* GHASH over padded associated data, padded encrypted data and lengths */
+	memset(s, 0, BLOCK_SIZE);
+	ghash(this, assoc, s);
+	ghash(this, crypt, s);
+	htoun64(len, assoc.len * 8);
+	htoun64(len + 8, crypt.len * 8);
+	ghash(this, chunk_from_thing(len), s);
+
 	if (!gctr(this, j, chunk_from_thing(s)))
 	{
 		return FALSE;
@@ -349,13 +330,15 @@ METHOD(aead_t, set_key, bool,
 	memcpy(this->salt, key.ptr + key.len - SALT_SIZE, SALT_SIZE);
 	key.len -= SALT_SIZE;
 	return this->crypter->set_key(this->crypter, key) &&
-		   create_h(this, this->h);
+		   create_h(this);
 }
 
 METHOD(aead_t, destroy, void,
 	private_gcm_aead_t *this)
 {
 	this->crypter->destroy(this->crypter);
+	memwipe(this->hh, sizeof(this->hh));
+	memwipe(this->hl, sizeof(this->hl));
 	free(this);
 }
 
@@ -54,6 +54,16 @@ struct private_mac_t {
 	 * Previously xor'ed key using ipad.
 	 */
 	chunk_t ipaded_key;
+
+	/**
+	 * Hasher state after hashing the ipad'ed key, if supported by hasher
+	 */
+	hasher_t *inner;
+
+	/**
+	 * Hasher state after hashing the opad'ed key, if supported by hasher
+	 */
+	hasher_t *outer;
 };
 
 METHOD(mac_t, get_mac, bool,
@@ -79,6 +89,16 @@ METHOD(mac_t, get_mac, bool,
 	inner.ptr = buffer;
 	inner.len = this->h->get_hash_size(this->h);
 
+	if (this->inner)
+	{
+		/* complete inner, continue outer from its precomputed state and
+		 * restore the inner state for the next call */
+		return this->h->get_hash(this->h, data, buffer) &&
+			   this->h->restore(this->h, this->outer) &&
+			   this->h->get_hash(this->h, inner, out) &&
+			   this->h->restore(this->h, this->inner);
+	}
+
 	/* complete inner, do outer and reinit for next call */
 	return this->h->get_hash(this->h, data, buffer) &&
 		   this->h->get_hash(this->h, this->opaded_key, NULL) &&
@@ -121,6 +141,17 @@ METHOD(mac_t, set_key, bool,
 		this->opaded_key.ptr[i] = buffer[i] ^ 0x5C;
 	}
 
+	if (this->inner)
+	{
+		/* precompute the states after hashing the outer and inner pad */
+		return this->h->reset(this->h) &&
+			   this->h->get_hash(this->h, this->opaded_key, NULL) &&
+			   this->outer->restore(this->outer, this->h) &&
+			   this->h->reset(this->h) &&
+			   this->h->get_hash(this->h, this->ipaded_key, NULL) &&
+			   this->inner->restore(this->inner, this->h);
+	}
+
 	/* begin hashing of inner pad */
 	return this->h->reset(this->h) &&
 		   this->h->get_hash(this->h, this->ipaded_key, NULL);
@@ -130,6 +161,8 @@ METHOD(mac_t, destroy, void,
 	private_mac_t *this)
 {
 	this->h->destroy(this->h);
+	DESTROY_IF(this->inner);
+	DESTROY_IF(this->outer);
 	chunk_clear(&this->opaded_key);
 	chunk_clear(&this->ipaded_key);
 	free(this);
@@ -182,6 +215,16 @@ static mac_t *hmac_create(hash_algorithm_t hash_algorithm)
 	this->ipaded_key.ptr = malloc(this->b);
 	this->ipaded_key.len = this->b;
 
+	/* keep the states after hashing the pads, if the hasher supports it */
+	this->inner = this->h->clone(this->h);
+	this->outer = this->h->clone(this->h);
+	if (!this->inner || !this->outer)
+	{
+		DESTROY_IF(this->inner);
+		DESTROY_IF(this->outer);
+		this->inner = this->outer = NULL;
+	}
+
 	return &this->public;
 }
 
@@ -15,6 +15,7 @@
 
 #define _GNU_SOURCE
 #include <string.h>
+#include <ctype.h>
 #include <mysql.h>
 
 #include "mysql_database.h"
@@ -32,6 +33,16 @@
 #define MYSQL_DATA_TRUNCATED 101
 #endif
 
+/**
+ * Maximum number of rows combined to a multi-row statement in execute_batch()
+ */
+#define BATCH_ROWS 64
+
+/**
+ * Maximum number of placeholders MySQL supports in a statement
+ */
+#define MAX_PARAMS 65535
+
 typedef struct private_mysql_database_t private_mysql_database_t;
 
 /**
@@ -54,6 +65,11 @@ struct private_mysql_database_t {
 	 */
 	mutex_t *mutex;
 
+	/**
+	 * thread-specific transaction, as transaction_t
+	 */
+	thread_value_t *transaction;
+
 	/**
 	 * hostname to connect to
 	 */
@@ -93,17 +109,41 @@ struct conn_t {
 	MYSQL *mysql;
 
 	/**
-	 * connection in use?
+	 * number of users, a transaction shares it with its enumerators
 	 */
-	bool in_use;
+	u_int in_use;
 };
 
+/**
+ * database transaction
+ */
+typedef struct {
+
+	/**
+	 * connection used by this transaction
+	 */
+	conn_t *conn;
+
+	/**
+	 * number of nested transactions
+	 */
+	u_int refs;
+
+	/**
+	 * TRUE if a nested transaction was rolled back
+	 */
+	bool rollback;
+
+} transaction_t;
+
 /**
  * Release a mysql connection
  */
-static void conn_release(conn_t *conn)
+static void conn_release(private_mysql_database_t *this, conn_t *conn)
 {
-	conn->in_use = FALSE;
+	this->mutex->lock(this->mutex);
+	conn->in_use--;
+	this->mutex->unlock(this->mutex);
 }
 
 /**
@@ -162,9 +202,19 @@ static conn_t *conn_get(private_mysql_database_t *this)
 {
 	conn_t *current, *found = NULL;
 	enumerator_t *enumerator;
+	transaction_t *trans;
 
 	thread_initialize();
 
+	trans = this->transaction->get(this->transaction);
+	if (trans)
+	{	/* statements of a transaction have to use its connection */
+		this->mutex->lock(this->mutex);
+		trans->conn->in_use++;
+		this->mutex->unlock(this->mutex);
+		return trans->conn;
+	}
+
 	while (TRUE)
 	{
 		this->mutex->lock(this->mutex);
@@ -174,7 +224,7 @@ static conn_t *conn_get(private_mysql_database_t *this)
 			if (!current->in_use)
 			{
 				found = current;
-				found->in_use = TRUE;
+				found->in_use = 1;
 				break;
 			}
 		}
@@ -197,9 +247,10 @@ static conn_t *conn_get(private_mysql_database_t *this)
 	}
 	if (found == NULL)
 	{
-		found = malloc_thing(conn_t);
-		found->in_use = TRUE;
-		found->mysql = mysql_init(NULL);
+		INIT(found,
+			.in_use = 1,
+			.mysql = mysql_init(NULL),
+		);
 		if (!mysql_real_connect(found->mysql, this->host, this->username,
 								this->password, this->database, this->port,
 								NULL, 0))
@@ -223,12 +274,11 @@ static conn_t *conn_get(private_mysql_database_t *this)
 }
 
 /**
- * Create and run a MySQL stmt using a sql string and args
+ * Create and prepare a MySQL stmt using a sql string
  */
-static MYSQL_STMT* run(MYSQL *mysql, char *sql, va_list *args)
+static MYSQL_STMT* prepare(MYSQL *mysql, char *sql)
 {
 	MYSQL_STMT *stmt;
-	int params;
 
 	stmt = mysql_stmt_init(mysql);
 	if (stmt == NULL)
@@ -244,40 +294,44 @@ static MYSQL_STMT* run(MYSQL *mysql, char *sql, va_list *args)
 		mysql_stmt_close(stmt);
 		return NULL;
 	}
+	return stmt;
+}
+
+/**
+ * Bind values to all placeholders of a prepared stmt and execute it
+ */
+static bool bind_execute(MYSQL_STMT *stmt, db_value_t *values)
+{
+	MYSQL_BIND *bind;
+	int params, i;
+
 	params = mysql_stmt_param_count(stmt);
 	if (params > 0)
 	{
-		int i;
-		MYSQL_BIND *bind;
-
-		bind = alloca(sizeof(MYSQL_BIND) * params);
-		memset(bind, 0, sizeof(MYSQL_BIND) * params);
-
+		bind = calloc(params, sizeof(MYSQL_BIND));
 		for (i = 0; i < params; i++)
 		{
-			switch (va_arg(*args, db_type_t))
+			switch (values[i].type)
 			{
 				case DB_INT:
 				{
 					bind[i].buffer_type = MYSQL_TYPE_LONG;
-					bind[i].buffer = (char*)alloca(sizeof(int));
-					*(int*)bind[i].buffer = va_arg(*args, int);
+					bind[i].buffer = (char*)&values[i].value.i;
 					bind[i].buffer_length = sizeof(int);
 					break;
 				}
 				case DB_UINT:
 				{
 					bind[i].buffer_type = MYSQL_TYPE_LONG;
-					bind[i].buffer = (char*)alloca(sizeof(u_int));
-					*(u_int*)bind[i].buffer = va_arg(*args, u_int);
+					bind[i].buffer = (char*)&values[i].value.u;
 					bind[i].buffer_length = sizeof(u_int);
 					bind[i].is_unsigned = TRUE;
 					break;
 				}
 				case DB_TEXT:
 				{
-					bind[i].buffer_type = MYSQL_TYPE_STRING;;
-					bind[i].buffer = va_arg(*args, char*);
+					bind[i].buffer_type = MYSQL_TYPE_STRING;
+					bind[i].buffer = values[i].value.text;
 					if (bind[i].buffer)
 					{
 						bind[i].buffer_length = strlen(bind[i].buffer);
@@ -286,17 +340,15 @@ static MYSQL_STMT* run(MYSQL *mysql, char *sql, va_list *args)
 				}
 				case DB_BLOB:
 				{
-					chunk_t chunk = va_arg(*args, chunk_t);
 					bind[i].buffer_type = MYSQL_TYPE_BLOB;
-					bind[i].buffer = chunk.ptr;
-					bind[i].buffer_length = chunk.len;
+					bind[i].buffer = values[i].value.blob.ptr;
+					bind[i].buffer_length = values[i].value.blob.len;
 					break;
 				}
 				case DB_DOUBLE:
 				{
 					bind[i].buffer_type = MYSQL_TYPE_DOUBLE;
-					bind[i].buffer = (char*)alloca(sizeof(double));
-					*(double*)bind[i].buffer = va_arg(*args, double);
+					bind[i].buffer = (char*)&values[i].value.d;
 					bind[i].buffer_length = sizeof(double);
 					break;
 				}
@@ -307,22 +359,70 @@ static MYSQL_STMT* run(MYSQL *mysql, char *sql, va_list *args)
 				}
 				default:
 					DBG1(DBG_LIB, "invalid data type supplied");
-					mysql_stmt_close(stmt);
-					return NULL;
+					free(bind);
+					return FALSE;
 			}
 		}
 		if (mysql_stmt_bind_param(stmt, bind))
 		{
 			DBG1(DBG_LIB, "binding MySQL param failed: %s",
 				 mysql_stmt_error(stmt));
-			mysql_stmt_close(stmt);
-			return NULL;
+			free(bind);
+			return FALSE;
 		}
+		free(bind);
 	}
 	if (mysql_stmt_execute(stmt))
 	{
 		DBG1(DBG_LIB, "executing MySQL statement failed: %s",
 			 mysql_stmt_error(stmt));
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Create and run a MySQL stmt using a sql string and args
+ */
+static MYSQL_STMT* run(MYSQL *mysql, char *sql, va_list *args)
+{
+	MYSQL_STMT *stmt;
+	db_value_t *values;
+	int params, i;
+
+	stmt = prepare(mysql, sql);
+	if (stmt == NULL)
+	{
+		return NULL;
+	}
+	params = mysql_stmt_param_count(stmt);
+	values = alloca(sizeof(db_value_t) * params);
+	for (i = 0; i < params; i++)
+	{
+		values[i].type = va_arg(*args, db_type_t);
+		switch (values[i].type)
+		{
+			case DB_INT:
+				values[i].value.i = va_arg(*args, int);
+				break;
+			case DB_UINT:
+				values[i].value.u = va_arg(*args, u_int);
+				break;
+			case DB_TEXT:
+				values[i].value.text = va_arg(*args, char*);
+				break;
+			case DB_BLOB:
+				values[i].value.blob = va_arg(*args, chunk_t);
+				break;
+			case DB_DOUBLE:
+				values[i].value.d = va_arg(*args, double);
+				break;
+			default:
+				break;
+		}
+	}
+	if (!bind_execute(stmt, values))
+	{
 		mysql_stmt_close(stmt);
 		return NULL;
 	}
@@ -338,6 +438,8 @@ typedef struct {
 	MYSQL_BIND *bind;
 	/** pooled connection handle */
 	conn_t *conn;
+	/** back reference to parent */
+	private_mysql_database_t *database;
 	/** value for INT, UINT, double */
 	union {
 		void *p_void;;
@@ -373,7 +475,7 @@ static void mysql_enumerator_destroy(mysql_enumerator_t *this)
 		}
 	}
 	mysql_stmt_close(this->stmt);
-	conn_release(this->conn);
+	conn_release(this->database, this->conn);
 	free(this->bind);
 	free(this->val.p_void);
 	free(this->length);
@@ -492,6 +594,14 @@ METHOD(database_t, query, enumerator_t*,
 
 	va_start(args, sql);
 	stmt = run(conn->mysql, sql, &args);
+	if (stmt && this->transaction->get(this->transaction) &&
+		mysql_stmt_store_result(stmt))
+	{	/* buffer the result, the transaction continues on the connection */
+		DBG1(DBG_LIB, "storing MySQL result failed: %s",
+			 mysql_stmt_error(stmt));
+		mysql_stmt_close(stmt);
+		stmt = NULL;
+	}
 	if (stmt)
 	{
 		int columns, i;
@@ -501,6 +611,7 @@ METHOD(database_t, query, enumerator_t*,
 		enumerator->public.destroy = (void*)mysql_enumerator_destroy;
 		enumerator->stmt = stmt;
 		enumerator->conn = conn;
+		enumerator->database = this;
 		columns = mysql_stmt_field_count(stmt);
 		enumerator->bind = calloc(columns, sizeof(MYSQL_BIND));
 		enumerator->length = calloc(columns, sizeof(unsigned long));
@@ -557,7 +668,7 @@ METHOD(database_t, query, enumerator_t*,
 	}
 	else
 	{
-		conn_release(conn);
+		conn_release(this, conn);
 	}
 	va_end(args);
 	return (enumerator_t*)enumerator;
@@ -588,10 +699,226 @@ METHOD(database_t, execute, int,
 		mysql_stmt_close(stmt);
 	}
 	va_end(args);
-	conn_release(conn);
+	conn_release(this, conn);
 	return affected;
 }
 
+/**
+ * Find the placeholder group of an "INSERT|REPLACE ... VALUES (...)" statement
+ */
+static char *values_group(char *sql, int *len)
+{
+	char *pos, *end;
+
+	end = sql + strlen(sql);
+	while (end > sql && isspace(end[-1]))
+	{
+		end--;
+	}
+	pos = strrchr(sql, '(');
+	if (!pos || strchr(pos, ')') != end - 1 || memchr(sql, '?', pos - sql))
+	{
+		return NULL;
+	}
+	*len = end - pos;
+	while (pos > sql && isspace(pos[-1]))
+	{
+		pos--;
+	}
+	if (pos - sql < 6 || !strncaseeq(pos - 6, "VALUES", 6) ||
+		(!strncaseeq(sql, "INSERT", 6) && !strncaseeq(sql, "REPLACE", 7)))
+	{
+		return NULL;
+	}
+	return end - *len;
+}
+
+/**
+ * Prepare a statement, combining rows if a placeholder group is given
+ */
+static MYSQL_STMT* prepare_rows(MYSQL *mysql, char *sql, char *group, int len,
+								int rows)
+{
+	MYSQL_STMT *stmt;
+	char *multi, *pos;
+	int i;
+
+	if (rows == 1)
+	{
+		return prepare(mysql, sql);
+	}
+	multi = malloc((group - sql) + rows * (len + 2));
+	pos = multi + (group - sql);
+	memcpy(multi, sql, group - sql);
+	for (i = 0; i < rows; i++)
+	{
+		memcpy(pos, group, len);
+		pos += len;
+		*pos++ = ',';
+		*pos++ = ' ';
+	}
+	pos[-2] = '\0';
+	stmt = prepare(mysql, multi);
+	free(multi);
+	return stmt;
+}
+
+METHOD(database_t, execute_batch, int,
+	private_mysql_database_t *this, char *sql, int rows, db_value_t *values)
+{
+	transaction_t *trans;
+	MYSQL_STMT *stmt = NULL;
+	char *group, *pos;
+	int len, params = 0, per_row = 0, current, prepared = 0, row = 0;
+	int affected = 0;
+
+	if (!this->public.db.transaction(&this->public.db, FALSE))
+	{
+		return -1;
+	}
+	trans = this->transaction->get(this->transaction);
+	group = values_group(sql, &len);
+	for (pos = group; pos && pos < group + len; pos++)
+	{
+		params += *pos == '?';
+	}
+	while (row < rows)
+	{
+		current = 1;
+		if (group)
+		{	/* combine rows to a single statement, saving round trips */
+			current = min(rows - row, BATCH_ROWS);
+			current = max(1, min(current, MAX_PARAMS / max(params, 1)));
+		}
+		if (current != prepared)
+		{
+			if (stmt)
+			{
+				mysql_stmt_close(stmt);
+			}
+			stmt = prepare_rows(trans->conn->mysql, sql, group, len, current);
+			prepared = current;
+			if (!stmt)
+			{
+				affected = -1;
+				break;
+			}
+			per_row = mysql_stmt_param_count(stmt) / current;
+		}
+		if (!bind_execute(stmt, &values[row * per_row]))
+		{
+			affected = -1;
+			break;
+		}
+		affected += mysql_stmt_affected_rows(stmt);
+		row += current;
+	}
+	if (stmt)
+	{
+		mysql_stmt_close(stmt);
+	}
+	if (affected < 0)
+	{
+		this->public.db.rollback(&this->public.db);
+		return -1;
+	}
+	return this->public.db.commit(&this->public.db) ? affected : -1;
+}
+
+METHOD(database_t, transaction, bool,
+	private_mysql_database_t *this, bool serializable)
+{
+	transaction_t *trans;
+	conn_t *conn;
+
+	trans = this->transaction->get(this->transaction);
+	if (trans)
+	{	/* only the outermost transaction gets committed */
+		trans->refs++;
+		return TRUE;
+	}
+	conn = conn_get(this);
+	if (!conn)
+	{
+		return FALSE;
+	}
+	if (serializable &&
+		mysql_query(conn->mysql, "SET TRANSACTION ISOLATION LEVEL SERIALIZABLE"))
+	{
+		DBG1(DBG_LIB, "starting MySQL transaction failed: %s",
+			 mysql_error(conn->mysql));
+		conn_release(this, conn);
+		return FALSE;
+	}
+	if (mysql_query(conn->mysql, "START TRANSACTION"))
+	{
+		DBG1(DBG_LIB, "starting MySQL transaction failed: %s",
+			 mysql_error(conn->mysql));
+		conn_release(this, conn);
+		return FALSE;
+	}
+	INIT(trans,
+		.conn = conn,
+	);
+	this->transaction->set(this->transaction, trans);
+	return TRUE;
+}
+
+/**
+ * Commit or roll back the transaction of the calling thread
+ */
+static bool finalize_transaction(private_mysql_database_t *this,
+								 bool rollback)
+{
+	transaction_t *trans;
+	bool rolled, success;
+
+	trans = this->transaction->get(this->transaction);
+	if (!trans)
+	{
+		DBG1(DBG_LIB, "no database transaction found");
+		return FALSE;
+	}
+	if (trans->refs)
+	{
+		trans->refs--;
+		trans->rollback |= rollback;
+		return TRUE;
+	}
+	rolled = rollback || trans->rollback;
+	if (rolled)
+	{
+		success = !mysql_rollback(trans->conn->mysql);
+	}
+	else
+	{
+		success = !mysql_commit(trans->conn->mysql);
+	}
+	if (!success)
+	{
+		DBG1(DBG_LIB, "%s MySQL transaction failed: %s",
+			 rolled ? "rolling back" : "committing",
+			 mysql_error(trans->conn->mysql));
+	}
+	this->transaction->set(this->transaction, NULL);
+	conn_release(this, trans->conn);
+	free(trans);
+	/* commit() fails if a nested transaction was rolled back */
+	return success && (rollback || !rolled);
+}
+
+METHOD(database_t, commit, bool,
+	private_mysql_database_t *this)
+{
+	return finalize_transaction(this, FALSE);
+}
+
+METHOD(database_t, rollback, bool,
+	private_mysql_database_t *this)
+{
+	return finalize_transaction(this, TRUE);
+}
+
 METHOD(database_t, get_driver,db_driver_t,
 	private_mysql_database_t *this)
 {
@@ -603,6 +930,7 @@ METHOD(database_t, destroy, void,
 {
 	this->pool->destroy_function(this->pool, (void*)conn_destroy);
 	this->mutex->destroy(this->mutex);
+	this->transaction->destroy(this->transaction);
 	free(this->host);
 	free(this->username);
 	free(this->password);
@@ -676,6 +1004,10 @@ mysql_database_t *mysql_database_create(char *uri)
 			.db = {
 				.query = _query,
 				.execute = _execute,
+				.execute_batch = _execute_batch,
+				.transaction = _transaction,
+				.commit = _commit,
+				.rollback = _rollback,
 				.get_driver = _get_driver,
 				.destroy = _destroy,
 			},
@@ -689,6 +1021,7 @@ mysql_database_t *mysql_database_create(char *uri)
 	}
 	this->mutex = mutex_create(MUTEX_TYPE_DEFAULT);
 	this->pool = linked_list_create();
+	this->transaction = thread_value_create(NULL);
 
 	/* check connectivity */
 	conn = conn_get(this);
@@ -697,7 +1030,7 @@ mysql_database_t *mysql_database_create(char *uri)
 		destroy(this);
 		return NULL;
 	}
-	conn_release(conn);
+	conn_release(this, conn);
 	return &this->public;
 }
 
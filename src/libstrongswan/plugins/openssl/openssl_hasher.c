@@ -81,6 +81,31 @@ METHOD(hasher_t, allocate_hash, bool,
 	return get_hash(this, chunk, NULL);
 }
 
+METHOD(hasher_t, clone_, hasher_t*,
+	private_openssl_hasher_t *this)
+{
+	private_openssl_hasher_t *clone;
+
+	INIT(clone,
+		.public = this->public,
+		.hasher = this->hasher,
+		.ctx = EVP_MD_CTX_create(),
+	);
+	if (EVP_MD_CTX_copy_ex(clone->ctx, this->ctx) != 1)
+	{
+		EVP_MD_CTX_destroy(clone->ctx);
+		free(clone);
+		return NULL;
+	}
+	return &clone->public.hasher;
+}
+
+METHOD(hasher_t, restore, bool,
+	private_openssl_hasher_t *this, private_openssl_hasher_t *other)
+{
+	return EVP_MD_CTX_copy_ex(this->ctx, other->ctx) == 1;
+}
+
 METHOD(hasher_t, destroy, void,
 	private_openssl_hasher_t *this)
 {
@@ -109,6 +134,8 @@ openssl_hasher_t *openssl_hasher_create(hash_algorithm_t algo)
 				.allocate_hash = _allocate_hash,
 				.get_hash_size = _get_hash_size,
 				.reset = _reset,
+				.clone = _clone_,
+				.restore = (void*)_restore,
 				.destroy = _destroy,
 			},
 		},
@@ -155,6 +155,8 @@ padlock_sha1_hasher_t *padlock_sha1_hasher_create(hash_algorithm_t algo)
 				.allocate_hash = _allocate_hash,
 				.get_hash_size = _get_hash_size,
 				.reset = _reset,
+				.clone = (void*)return_null,
+				.restore = (void*)return_false,
 				.destroy = _destroy,
 			},
 		},
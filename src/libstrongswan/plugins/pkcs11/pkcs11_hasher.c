@@ -317,6 +317,8 @@ pkcs11_hasher_t *pkcs11_hasher_create(hash_algorithm_t algo)
 				.reset = _reset,
 				.get_hash = _get_hash,
 				.allocate_hash = _allocate_hash,
+				.clone = (void*)return_null,
+				.restore = (void*)return_false,
 				.destroy = _destroy,
 			},
 		},
@@ -222,6 +222,23 @@ METHOD(hasher_t, get_hash_size, size_t,
 	return HASH_SIZE_SHA1;
 }
 
+METHOD(hasher_t, clone_, hasher_t*,
+	private_sha1_hasher_t *this)
+{
+	private_sha1_hasher_t *clone;
+
+	clone = malloc_thing(private_sha1_hasher_t);
+	memcpy(clone, this, sizeof(private_sha1_hasher_t));
+	return &clone->public.hasher_interface;
+}
+
+METHOD(hasher_t, restore, bool,
+	private_sha1_hasher_t *this, private_sha1_hasher_t *other)
+{
+	memcpy(this, other, sizeof(private_sha1_hasher_t));
+	return TRUE;
+}
+
 METHOD(hasher_t, destroy, void,
 	private_sha1_hasher_t *this)
 {
@@ -247,6 +264,8 @@ sha1_hasher_t *sha1_hasher_create(hash_algorithm_t algo)
 				.allocate_hash = _allocate_hash,
 				.get_hash_size = _get_hash_size,
 				.reset = _reset,
+				.clone = _clone_,
+				.restore = (void*)_restore,
 				.destroy = _destroy,
 			},
 		},
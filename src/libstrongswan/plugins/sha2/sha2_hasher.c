@@ -612,6 +612,40 @@ METHOD(hasher_t, get_hash_size512, size_t,
 	return HASH_SIZE_SHA512;
 }
 
+METHOD(hasher_t, clone256, hasher_t*,
+	private_sha256_hasher_t *this)
+{
+	private_sha256_hasher_t *clone;
+
+	clone = malloc_thing(private_sha256_hasher_t);
+	memcpy(clone, this, sizeof(private_sha256_hasher_t));
+	return &clone->public.hasher_interface;
+}
+
+METHOD(hasher_t, restore256, bool,
+	private_sha256_hasher_t *this, private_sha256_hasher_t *other)
+{
+	memcpy(this, other, sizeof(private_sha256_hasher_t));
+	return TRUE;
+}
+
+METHOD(hasher_t, clone512, hasher_t*,
+	private_sha512_hasher_t *this)
+{
+	private_sha512_hasher_t *clone;
+
+	clone = malloc_thing(private_sha512_hasher_t);
+	memcpy(clone, this, sizeof(private_sha512_hasher_t));
+	return &clone->public.hasher_interface;
+}
+
+METHOD(hasher_t, restore512, bool,
+	private_sha512_hasher_t *this, private_sha512_hasher_t *other)
+{
+	memcpy(this, other, sizeof(private_sha512_hasher_t));
+	return TRUE;
+}
+
 METHOD(hasher_t, destroy, void,
 	sha2_hasher_t *this)
 {
@@ -636,6 +670,8 @@ sha2_hasher_t *sha2_hasher_create(hash_algorithm_t algorithm)
 						.get_hash_size = _get_hash_size224,
 						.get_hash = _get_hash224,
 						.allocate_hash = _allocate_hash224,
+						.clone = _clone256,
+						.restore = (void*)_restore256,
 						.destroy = _destroy,
 					},
 				},
@@ -654,6 +690,8 @@ sha2_hasher_t *sha2_hasher_create(hash_algorithm_t algorithm)
 					.get_hash_size = _get_hash_size256,
 					.get_hash = _get_hash256,
 					.allocate_hash = _allocate_hash256,
+					.clone = _clone256,
+					.restore = (void*)_restore256,
 					.destroy = _destroy,
 					},
 				},
@@ -672,6 +710,8 @@ sha2_hasher_t *sha2_hasher_create(hash_algorithm_t algorithm)
 					.get_hash_size = _get_hash_size384,
 					.get_hash = _get_hash384,
 					.allocate_hash = _allocate_hash384,
+					.clone = _clone512,
+					.restore = (void*)_restore512,
 					.destroy = _destroy,
 					},
 				},
@@ -690,6 +730,8 @@ sha2_hasher_t *sha2_hasher_create(hash_algorithm_t algorithm)
 					.get_hash_size = _get_hash_size512,
 					.get_hash = _get_hash512,
 					.allocate_hash = _allocate_hash512,
+					.clone = _clone512,
+					.restore = (void*)_restore512,
 					.destroy = _destroy,
 					},
 				},
@@ -0,0 +1,407 @@
+/*
+ * Copyright (C) 2013 HSR Hochschule fuer Technik Rapperswil
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#include "sha_ni_hasher.h"
+
+#include <string.h>
+#include <immintrin.h>
+
+/**
+ * Functions using the SHA extensions get compiled for the required
+ * instruction sets, they are only called if the CPU supports them.
+ */
+#define SHA_NI_TARGET __attribute__((target("sha,sse4.1")))
+
+/**
+ * SHA block size
+ */
+#define BLOCK_SIZE 64
+
+typedef struct private_sha_ni_hasher_t private_sha_ni_hasher_t;
+
+/**
+ * Function processing a number of complete blocks
+ */
+typedef void (*process_t)(u_int32_t *state, u_int8_t *data, size_t blocks);
+
+/**
+ * Private data of a sha_ni_hasher_t object.
+ */
+struct private_sha_ni_hasher_t {
+
+	/**
+	 * Public interface.
+	 */
+	sha_ni_hasher_t public;
+
+	/**
+	 * Intermediate hash value, uses 5 words for SHA1
+	 */
+	u_int32_t state[8];
+
+	/**
+	 * Data not yet processed
+	 */
+	u_int8_t buffer[BLOCK_SIZE];
+
+	/**
+	 * Number of bytes in buffer
+	 */
+	size_t buflen;
+
+	/**
+	 * Number of bytes hashed so far
+	 */
+	u_int64_t len;
+
+	/**
+	 * Block processing function
+	 */
+	process_t process;
+
+	/**
+	 * Initial hash value
+	 */
+	const u_int32_t *init;
+
+	/**
+	 * Size of the hash value
+	 */
+	size_t hash_size;
+};
+
+static const u_int32_t sha1_init[5] = {
+	0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+};
+
+static const u_int32_t sha224_init[8] = {
+	0xc1059ed8, 0x367cd507, 0x3070dd17, 0xf70e5939, 0xffc00b31, 0x68581511,
+	0x64f98fa7, 0xbefa4fa4
+};
+
+static const u_int32_t sha256_init[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c,
+	0x1f83d9ab, 0x5be0cd19
+};
+
+static const u_int32_t sha256_K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+	0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+	0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+	0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+	0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+	0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+/**
+ * Get the message words for the next four SHA1 rounds, and combine them with
+ * the state to get the E value for these rounds
+ */
+static inline SHA_NI_TARGET __m128i sha1_next(__m128i *w, int i, __m128i mask,
+											  u_int8_t *data, __m128i e,
+											  __m128i e_prev)
+{
+	if (i < 4)
+	{
+		w[i] = _mm_shuffle_epi8(_mm_loadu_si128((__m128i*)(data + i * 16)),
+								mask);
+	}
+	else
+	{	/* message schedule for words 16 to 79 */
+		w[i % 4] = _mm_sha1msg2_epu32(
+						_mm_xor_si128(
+							_mm_sha1msg1_epu32(w[i % 4], w[(i + 1) % 4]),
+							w[(i + 2) % 4]),
+						w[(i + 3) % 4]);
+	}
+	if (i == 0)
+	{
+		return _mm_add_epi32(e, w[0]);
+	}
+	return _mm_sha1nexte_epu32(e_prev, w[i % 4]);
+}
+
+/**
+ * Do five times four SHA1 rounds using round function f
+ */
+#define SHA1_ROUNDS20(f) \
+	for (j = 0; j < 5; j++, i++) \
+	{ \
+		e = sha1_next(w, i, mask, data, e, e_prev); \
+		e_prev = abcd; \
+		abcd = _mm_sha1rnds4_epu32(abcd, e, f); \
+	}
+
+/**
+ * Process blocks using SHA1
+ */
+static SHA_NI_TARGET void process_sha1(u_int32_t *state, u_int8_t *data,
+									   size_t blocks)
+{
+	const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL,
+										0x08090a0b0c0d0e0fULL);
+	__m128i abcd, abcd_save, e, e_save, e_prev, w[4];
+	int i, j;
+
+	abcd = _mm_shuffle_epi32(_mm_loadu_si128((__m128i*)state), 0x1b);
+	e_save = _mm_set_epi32(state[4], 0, 0, 0);
+	e_prev = e_save;
+
+	while (blocks--)
+	{
+		abcd_save = abcd;
+		e = e_save;
+		i = 0;
+		SHA1_ROUNDS20(0);
+		SHA1_ROUNDS20(1);
+		SHA1_ROUNDS20(2);
+		SHA1_ROUNDS20(3);
+		e_save = _mm_sha1nexte_epu32(e_prev, e_save);
+		abcd = _mm_add_epi32(abcd, abcd_save);
+		data += BLOCK_SIZE;
+	}
+
+	_mm_storeu_si128((__m128i*)state, _mm_shuffle_epi32(abcd, 0x1b));
+	state[4] = _mm_extract_epi32(e_save, 3);
+}
+
+/**
+ * Process blocks using SHA256
+ */
+static SHA_NI_TARGET void process_sha256(u_int32_t *state, u_int8_t *data,
+										 size_t blocks)
+{
+	const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+										0x0405060700010203ULL);
+	__m128i abef, cdgh, abef_save, cdgh_save, tmp, msg, w[4];
+	int i;
+
+	/* reorder the state words as required by sha256rnds2 */
+	tmp = _mm_shuffle_epi32(_mm_loadu_si128((__m128i*)&state[0]), 0xb1);
+	cdgh = _mm_shuffle_epi32(_mm_loadu_si128((__m128i*)&state[4]), 0x1b);
+	abef = _mm_alignr_epi8(tmp, cdgh, 8);
+	cdgh = _mm_blend_epi16(cdgh, tmp, 0xf0);
+
+	while (blocks--)
+	{
+		abef_save = abef;
+		cdgh_save = cdgh;
+		for (i = 0; i < 16; i++)
+		{
+			if (i < 4)
+			{
+				w[i] = _mm_shuffle_epi8(
+							_mm_loadu_si128((__m128i*)(data + i * 16)), mask);
+			}
+			else
+			{	/* message schedule for words 16 to 63 */
+				w[i % 4] = _mm_sha256msg2_epu32(
+							_mm_add_epi32(
+								_mm_sha256msg1_epu32(w[i % 4], w[(i + 1) % 4]),
+								_mm_alignr_epi8(w[(i + 3) % 4],
+												w[(i + 2) % 4], 4)),
+							w[(i + 3) % 4]);
+			}
+			msg = _mm_add_epi32(w[i % 4],
+							_mm_loadu_si128((__m128i*)&sha256_K[i * 4]));
+			cdgh = _mm_sha256rnds2_epu32(cdgh, abef, msg);
+			msg = _mm_shuffle_epi32(msg, 0x0e);
+			abef = _mm_sha256rnds2_epu32(abef, cdgh, msg);
+		}
+		abef = _mm_add_epi32(abef, abef_save);
+		cdgh = _mm_add_epi32(cdgh, cdgh_save);
+		data += BLOCK_SIZE;
+	}
+
+	tmp = _mm_shuffle_epi32(abef, 0x1b);
+	cdgh = _mm_shuffle_epi32(cdgh, 0xb1);
+	_mm_storeu_si128((__m128i*)&state[0], _mm_blend_epi16(tmp, cdgh, 0xf0));
+	_mm_storeu_si128((__m128i*)&state[4], _mm_alignr_epi8(cdgh, tmp, 8));
+}
+
+/**
+ * Append data to the hash
+ */
+static void update(private_sha_ni_hasher_t *this, chunk_t data)
+{
+	size_t len;
+
+	this->len += data.len;
+	if (this->buflen)
+	{
+		len = min(data.len, BLOCK_SIZE - this->buflen);
+		memcpy(this->buffer + this->buflen, data.ptr, len);
+		this->buflen += len;
+		data = chunk_skip(data, len);
+		if (this->buflen < BLOCK_SIZE)
+		{
+			return;
+		}
+		this->process(this->state, this->buffer, 1);
+		this->buflen = 0;
+	}
+	if (data.len >= BLOCK_SIZE)
+	{
+		this->process(this->state, data.ptr, data.len / BLOCK_SIZE);
+		data = chunk_skip(data, data.len - data.len % BLOCK_SIZE);
+	}
+	if (data.len)
+	{
+		memcpy(this->buffer, data.ptr, data.len);
+		this->buflen = data.len;
+	}
+}
+
+/**
+ * Pad the data, complete the hash and write it to out
+ */
+static void final(private_sha_ni_hasher_t *this, u_int8_t *out)
+{
+	u_int64_t bits;
+	u_int32_t word;
+	int i;
+
+	bits = this->len * 8;
+	this->buffer[this->buflen++] = 0x80;
+	if (this->buflen > BLOCK_SIZE - sizeof(bits))
+	{
+		memset(this->buffer + this->buflen, 0, BLOCK_SIZE - this->buflen);
+		this->process(this->state, this->buffer, 1);
+		this->buflen = 0;
+	}
+	memset(this->buffer + this->buflen, 0,
+		   BLOCK_SIZE - sizeof(bits) - this->buflen);
+	htoun64(this->buffer + BLOCK_SIZE - sizeof(bits), bits);
+	this->process(this->state, this->buffer, 1);
+
+	for (i = 0; i < this->hash_size / sizeof(word); i++)
+	{
+		htoun32(out + i * sizeof(word), this->state[i]);
+	}
+}
+
+METHOD(hasher_t, reset, bool,
+	private_sha_ni_hasher_t *this)
+{
+	memcpy(this->state, this->init,
+		   this->process == process_sha1 ? sizeof(sha1_init)
+										 : sizeof(sha256_init));
+	this->buflen = 0;
+	this->len = 0;
+	return TRUE;
+}
+
+METHOD(hasher_t, get_hash, bool,
+	private_sha_ni_hasher_t *this, chunk_t chunk, u_int8_t *hash)
+{
+	update(this, chunk);
+	if (hash)
+	{
+		final(this, hash);
+		reset(this);
+	}
+	return TRUE;
+}
+
+METHOD(hasher_t, allocate_hash, bool,
+	private_sha_ni_hasher_t *this, chunk_t chunk, chunk_t *hash)
+{
+	if (hash)
+	{
+		*hash = chunk_alloc(this->hash_size);
+		return get_hash(this, chunk, hash->ptr);
+	}
+	return get_hash(this, chunk, NULL);
+}
+
+METHOD(hasher_t, get_hash_size, size_t,
+	private_sha_ni_hasher_t *this)
+{
+	return this->hash_size;
+}
+
+METHOD(hasher_t, clone_, hasher_t*,
+	private_sha_ni_hasher_t *this)
+{
+	private_sha_ni_hasher_t *clone;
+
+	clone = malloc_thing(private_sha_ni_hasher_t);
+	memcpy(clone, this, sizeof(private_sha_ni_hasher_t));
+	return &clone->public.hasher;
+}
+
+METHOD(hasher_t, restore, bool,
+	private_sha_ni_hasher_t *this, private_sha_ni_hasher_t *other)
+{
+	memcpy(this, other, sizeof(private_sha_ni_hasher_t));
+	return TRUE;
+}
+
+METHOD(hasher_t, destroy, void,
+	private_sha_ni_hasher_t *this)
+{
+	free(this);
+}
+
+/*
+ * Described in header
+ */
+sha_ni_hasher_t *sha_ni_hasher_create(hash_algorithm_t algo)
+{
+	private_sha_ni_hasher_t *this;
+
+	INIT(this,
+		.public = {
+			.hasher = {
+				.get_hash = _get_hash,
+				.allocate_hash = _allocate_hash,
+				.get_hash_size = _get_hash_size,
+				.reset = _reset,
+				.clone = _clone_,
+				.restore = (void*)_restore,
+				.destroy = _destroy,
+			},
+		},
+	);
+
+	switch (algo)
+	{
+		case HASH_SHA1:
+			this->process = process_sha1;
+			this->init = sha1_init;
+			this->hash_size = HASH_SIZE_SHA1;
+			break;
+		case HASH_SHA224:
+			this->process = process_sha256;
+			this->init = sha224_init;
+			this->hash_size = HASH_SIZE_SHA224;
+			break;
+		case HASH_SHA256:
+			this->process = process_sha256;
+			this->init = sha256_init;
+			this->hash_size = HASH_SIZE_SHA256;
+			break;
+		default:
+			free(this);
+			return NULL;
+	}
+	reset(this);
+
+	return &this->public;
+}
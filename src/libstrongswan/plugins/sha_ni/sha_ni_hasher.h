@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2013 HSR Hochschule fuer Technik Rapperswil
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+/**
+ * @defgroup sha_ni_hasher sha_ni_hasher
+ * @{ @ingroup sha_ni_p
+ */
+
+#ifndef SHA_NI_HASHER_H_
+#define SHA_NI_HASHER_H_
+
+typedef struct sha_ni_hasher_t sha_ni_hasher_t;
+
+#include <crypto/hashers/hasher.h>
+
+/**
+ * Implementation of hasher_t using the SHA1/SHA256 instructions of the Intel
+ * SHA extensions.
+ */
+struct sha_ni_hasher_t {
+
+	/**
+	 * Implements hasher_t interface.
+	 */
+	hasher_t hasher;
+};
+
+/**
+ * Creates a new sha_ni_hasher_t.
+ *
+ * The caller must make sure the CPU supports the SHA extensions.
+ *
+ * @param algo		algorithm, HASH_SHA1, HASH_SHA224 or HASH_SHA256
+ * @return			sha_ni_hasher_t object, NULL if not supported
+ */
+sha_ni_hasher_t *sha_ni_hasher_create(hash_algorithm_t algo);
+
+#endif /** SHA_NI_HASHER_H_ @}*/
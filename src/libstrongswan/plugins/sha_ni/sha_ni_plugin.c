@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2013 HSR Hochschule fuer Technik Rapperswil
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#include "sha_ni_plugin.h"
+#include "sha_ni_hasher.h"
+
+#include <library.h>
+#include <utils/debug.h>
+
+typedef struct private_sha_ni_plugin_t private_sha_ni_plugin_t;
+typedef enum cpuid_feature_t cpuid_feature_t;
+
+/**
+ * private data of sha_ni_plugin
+ */
+struct private_sha_ni_plugin_t {
+
+	/**
+	 * public functions
+	 */
+	sha_ni_plugin_t public;
+};
+
+/**
+ * CPU feature flags, returned via cpuid(1) in ecx and cpuid(7) in ebx
+ */
+enum cpuid_feature_t {
+	CPUID_SSSE3 =		(1<<9),
+	CPUID_SSE41 =		(1<<19),
+	CPUID_SHA =			(1<<29),
+};
+
+/**
+ * Get cpuid for info and subleaf, return eax, ebx, ecx and edx.
+ * -fPIC requires to save ebx on IA-32.
+ */
+static void cpuid(u_int op, u_int sub, u_int *a, u_int *b, u_int *c, u_int *d)
+{
+#ifdef __x86_64__
+	asm("cpuid" : "=a" (*a), "=b" (*b), "=c" (*c), "=d" (*d)
+				: "a" (op), "c" (sub));
+#else /* __i386__ */
+	asm("pushl %%ebx;"
+		"cpuid;"
+		"movl %%ebx, %1;"
+		"popl %%ebx;"
+		: "=a" (*a), "=r" (*b), "=c" (*c), "=d" (*d) : "a" (op), "c" (sub));
+#endif /* __x86_64__ / __i386__*/
+}
+
+/**
+ * Check if we have the SHA extensions and the SSE versions used with them
+ */
+static bool have_sha_ni()
+{
+	u_int a, b, c, d;
+
+	cpuid(0, 0, &a, &b, &c, &d);
+	if (a >= 7)
+	{
+		cpuid(1, 0, &a, &b, &c, &d);
+		if ((c & CPUID_SSSE3) && (c & CPUID_SSE41))
+		{
+			cpuid(7, 0, &a, &b, &c, &d);
+			if (b & CPUID_SHA)
+			{
+				DBG1(DBG_LIB, "detected SHA extensions support");
+				return TRUE;
+			}
+		}
+	}
+	DBG1(DBG_LIB, "no SHA extensions support, disabled");
+	return FALSE;
+}
+
+METHOD(plugin_t, get_name, char*,
+	private_sha_ni_plugin_t *this)
+{
+	return "sha-ni";
+}
+
+METHOD(plugin_t, get_features, int,
+	private_sha_ni_plugin_t *this, plugin_feature_t *features[])
+{
+	static plugin_feature_t f[] = {
+		PLUGIN_REGISTER(HASHER, sha_ni_hasher_create),
+			PLUGIN_PROVIDE(HASHER, HASH_SHA1),
+			PLUGIN_PROVIDE(HASHER, HASH_SHA224),
+			PLUGIN_PROVIDE(HASHER, HASH_SHA256),
+	};
+	*features = f;
+	return countof(f);
+}
+
+METHOD(plugin_t, destroy, void,
+	private_sha_ni_plugin_t *this)
+{
+	free(this);
+}
+
+/*
+ * see header file
+ */
+plugin_t *sha_ni_plugin_create()
+{
+	private_sha_ni_plugin_t *this;
+
+	INIT(this,
+		.public = {
+			.plugin = {
+				.get_name = _get_name,
+				.reload = (void*)return_false,
+				.destroy = _destroy,
+			},
+		},
+	);
+
+	if (have_sha_ni())
+	{
+		this->public.plugin.get_features = _get_features;
+	}
+
+	return &this->public.plugin;
+}
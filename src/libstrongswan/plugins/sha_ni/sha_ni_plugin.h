@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2013 HSR Hochschule fuer Technik Rapperswil
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+/**
+ * @defgroup sha_ni_p sha_ni
+ * @ingroup plugins
+ *
+ * @defgroup sha_ni_plugin sha_ni_plugin
+ * @{ @ingroup sha_ni_p
+ */
+
+#ifndef SHA_NI_PLUGIN_H_
+#define SHA_NI_PLUGIN_H_
+
+#include <plugins/plugin.h>
+
+typedef struct sha_ni_plugin_t sha_ni_plugin_t;
+
+/**
+ * Plugin providing SHA1 and SHA224/SHA256 hashers based on the Intel SHA
+ * extensions.
+ */
+struct sha_ni_plugin_t {
+
+	/**
+	 * implements plugin interface
+	 */
+	plugin_t plugin;
+};
+
+#endif /** SHA_NI_PLUGIN_H_ @}*/
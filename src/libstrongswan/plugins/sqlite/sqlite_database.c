@@ -19,10 +19,48 @@
 #include <unistd.h>
 #include <library.h>
 #include <utils/debug.h>
+#include <threading/thread.h>
 #include <threading/mutex.h>
+#include <collections/hashtable.h>
+#include <collections/linked_list.h>
+
+#if SQLITE_VERSION_NUMBER >= 3007000
+/* write-ahead logging allows readers in parallel to a writer */
+#define HAVE_SQLITE_WAL
+#endif
 
 typedef struct private_sqlite_database_t private_sqlite_database_t;
 
+/**
+ * A prepared statement, optionally cached in a connection
+ */
+typedef struct {
+	/** SQL string the statement was prepared from, NULL if not cached */
+	char *sql;
+	/** prepared sqlite statement */
+	sqlite3_stmt *stmt;
+	/** statement currently in use by execute() or an enumerator */
+	bool in_use;
+	/** value of the connections LRU clock when last used */
+	u_int used;
+} stmt_t;
+
+/**
+ * A sqlite connection with its statement cache
+ */
+typedef struct {
+	/** sqlite database connection */
+	sqlite3 *db;
+	/** connection in use, readers only */
+	bool in_use;
+	/** cached statements, char* => stmt_t */
+	hashtable_t *cache;
+	/** LRU clock, incremented with each statement use */
+	u_int clock;
+	/** mutex protecting the cache */
+	mutex_t *mutex;
+} conn_t;
+
 /**
  * private data of sqlite_database
  */
@@ -34,90 +72,384 @@ struct private_sqlite_database_t {
 	sqlite_database_t public;
 
 	/**
-	 * sqlite database connection
+	 * read-write connection, used for execute() and as reader fallback
 	 */
-	sqlite3 *db;
+	conn_t *writer;
+
+	/**
+	 * pool of read-only connections (conn_t), NULL if WAL is not in use
+	 */
+	linked_list_t *pool;
+
+	/**
+	 * mutex to lock pool
+	 */
+	mutex_t *pool_mutex;
+
+	/**
+	 * database file, to open additional reader connections
+	 */
+	char *file;
+
+	/**
+	 * maximum number of statements cached per connection
+	 */
+	u_int cache_size;
+
+	/**
+	 * thread which has a transaction open on the writer connection
+	 */
+	thread_t *transaction;
+
+	/**
+	 * number of nested transactions started with transaction()
+	 */
+	u_int refs;
+
+	/**
+	 * a nested transaction has been rolled back
+	 */
+	bool rollback;
 
 	/**
-	 * mutex used to lock execute()
+	 * mutex used to lock execute() and queries on the writer connection
 	 */
 	mutex_t *mutex;
 };
 
 /**
- * Create and run a sqlite stmt using a sql string and args
+ * Hashtable hash function
  */
-static sqlite3_stmt* run(private_sqlite_database_t *this, char *sql,
-						 va_list *args)
+static u_int hash(char *key)
 {
-	sqlite3_stmt *stmt = NULL;
-	int params, i, res = SQLITE_OK;
+	return chunk_hash(chunk_create(key, strlen(key)));
+}
 
-#ifdef HAVE_SQLITE3_PREPARE_V2
-	if (sqlite3_prepare_v2(this->db, sql, -1, &stmt, NULL) == SQLITE_OK)
+/**
+ * Hashtable equals function
+ */
+static bool equals(char *a, char *b)
+{
+	return streq(a, b);
+}
+
+/**
+ * Busy handler implementation
+ */
+static int busy_handler(private_sqlite_database_t *this, int count)
+{
+	/* add a backoff time, quadratically increasing with every try */
+	usleep(count * count * 1000);
+	/* always retry */
+	return 1;
+}
+
+/**
+ * Destroy a statement
+ */
+static void stmt_destroy(stmt_t *stmt)
+{
+	sqlite3_finalize(stmt->stmt);
+	free(stmt->sql);
+	free(stmt);
+}
+
+/**
+ * Open a connection to the database file
+ */
+static conn_t *conn_open(private_sqlite_database_t *this, bool readonly)
+{
+	conn_t *conn;
+	int res;
+
+	INIT(conn,
+		.cache = hashtable_create((hashtable_hash_t)hash,
+								  (hashtable_equals_t)equals, 8),
+		.mutex = mutex_create(MUTEX_TYPE_DEFAULT),
+	);
+
+#if SQLITE_VERSION_NUMBER >= 3005000
+	res = sqlite3_open_v2(this->file, &conn->db, readonly ?
+						  SQLITE_OPEN_READONLY :
+						  SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL);
 #else
-	if (sqlite3_prepare(this->db, sql, -1, &stmt, NULL) == SQLITE_OK)
+	res = sqlite3_open(this->file, &conn->db);
 #endif
+	if (res != SQLITE_OK)
+	{
+		DBG1(DBG_LIB, "opening SQLite database '%s' failed: %s",
+			 this->file, sqlite3_errmsg(conn->db));
+		sqlite3_close(conn->db);
+		conn->cache->destroy(conn->cache);
+		conn->mutex->destroy(conn->mutex);
+		free(conn);
+		return NULL;
+	}
+	sqlite3_busy_handler(conn->db, (void*)busy_handler, this);
+	return conn;
+}
+
+/**
+ * Close a connection and destroy its cached statements
+ */
+static void conn_close(conn_t *conn)
+{
+	enumerator_t *enumerator;
+	stmt_t *stmt;
+
+	enumerator = conn->cache->create_enumerator(conn->cache);
+	while (enumerator->enumerate(enumerator, NULL, &stmt))
+	{
+		stmt_destroy(stmt);
+	}
+	enumerator->destroy(enumerator);
+	conn->cache->destroy(conn->cache);
+	if (sqlite3_close(conn->db) == SQLITE_BUSY)
+	{
+		DBG1(DBG_LIB, "sqlite close failed because database is busy");
+	}
+	conn->mutex->destroy(conn->mutex);
+	free(conn);
+}
+
+/**
+ * Lock and return the writer connection for a query
+ */
+static conn_t *conn_get_writer(private_sqlite_database_t *this)
+{
+	/* queries of other threads must not see the uncommitted changes of an
+	 * open transaction, execute() holds this lock until it completes */
+	this->mutex->lock(this->mutex);
+	return this->writer;
+}
+
+/**
+ * Get a connection to run a query on
+ */
+static conn_t *conn_get(private_sqlite_database_t *this)
+{
+	enumerator_t *enumerator;
+	conn_t *current, *found = NULL;
+
+	if (!this->pool || this->transaction == thread_current())
+	{	/* a transaction must see its own changes, use the writer */
+		return conn_get_writer(this);
+	}
+	this->pool_mutex->lock(this->pool_mutex);
+	enumerator = this->pool->create_enumerator(this->pool);
+	while (enumerator->enumerate(enumerator, &current))
 	{
-		params = sqlite3_bind_parameter_count(stmt);
-		for (i = 1; i <= params; i++)
+		if (!current->in_use)
 		{
-			switch (va_arg(*args, db_type_t))
-			{
-				case DB_INT:
-				{
-					res = sqlite3_bind_int(stmt, i, va_arg(*args, int));
-					break;
-				}
-				case DB_UINT:
-				{
-					res = sqlite3_bind_int64(stmt, i, va_arg(*args, u_int));
-					break;
-				}
-				case DB_TEXT:
-				{
-					const char *text = va_arg(*args, const char*);
-					res = sqlite3_bind_text(stmt, i, text, -1, SQLITE_STATIC);
-					break;
-				}
-				case DB_BLOB:
-				{
-					chunk_t c = va_arg(*args, chunk_t);
-					res = sqlite3_bind_blob(stmt, i, c.ptr, c.len, SQLITE_STATIC);
-					break;
-				}
-				case DB_DOUBLE:
-				{
-					res = sqlite3_bind_double(stmt, i, va_arg(*args, double));
-					break;
-				}
-				case DB_NULL:
-				{
-					res = sqlite3_bind_null(stmt, i);
-					break;
-				}
-				default:
-				{
-					res = SQLITE_MISUSE;
-					break;
-				}
-			}
-			if (res != SQLITE_OK)
-			{
-				break;
-			}
+			found = current;
+			found->in_use = TRUE;
+			break;
 		}
 	}
+	enumerator->destroy(enumerator);
+	this->pool_mutex->unlock(this->pool_mutex);
+	if (found)
+	{
+		return found;
+	}
+	/* we don't need a lock while opening the connection */
+	found = conn_open(this, TRUE);
+	if (!found)
+	{
+		return conn_get_writer(this);
+	}
+	found->in_use = TRUE;
+	this->pool_mutex->lock(this->pool_mutex);
+	this->pool->insert_last(this->pool, found);
+	DBG2(DBG_LIB, "increased SQLite read connection pool size to %d",
+		 this->pool->get_count(this->pool));
+	this->pool_mutex->unlock(this->pool_mutex);
+	return found;
+}
+
+/**
+ * Release a connection obtained with conn_get()
+ */
+static void conn_release(private_sqlite_database_t *this, conn_t *conn)
+{
+	if (conn != this->writer)
+	{
+		this->pool_mutex->lock(this->pool_mutex);
+		conn->in_use = FALSE;
+		this->pool_mutex->unlock(this->pool_mutex);
+	}
 	else
+	{
+		this->mutex->unlock(this->mutex);
+	}
+}
+
+/**
+ * Remove the least recently used idle statement from the cache
+ */
+static bool cache_evict(conn_t *conn)
+{
+	enumerator_t *enumerator;
+	stmt_t *current, *found = NULL;
+
+	enumerator = conn->cache->create_enumerator(conn->cache);
+	while (enumerator->enumerate(enumerator, NULL, &current))
+	{
+		if (!current->in_use && (!found || current->used < found->used))
+		{
+			found = current;
+		}
+	}
+	enumerator->destroy(enumerator);
+	if (!found)
+	{
+		return FALSE;
+	}
+	conn->cache->remove(conn->cache, found->sql);
+	stmt_destroy(found);
+	return TRUE;
+}
+
+/**
+ * Get a prepared statement for a sql string, from the cache if possible
+ */
+static stmt_t *prepare(private_sqlite_database_t *this, conn_t *conn,
+					   char *sql)
+{
+	stmt_t *stmt;
+	int res;
+
+	conn->mutex->lock(conn->mutex);
+	stmt = conn->cache->get(conn->cache, sql);
+	if (stmt && !stmt->in_use)
+	{
+		stmt->in_use = TRUE;
+		stmt->used = ++conn->clock;
+		conn->mutex->unlock(conn->mutex);
+		return stmt;
+	}
+	INIT(stmt,
+		.in_use = TRUE,
+		.used = ++conn->clock,
+	);
+#ifdef HAVE_SQLITE3_PREPARE_V2
+	res = sqlite3_prepare_v2(conn->db, sql, -1, &stmt->stmt, NULL);
+#else
+	res = sqlite3_prepare(conn->db, sql, -1, &stmt->stmt, NULL);
+#endif
+	if (res != SQLITE_OK)
 	{
 		DBG1(DBG_LIB, "preparing sqlite statement failed: %s",
-			 sqlite3_errmsg(this->db));
+			 sqlite3_errmsg(conn->db));
+		conn->mutex->unlock(conn->mutex);
+		sqlite3_finalize(stmt->stmt);
+		free(stmt);
+		return NULL;
+	}
+	/* if the cached statement is in use, the new one is used only once */
+	if (this->cache_size && !conn->cache->get(conn->cache, sql) &&
+		(conn->cache->get_count(conn->cache) < this->cache_size ||
+		 cache_evict(conn)))
+	{
+		stmt->sql = strdup(sql);
+		conn->cache->put(conn->cache, stmt->sql, stmt);
+	}
+	conn->mutex->unlock(conn->mutex);
+	return stmt;
+}
+
+/**
+ * Return a statement obtained with prepare() to the cache, or destroy it
+ */
+static void finish(conn_t *conn, stmt_t *stmt)
+{
+	if (stmt->sql)
+	{
+		/* ends an implicit read transaction and releases bound args */
+		sqlite3_reset(stmt->stmt);
+		sqlite3_clear_bindings(stmt->stmt);
+		conn->mutex->lock(conn->mutex);
+		stmt->in_use = FALSE;
+		conn->mutex->unlock(conn->mutex);
+	}
+	else
+	{
+		stmt_destroy(stmt);
+	}
+}
+
+/**
+ * Bind a value to a placeholder of a statement
+ */
+static int bind_value(sqlite3_stmt *stmt, int i, db_value_t *value)
+{
+	switch (value->type)
+	{
+		case DB_INT:
+			return sqlite3_bind_int(stmt, i, value->value.i);
+		case DB_UINT:
+			return sqlite3_bind_int64(stmt, i, value->value.u);
+		case DB_TEXT:
+			return sqlite3_bind_text(stmt, i, value->value.text, -1,
+									 SQLITE_STATIC);
+		case DB_BLOB:
+			return sqlite3_bind_blob(stmt, i, value->value.blob.ptr,
+									 value->value.blob.len, SQLITE_STATIC);
+		case DB_DOUBLE:
+			return sqlite3_bind_double(stmt, i, value->value.d);
+		case DB_NULL:
+			return sqlite3_bind_null(stmt, i);
+		default:
+			return SQLITE_MISUSE;
+	}
+}
+
+/**
+ * Prepare and bind a sqlite stmt using a sql string and args
+ */
+static stmt_t* run(private_sqlite_database_t *this, conn_t *conn, char *sql,
+				   va_list *args)
+{
+	db_value_t value;
+	stmt_t *stmt;
+	int params, i, res = SQLITE_OK;
+
+	stmt = prepare(this, conn, sql);
+	if (!stmt)
+	{
+		return NULL;
+	}
+	params = sqlite3_bind_parameter_count(stmt->stmt);
+	for (i = 1; i <= params && res == SQLITE_OK; i++)
+	{
+		value.type = va_arg(*args, db_type_t);
+		switch (value.type)
+		{
+			case DB_INT:
+				value.value.i = va_arg(*args, int);
+				break;
+			case DB_UINT:
+				value.value.u = va_arg(*args, u_int);
+				break;
+			case DB_TEXT:
+				value.value.text = va_arg(*args, char*);
+				break;
+			case DB_BLOB:
+				value.value.blob = va_arg(*args, chunk_t);
+				break;
+			case DB_DOUBLE:
+				value.value.d = va_arg(*args, double);
+				break;
+			default:
+				break;
+		}
+		res = bind_value(stmt->stmt, i, &value);
 	}
 	if (res != SQLITE_OK)
 	{
 		DBG1(DBG_LIB, "binding sqlite statement failed: %s",
-			 sqlite3_errmsg(this->db));
-		sqlite3_finalize(stmt);
+			 sqlite3_errmsg(conn->db));
+		finish(conn, stmt);
 		return NULL;
 	}
 	return stmt;
@@ -126,8 +458,10 @@ static sqlite3_stmt* run(private_sqlite_database_t *this, char *sql,
 typedef struct {
 	/** implements enumerator_t */
 	enumerator_t public;
-	/** associated sqlite statement */
-	sqlite3_stmt *stmt;
+	/** associated statement */
+	stmt_t *stmt;
+	/** connection the statement runs on */
+	conn_t *conn;
 	/** number of result columns */
 	int count;
 	/** column types */
@@ -141,10 +475,8 @@ typedef struct {
  */
 static void sqlite_enumerator_destroy(sqlite_enumerator_t *this)
 {
-	sqlite3_finalize(this->stmt);
-#if SQLITE_VERSION_NUMBER < 3005000
-	this->database->mutex->unlock(this->database->mutex);
-#endif
+	finish(this->conn, this->stmt);
+	conn_release(this->database, this->conn);
 	free(this->columns);
 	free(this);
 }
@@ -154,16 +486,17 @@ static void sqlite_enumerator_destroy(sqlite_enumerator_t *this)
  */
 static bool sqlite_enumerator_enumerate(sqlite_enumerator_t *this, ...)
 {
+	sqlite3_stmt *stmt = this->stmt->stmt;
 	int i;
 	va_list args;
 
-	switch (sqlite3_step(this->stmt))
+	switch (sqlite3_step(stmt))
 	{
 		case SQLITE_ROW:
 			break;
 		default:
 			DBG1(DBG_LIB, "stepping sqlite statement failed: %s",
-				 sqlite3_errmsg(this->database->db));
+				 sqlite3_errmsg(this->conn->db));
 			/* fall */
 		case SQLITE_DONE:
 			return FALSE;
@@ -176,32 +509,32 @@ static bool sqlite_enumerator_enumerate(sqlite_enumerator_t *this, ...)
 			case DB_INT:
 			{
 				int *value = va_arg(args, int*);
-				*value = sqlite3_column_int(this->stmt, i);
+				*value = sqlite3_column_int(stmt, i);
 				break;
 			}
 			case DB_UINT:
 			{
 				u_int *value = va_arg(args, u_int*);
-				*value = (u_int)sqlite3_column_int64(this->stmt, i);
+				*value = (u_int)sqlite3_column_int64(stmt, i);
 				break;
 			}
 			case DB_TEXT:
 			{
 				const unsigned char **value = va_arg(args, const unsigned char**);
-				*value = sqlite3_column_text(this->stmt, i);
+				*value = sqlite3_column_text(stmt, i);
 				break;
 			}
 			case DB_BLOB:
 			{
 				chunk_t *chunk = va_arg(args, chunk_t*);
-				chunk->len = sqlite3_column_bytes(this->stmt, i);
-				chunk->ptr = (u_char*)sqlite3_column_blob(this->stmt, i);
+				chunk->len = sqlite3_column_bytes(stmt, i);
+				chunk->ptr = (u_char*)sqlite3_column_blob(stmt, i);
 				break;
 			}
 			case DB_DOUBLE:
 			{
 				double *value = va_arg(args, double*);
-				*value = sqlite3_column_double(this->stmt, i);
+				*value = sqlite3_column_double(stmt, i);
 				break;
 			}
 			default:
@@ -217,25 +550,25 @@ static bool sqlite_enumerator_enumerate(sqlite_enumerator_t *this, ...)
 METHOD(database_t, query, enumerator_t*,
 	private_sqlite_database_t *this, char *sql, ...)
 {
-	sqlite3_stmt *stmt;
+	stmt_t *stmt;
+	conn_t *conn;
 	va_list args;
 	sqlite_enumerator_t *enumerator = NULL;
 	int i;
 
-#if SQLITE_VERSION_NUMBER < 3005000
-	/* sqlite connections prior to 3.5 may be used by a single thread only, */
-	this->mutex->lock(this->mutex);
-#endif
-
+	/* sqlite connections prior to 3.5 may be used by a single thread only,
+	 * but as WAL is not available with these, conn_get() locks the writer */
+	conn = conn_get(this);
 	va_start(args, sql);
-	stmt = run(this, sql, &args);
+	stmt = run(this, conn, sql, &args);
 	if (stmt)
 	{
 		enumerator = malloc_thing(sqlite_enumerator_t);
 		enumerator->public.enumerate = (void*)sqlite_enumerator_enumerate;
 		enumerator->public.destroy = (void*)sqlite_enumerator_destroy;
 		enumerator->stmt = stmt;
-		enumerator->count = sqlite3_column_count(stmt);
+		enumerator->conn = conn;
+		enumerator->count = sqlite3_column_count(stmt->stmt);
 		enumerator->columns = malloc(sizeof(db_type_t) * enumerator->count);
 		enumerator->database = this;
 		for (i = 0; i < enumerator->count; i++)
@@ -243,6 +576,10 @@ METHOD(database_t, query, enumerator_t*,
 			enumerator->columns[i] = va_arg(args, db_type_t);
 		}
 	}
+	else
+	{
+		conn_release(this, conn);
+	}
 	va_end(args);
 	return (enumerator_t*)enumerator;
 }
@@ -250,61 +587,200 @@ METHOD(database_t, query, enumerator_t*,
 METHOD(database_t, execute, int,
 	private_sqlite_database_t *this, int *rowid, char *sql, ...)
 {
-	sqlite3_stmt *stmt;
+	conn_t *conn = this->writer;
+	stmt_t *stmt;
 	int affected = -1;
 	va_list args;
 
 	/* we need a lock to get our rowid/changes correctly */
 	this->mutex->lock(this->mutex);
 	va_start(args, sql);
-	stmt = run(this, sql, &args);
+	stmt = run(this, conn, sql, &args);
 	va_end(args);
 	if (stmt)
 	{
-		if (sqlite3_step(stmt) == SQLITE_DONE)
+		if (sqlite3_step(stmt->stmt) == SQLITE_DONE)
 		{
 			if (rowid)
 			{
-				*rowid = sqlite3_last_insert_rowid(this->db);
+				*rowid = sqlite3_last_insert_rowid(conn->db);
 			}
-			affected = sqlite3_changes(this->db);
+			affected = sqlite3_changes(conn->db);
 		}
 		else
 		{
 			DBG1(DBG_LIB, "sqlite execute failed: %s",
-				 sqlite3_errmsg(this->db));
+				 sqlite3_errmsg(conn->db));
 		}
-		sqlite3_finalize(stmt);
+		finish(conn, stmt);
+	}
+	if (sqlite3_get_autocommit(conn->db))
+	{
+		if (this->transaction)
+		{	/* release the lock we hold since the transaction started */
+			this->transaction = NULL;
+			this->mutex->unlock(this->mutex);
+		}
+	}
+	else if (!this->transaction)
+	{	/* keep other writers out until the transaction completes */
+		this->transaction = thread_current();
+		this->mutex->lock(this->mutex);
 	}
 	this->mutex->unlock(this->mutex);
 	return affected;
 }
 
+METHOD(database_t, transaction, bool,
+	private_sqlite_database_t *this, bool serializable)
+{
+	if (this->transaction == thread_current())
+	{	/* only the outermost transaction gets committed */
+		this->refs++;
+		return TRUE;
+	}
+	/* execute() keeps other writers out until the transaction completes */
+	return _execute(this, NULL, serializable ? "BEGIN EXCLUSIVE TRANSACTION"
+												: "BEGIN TRANSACTION") >= 0;
+}
+
+/**
+ * Commit or roll back the transaction of the calling thread
+ */
+static bool finalize_transaction(private_sqlite_database_t *this,
+								 bool rollback)
+{
+	bool rolled, success;
+
+	if (this->transaction != thread_current())
+	{
+		DBG1(DBG_LIB, "no database transaction found");
+		return FALSE;
+	}
+	if (this->refs)
+	{
+		this->refs--;
+		this->rollback |= rollback;
+		return TRUE;
+	}
+	rolled = rollback || this->rollback;
+	this->rollback = FALSE;
+	success = _execute(this, NULL, rolled ? "ROLLBACK TRANSACTION"
+										  : "COMMIT TRANSACTION") >= 0;
+	if (!success && this->transaction == thread_current())
+	{	/* don't keep the transaction and our lock if commit failed */
+		_execute(this, NULL, "ROLLBACK TRANSACTION");
+	}
+	/* commit() fails if a nested transaction was rolled back */
+	return success && (rollback || !rolled);
+}
+
+METHOD(database_t, commit, bool,
+	private_sqlite_database_t *this)
+{
+	return finalize_transaction(this, FALSE);
+}
+
+METHOD(database_t, rollback, bool,
+	private_sqlite_database_t *this)
+{
+	return finalize_transaction(this, TRUE);
+}
+
+METHOD(database_t, execute_batch, int,
+	private_sqlite_database_t *this, char *sql, int rows, db_value_t *values)
+{
+	conn_t *conn = this->writer;
+	stmt_t *stmt;
+	int params, row, i, affected = 0, res = SQLITE_OK;
+
+	if (!_transaction(this, FALSE))
+	{
+		return -1;
+	}
+	stmt = prepare(this, conn, sql);
+	if (!stmt)
+	{
+		_rollback(this);
+		return -1;
+	}
+	params = sqlite3_bind_parameter_count(stmt->stmt);
+	for (row = 0; row < rows; row++)
+	{
+		for (i = 0; i < params && res == SQLITE_OK; i++)
+		{
+			res = bind_value(stmt->stmt, i + 1, &values[row * params + i]);
+		}
+		if (res != SQLITE_OK || sqlite3_step(stmt->stmt) != SQLITE_DONE)
+		{
+			DBG1(DBG_LIB, "sqlite batch execute failed: %s",
+				 sqlite3_errmsg(conn->db));
+			affected = -1;
+			break;
+		}
+		affected += sqlite3_changes(conn->db);
+		sqlite3_reset(stmt->stmt);
+	}
+	finish(conn, stmt);
+	if (affected < 0)
+	{
+		_rollback(this);
+		return -1;
+	}
+	return _commit(this) ? affected : -1;
+}
+
 METHOD(database_t, get_driver, db_driver_t,
 	private_sqlite_database_t *this)
 {
 	return DB_SQLITE;
 }
 
+#ifdef HAVE_SQLITE_WAL
 /**
- * Busy handler implementation
+ * Switch the database to write-ahead logging, create a reader pool if it works
  */
-static int busy_handler(private_sqlite_database_t *this, int count)
+static void enable_wal(private_sqlite_database_t *this)
 {
-	/* add a backoff time, quadratically increasing with every try */
-	usleep(count * count * 1000);
-	/* always retry */
-	return 1;
+	sqlite3_stmt *stmt;
+	const unsigned char *mode = NULL;
+
+	if (sqlite3_prepare_v2(this->writer->db, "PRAGMA journal_mode = WAL", -1,
+						   &stmt, NULL) == SQLITE_OK)
+	{
+		if (sqlite3_step(stmt) == SQLITE_ROW)
+		{
+			mode = sqlite3_column_text(stmt, 0);
+		}
+		if (mode && strcaseeq((char*)mode, "wal"))
+		{
+			this->pool = linked_list_create();
+		}
+		else
+		{	/* e.g. in-memory databases */
+			DBG1(DBG_LIB, "SQLite database '%s' does not support WAL (%s), "
+				 "using a single connection", this->file,
+				 mode ?: (const unsigned char*)sqlite3_errmsg(this->writer->db));
+		}
+		sqlite3_finalize(stmt);
+	}
 }
+#endif /* HAVE_SQLITE_WAL */
 
 METHOD(database_t, destroy, void,
 	private_sqlite_database_t *this)
 {
-	if (sqlite3_close(this->db) == SQLITE_BUSY)
+	if (this->pool)
 	{
-		DBG1(DBG_LIB, "sqlite close failed because database is busy");
+		this->pool->destroy_function(this->pool, (void*)conn_close);
+	}
+	if (this->writer)
+	{
+		conn_close(this->writer);
 	}
+	this->pool_mutex->destroy(this->pool_mutex);
 	this->mutex->destroy(this->mutex);
+	free(this->file);
 	free(this);
 }
 
@@ -313,7 +789,6 @@ METHOD(database_t, destroy, void,
  */
 sqlite_database_t *sqlite_database_create(char *uri)
 {
-	char *file;
 	private_sqlite_database_t *this;
 
 	/**
@@ -323,30 +798,44 @@ sqlite_database_t *sqlite_database_create(char *uri)
 	{
 		return NULL;
 	}
-	file = uri + 9;
 
 	INIT(this,
 		.public = {
 			.db = {
 				.query = _query,
 				.execute = _execute,
+				.execute_batch = _execute_batch,
+				.transaction = _transaction,
+				.commit = _commit,
+				.rollback = _rollback,
 				.get_driver = _get_driver,
 				.destroy = _destroy,
 			},
 		},
+		.file = strdup(uri + 9),
+#ifdef HAVE_SQLITE3_PREPARE_V2
+		/* statements prepared with the legacy API don't survive schema
+		 * changes, so we don't cache them */
+		.cache_size = lib->settings->get_int(lib->settings,
+						"libstrongswan.plugins.sqlite.statement_cache", 32),
+#endif
 		.mutex = mutex_create(MUTEX_TYPE_RECURSIVE),
+		.pool_mutex = mutex_create(MUTEX_TYPE_DEFAULT),
 	);
 
-	if (sqlite3_open(file, &this->db) != SQLITE_OK)
+	this->writer = conn_open(this, FALSE);
+	if (!this->writer)
 	{
-		DBG1(DBG_LIB, "opening SQLite database '%s' failed: %s",
-			 file, sqlite3_errmsg(this->db));
 		_destroy(this);
 		return NULL;
 	}
-
-	sqlite3_busy_handler(this->db, (void*)busy_handler, this);
+#ifdef HAVE_SQLITE_WAL
+	if (lib->settings->get_bool(lib->settings,
+								"libstrongswan.plugins.sqlite.wal", FALSE))
+	{
+		enable_wal(this);
+	}
+#endif /* HAVE_SQLITE_WAL */
 
 	return &this->public;
 }
-
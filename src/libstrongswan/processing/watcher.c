@@ -0,0 +1,623 @@
+/*
+ * Copyright (C) 2013 HSR Hochschule fuer Technik Rapperswil
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#include "watcher.h"
+
+#include <library.h>
+#include <threading/thread.h>
+#include <threading/mutex.h>
+#include <threading/condvar.h>
+#include <collections/hashtable.h>
+#include <processing/jobs/callback_job.h>
+
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+
+/**
+ * Maximum number of events fetched with a single epoll_wait()
+ */
+#define MAX_EVENTS 32
+
+typedef struct private_watcher_t private_watcher_t;
+
+/**
+ * Private data of an watcher_t object.
+ */
+struct private_watcher_t {
+
+	/**
+	 * Public watcher_t interface.
+	 */
+	watcher_t public;
+
+	/**
+	 * Registered file descriptors, int* => entry_t
+	 */
+	hashtable_t *entries;
+
+	/**
+	 * Lock for entries
+	 */
+	mutex_t *mutex;
+
+	/**
+	 * Signaled when a callback returns
+	 */
+	condvar_t *condvar;
+
+	/**
+	 * Is the watcher job queued or running?
+	 */
+	bool running;
+
+#ifdef HAVE_SYS_EPOLL_H
+	/**
+	 * epoll instance watching all registered file descriptors
+	 */
+	int epfd;
+#else
+	/**
+	 * Pipe to wake up the watcher thread if the set of fds changed
+	 */
+	int notify[2];
+#endif
+};
+
+/**
+ * A registered file descriptor
+ */
+typedef struct {
+	/** file descriptor */
+	int fd;
+	/** events to watch for */
+	watcher_event_t events;
+	/** callback to invoke */
+	watcher_cb_t cb;
+	/** user data to pass to callback */
+	void *data;
+	/** callback is currently active, fd is not watched */
+	bool active;
+	/** entry has been unregistered while the callback was active */
+	bool removed;
+	/** fd has been closed in the active callback and registered again */
+	bool orphaned;
+} entry_t;
+
+/**
+ * Data passed to a callback job
+ */
+typedef struct {
+	/** watcher instance */
+	private_watcher_t *this;
+	/** entry to invoke the callback for */
+	entry_t *entry;
+	/** events that occurred */
+	watcher_event_t events;
+	/** the callback has been invoked */
+	bool done;
+} notify_data_t;
+
+/**
+ * Hash function for entries
+ */
+static u_int hash(int *key)
+{
+	return *key;
+}
+
+/**
+ * Equals function for entries
+ */
+static bool equals(int *key, int *other_key)
+{
+	return *key == *other_key;
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+
+/**
+ * Register an entry with, or rearm it in, the epoll instance
+ */
+static void backend_arm(private_watcher_t *this, entry_t *entry, int op)
+{
+	struct epoll_event event = {
+		.events = EPOLLONESHOT,
+		.data = {
+			.fd = entry->fd,
+		},
+	};
+
+	if (entry->events & WATCHER_READ)
+	{
+		event.events |= EPOLLIN;
+	}
+	if (entry->events & WATCHER_WRITE)
+	{
+		event.events |= EPOLLOUT;
+	}
+	if (entry->events & WATCHER_EXCEPT)
+	{
+		event.events |= EPOLLPRI;
+	}
+	if (epoll_ctl(this->epfd, op, entry->fd, &event) != 0)
+	{
+		DBG1(DBG_JOB, "watching fd %d failed: %s", entry->fd, strerror(errno));
+	}
+}
+
+/**
+ * Start watching a new entry
+ */
+static void backend_add(private_watcher_t *this, entry_t *entry)
+{
+	backend_arm(this, entry, EPOLL_CTL_ADD);
+}
+
+/**
+ * Continue watching an entry after its callback returned
+ */
+static void backend_rearm(private_watcher_t *this, entry_t *entry)
+{
+	backend_arm(this, entry, EPOLL_CTL_MOD);
+}
+
+/**
+ * Stop watching an entry
+ */
+static void backend_del(private_watcher_t *this, entry_t *entry)
+{
+	struct epoll_event event = {};
+
+	epoll_ctl(this->epfd, EPOLL_CTL_DEL, entry->fd, &event);
+}
+
+#else /* !HAVE_SYS_EPOLL_H */
+
+/**
+ * Wake up the watcher thread to rebuild its set of file descriptors
+ */
+static void wakeup(private_watcher_t *this)
+{
+	char buf = 0;
+
+	ignore_result(write(this->notify[1], &buf, sizeof(buf)));
+}
+
+static void backend_add(private_watcher_t *this, entry_t *entry)
+{
+	wakeup(this);
+}
+
+static void backend_rearm(private_watcher_t *this, entry_t *entry)
+{
+	wakeup(this);
+}
+
+static void backend_del(private_watcher_t *this, entry_t *entry)
+{
+	wakeup(this);
+}
+
+#endif /* HAVE_SYS_EPOLL_H */
+
+/**
+ * Invoke the callback of an entry for all events that occurred
+ */
+static job_requeue_t notify(notify_data_t *data)
+{
+	private_watcher_t *this = data->this;
+	entry_t *entry = data->entry;
+	watcher_event_t event;
+	bool keep = TRUE;
+
+	for (event = WATCHER_READ; event <= WATCHER_EXCEPT; event <<= 1)
+	{
+		if ((data->events & event) &&
+			!entry->cb(entry->data, entry->fd, event))
+		{
+			keep = FALSE;
+			break;
+		}
+	}
+
+	this->mutex->lock(this->mutex);
+	data->done = TRUE;
+	entry->active = FALSE;
+	if (entry->removed)
+	{	/* remove() waits for us and frees the entry */
+		this->condvar->broadcast(this->condvar);
+	}
+	else if (entry->orphaned)
+	{	/* replaced by a new registration of the same fd */
+		free(entry);
+	}
+	else if (keep)
+	{
+		backend_rearm(this, entry);
+	}
+	else
+	{
+		this->entries->remove(this->entries, &entry->fd);
+		backend_del(this, entry);
+		free(entry);
+	}
+	this->mutex->unlock(this->mutex);
+	return JOB_REQUEUE_NONE;
+}
+
+/**
+ * Cleanup a callback job, release the entry if it never got invoked
+ */
+static void notify_cleanup(notify_data_t *data)
+{
+	private_watcher_t *this = data->this;
+
+	if (!data->done)
+	{
+		this->mutex->lock(this->mutex);
+		data->entry->active = FALSE;
+		if (data->entry->orphaned)
+		{
+			free(data->entry);
+		}
+		else
+		{
+			this->condvar->broadcast(this->condvar);
+		}
+		this->mutex->unlock(this->mutex);
+	}
+	free(data);
+}
+
+/**
+ * Queue a callback job for the entry registered for fd, mutex must be held
+ */
+static void dispatch(private_watcher_t *this, int fd, watcher_event_t events,
+					 bool error)
+{
+	notify_data_t *data;
+	entry_t *entry;
+
+	entry = this->entries->get(this->entries, &fd);
+	if (!entry || entry->active)
+	{
+		return;
+	}
+	if (error)
+	{	/* let the callback see the error/hangup when reading/writing */
+		events |= entry->events;
+	}
+	events &= entry->events;
+	if (!events)
+	{
+		backend_rearm(this, entry);
+		return;
+	}
+	entry->active = TRUE;
+
+	INIT(data,
+		.this = this,
+		.entry = entry,
+		.events = events,
+	);
+	lib->processor->queue_job(lib->processor,
+		(job_t*)callback_job_create_with_prio((callback_job_cb_t)notify, data,
+					(callback_job_cleanup_t)notify_cleanup,
+					(callback_job_cancel_t)return_false, JOB_PRIO_CRITICAL));
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+
+/**
+ * Wait for events on the registered file descriptors
+ */
+static job_requeue_t watch(private_watcher_t *this)
+{
+	struct epoll_event events[MAX_EVENTS];
+	watcher_event_t occurred;
+	bool oldstate;
+	int count, i;
+
+	oldstate = thread_cancelability(TRUE);
+	count = epoll_wait(this->epfd, events, countof(events), -1);
+	thread_cancelability(oldstate);
+
+	if (count < 0)
+	{
+		if (errno != EINTR)
+		{
+			DBG1(DBG_JOB, "waiting for fd events failed: %s", strerror(errno));
+			sleep(1);
+		}
+		return JOB_REQUEUE_DIRECT;
+	}
+
+	this->mutex->lock(this->mutex);
+	for (i = 0; i < count; i++)
+	{
+		occurred = 0;
+		if (events[i].events & EPOLLIN)
+		{
+			occurred |= WATCHER_READ;
+		}
+		if (events[i].events & EPOLLOUT)
+		{
+			occurred |= WATCHER_WRITE;
+		}
+		if (events[i].events & EPOLLPRI)
+		{
+			occurred |= WATCHER_EXCEPT;
+		}
+		dispatch(this, events[i].data.fd, occurred,
+				 events[i].events & (EPOLLERR | EPOLLHUP));
+	}
+	this->mutex->unlock(this->mutex);
+	return JOB_REQUEUE_DIRECT;
+}
+
+#else /* !HAVE_SYS_EPOLL_H */
+
+/**
+ * Wait for events on the registered file descriptors
+ */
+static job_requeue_t watch(private_watcher_t *this)
+{
+	enumerator_t *enumerator;
+	struct pollfd *pfd;
+	watcher_event_t occurred;
+	entry_t *entry;
+	bool oldstate;
+	char buf[32];
+	int count = 1, res, i;
+
+	this->mutex->lock(this->mutex);
+	pfd = calloc(this->entries->get_count(this->entries) + 1, sizeof(*pfd));
+	pfd[0].fd = this->notify[0];
+	pfd[0].events = POLLIN;
+	enumerator = this->entries->create_enumerator(this->entries);
+	while (enumerator->enumerate(enumerator, NULL, &entry))
+	{
+		if (entry->active)
+		{
+			continue;
+		}
+		pfd[count].fd = entry->fd;
+		if (entry->events & WATCHER_READ)
+		{
+			pfd[count].events |= POLLIN;
+		}
+		if (entry->events & WATCHER_WRITE)
+		{
+			pfd[count].events |= POLLOUT;
+		}
+		if (entry->events & WATCHER_EXCEPT)
+		{
+			pfd[count].events |= POLLPRI;
+		}
+		count++;
+	}
+	enumerator->destroy(enumerator);
+	this->mutex->unlock(this->mutex);
+
+	thread_cleanup_push(free, pfd);
+	oldstate = thread_cancelability(TRUE);
+	res = poll(pfd, count, -1);
+	thread_cancelability(oldstate);
+	thread_cleanup_pop(FALSE);
+
+	if (res < 0)
+	{
+		if (errno != EINTR)
+		{
+			DBG1(DBG_JOB, "waiting for fd events failed: %s", strerror(errno));
+			sleep(1);
+		}
+		free(pfd);
+		return JOB_REQUEUE_DIRECT;
+	}
+	if (pfd[0].revents & POLLIN)
+	{
+		while (read(this->notify[0], buf, sizeof(buf)) > 0)
+		{
+			/* drain pending notifications */
+		}
+	}
+
+	this->mutex->lock(this->mutex);
+	for (i = 1; i < count; i++)
+	{
+		if (!pfd[i].revents)
+		{
+			continue;
+		}
+		occurred = 0;
+		if (pfd[i].revents & POLLIN)
+		{
+			occurred |= WATCHER_READ;
+		}
+		if (pfd[i].revents & POLLOUT)
+		{
+			occurred |= WATCHER_WRITE;
+		}
+		if (pfd[i].revents & POLLPRI)
+		{
+			occurred |= WATCHER_EXCEPT;
+		}
+		dispatch(this, pfd[i].fd, occurred,
+				 pfd[i].revents & (POLLERR | POLLHUP | POLLNVAL));
+	}
+	this->mutex->unlock(this->mutex);
+	free(pfd);
+	return JOB_REQUEUE_DIRECT;
+}
+
+#endif /* HAVE_SYS_EPOLL_H */
+
+/**
+ * Cleanup function for the watcher job
+ */
+static void watch_cleanup(private_watcher_t *this)
+{
+	this->mutex->lock(this->mutex);
+	this->running = FALSE;
+	this->mutex->unlock(this->mutex);
+}
+
+/**
+ * Queue the watcher job if it is not running, mutex must be held
+ */
+static void start_watching(private_watcher_t *this)
+{
+	if (!this->running)
+	{
+		this->running = TRUE;
+		lib->processor->queue_job(lib->processor,
+			(job_t*)callback_job_create_with_prio((callback_job_cb_t)watch,
+					this, (callback_job_cleanup_t)watch_cleanup,
+					(callback_job_cancel_t)return_false, JOB_PRIO_CRITICAL));
+	}
+}
+
+METHOD(watcher_t, add, void,
+	private_watcher_t *this, int fd, watcher_event_t events,
+	watcher_cb_t cb, void *data)
+{
+	entry_t *entry, *old;
+
+	INIT(entry,
+		.fd = fd,
+		.events = events,
+		.cb = cb,
+		.data = data,
+	);
+
+	this->mutex->lock(this->mutex);
+	old = this->entries->put(this->entries, &entry->fd, entry);
+	if (old && !old->active)
+	{
+		DBG1(DBG_JOB, "fd %d registered twice with watcher", fd);
+		this->entries->put(this->entries, &old->fd, old);
+		free(entry);
+	}
+	else
+	{
+		if (old)
+		{	/* the fd got closed by an active callback and has been reused */
+			old->orphaned = TRUE;
+		}
+		backend_add(this, entry);
+		start_watching(this);
+	}
+	this->mutex->unlock(this->mutex);
+}
+
+METHOD(watcher_t, remove_, void,
+	private_watcher_t *this, int fd)
+{
+	entry_t *entry;
+
+	this->mutex->lock(this->mutex);
+	entry = this->entries->remove(this->entries, &fd);
+	if (entry)
+	{
+		backend_del(this, entry);
+		entry->removed = TRUE;
+		while (entry->active)
+		{
+			this->condvar->wait(this->condvar, this->mutex);
+		}
+		free(entry);
+	}
+	this->mutex->unlock(this->mutex);
+}
+
+METHOD(watcher_t, destroy, void,
+	private_watcher_t *this)
+{
+	enumerator_t *enumerator;
+	entry_t *entry;
+
+	enumerator = this->entries->create_enumerator(this->entries);
+	while (enumerator->enumerate(enumerator, NULL, &entry))
+	{
+		free(entry);
+	}
+	enumerator->destroy(enumerator);
+	this->entries->destroy(this->entries);
+#ifdef HAVE_SYS_EPOLL_H
+	if (this->epfd >= 0)
+	{
+		close(this->epfd);
+	}
+#else
+	close(this->notify[0]);
+	close(this->notify[1]);
+#endif
+	this->condvar->destroy(this->condvar);
+	this->mutex->destroy(this->mutex);
+	free(this);
+}
+
+/*
+ * Described in header.
+ */
+watcher_t *watcher_create()
+{
+	private_watcher_t *this;
+
+	INIT(this,
+		.public = {
+			.add = _add,
+			.remove = _remove_,
+			.destroy = _destroy,
+		},
+		.entries = hashtable_create((hashtable_hash_t)hash,
+									(hashtable_equals_t)equals, 32),
+		.mutex = mutex_create(MUTEX_TYPE_DEFAULT),
+		.condvar = condvar_create(CONDVAR_TYPE_DEFAULT),
+	);
+
+#ifdef HAVE_SYS_EPOLL_H
+	this->epfd = epoll_create(MAX_EVENTS);
+	if (this->epfd < 0)
+	{
+		DBG1(DBG_JOB, "creating epoll instance failed: %s", strerror(errno));
+	}
+	else
+	{
+		fcntl(this->epfd, F_SETFD, FD_CLOEXEC);
+	}
+#else
+	if (pipe(this->notify) != 0)
+	{
+		DBG1(DBG_JOB, "creating watcher notify pipe failed: %s",
+			 strerror(errno));
+		this->notify[0] = this->notify[1] = -1;
+	}
+	else
+	{
+		fcntl(this->notify[0], F_SETFL, O_NONBLOCK);
+		fcntl(this->notify[1], F_SETFL, O_NONBLOCK);
+		fcntl(this->notify[0], F_SETFD, FD_CLOEXEC);
+		fcntl(this->notify[1], F_SETFD, FD_CLOEXEC);
+	}
+#endif
+	return &this->public;
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2013 HSR Hochschule fuer Technik Rapperswil
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+/**
+ * @defgroup watcher watcher
+ * @{ @ingroup processing
+ */
+
+#ifndef WATCHER_H_
+#define WATCHER_H_
+
+typedef struct watcher_t watcher_t;
+typedef enum watcher_event_t watcher_event_t;
+
+#include <library.h>
+
+/**
+ * Events to watch for on a file descriptor.
+ */
+enum watcher_event_t {
+	/** file descriptor is readable, or the peer closed the connection */
+	WATCHER_READ = (1<<0),
+	/** file descriptor is writable */
+	WATCHER_WRITE = (1<<1),
+	/** exceptional condition, e.g. out-of-band data */
+	WATCHER_EXCEPT = (1<<2),
+};
+
+/**
+ * Callback function invoked for file descriptor events.
+ *
+ * The callback is executed asynchronously as a job in the thread pool.
+ * Watching the file descriptor is suspended until the callback returns, so
+ * there is never more than one callback active for the same file descriptor.
+ * Long running operations should therefore read the data and return quickly,
+ * handing the processing over to a separate job.
+ *
+ * The callback may close fd, but only if it returns FALSE.
+ *
+ * @param data			user data passed during registration
+ * @param fd			file descriptor the event occurred on
+ * @param event			event that occurred, a single watcher_event_t flag
+ * @return				TRUE to keep watching fd, FALSE to unregister it
+ */
+typedef bool (*watcher_cb_t)(void *data, int fd, watcher_event_t event);
+
+/**
+ * Event loop watching file descriptors for a set of plugins and services.
+ *
+ * Instead of running a blocking select() loop in a dedicated thread for each
+ * listening or connected socket, users register file descriptors with the
+ * watcher. A single thread waits for events on all registered file
+ * descriptors (using epoll(7) where available, poll(2) otherwise) and
+ * dispatches the registered callbacks to the processor.
+ */
+struct watcher_t {
+
+	/**
+	 * Start watching a file descriptor for events.
+	 *
+	 * The file descriptor must not be closed before it has been unregistered,
+	 * either by calling remove() or by returning FALSE from the callback.
+	 *
+	 * @param fd			file descriptor to watch
+	 * @param events		ORed set of events to watch for
+	 * @param cb			callback function to invoke on events
+	 * @param data			data to pass to cb
+	 */
+	void (*add)(watcher_t *this, int fd, watcher_event_t events,
+				watcher_cb_t cb, void *data);
+
+	/**
+	 * Stop watching a file descriptor.
+	 *
+	 * If the callback for this file descriptor is currently active, the call
+	 * blocks until it returns. It therefore must not be called from within
+	 * the callback itself, return FALSE from the callback instead.
+	 *
+	 * @param fd			file descriptor to stop watching
+	 */
+	void (*remove)(watcher_t *this, int fd);
+
+	/**
+	 * Destroy a watcher_t.
+	 */
+	void (*destroy)(watcher_t *this);
+};
+
+/**
+ * Create a watcher instance.
+ *
+ * @return			watcher
+ */
+watcher_t *watcher_create();
+
+#endif /** WATCHER_H_ @}*/
@@ -25,6 +25,7 @@
 #include <collections/linked_list.h>
 #include <utils/identification.h>
 #include <utils/debug.h>
+#include <utils/slab.h>
 
 #define NON_SUBNET_ADDRESS_RANGE	255
 
@@ -589,7 +590,7 @@ METHOD(traffic_selector_t, is_contained_in, bool,
 		{
 			contained_in = TRUE;
 		}
-		free(subset);
+		slab_free(subset, sizeof(*subset));
 	}
 	return contained_in;
 }
@@ -690,7 +691,7 @@ METHOD(traffic_selector_t, clone_, traffic_selector_t*,
 METHOD(traffic_selector_t, destroy, void,
 	private_traffic_selector_t *this)
 {
-	free(this);
+	slab_free(this, sizeof(*this));
 }
 
 /*
@@ -709,7 +710,7 @@ traffic_selector_t *traffic_selector_create_from_bytes(u_int8_t protocol,
 		case TS_IPV4_ADDR_RANGE:
 			if (from.len != 4 || to.len != 4)
 			{
-				free(this);
+				slab_free(this, sizeof(*this));
 				return NULL;
 			}
 			memcpy(this->from4, from.ptr, from.len);
@@ -718,14 +719,14 @@ traffic_selector_t *traffic_selector_create_from_bytes(u_int8_t protocol,
 		case TS_IPV6_ADDR_RANGE:
 			if (from.len != 16 || to.len != 16)
 			{
-				free(this);
+				slab_free(this, sizeof(*this));
 				return NULL;
 			}
 			memcpy(this->from6, from.ptr, from.len);
 			memcpy(this->to6, to.ptr, to.len);
 			break;
 		default:
-			free(this);
+			slab_free(this, sizeof(*this));
 			return NULL;
 	}
 	calc_netbits(this);
@@ -750,7 +751,7 @@ traffic_selector_t *traffic_selector_create_from_rfc3779_format(ts_type_t type,
 			len = 16;
 			break;
 		default:
-			free(this);
+			slab_free(this, sizeof(*this));
 			return NULL;
 	}
 	memset(this->from, 0x00, len);
@@ -794,7 +795,7 @@ traffic_selector_t *traffic_selector_create_from_subnet(host_t *net,
 			break;
 		default:
 			net->destroy(net);
-			free(this);
+			slab_free(this, sizeof(*this));
 			return NULL;
 	}
 	from = net->get_address(net);
@@ -834,7 +835,7 @@ traffic_selector_t *traffic_selector_create_from_string(
 	if (inet_pton(family, from_addr, this->from) != 1 ||
 		inet_pton(family, to_addr, this->to) != 1)
 	{
-		free(this);
+		slab_free(this, sizeof(*this));
 		return NULL;
 	}
 
@@ -886,7 +887,7 @@ static private_traffic_selector_t *traffic_selector_create(u_int8_t protocol,
 {
 	private_traffic_selector_t *this;
 
-	INIT(this,
+	INIT_SLAB(this,
 		.public = {
 			.get_subset = _get_subset,
 			.equals = _equals,
@@ -0,0 +1,317 @@
+/*
+ * Copyright (C) 2013 HSR Hochschule fuer Technik Rapperswil
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#include "test_suite.h"
+
+#include <crypto/dh_pool.h>
+
+#include <unistd.h>
+
+/**
+ * Number of key pairs kept in the pool
+ */
+#define POOL_SIZE 3
+
+/**
+ * Pool under test
+ */
+static dh_pool_t *pool;
+
+/**
+ * Number of existing fake DH objects
+ */
+static refcount_t alive;
+
+/**
+ * Number of fake DH objects created
+ */
+static refcount_t created;
+
+METHOD(diffie_hellman_t, fake_get_dh_group, diffie_hellman_group_t,
+	diffie_hellman_t *this)
+{
+	return MODP_NULL;
+}
+
+METHOD(diffie_hellman_t, fake_destroy, void,
+	diffie_hellman_t *this)
+{
+	ignore_result(ref_put(&alive));
+	free(this);
+}
+
+/**
+ * Create a fake DH object, counting existing instances
+ */
+static diffie_hellman_t *fake_create(diffie_hellman_group_t group)
+{
+	diffie_hellman_t *this;
+
+	INIT(this,
+		.get_dh_group = _fake_get_dh_group,
+		.destroy = _fake_destroy,
+	);
+	ref_get(&alive);
+	ref_get(&created);
+	return this;
+}
+
+/**
+ * Get the statistics of the pool for a group, FALSE if it has no entry
+ */
+static bool get_stats(diffie_hellman_group_t group, u_int *hits,
+					  u_int *misses, u_int *available)
+{
+	enumerator_t *enumerator;
+	diffie_hellman_group_t current;
+	bool found = FALSE;
+
+	enumerator = pool->create_stats_enumerator(pool);
+	while (enumerator->enumerate(enumerator, &current, hits, misses,
+								 available))
+	{
+		if (current == group)
+		{
+			found = TRUE;
+			break;
+		}
+	}
+	enumerator->destroy(enumerator);
+	return found;
+}
+
+/**
+ * Wait until the background jobs filled the pool for a group
+ */
+static bool wait_for_refill(diffie_hellman_group_t group)
+{
+	u_int hits, misses, available;
+	int i;
+
+	for (i = 0; i < 200; i++)
+	{
+		if (get_stats(group, &hits, &misses, &available) &&
+			available == POOL_SIZE)
+		{
+			return TRUE;
+		}
+		usleep(10000);
+	}
+	return FALSE;
+}
+
+/**
+ * Assert the statistics of the pool for a group
+ */
+static void assert_stats(diffie_hellman_group_t group, u_int hits,
+						 u_int misses, u_int available)
+{
+	u_int h, m, a;
+
+	ck_assert(get_stats(group, &h, &m, &a));
+	ck_assert_int_eq(h, hits);
+	ck_assert_int_eq(m, misses);
+	ck_assert_int_eq(a, available);
+}
+
+/**
+ * Fill the pool for MODP_NULL, with a miss for the initial request
+ */
+static void fill()
+{
+	diffie_hellman_t *dh;
+
+	dh = pool->get(pool, MODP_NULL);
+	ck_assert(dh);
+	dh->destroy(dh);
+	ck_assert(wait_for_refill(MODP_NULL));
+}
+
+START_SETUP(setup_pool)
+{
+	alive = created = 0;
+	lib->crypto->add_dh(lib->crypto, MODP_NULL, "test",
+						(dh_constructor_t)fake_create);
+	lib->settings->set_int(lib->settings, "libstrongswan.dh_pool.size",
+						   POOL_SIZE);
+	lib->processor->set_threads(lib->processor, 2);
+	pool = dh_pool_create();
+}
+END_SETUP
+
+START_TEARDOWN(teardown_pool)
+{
+	/* stop refill jobs before the pool goes away */
+	lib->processor->cancel(lib->processor);
+	pool->destroy(pool);
+	lib->crypto->remove_dh(lib->crypto, (dh_constructor_t)fake_create);
+	lib->settings->set_int(lib->settings, "libstrongswan.dh_pool.size", 0);
+	ck_assert_int_eq(alive, 0);
+}
+END_TEARDOWN
+
+START_TEST(test_disabled)
+{
+	diffie_hellman_t *dh;
+	u_int hits, misses, available;
+
+	pool->destroy(pool);
+	lib->settings->set_int(lib->settings, "libstrongswan.dh_pool.size", 0);
+	pool = dh_pool_create();
+
+	dh = pool->get(pool, MODP_NULL);
+	ck_assert(dh);
+	ck_assert_int_eq(dh->get_dh_group(dh), MODP_NULL);
+	dh->destroy(dh);
+
+	/* nothing gets tracked or precomputed */
+	usleep(50000);
+	ck_assert(!get_stats(MODP_NULL, &hits, &misses, &available));
+	ck_assert_int_eq(created, 1);
+}
+END_TEST
+
+START_TEST(test_miss)
+{
+	fill();
+	/* the first key pair is created inline, the pool gets filled after */
+	assert_stats(MODP_NULL, 0, 1, POOL_SIZE);
+	ck_assert_int_eq(created, POOL_SIZE + 1);
+	ck_assert_int_eq(alive, POOL_SIZE);
+}
+END_TEST
+
+START_TEST(test_hit)
+{
+	diffie_hellman_t *dh[POOL_SIZE];
+	int i, j;
+
+	fill();
+	for (i = 0; i < POOL_SIZE; i++)
+	{
+		dh[i] = pool->get(pool, MODP_NULL);
+		ck_assert(dh[i]);
+		ck_assert_int_eq(dh[i]->get_dh_group(dh[i]), MODP_NULL);
+		/* each key pair is handed out once */
+		for (j = 0; j < i; j++)
+		{
+			ck_assert(dh[i] != dh[j]);
+		}
+	}
+	ck_assert(wait_for_refill(MODP_NULL));
+	assert_stats(MODP_NULL, POOL_SIZE, 1, POOL_SIZE);
+	for (i = 0; i < POOL_SIZE; i++)
+	{
+		dh[i]->destroy(dh[i]);
+	}
+}
+END_TEST
+
+START_TEST(test_refill)
+{
+	diffie_hellman_t *dh;
+	int i;
+
+	fill();
+	for (i = 0; i < POOL_SIZE; i++)
+	{
+		dh = pool->get(pool, MODP_NULL);
+		ck_assert(dh);
+		dh->destroy(dh);
+	}
+	/* all handed out key pairs got replaced, but not more */
+	ck_assert(wait_for_refill(MODP_NULL));
+	usleep(50000);
+	assert_stats(MODP_NULL, POOL_SIZE, 1, POOL_SIZE);
+	ck_assert_int_eq(created, 2 * POOL_SIZE + 1);
+	ck_assert_int_eq(alive, POOL_SIZE);
+}
+END_TEST
+
+START_TEST(test_unsupported)
+{
+	lib->crypto->remove_dh(lib->crypto, (dh_constructor_t)fake_create);
+
+	ck_assert(pool->get(pool, MODP_NULL) == NULL);
+	/* the refill job disables the pool for the group */
+	usleep(50000);
+	ck_assert(pool->get(pool, MODP_NULL) == NULL);
+	assert_stats(MODP_NULL, 0, 1, 0);
+}
+END_TEST
+
+START_TEST(test_flush)
+{
+	fill();
+	pool->flush(pool);
+	assert_stats(MODP_NULL, 0, 1, 0);
+	ck_assert_int_eq(alive, 0);
+}
+END_TEST
+
+START_TEST(test_destroy_outstanding)
+{
+	diffie_hellman_t *dh[2];
+
+	fill();
+	dh[0] = pool->get(pool, MODP_NULL);
+	dh[1] = pool->get(pool, MODP_NULL);
+	ck_assert(wait_for_refill(MODP_NULL));
+	lib->processor->cancel(lib->processor);
+
+	/* pooled key pairs get destroyed, handed out ones stay valid */
+	pool->destroy(pool);
+	ck_assert_int_eq(alive, 2);
+	ck_assert_int_eq(dh[0]->get_dh_group(dh[0]), MODP_NULL);
+	ck_assert_int_eq(dh[1]->get_dh_group(dh[1]), MODP_NULL);
+	dh[0]->destroy(dh[0]);
+	dh[1]->destroy(dh[1]);
+	ck_assert_int_eq(alive, 0);
+
+	pool = dh_pool_create();
+}
+END_TEST
+
+Suite *dh_pool_suite_create()
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("dh_pool");
+
+	tc = tcase_create("disabled");
+	tcase_add_checked_fixture(tc, setup_pool, teardown_pool);
+	tcase_add_test(tc, test_disabled);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("accounting");
+	tcase_add_checked_fixture(tc, setup_pool, teardown_pool);
+	tcase_add_test(tc, test_miss);
+	tcase_add_test(tc, test_hit);
+	tcase_add_test(tc, test_unsupported);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("refill");
+	tcase_add_checked_fixture(tc, setup_pool, teardown_pool);
+	tcase_add_test(tc, test_refill);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("cleanup");
+	tcase_add_checked_fixture(tc, setup_pool, teardown_pool);
+	tcase_add_test(tc, test_flush);
+	tcase_add_test(tc, test_destroy_outstanding);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
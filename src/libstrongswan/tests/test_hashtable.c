@@ -16,6 +16,8 @@
 #include "test_suite.h"
 
 #include <collections/hashtable.h>
+#include <collections/concurrent_hashtable.h>
+#include <threading/thread.h>
 #include <utils/chunk.h>
 
 /*******************************************************************************
@@ -309,6 +311,197 @@ START_TEST(test_remove_at_one_bucket)
 }
 END_TEST
 
+/*******************************************************************************
+ * concurrent hash table
+ */
+
+static concurrent_hashtable_t *cht;
+
+START_SETUP(setup_cht)
+{
+	cht = concurrent_hashtable_create((hashtable_hash_t)hash,
+									  (hashtable_equals_t)equals, 0, 4);
+	ck_assert_int_eq(cht->get_count(cht), 0);
+}
+END_SETUP
+
+START_TEARDOWN(teardown_cht)
+{
+	cht->destroy(cht);
+}
+END_TEARDOWN
+
+START_TEST(test_concurrent_put_get)
+{
+	char *k1 = "key1", *k2 = "key2", *k3 = "key3";
+	char *v1 = "val1", *v2 = "val2", *v3 = "val3", *value;
+
+	value = cht->put(cht, k1, v1);
+	ck_assert_int_eq(cht->get_count(cht), 1);
+	ck_assert(streq(cht->get(cht, k1), v1));
+	ck_assert(cht->get(cht, k2) == NULL);
+	ck_assert(value == NULL);
+
+	cht->put(cht, k2, v2);
+	cht->put(cht, k3, v3);
+	ck_assert_int_eq(cht->get_count(cht), 3);
+	ck_assert(streq(cht->get(cht, k1), v1));
+	ck_assert(streq(cht->get(cht, k2), v2));
+	ck_assert(streq(cht->get(cht, k3), v3));
+
+	value = cht->put(cht, k2, v1);
+	ck_assert_int_eq(cht->get_count(cht), 3);
+	ck_assert(streq(value, v2));
+	ck_assert(streq(cht->get(cht, k2), v1));
+
+	value = cht->put_if_absent(cht, k2, v2);
+	ck_assert(streq(value, v1));
+	ck_assert(streq(cht->get(cht, k2), v1));
+	value = cht->put_if_absent(cht, "key4", v2);
+	ck_assert(value == NULL);
+	ck_assert(streq(cht->get(cht, "key4"), v2));
+	ck_assert_int_eq(cht->get_count(cht), 4);
+}
+END_TEST
+
+START_TEST(test_concurrent_get_match)
+{
+	char *k1 = "key1_a", *k2 = "key2", *k3 = "key1_b", *k4 = "key1_c";
+	char *v1 = "val1", *v2 = "val2", *v3 = "val3", *value;
+
+	cht = concurrent_hashtable_create((hashtable_hash_t)hash_match,
+									  (hashtable_equals_t)equals, 0, 0);
+
+	cht->put(cht, k1, v1);
+	cht->put(cht, k2, v2);
+	cht->put(cht, k3, v3);
+	ck_assert_int_eq(cht->get_count(cht), 3);
+	ck_assert(streq(cht->get(cht, k3), v3));
+
+	value = cht->get_match(cht, k2, (hashtable_equals_t)equal_match);
+	ck_assert(streq(value, v2));
+	value = cht->get_match(cht, k4, (hashtable_equals_t)equal_match);
+	ck_assert(streq(value, v1));
+	value = cht->get_match(cht, "key3", (hashtable_equals_t)equal_match);
+	ck_assert(value == NULL);
+
+	cht->destroy(cht);
+}
+END_TEST
+
+/**
+ * Number of items added to a concurrent hash table in a test
+ */
+#define CONCURRENT_ITEMS 2048
+
+/**
+ * Keys for concurrent hash table tests
+ */
+static char concurrent_keys[CONCURRENT_ITEMS][16];
+
+/**
+ * Fill the table, remove every other item and check the remaining
+ */
+static void do_concurrent_remove(int first, int count)
+{
+	int i;
+
+	for (i = first; i < first + count; i++)
+	{
+		ck_assert(cht->put(cht, concurrent_keys[i], concurrent_keys[i]) == NULL);
+	}
+	for (i = first; i < first + count; i += 2)
+	{
+		ck_assert(cht->remove(cht, concurrent_keys[i]) == concurrent_keys[i]);
+		ck_assert(cht->remove(cht, concurrent_keys[i]) == NULL);
+	}
+	for (i = first; i < first + count; i++)
+	{
+		if (i % 2)
+		{
+			ck_assert(cht->get(cht, concurrent_keys[i]) == concurrent_keys[i]);
+		}
+		else
+		{
+			ck_assert(cht->get(cht, concurrent_keys[i]) == NULL);
+		}
+	}
+}
+
+START_SETUP(setup_concurrent_keys)
+{
+	int i;
+
+	for (i = 0; i < CONCURRENT_ITEMS; i++)
+	{
+		snprintf(concurrent_keys[i], sizeof(concurrent_keys[i]), "key%d", i);
+	}
+	cht = concurrent_hashtable_create((hashtable_hash_t)hash,
+									  (hashtable_equals_t)equals, 0, 4);
+}
+END_SETUP
+
+START_TEST(test_concurrent_remove)
+{
+	enumerator_t *enumerator;
+	char *key, *value;
+	int count = 0;
+
+	/* grows the segments repeatedly and shifts clusters on removal */
+	do_concurrent_remove(0, CONCURRENT_ITEMS);
+	ck_assert_int_eq(cht->get_count(cht), CONCURRENT_ITEMS / 2);
+
+	enumerator = cht->create_enumerator(cht);
+	while (enumerator->enumerate(enumerator, &key, &value))
+	{
+		ck_assert(key == value);
+		ck_assert(cht->get(cht, key) == value);
+		count++;
+	}
+	enumerator->destroy(enumerator);
+	ck_assert_int_eq(count, CONCURRENT_ITEMS / 2);
+}
+END_TEST
+
+START_TEST(test_concurrent_remove_one_segment)
+{
+	cht->destroy(cht);
+	cht = concurrent_hashtable_create((hashtable_hash_t)hash,
+									  (hashtable_equals_t)equals, 0, 1);
+	do_concurrent_remove(0, CONCURRENT_ITEMS);
+	ck_assert_int_eq(cht->get_count(cht), CONCURRENT_ITEMS / 2);
+}
+END_TEST
+
+/**
+ * Number of threads concurrently modifying the table
+ */
+#define CONCURRENT_THREADS 8
+
+static void *concurrent_run(intptr_t first)
+{
+	do_concurrent_remove(first, CONCURRENT_ITEMS / CONCURRENT_THREADS);
+	return NULL;
+}
+
+START_TEST(test_concurrent_threads)
+{
+	thread_t *threads[CONCURRENT_THREADS];
+	int i;
+
+	for (i = 0; i < CONCURRENT_THREADS; i++)
+	{
+		threads[i] = thread_create((void*)concurrent_run, (void*)(intptr_t)
+								(i * CONCURRENT_ITEMS / CONCURRENT_THREADS));
+	}
+	for (i = 0; i < CONCURRENT_THREADS; i++)
+	{
+		threads[i]->join(threads[i]);
+	}
+	ck_assert_int_eq(cht->get_count(cht), CONCURRENT_ITEMS / 2);
+}
+END_TEST
+
 Suite *hashtable_suite_create()
 {
 	Suite *s;
@@ -342,5 +535,21 @@ Suite *hashtable_suite_create()
 	tcase_add_test(tc, test_remove_at_one_bucket);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("concurrent put/get");
+	tcase_add_checked_fixture(tc, setup_cht, teardown_cht);
+	tcase_add_test(tc, test_concurrent_put_get);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("concurrent get_match");
+	tcase_add_test(tc, test_concurrent_get_match);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("concurrent remove");
+	tcase_add_checked_fixture(tc, setup_concurrent_keys, teardown_cht);
+	tcase_add_test(tc, test_concurrent_remove);
+	tcase_add_test(tc, test_concurrent_remove_one_segment);
+	tcase_add_test(tc, test_concurrent_threads);
+	suite_add_tcase(s, tc);
+
 	return s;
 }
@@ -80,8 +80,10 @@ int main()
 	srunner_add_suite(sr, hashtable_suite_create());
 	srunner_add_suite(sr, identification_suite_create());
 	srunner_add_suite(sr, threading_suite_create());
+	srunner_add_suite(sr, watcher_suite_create());
 	srunner_add_suite(sr, utils_suite_create());
 	srunner_add_suite(sr, vectors_suite_create());
+	srunner_add_suite(sr, dh_pool_suite_create());
 	if (lib->plugins->has_feature(lib->plugins,
 								  PLUGIN_DEPENDS(PRIVKEY_GEN, KEY_RSA)))
 	{
@@ -28,8 +28,10 @@ Suite *linked_list_enumerator_suite_create();
 Suite *hashtable_suite_create();
 Suite *identification_suite_create();
 Suite *threading_suite_create();
+Suite *watcher_suite_create();
 Suite *utils_suite_create();
 Suite *vectors_suite_create();
+Suite *dh_pool_suite_create();
 Suite *ecdsa_suite_create();
 Suite *rsa_suite_create();
 
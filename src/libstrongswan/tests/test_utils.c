@@ -243,6 +243,33 @@ START_TEST(test_memxor_aligned)
 }
 END_TEST
 
+/*******************************************************************************
+ * malloc_align/free_align
+ */
+
+START_TEST(test_malloc_align)
+{
+	void *ptr;
+	int size, align;
+
+	for (size = 0; size < 128; size++)
+	{
+		for (align = 0; align < 256; align++)
+		{
+			ptr = malloc_align(size, align);
+			ck_assert(ptr);
+			if (align)
+			{
+				ck_assert((uintptr_t)ptr % align == 0);
+			}
+			memset(ptr, 0xEF, size);
+			free_align(ptr);
+		}
+	}
+	free_align(NULL);
+}
+END_TEST
+
 /*******************************************************************************
  * memstr
  */
@@ -421,6 +448,10 @@ Suite *utils_suite_create()
 	tcase_add_test(tc, test_memxor_aligned);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("malloc_align");
+	tcase_add_test(tc, test_malloc_align);
+	suite_add_tcase(s, tc);
+
 	tc = tcase_create("memstr");
 	tcase_add_loop_test(tc, test_memstr, 0, countof(memstr_data));
 	suite_add_tcase(s, tc);
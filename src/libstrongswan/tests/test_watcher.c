@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2013 HSR Hochschule fuer Technik Rapperswil
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#include "test_suite.h"
+
+#include <processing/watcher.h>
+#include <threading/mutex.h>
+#include <threading/condvar.h>
+
+#include <unistd.h>
+#include <sys/socket.h>
+
+static mutex_t *mutex;
+static condvar_t *condvar;
+
+static int events;
+
+/**
+ * Wait until the callbacks have been invoked the given number of times
+ */
+static bool wait_for_events(int count)
+{
+	bool timed_out = FALSE;
+
+	mutex->lock(mutex);
+	while (events < count && !timed_out)
+	{
+		timed_out = condvar->timed_wait(condvar, mutex, 2000);
+	}
+	mutex->unlock(mutex);
+	return !timed_out;
+}
+
+/**
+ * Read a single byte, unregister after the third
+ */
+static bool read_cb(void *data, int fd, watcher_event_t event)
+{
+	char buf;
+	bool keep;
+
+	ck_assert(event == WATCHER_READ);
+	ck_assert(data == &events);
+	ck_assert_int_eq(read(fd, &buf, 1), 1);
+
+	mutex->lock(mutex);
+	keep = ++events < 3;
+	condvar->signal(condvar);
+	mutex->unlock(mutex);
+	return keep;
+}
+
+START_SETUP(setup_watcher)
+{
+	mutex = mutex_create(MUTEX_TYPE_DEFAULT);
+	condvar = condvar_create(CONDVAR_TYPE_DEFAULT);
+	events = 0;
+	lib->processor->set_threads(lib->processor, 4);
+}
+END_SETUP
+
+START_TEARDOWN(teardown_watcher)
+{
+	lib->processor->cancel(lib->processor);
+	condvar->destroy(condvar);
+	mutex->destroy(mutex);
+}
+END_TEARDOWN
+
+START_TEST(test_read)
+{
+	int fd[2];
+
+	ck_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fd) == 0);
+
+	lib->watcher->add(lib->watcher, fd[0], WATCHER_READ, read_cb, &events);
+	ck_assert_int_eq(write(fd[1], "abcd", 4), 4);
+	ck_assert(wait_for_events(3));
+
+	/* the callback unregistered itself, the last byte is not consumed */
+	usleep(50000);
+	ck_assert_int_eq(events, 3);
+
+	close(fd[0]);
+	close(fd[1]);
+}
+END_TEST
+
+START_TEST(test_remove)
+{
+	int fd[2];
+
+	ck_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fd) == 0);
+
+	lib->watcher->add(lib->watcher, fd[0], WATCHER_READ, read_cb, &events);
+	ck_assert_int_eq(write(fd[1], "a", 1), 1);
+	ck_assert(wait_for_events(1));
+
+	lib->watcher->remove(lib->watcher, fd[0]);
+	ck_assert_int_eq(write(fd[1], "b", 1), 1);
+	usleep(50000);
+	ck_assert_int_eq(events, 1);
+
+	close(fd[0]);
+	close(fd[1]);
+}
+END_TEST
+
+/**
+ * Count writable events on one of several fds
+ */
+static bool write_cb(void *data, int fd, watcher_event_t event)
+{
+	ck_assert(event == WATCHER_WRITE);
+
+	mutex->lock(mutex);
+	events++;
+	condvar->signal(condvar);
+	mutex->unlock(mutex);
+	return FALSE;
+}
+
+START_TEST(test_multiple)
+{
+	int fd[8][2], i;
+
+	for (i = 0; i < countof(fd); i++)
+	{
+		ck_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fd[i]) == 0);
+		lib->watcher->add(lib->watcher, fd[i][0], WATCHER_WRITE, write_cb, NULL);
+	}
+	ck_assert(wait_for_events(countof(fd)));
+	for (i = 0; i < countof(fd); i++)
+	{
+		close(fd[i][0]);
+		close(fd[i][1]);
+	}
+}
+END_TEST
+
+Suite *watcher_suite_create()
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("watcher");
+
+	tc = tcase_create("read");
+	tcase_add_checked_fixture(tc, setup_watcher, teardown_watcher);
+	tcase_add_test(tc, test_read);
+	tcase_add_test(tc, test_remove);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("multiple");
+	tcase_add_checked_fixture(tc, setup_watcher, teardown_watcher);
+	tcase_add_test(tc, test_multiple);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
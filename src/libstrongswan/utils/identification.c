@@ -27,6 +27,7 @@
 #include <asn1/oid.h>
 #include <asn1/asn1.h>
 #include <crypto/hashers/hasher.h>
+#include <utils/slab.h>
 
 ENUM_BEGIN(id_match_names, ID_MATCH_NONE, ID_MATCH_MAX_WILDCARDS,
 	"MATCH_NONE",
@@ -852,7 +853,9 @@ int identification_printf_hook(printf_hook_data_t *data,
 METHOD(identification_t, clone_, identification_t*,
 	private_identification_t *this)
 {
-	private_identification_t *clone = malloc_thing(private_identification_t);
+	private_identification_t *clone;
+
+	clone = slab_alloc(sizeof(private_identification_t));
 
 	memcpy(clone, this, sizeof(private_identification_t));
 	if (this->encoded.len)
@@ -866,7 +869,7 @@ METHOD(identification_t, destroy, void,
 	private_identification_t *this)
 {
 	chunk_free(&this->encoded);
-	free(this);
+	slab_free(this, sizeof(*this));
 }
 
 /**
@@ -876,7 +879,7 @@ static private_identification_t *identification_create(id_type_t type)
 {
 	private_identification_t *this;
 
-	INIT(this,
+	INIT_SLAB(this,
 		.public = {
 			.get_encoding = _get_encoding,
 			.get_type = _get_type,
@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2013 HSR Hochschule fuer Technik Rapperswil
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#include "slab.h"
+
+#include <stdlib.h>
+
+#if defined(SLAB_ALLOCATOR) && !defined(LEAK_DETECTIVE)
+
+#include <pthread.h>
+
+/**
+ * Granularity of the size classes
+ */
+#define CLASS_STEP 16
+
+/**
+ * Number of size classes, objects up to CLASS_STEP * CLASSES bytes are pooled
+ */
+#define CLASSES 16
+
+/**
+ * Size of the pages objects are carved from
+ */
+#define PAGE_SIZE (64 * 1024)
+
+/**
+ * Number of objects moved between a thread cache and the shared depot
+ */
+#define BATCH 64
+
+typedef struct object_t object_t;
+
+/**
+ * A free object, objects are at least CLASS_STEP bytes
+ */
+struct object_t {
+	/** next free object in a list */
+	object_t *next;
+	/** next batch in the depot, valid for the first object of a batch */
+	object_t *next_batch;
+};
+
+/**
+ * Free objects of a size class cached by a thread
+ */
+typedef struct {
+	/** free objects */
+	object_t *head;
+	/** number of free objects */
+	u_int count;
+} cache_t;
+
+/**
+ * Batches of free objects of a size class shared by all threads
+ */
+typedef struct {
+	/** mutex for this depot */
+	pthread_mutex_t mutex;
+	/** batches of free objects */
+	object_t *batches;
+} depot_t;
+
+/**
+ * Use the static TLS model, as the dynamic model requires a call to
+ * __tls_get_addr() for each access from a shared library
+ */
+#define TLS __thread __attribute__((tls_model("initial-exec")))
+
+/**
+ * Per-thread caches
+ */
+static TLS cache_t caches[CLASSES];
+
+/**
+ * Whether the cleanup of this thread's caches has been registered
+ */
+static TLS int registered;
+
+/**
+ * Shared depots
+ */
+static depot_t depots[CLASSES] = {
+	[0 ... CLASSES - 1] = {
+		.mutex = PTHREAD_MUTEX_INITIALIZER,
+	},
+};
+
+/**
+ * Key to flush the caches of exiting threads
+ */
+static pthread_key_t key;
+
+/**
+ * Create key only once
+ */
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Put a list of free objects into the depot
+ */
+static void depot_put(int class, object_t *batch)
+{
+	depot_t *depot = &depots[class];
+
+	pthread_mutex_lock(&depot->mutex);
+	batch->next_batch = depot->batches;
+	depot->batches = batch;
+	pthread_mutex_unlock(&depot->mutex);
+}
+
+/**
+ * Flush the caches of an exiting thread to the depots
+ */
+static void flush_caches(void *unused)
+{
+	int class;
+
+	for (class = 0; class < CLASSES; class++)
+	{
+		if (caches[class].head)
+		{
+			depot_put(class, caches[class].head);
+			caches[class].head = NULL;
+			caches[class].count = 0;
+		}
+	}
+}
+
+/**
+ * Create the key used to flush caches
+ */
+static void create_key()
+{
+	pthread_key_create(&key, flush_caches);
+}
+
+/**
+ * Fill the cache of a size class from the depot or a new page
+ */
+static void refill(int class, cache_t *cache)
+{
+	depot_t *depot = &depots[class];
+	object_t *object;
+	size_t size;
+	char *page;
+	int i;
+
+	if (!registered)
+	{
+		pthread_once(&key_once, create_key);
+		pthread_setspecific(key, &registered);
+		registered = 1;
+	}
+
+	pthread_mutex_lock(&depot->mutex);
+	object = depot->batches;
+	if (object)
+	{
+		depot->batches = object->next_batch;
+	}
+	pthread_mutex_unlock(&depot->mutex);
+
+	if (object)
+	{	/* batches flushed by exiting threads may have any length */
+		cache->head = object;
+		for (cache->count = 0; object; object = object->next)
+		{
+			cache->count++;
+		}
+		return;
+	}
+
+	size = (class + 1) * CLASS_STEP;
+	page = malloc(PAGE_SIZE);
+	if (!page)
+	{
+		return;
+	}
+	for (i = PAGE_SIZE / size - 1; i >= 0; i--)
+	{
+		object = (object_t*)(page + i * size);
+		object->next = cache->head;
+		cache->head = object;
+		cache->count++;
+	}
+}
+
+/**
+ * Described in header.
+ */
+void *slab_alloc(size_t size)
+{
+	object_t *object;
+	cache_t *cache;
+	int class;
+
+	if (size == 0 || size > CLASS_STEP * CLASSES)
+	{
+		return malloc(size);
+	}
+	class = (size - 1) / CLASS_STEP;
+	cache = &caches[class];
+	if (!cache->head)
+	{
+		refill(class, cache);
+		if (!cache->head)
+		{
+			return NULL;
+		}
+	}
+	object = cache->head;
+	cache->head = object->next;
+	cache->count--;
+	return object;
+}
+
+/**
+ * Described in header.
+ */
+void slab_free(void *ptr, size_t size)
+{
+	object_t *object = ptr, *last;
+	cache_t *cache;
+	int class, i;
+
+	if (!ptr)
+	{
+		return;
+	}
+	if (size == 0 || size > CLASS_STEP * CLASSES)
+	{
+		free(ptr);
+		return;
+	}
+	class = (size - 1) / CLASS_STEP;
+	cache = &caches[class];
+	object->next = cache->head;
+	cache->head = object;
+	if (++cache->count >= 2 * BATCH)
+	{	/* move a batch to the depot for other threads to use */
+		last = object;
+		for (i = 1; i < BATCH && last->next; i++)
+		{
+			last = last->next;
+		}
+		cache->head = last->next;
+		cache->count -= i;
+		last->next = NULL;
+		depot_put(class, object);
+	}
+}
+
+#else /* !SLAB_ALLOCATOR || LEAK_DETECTIVE */
+
+/**
+ * Described in header.
+ */
+void *slab_alloc(size_t size)
+{
+	return malloc(size);
+}
+
+/**
+ * Described in header.
+ */
+void slab_free(void *ptr, size_t size)
+{
+	free(ptr);
+}
+
+#endif /* SLAB_ALLOCATOR && !LEAK_DETECTIVE */
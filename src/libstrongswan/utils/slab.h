@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2013 HSR Hochschule fuer Technik Rapperswil
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+/**
+ * @defgroup slab slab
+ * @{ @ingroup utils
+ */
+
+#ifndef SLAB_H_
+#define SLAB_H_
+
+#include <sys/types.h>
+
+/**
+ * Allocate memory for a small, frequently allocated object.
+ *
+ * If built with --enable-slab, objects up to 256 bytes are taken from size
+ * class pools with a per-thread cache, which avoids contention on the
+ * allocator's arenas. Memory of these pools is never returned to the system,
+ * but reused for objects of the same size class. Larger objects, and all
+ * objects if built without --enable-slab or with --enable-leak-detective (to
+ * keep track of each object), are allocated with malloc().
+ *
+ * Memory allocated with this function MUST be released with slab_free(),
+ * passing the same size.
+ *
+ * @param size		size of the object
+ * @return			allocated memory
+ */
+void *slab_alloc(size_t size);
+
+/**
+ * Release memory allocated with slab_alloc().
+ *
+ * @param ptr		memory to release, may be NULL
+ * @param size		size of the object, as passed to slab_alloc()
+ */
+void slab_free(void *ptr, size_t size);
+
+/**
+ * Object allocation/initialization macro, same as INIT() but using
+ * slab_alloc(). Objects have to be released with slab_free().
+ */
+#define INIT_SLAB(this, ...) { (this) = slab_alloc(sizeof(*(this))); \
+							   *(this) = (typeof(*(this))){ __VA_ARGS__ }; }
+
+#endif /** SLAB_H_ @}*/
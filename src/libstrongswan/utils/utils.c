@@ -45,6 +45,43 @@ ENUM(status_names, SUCCESS, NEED_MORE,
 	"NEED_MORE",
 );
 
+/**
+ * Described in header.
+ */
+void *malloc_align(size_t size, u_int8_t align)
+{
+	u_int8_t pad;
+	void *ptr;
+
+	if (align == 0)
+	{
+		align = 1;
+	}
+	ptr = malloc(align + size);
+	if (!ptr)
+	{
+		return NULL;
+	}
+	/* at least one byte of padding, all of them store the padding length */
+	pad = align - ((uintptr_t)ptr % align);
+	memset(ptr, pad, pad);
+	return ptr + pad;
+}
+
+/**
+ * Described in header.
+ */
+void free_align(void *ptr)
+{
+	u_int8_t pad;
+
+	if (ptr)
+	{
+		pad = *((u_int8_t*)ptr - 1);
+		free(ptr - pad);
+	}
+}
+
 /**
  * Described in header.
  */
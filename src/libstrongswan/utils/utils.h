@@ -392,6 +392,24 @@ typedef struct timespec timespec_t;
  */
 typedef struct sockaddr sockaddr_t;
 
+/**
+ * Allocate memory aligned to a multiple of align bytes.
+ *
+ * The memory has to be freed with free_align().
+ *
+ * @param size		number of bytes to allocate
+ * @param align		alignment, between 1 and 255 bytes
+ * @return			allocated, uninitialized memory
+ */
+void *malloc_align(size_t size, u_int8_t align);
+
+/**
+ * Free memory allocated with malloc_align().
+ *
+ * @param ptr		memory to free, may be NULL
+ */
+void free_align(void *ptr);
+
 /**
  * Same as memcpy, but XORs src into dst instead of copy
  */
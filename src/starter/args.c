@@ -703,3 +703,67 @@ bool cmp_args(kw_token_t first, kw_token_t last, char *base1, char *base2)
 	}
 	return TRUE;
 }
+
+/*
+ *  hash all arguments in a struct compared by cmp_args()
+ */
+u_int hash_args(kw_token_t first, kw_token_t last, char *base, u_int hash)
+{
+	kw_token_t token;
+
+	for (token = first; token <= last; token++)
+	{
+		char *p = base + token_info[token].offset;
+
+		switch (token_info[token].type)
+		{
+		case ARG_ENUM:
+			if (token_info[token].list == LST_bool)
+			{
+				hash = chunk_hash_inc(chunk_create(p, sizeof(bool)), hash);
+			}
+			else
+			{
+				hash = chunk_hash_inc(chunk_create(p, sizeof(int)), hash);
+			}
+			break;
+		case ARG_UINT:
+			hash = chunk_hash_inc(chunk_create(p, sizeof(u_int)), hash);
+			break;
+		case ARG_ULNG:
+		case ARG_PCNT:
+			hash = chunk_hash_inc(chunk_create(p, sizeof(unsigned long)), hash);
+			break;
+		case ARG_ULLI:
+			hash = chunk_hash_inc(chunk_create(p, sizeof(unsigned long long)),
+								  hash);
+			break;
+		case ARG_TIME:
+			hash = chunk_hash_inc(chunk_create(p, sizeof(time_t)), hash);
+			break;
+		case ARG_STR:
+			{
+				char **cp = (char **)p;
+
+				if (*cp)
+				{
+					hash = chunk_hash_inc(chunk_from_str(*cp), hash);
+				}
+			}
+			break;
+		case ARG_LST:
+			{
+				char **list = *(char ***)p;
+
+				for ( ; list && *list; list++)
+				{
+					hash = chunk_hash_inc(chunk_from_str(*list), hash);
+				}
+			}
+			break;
+		default:
+			break;
+		}
+	}
+	return hash;
+}
@@ -27,6 +27,8 @@ extern void clone_args(kw_token_t first, kw_token_t last, char *base1
 	, char *base2);
 extern bool cmp_args(kw_token_t first, kw_token_t last, char *base1
 	, char *base2);
+extern u_int hash_args(kw_token_t first, kw_token_t last, char *base
+	, u_int hash);
 
 #endif /* _ARGS_H_ */
 
@@ -20,6 +20,7 @@
 
 #define VARCMP(obj) if (c1->obj != c2->obj) return FALSE
 #define STRCMP(obj) if (strcmp(c1->obj,c2->obj)) return FALSE
+#define VARHASH(obj) hash = chunk_hash_inc(chunk_from_thing(c->obj), hash)
 
 static bool starter_cmp_end(starter_end_t *c1, starter_end_t *c2)
 {
@@ -64,3 +65,37 @@ bool starter_cmp_ca(starter_ca_t *c1, starter_ca_t *c2)
 
 	return cmp_args(KW_CA_NAME, KW_CA_LAST, (char *)c1, (char *)c2);
 }
+
+static u_int starter_hash_end(starter_end_t *c, u_int hash)
+{
+	VARHASH(modecfg);
+	VARHASH(from_port);
+	VARHASH(to_port);
+	VARHASH(protocol);
+
+	return hash_args(KW_END_FIRST, KW_END_LAST, (char *)c, hash);
+}
+
+u_int starter_hash_conn(starter_conn_t *c)
+{
+	u_int hash = 0;
+
+	VARHASH(mode);
+	VARHASH(proxy_mode);
+	VARHASH(options);
+	VARHASH(mark_in.value);
+	VARHASH(mark_in.mask);
+	VARHASH(mark_out.value);
+	VARHASH(tfc);
+	VARHASH(sa_keying_tries);
+
+	hash = starter_hash_end(&c->left, hash);
+	hash = starter_hash_end(&c->right, hash);
+
+	return hash_args(KW_CONN_NAME, KW_CONN_LAST, (char *)c, hash);
+}
+
+u_int starter_hash_ca(starter_ca_t *c)
+{
+	return hash_args(KW_CA_NAME, KW_CA_LAST, (char *)c, 0);
+}
@@ -18,5 +18,9 @@
 bool starter_cmp_conn(starter_conn_t *c1, starter_conn_t *c2);
 bool starter_cmp_ca(starter_ca_t *c1, starter_ca_t *c2);
 
+/* hash the contents compared by starter_cmp_conn()/starter_cmp_ca() */
+u_int starter_hash_conn(starter_conn_t *c);
+u_int starter_hash_ca(starter_ca_t *c);
+
 #endif
 
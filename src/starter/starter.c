@@ -37,6 +37,7 @@
 #include <utils/backtrace.h>
 #include <threading/thread.h>
 #include <utils/debug.h>
+#include <collections/hashtable.h>
 
 #include "confread.h"
 #include "files.h"
@@ -391,6 +392,70 @@ static void cleanup()
 	}
 }
 
+/**
+ * Hashtable equals function for sections, sections are only equal to themselves
+ */
+static bool section_equals(void *a, void *b)
+{
+	return a == b;
+}
+
+/**
+ * Match a loaded conn section against new conn sections not yet matched
+ */
+static bool conn_match(starter_conn_t *conn, starter_conn_t *conn2)
+{
+	return conn2->state == STATE_TO_ADD && starter_cmp_conn(conn, conn2);
+}
+
+/**
+ * Match a loaded ca section against new ca sections not yet matched
+ */
+static bool ca_match(starter_ca_t *ca, starter_ca_t *ca2)
+{
+	return ca2->state == STATE_TO_ADD && starter_cmp_ca(ca, ca2);
+}
+
+/**
+ * Create an index over the new conn sections, by the hash of their contents
+ */
+static hashtable_t *index_conns(starter_config_t *cfg)
+{
+	hashtable_t *index;
+	starter_conn_t *conn;
+
+	index = hashtable_create((hashtable_hash_t)starter_hash_conn,
+							 section_equals, 128);
+	for (conn = cfg->conn_first; conn; conn = conn->next)
+	{
+		if (conn->state == STATE_TO_ADD)
+		{
+			index->put(index, conn, conn);
+		}
+	}
+	return index;
+}
+
+/**
+ * Create an index over the new ca sections, by the hash of their contents
+ */
+static hashtable_t *index_cas(starter_config_t *cfg)
+{
+	hashtable_t *index;
+	starter_ca_t *ca;
+
+	index = hashtable_create((hashtable_hash_t)starter_hash_ca,
+							 section_equals, 8);
+	for (ca = cfg->ca_first; ca; ca = ca->next)
+	{
+		if (ca->state == STATE_TO_ADD)
+		{
+			index->put(index, ca, ca);
+		}
+	}
+	return index;
+}
+
 static void usage(char *name)
 {
 	fprintf(stderr, "Usage: starter [--nofork] [--auto-update <sec>]\n"
@@ -406,6 +471,7 @@ int main (int argc, char **argv)
 	starter_config_t *new_cfg;
 	starter_conn_t *conn, *conn2;
 	starter_ca_t *ca, *ca2;
+	hashtable_t *index;
 
 	struct sigaction action;
 	struct stat stb;
@@ -674,6 +740,11 @@ int main (int argc, char **argv)
 			exit(LSB_RC_SUCCESS);
 		}
 
+		/*
+		 * Send all changes below over a single stroke connection
+		 */
+		starter_stroke_batch_begin();
+
 		/*
 		 * Delete all connections. Will be added below
 		 */
@@ -724,22 +795,22 @@ int main (int argc, char **argv)
 				/* Switch to new config. New conn will be loaded below */
 
 				/* Look for new connections that are already loaded */
+				index = index_conns(new_cfg);
 				for (conn = cfg->conn_first; conn; conn = conn->next)
 				{
 					if (conn->state == STATE_ADDED)
 					{
-						for (conn2 = new_cfg->conn_first; conn2; conn2 = conn2->next)
+						conn2 = index->get_match(index, conn,
+												 (hashtable_equals_t)conn_match);
+						if (conn2)
 						{
-							if (conn2->state == STATE_TO_ADD && starter_cmp_conn(conn, conn2))
-							{
-								conn->state = STATE_REPLACED;
-								conn2->state = STATE_ADDED;
-								conn2->id = conn->id;
-								break;
-							}
+							conn->state = STATE_REPLACED;
+							conn2->state = STATE_ADDED;
+							conn2->id = conn->id;
 						}
 					}
 				}
+				index->destroy(index);
 
 				/* Remove conn sections that have become unused */
 				for (conn = cfg->conn_first; conn; conn = conn->next)
@@ -758,21 +829,21 @@ int main (int argc, char **argv)
 				}
 
 				/* Look for new ca sections that are already loaded */
+				index = index_cas(new_cfg);
 				for (ca = cfg->ca_first; ca; ca = ca->next)
 				{
 					if (ca->state == STATE_ADDED)
 					{
-						for (ca2 = new_cfg->ca_first; ca2; ca2 = ca2->next)
+						ca2 = index->get_match(index, ca,
+											   (hashtable_equals_t)ca_match);
+						if (ca2)
 						{
-							if (ca2->state == STATE_TO_ADD && starter_cmp_ca(ca, ca2))
-							{
-								ca->state = STATE_REPLACED;
-								ca2->state = STATE_ADDED;
-								break;
-							}
+							ca->state = STATE_REPLACED;
+							ca2->state = STATE_ADDED;
 						}
 					}
 				}
+				index->destroy(index);
 
 				/* Remove ca sections that have become unused */
 				for (ca = cfg->ca_first; ca; ca = ca->next)
@@ -884,6 +955,8 @@ int main (int argc, char **argv)
 			}
 		}
 
+		starter_stroke_batch_end();
+
 		/*
 		 * If auto_update activated, when to stop select
 		 */
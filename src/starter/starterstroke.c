@@ -21,6 +21,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <poll.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
@@ -54,20 +55,25 @@ static char* push_string(stroke_msg_t *msg, char *string)
 	}
 }
 
-static int send_stroke_msg (stroke_msg_t *msg)
+/**
+ * TRUE if stroke messages get sent over a single connection, as a batch
+ */
+static bool batching = FALSE;
+
+/**
+ * Socket of the open batch connection to charon, -1 if none
+ */
+static int batch_sock = -1;
+
+static int connect_charon()
 {
 	struct sockaddr_un ctl_addr;
-	int byte_count;
-	char buffer[64];
+	int sock;
 
 	ctl_addr.sun_family = AF_UNIX;
 	strcpy(ctl_addr.sun_path, CHARON_CTL_FILE);
 
-	/* starter is not called from commandline, and therefore absolutely silent */
-	msg->output_verbosity = -1;
-
-	int sock = socket(AF_UNIX, SOCK_STREAM, 0);
-
+	sock = socket(AF_UNIX, SOCK_STREAM, 0);
 	if (sock < 0)
 	{
 		DBG1(DBG_APP, "socket() failed: %s", strerror(errno));
@@ -79,23 +85,143 @@ static int send_stroke_msg (stroke_msg_t *msg)
 		close(sock);
 		return -1;
 	}
+	return sock;
+}
 
-	/* send message */
-	if (write(sock, msg, msg->length) != msg->length)
-	{
-		DBG1(DBG_APP, "write(charon_ctl) failed: %s", strerror(errno));
-		close(sock);
-		return -1;
-	}
-	while ((byte_count = read(sock, buffer, sizeof(buffer)-1)) > 0)
+/**
+ * Log the output returned by charon, returns FALSE on EOF or errors
+ */
+static bool log_output(int sock, int flags)
+{
+	int byte_count;
+	char buffer[64];
+
+	while ((byte_count = recv(sock, buffer, sizeof(buffer)-1, flags)) > 0)
 	{
 		buffer[byte_count] = '\0';
 		DBG1(DBG_APP, "%s", buffer);
 	}
 	if (byte_count < 0)
 	{
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+		{
+			return TRUE;
+		}
 		DBG1(DBG_APP, "read() failed: %s", strerror(errno));
 	}
+	return FALSE;
+}
+
+/**
+ * Write a message to the batch connection. The output returned by charon
+ * while processing earlier messages is read in between, so neither side
+ * blocks on a full socket buffer.
+ */
+static bool write_batch(void *data, size_t len)
+{
+	struct pollfd pfd = {
+		.fd = batch_sock,
+		.events = POLLIN | POLLOUT,
+	};
+	char *pos = data;
+	ssize_t written;
+
+	while (len)
+	{
+		if (poll(&pfd, 1, -1) < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			DBG1(DBG_APP, "poll(charon_ctl) failed: %s", strerror(errno));
+			return FALSE;
+		}
+		if ((pfd.revents & POLLIN) && !log_output(batch_sock, MSG_DONTWAIT))
+		{
+			return FALSE;
+		}
+		if (pfd.revents & (POLLERR | POLLHUP))
+		{
+			DBG1(DBG_APP, "charon_ctl connection closed");
+			return FALSE;
+		}
+		if (pfd.revents & POLLOUT)
+		{
+			written = send(batch_sock, pos, len, MSG_DONTWAIT);
+			if (written < 0)
+			{
+				if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+				{
+					continue;
+				}
+				DBG1(DBG_APP, "write(charon_ctl) failed: %s", strerror(errno));
+				return FALSE;
+			}
+			pos += written;
+			len -= written;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Open the batch connection to charon, announcing that more messages follow
+ */
+static bool open_batch()
+{
+	stroke_msg_t msg;
+
+	batch_sock = connect_charon();
+	if (batch_sock < 0)
+	{
+		return FALSE;
+	}
+	memset(&msg, 0, offsetof(stroke_msg_t, buffer));
+	msg.type = STR_BATCH;
+	msg.length = offsetof(stroke_msg_t, buffer);
+	msg.output_verbosity = -1;
+	if (!write_batch(&msg, msg.length))
+	{
+		close(batch_sock);
+		batch_sock = -1;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static int send_stroke_msg (stroke_msg_t *msg)
+{
+	int sock;
+
+	/* starter is not called from commandline, and therefore absolutely silent */
+	msg->output_verbosity = -1;
+
+	if (batching && (batch_sock >= 0 || open_batch()))
+	{
+		if (write_batch(msg, msg->length))
+		{
+			return 0;
+		}
+		close(batch_sock);
+		batch_sock = -1;
+		return -1;
+	}
+
+	sock = connect_charon();
+	if (sock < 0)
+	{
+		return -1;
+	}
+
+	/* send message */
+	if (write(sock, msg, msg->length) != msg->length)
+	{
+		DBG1(DBG_APP, "write(charon_ctl) failed: %s", strerror(errno));
+		close(sock);
+		return -1;
+	}
+	log_output(sock, 0);
 
 	close(sock);
 	return 0;
@@ -332,3 +458,21 @@ int starter_stroke_configure(starter_config_t *cfg)
 	}
 	return 0;
 }
+
+void starter_stroke_batch_begin()
+{
+	batching = TRUE;
+}
+
+void starter_stroke_batch_end()
+{
+	batching = FALSE;
+	if (batch_sock >= 0)
+	{
+		/* charon processes the batch until we close our end */
+		shutdown(batch_sock, SHUT_WR);
+		log_output(batch_sock, 0);
+		close(batch_sock);
+		batch_sock = -1;
+	}
+}
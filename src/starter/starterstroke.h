@@ -27,4 +27,8 @@ int starter_stroke_add_ca(starter_ca_t *ca);
 int starter_stroke_del_ca(starter_ca_t *ca);
 int starter_stroke_configure(starter_config_t *cfg);
 
+/* send all following messages over a single connection, until batch_end() */
+void starter_stroke_batch_begin();
+void starter_stroke_batch_end();
+
 #endif /* _STARTER_STROKE_H_ */
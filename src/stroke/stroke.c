@@ -236,10 +236,14 @@ static int unroute_connection(char *name)
 	return send_stroke_msg(&msg);
 }
 
-static int show_status(stroke_keyword_t kw, char *connection)
+static void exit_usage(char *error);
+
+static int show_status(stroke_keyword_t kw, int argc, char *argv[])
 {
 	stroke_msg_t msg;
+	int i = 0;
 
+	memset(&msg, 0, sizeof(msg));
 	switch (kw)
 	{
 		case STROKE_STATUSALL:
@@ -253,7 +257,49 @@ static int show_status(stroke_keyword_t kw, char *connection)
 			break;
 	}
 	msg.length = offsetof(stroke_msg_t, buffer);
-	msg.status.name = push_string(&msg, connection);
+	if (argc && strncmp(argv[0], "--", 2) != 0)
+	{
+		msg.status.name = push_string(&msg, argv[i++]);
+	}
+	if (i < argc)
+	{	/* options are only evaluated in this message type, which keeps the
+		 * other ones compatible with older daemons */
+		msg.status.all = msg.type != STR_STATUS;
+		msg.status.noblk = msg.type == STR_STATUS_ALL_NOBLK;
+		msg.type = STR_STATUS_FILTER;
+	}
+	for (; i < argc; i++)
+	{
+		if (streq(argv[i], "--nocounters"))
+		{
+			msg.status.nocounters = 1;
+			continue;
+		}
+		if (i + 1 == argc)
+		{
+			exit_usage("status option needs an argument");
+		}
+		if (streq(argv[i], "--peer"))
+		{
+			msg.status.peer = push_string(&msg, argv[++i]);
+		}
+		else if (streq(argv[i], "--state"))
+		{
+			msg.status.state = push_string(&msg, argv[++i]);
+		}
+		else if (streq(argv[i], "--offset"))
+		{
+			msg.status.offset = atoi(argv[++i]);
+		}
+		else if (streq(argv[i], "--limit"))
+		{
+			msg.status.limit = atoi(argv[++i]);
+		}
+		else
+		{
+			exit_usage("unknown status option");
+		}
+	}
 	return send_stroke_msg(&msg);
 }
 
@@ -434,11 +480,15 @@ static void exit_usage(char *error)
 	printf("    where: TYPE is any|dmn|mgr|ike|chd|job|cfg|knl|net|asn|enc|tnc|imc|imv|pts|tls|esp|lib\n");
 	printf("           LEVEL is -1|0|1|2|3|4\n");
 	printf("  Show connection status:\n");
-	printf("    stroke status\n");
+	printf("    stroke status [NAME] [OPTIONS]\n");
 	printf("  Show extended status information:\n");
-	printf("    stroke statusall\n");
+	printf("    stroke statusall [NAME] [OPTIONS]\n");
 	printf("  Show extended status information without blocking:\n");
-	printf("    stroke statusall-nb\n");
+	printf("    stroke statusall-nb [NAME] [OPTIONS]\n");
+	printf("    where: NAME is a connection name to show the status for\n");
+	printf("           OPTIONS are --peer ADDRESS|ID, --state STATE, --offset N,\n");
+	printf("           --limit N to filter IKE_SAs and --nocounters to skip\n");
+	printf("           querying traffic counters from the kernel\n");
 	printf("  Show list of authority and attribute certificates:\n");
 	printf("    stroke listcacerts|listocspcerts|listaacerts|listacerts\n");
 	printf("  Show list of end entity certificates, ca info records  and crls:\n");
@@ -573,7 +623,7 @@ int main(int argc, char *argv[])
 		case STROKE_STATUS:
 		case STROKE_STATUSALL:
 		case STROKE_STATUSALL_NOBLK:
-			res = show_status(token->kw, argc > 2 ? argv[2] : NULL);
+			res = show_status(token->kw, argc - 2, argv + 2);
 			break;
 		case STROKE_LIST_PUBKEYS:
 		case STROKE_LIST_CERTS:
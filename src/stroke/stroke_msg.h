@@ -230,6 +230,10 @@ struct stroke_msg_t {
 		STR_USER_CREDS,
 		/* print/reset counters */
 		STR_COUNTERS,
+		/* process all following messages on this connection as a batch */
+		STR_BATCH,
+		/* show connection status with filter and paging options */
+		STR_STATUS_FILTER,
 		/* more to come */
 	} type;
 
@@ -240,7 +244,29 @@ struct stroke_msg_t {
 		/* data for STR_INITIATE, STR_ROUTE, STR_UP, STR_DOWN, ... */
 		struct {
 			char *name;
-		} initiate, route, unroute, terminate, rekey, status, del_conn, del_ca;
+		} initiate, route, unroute, terminate, rekey, del_conn, del_ca;
+
+		/* data for STR_STATUS, STR_STATUS_ALL and STR_STATUS_ALL_NOBLK, which
+		 * only use the name as older clients don't initialize the other
+		 * fields, and for STR_STATUS_FILTER, which uses all of them */
+		struct {
+			/* connection name to filter for, NULL for all */
+			char *name;
+			/* remote address or identity to filter IKE_SAs for, NULL for all */
+			char *peer;
+			/* IKE_SA state to filter for, NULL for all */
+			char *state;
+			/* number of matching IKE_SAs to skip */
+			u_int32_t offset;
+			/* maximum number of IKE_SAs to show, 0 for no limit */
+			u_int32_t limit;
+			/* don't query the kernel for CHILD_SA traffic counters */
+			int nocounters;
+			/* show verbose status, as STR_STATUS_ALL */
+			int all;
+			/* don't block on IKE_SAs in use, as STR_STATUS_ALL_NOBLK */
+			int noblk;
+		} status;
 
 		/* data for STR_TERMINATE_SRCIP */
 		struct {